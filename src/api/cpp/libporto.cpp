@@ -1,5 +1,7 @@
 #include "libporto.hpp"
 
+#include <algorithm>
+
 #include <google/protobuf/text_format.h>
 #include <google/protobuf/io/zero_copy_stream_impl.h>
 #include <google/protobuf/io/coded_stream.h>
@@ -9,14 +11,40 @@ extern "C" {
 #include <unistd.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <time.h>
 }
 
 namespace Porto {
 
+TPortoApi::TPortoApi() {
+    ResetResponse();
+}
+
 TPortoApi::~TPortoApi() {
     Close();
 }
 
+void TPortoApi::ResetResponse() {
+    size_t used = RspArena ? RspArena->SpaceAllocated() : 0;
+
+    /* Grow initial block to fit typical response, then reuse it */
+    if (!RspArena || (used > RspBlock.size() && RspBlock.size() < ARENA_BLOCK_MAX)) {
+        RspArena.reset();
+        RspBlock.resize(std::min(std::max(used, ARENA_BLOCK_MIN), ARENA_BLOCK_MAX));
+
+        google::protobuf::ArenaOptions options;
+        options.initial_block = RspBlock.data();
+        options.initial_block_size = RspBlock.size();
+        RspArena.reset(new google::protobuf::Arena(options));
+    } else
+        RspArena->Reset();
+
+    Rsp = google::protobuf::Arena::CreateMessage<TPortoResponse>(RspArena.get());
+}
+
 EError TPortoApi::SetError(const TString &prefix, int _errno) {
     switch (_errno) {
         case ENOENT:
@@ -62,6 +90,8 @@ EError TPortoApi::Connect(const char *socket_path) {
     if (connect(Fd, (struct sockaddr *) &peer_addr, peer_addr_size) < 0)
         return SetError("connect", errno);
 
+    Input.reset(new google::protobuf::io::FileInputStream(Fd));
+
     /* Restore async wait state */
     if (!AsyncWaitNames.empty()) {
         for (auto &name: AsyncWaitNames)
@@ -80,6 +110,8 @@ void TPortoApi::Close() {
     if (Fd >= 0)
         close(Fd);
     Fd = -1;
+    Input.reset();
+    PendingCalls.clear();
 }
 
 EError TPortoApi::SetSocketTimeout(int direction, int timeout) {
@@ -136,7 +168,11 @@ EError TPortoApi::Send(const TPortoRequest &req) {
 }
 
 EError TPortoApi::Recv(TPortoResponse &rsp) {
-    google::protobuf::io::FileInputStream raw(Fd);
+    auto stream = Input; /* Close() on error drops it under the coded stream */
+    if (!stream)
+        return SetError("recv", ENOTCONN);
+
+    auto &raw = *stream;
     google::protobuf::io::CodedInputStream input(&raw);
 
     while (true) {
@@ -160,6 +196,12 @@ EError TPortoApi::Recv(TPortoResponse &rsp) {
             continue;
         }
 
+        if (rsp.has_subscribeupdate()) {
+            if (SubscribeCallback)
+                SubscribeCallback(rsp.subscribeupdate());
+            continue;
+        }
+
         return EError::Success;
     }
 }
@@ -172,6 +214,10 @@ EError TPortoApi::Call(const TPortoRequest &req,
     if (Fd < 0)
         err = Connect();
 
+    /* Responses for pipelined calls come first */
+    if (!err && !PendingCalls.empty())
+        err = Complete();
+
     if (!err)
         err = Send(req);
 
@@ -192,8 +238,79 @@ EError TPortoApi::Call(const TPortoRequest &req,
     return err;
 }
 
+EError TPortoApi::CallAsync(const TPortoRequest &req, TResponseCallback callback) {
+    EError err = EError::Success;
+
+    if (Fd < 0)
+        err = Connect();
+
+    if (!err) {
+        TPortoRequest pipelined(req);
+        pipelined.set_request_id(++LastRequestId);
+        err = Send(pipelined);
+    }
+
+    if (!err)
+        PendingCalls[LastRequestId] = callback;
+
+    return err;
+}
+
+EError TPortoApi::Complete() {
+    /* Pending calls are dropped at disconnect */
+    if (PendingCalls.empty())
+        return EError::Success;
+
+    /* Stream might read ahead several responses, keep it per connection */
+    auto stream = Input; /* Close() on error drops it under the coded stream */
+    auto &raw = *stream;
+    google::protobuf::io::CodedInputStream input(&raw);
+    TPortoResponse rsp;
+
+    while (!PendingCalls.empty()) {
+        uint32_t size;
+
+        if (!input.ReadVarint32(&size))
+            return SetError("recv", raw.GetErrno() ?: EIO);
+
+        auto prev_limit = input.PushLimit(size);
+
+        rsp.Clear();
+
+        if (!rsp.ParseFromCodedStream(&input))
+            return SetError("recv", raw.GetErrno() ?: EIO);
+
+        input.PopLimit(prev_limit);
+
+        if (rsp.has_asyncwait()) {
+            if (AsyncWaitCallback)
+                AsyncWaitCallback(rsp.asyncwait());
+            continue;
+        }
+
+        if (rsp.has_subscribeupdate()) {
+            if (SubscribeCallback)
+                SubscribeCallback(rsp.subscribeupdate());
+            continue;
+        }
+
+        auto it = PendingCalls.find(rsp.request_id());
+        if (it == PendingCalls.end())
+            continue;
+
+        auto callback = it->second;
+        PendingCalls.erase(it);
+
+        if (callback)
+            callback(rsp);
+    }
+
+    return EError::Success;
+}
+
 EError TPortoApi::Call(int extra_timeout) {
-    Call(Req, Rsp, extra_timeout);
+    ResetResponse();
+    Call(Req, *Rsp, extra_timeout);
     return LastError;
 }
 
@@ -207,8 +324,9 @@ EError TPortoApi::Call(const TString &req,
         return EError::InvalidMethod;
     }
 
-    Call(Req, Rsp, extra_timeout);
-    rsp = Rsp.DebugString();
+    ResetResponse();
+    Call(Req, *Rsp, extra_timeout);
+    rsp = Rsp->DebugString();
 
     return LastError;
 }
@@ -218,8 +336,8 @@ EError TPortoApi::GetVersion(TString &tag, TString &revision) {
     Req.mutable_version();
 
     if (!Call()) {
-        tag = Rsp.version().tag();
-        revision = Rsp.version().revision();
+        tag = Rsp->version().tag();
+        revision = Rsp->version().revision();
     }
 
     return LastError;
@@ -229,7 +347,7 @@ const TGetSystemResponse *TPortoApi::GetSystem() {
     Req.Clear();
     Req.mutable_getsystem();
     if (!Call())
-        return &Rsp.getsystem();
+        return &Rsp->getsystem();
     return nullptr;
 }
 
@@ -242,7 +360,7 @@ const TGetSystemConfigResponse *TPortoApi::GetSystemConfig() {
     Req.Clear();
     Req.mutable_getsystemconfig();
     if (!Call())
-        return &Rsp.getsystemconfig();
+        return &Rsp->getsystemconfig();
     return nullptr;
 }
 
@@ -276,7 +394,7 @@ const TListResponse *TPortoApi::List(const TString &mask) {
         req->set_mask(mask);
 
     if (!Call())
-        return &Rsp.list();
+        return &Rsp->list();
 
     return nullptr;
 }
@@ -287,8 +405,8 @@ EError TPortoApi::List(std::vector<TString> &list, const TString &mask) {
     if(!mask.empty())
         req->set_mask(mask);
     if (!Call())
-        list = std::vector<TString>(std::begin(Rsp.list().name()),
-                                        std::end(Rsp.list().name()));
+        list = std::vector<TString>(std::begin(Rsp->list().name()),
+                                        std::end(Rsp->list().name()));
     return LastError;
 }
 
@@ -300,7 +418,7 @@ const TListPropertiesResponse *TPortoApi::ListProperties() {
         return nullptr;
 
     bool has_data = false;
-    for (const auto &prop: Rsp.listproperties().list()) {
+    for (const auto &prop: Rsp->listproperties().list()) {
         if (prop.read_only()) {
             has_data = true;
             break;
@@ -314,7 +432,7 @@ const TListPropertiesResponse *TPortoApi::ListProperties() {
         req.mutable_listdataproperties();
         if (!Call(req, rsp)) {
             for (const auto &data: rsp.listdataproperties().list()) {
-                auto d = Rsp.mutable_listproperties()->add_list();
+                auto d = Rsp->mutable_listproperties()->add_list();
                 d->set_name(data.name());
                 d->set_desc(data.desc());
                 d->set_read_only(true);
@@ -322,7 +440,7 @@ const TListPropertiesResponse *TPortoApi::ListProperties() {
         }
     }
 
-    return &Rsp.listproperties();
+    return &Rsp->listproperties();
 }
 
 EError TPortoApi::ListProperties(std::vector<TString> &properties) {
@@ -353,21 +471,118 @@ const TGetResponse *TPortoApi::Get(const std::vector<TString> &names,
         get->set_sync(true);
     if (flags & GET_REAL)
         get->set_real(true);
+    if (flags & GET_COLUMNAR)
+        get->set_columnar(true);
 
     if (!Call())
-        return &Rsp.get();
+        return &Rsp->get();
 
     return nullptr;
 }
 
+void TGetTable::Reset(const std::vector<TString> &properties, size_t rows) {
+    Names.clear();
+    Properties = properties;
+    Cells.assign(rows * properties.size(), TCell());
+}
+
+TString TGetTable::Value(size_t row, size_t col) const {
+    auto &cell = Cells[row * Properties.size() + col];
+    if (cell.Error != EError::Success)
+        return "";
+    if (cell.Text)
+        return *cell.Text;
+    return std::to_string(cell.Number);
+}
+
+EError TGetTable::GetUint(size_t row, size_t col, uint64_t &value) const {
+    auto &cell = Cells[row * Properties.size() + col];
+    if (cell.Error != EError::Success)
+        return cell.Error;
+    if (!cell.Text) {
+        value = cell.Number;
+        return EError::Success;
+    }
+    const char *ptr = cell.Text->c_str();
+    char *end;
+    errno = 0;
+    value = strtoull(ptr, &end, 10);
+    if (errno || end == ptr || *end)
+        return EError::InvalidValue;
+    return EError::Success;
+}
+
+EError TPortoApi::GetTable(const std::vector<TString> &names,
+                           const std::vector<TString> &properties,
+                           TGetTable &table,
+                           int flags) {
+    auto rsp = Get(names, properties, flags);
+    if (!rsp)
+        return LastError;
+
+    if (flags & GET_COLUMNAR) {
+        table.Reset(properties, rsp->container().size());
+
+        for (auto &name: rsp->container())
+            table.Names.push_back(&name);
+
+        for (auto &column: rsp->column()) {
+            auto prop = std::find(properties.begin(), properties.end(), column.variable());
+            if (prop == properties.end())
+                continue;
+            size_t col = prop - properties.begin();
+
+            for (size_t row = 0; row < table.Rows(); row++) {
+                auto &cell = table.Cell(row, col);
+                cell.Error = EError::Success;
+                if ((int)row < column.text().size())
+                    cell.Text = &column.text(row);
+                else if ((int)row < column.number().size())
+                    cell.Number = column.number(row);
+            }
+
+            for (int i = 0; i < column.error_row().size() && i < column.error().size(); i++)
+                if (column.error_row(i) < table.Rows())
+                    table.Cell(column.error_row(i), col).Error = column.error(i);
+        }
+    } else {
+        table.Reset(properties, rsp->list().size());
+
+        for (int row = 0; row < rsp->list().size(); row++) {
+            auto &ct = rsp->list(row);
+
+            table.Names.push_back(&ct.name());
+
+            /* Values come in requested order, fall back to lookup */
+            for (int i = 0; i < ct.keyval().size(); i++) {
+                auto &kv = ct.keyval(i);
+                size_t col = i;
+                if (col >= properties.size() || properties[col] != kv.variable()) {
+                    auto prop = std::find(properties.begin(), properties.end(), kv.variable());
+                    if (prop == properties.end())
+                        continue;
+                    col = prop - properties.begin();
+                }
+
+                auto &cell = table.Cell(row, col);
+                cell.Error = kv.has_error() ? kv.error() : EError::Success;
+                if (kv.has_value())
+                    cell.Text = &kv.value();
+            }
+        }
+    }
+
+    return EError::Success;
+}
+
 const TContainer *TPortoApi::GetContainer(const TString &name) {
     Req.Clear();
     auto req = Req.mutable_getcontainer();
 
     req->add_name(name);
 
-    if (!Call() && Rsp.getcontainer().container().size())
-        return &Rsp.getcontainer().container(0);
+    if (!Call() && Rsp->getcontainer().container().size())
+        return &Rsp->getcontainer().container(0);
 
     return nullptr;
 }
@@ -379,8 +594,28 @@ const TGetContainerResponse *TPortoApi::GetContainers(uint64_t changed_since) {
     if (changed_since)
         req->set_changed_since(changed_since);
 
-    if (!Call() && Rsp.has_getcontainer())
-        return &Rsp.getcontainer();
+    if (!Call() && Rsp->has_getcontainer())
+        return &Rsp->getcontainer();
+
+    return nullptr;
+}
+
+const TReadStreamResponse *TPortoApi::ReadStream(const TString &name,
+                                                 const TString &stream,
+                                                 uint64_t offset,
+                                                 uint64_t limit) {
+    Req.Clear();
+    auto req = Req.mutable_readstream();
+
+    req->set_name(name);
+    req->set_stream(stream);
+    if (offset != UINT64_MAX)
+        req->set_offset(offset);
+    if (limit)
+        req->set_limit(limit);
+
+    if (!Call() && Rsp->has_readstream())
+        return &Rsp->readstream();
 
     return nullptr;
 }
@@ -400,7 +635,7 @@ EError TPortoApi::GetProperty(const TString &name,
         req->set_real(true);
 
     if (!Call())
-        value = Rsp.getproperty().value();
+        value = Rsp->getproperty().value();
 
     return LastError;
 }
@@ -466,8 +701,8 @@ EError TPortoApi::IncLabel(const TString &name,
 
     Call();
 
-    if (Rsp.has_inclabel())
-        result = Rsp.inclabel().result();
+    if (Rsp->has_inclabel())
+        result = Rsp->inclabel().result();
 
     return LastError;
 }
@@ -528,6 +763,67 @@ EError TPortoApi::Respawn(const TString &name) {
     return Call();
 }
 
+EError TPortoApi::Checkpoint(const TString &name, const TString &path, bool leave_running) {
+    Req.Clear();
+    auto req = Req.mutable_checkpoint();
+
+    req->set_name(name);
+    req->set_path(path);
+    if (leave_running)
+        req->set_leave_running(leave_running);
+
+    return Call();
+}
+
+EError TPortoApi::Restore(const TString &name, const TString &path) {
+    Req.Clear();
+    auto req = Req.mutable_restore();
+
+    req->set_name(name);
+    req->set_path(path);
+
+    return Call();
+}
+
+const TBatchResponse *TPortoApi::Batch(const TBatchRequest &batch,
+                                       int extra_timeout) {
+    Req.Clear();
+    *Req.mutable_batch() = batch;
+
+    if (!Call(extra_timeout))
+        return &Rsp->batch();
+
+    return nullptr;
+}
+
+EError TPortoApi::Subscribe(const std::vector<TString> &names,
+                           const std::vector<TString> &properties,
+                           uint64_t period_ms,
+                           TSubscribeCallback callback) {
+    Req.Clear();
+    auto req = Req.mutable_subscribe();
+
+    for (auto &name: names)
+        req->add_name(name);
+    for (auto &prop: properties)
+        req->add_variable(prop);
+    req->set_period_ms(period_ms);
+
+    SubscribeCallback = callback;
+
+    if (Call())
+        SubscribeCallback = nullptr;
+
+    return LastError;
+}
+
+EError TPortoApi::Unsubscribe() {
+    Req.Clear();
+    Req.mutable_subscribe()->set_period_ms(0);
+    SubscribeCallback = nullptr;
+    return Call();
+}
+
 EError TPortoApi::WaitContainer(const TString &name,
                                 TString &result_state,
                                 int wait_timeout) {
@@ -540,9 +836,9 @@ EError TPortoApi::WaitContainer(const TString &name,
         req->set_timeout_ms(wait_timeout * 1000);
 
     if (!Call(wait_timeout)) {
-        if (Rsp.wait().has_state())
-            result_state = Rsp.wait().state();
-        else if (Rsp.wait().name() == "")
+        if (Rsp->wait().has_state())
+            result_state = Rsp->wait().state();
+        else if (Rsp->wait().name() == "")
             result_state = "timeout";
         else
             result_state = "dead";
@@ -564,15 +860,15 @@ EError TPortoApi::WaitContainers(const std::vector<TString> &names,
         req->set_timeout_ms(wait_timeout * 1000);
 
     if (!Call(wait_timeout)) {
-        if (Rsp.wait().has_state())
-            result_state = Rsp.wait().state();
-        else if (Rsp.wait().name() == "")
+        if (Rsp->wait().has_state())
+            result_state = Rsp->wait().state();
+        else if (Rsp->wait().name() == "")
             result_state = "timeout";
         else
             result_state = "dead";
     }
 
-    result_name = Rsp.wait().name();
+    result_name = Rsp->wait().name();
 
     return LastError;
 }
@@ -592,8 +888,8 @@ const TWaitResponse *TPortoApi::Wait(const std::vector<TString> &names,
 
     Call(wait_timeout);
 
-    if (Rsp.has_wait())
-        return &Rsp.wait();
+    if (Rsp->has_wait())
+        return &Rsp->wait();
 
     return nullptr;
 }
@@ -639,7 +935,7 @@ EError TPortoApi::ConvertPath(const TString &path,
     req->set_destination(dest);
 
     if (!Call())
-        res = Rsp.convertpath().path();
+        res = Rsp->convertpath().path();
 
     return LastError;
 }
@@ -677,7 +973,7 @@ EError TPortoApi::LocateProcess(int pid, const TString &comm,
     req->set_comm(comm);
 
     if (!Call())
-        name = Rsp.locateprocess().name();
+        name = Rsp->locateprocess().name();
 
     return LastError;
 }
@@ -689,7 +985,7 @@ const TListVolumePropertiesResponse *TPortoApi::ListVolumeProperties() {
     Req.mutable_listvolumeproperties();
 
     if (!Call())
-        return &Rsp.listvolumeproperties();
+        return &Rsp->listvolumeproperties();
 
     return nullptr;
 }
@@ -718,7 +1014,7 @@ EError TPortoApi::CreateVolume(TString &path,
     }
 
     if (!Call(DiskTimeout) && path.empty())
-        path = Rsp.createvolume().path();
+        path = Rsp->createvolume().path();
 
     return LastError;
 }
@@ -811,7 +1107,7 @@ TPortoApi::ListVolumes(const TString &path,
     if (Call())
         return nullptr;
 
-    auto list = Rsp.mutable_listvolumes();
+    auto list = Rsp->mutable_listvolumes();
 
     /* compat */
     for (auto v: *list->mutable_volumes()) {
@@ -851,8 +1147,8 @@ const TVolume *TPortoApi::GetVolume(const TString &path) {
 
     req->add_path(path);
 
-    if (!Call() && Rsp.getvolume().volume().size())
-        return &Rsp.getvolume().volume(0);
+    if (!Call() && Rsp->getvolume().volume().size())
+        return &Rsp->getvolume().volume(0);
 
     return nullptr;
 }
@@ -864,8 +1160,8 @@ const TGetVolumeResponse *TPortoApi::GetVolumes(uint64_t changed_since) {
     if (changed_since)
         req->set_changed_since(changed_since);
 
-    if (!Call() && Rsp.has_getvolume())
-        return &Rsp.getvolume();
+    if (!Call() && Rsp->has_getvolume())
+        return &Rsp->getvolume();
 
     return nullptr;
 }
@@ -893,7 +1189,8 @@ EError TPortoApi::ImportLayer(const TString &layer,
 
 EError TPortoApi::ExportLayer(const TString &volume,
                               const TString &tarball,
-                              const TString &compress) {
+                              const TString &compress,
+                              uint64_t changed_since) {
     Req.Clear();
     auto req = Req.mutable_exportlayer();
 
@@ -901,6 +1198,8 @@ EError TPortoApi::ExportLayer(const TString &volume,
     req->set_tarball(tarball);
     if (compress.size())
         req->set_compress(compress);
+    if (changed_since)
+        req->set_changed_since(changed_since);
 
     return Call(DiskTimeout);
 }
@@ -945,7 +1244,7 @@ const TListLayersResponse *TPortoApi::ListLayers(const TString &place,
     if (Call())
         return nullptr;
 
-    auto list = Rsp.mutable_listlayers();
+    auto list = Rsp->mutable_listlayers();
 
     /* compat conversion */
     if (!list->layers().size() && list->layer().size()) {
@@ -974,8 +1273,8 @@ EError TPortoApi::ListLayers(std::vector<TString> &layers,
         req->set_mask(mask);
 
     if (!Call())
-        layers = std::vector<TString>(std::begin(Rsp.listlayers().layer()),
-                                      std::end(Rsp.listlayers().layer()));
+        layers = std::vector<TString>(std::begin(Rsp->listlayers().layer()),
+                                      std::end(Rsp->listlayers().layer()));
 
     return LastError;
 }
@@ -991,7 +1290,7 @@ EError TPortoApi::GetLayerPrivate(TString &private_value,
         req->set_place(place);
 
     if (!Call())
-        private_value = Rsp.getlayerprivate().private_value();
+        private_value = Rsp->getlayerprivate().private_value();
 
     return LastError;
 }
@@ -1025,7 +1324,7 @@ const TListStoragesResponse *TPortoApi::ListStorages(const TString &place,
     if (Call())
         return nullptr;
 
-    return &Rsp.liststorages();
+    return &Rsp->liststorages();
 }
 
 EError TPortoApi::ListStorages(std::vector<TString> &storages,
@@ -1041,7 +1340,7 @@ EError TPortoApi::ListStorages(std::vector<TString> &storages,
 
     if (!Call()) {
         storages.clear();
-        for (auto &storage: Rsp.liststorages().storages())
+        for (auto &storage: Rsp->liststorages().storages())
             storages.push_back(storage.name());
     }
 
@@ -1097,4 +1396,383 @@ EError TPortoApi::ExportStorage(const TString &storage,
     return Call(DiskTimeout);
 }
 
+static uint64_t MonotonicMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+TPortoPool::TPortoPool(int connections, const TString &socket_path) :
+    SocketPath(socket_path), Timeout(DEFAULT_TIMEOUT)
+{
+    Connections.resize(connections > 0 ? connections : 1);
+
+    EpollFd = epoll_create1(EPOLL_CLOEXEC);
+    EventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+    if (EpollFd >= 0 && EventFd >= 0) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u32 = 0;
+        if (!epoll_ctl(EpollFd, EPOLL_CTL_ADD, EventFd, &ev)) {
+            Thread = std::thread(&TPortoPool::Run, this);
+            return;
+        }
+    }
+
+    if (EpollFd >= 0)
+        close(EpollFd);
+    if (EventFd >= 0)
+        close(EventFd);
+    EpollFd = EventFd = -1;
+}
+
+TPortoPool::~TPortoPool() {
+    TCompleted completed;
+
+    if (Thread.joinable()) {
+        uint64_t one = 1;
+
+        Mutex.lock();
+        Stopping = true;
+        Mutex.unlock();
+
+        if (write(EventFd, &one, sizeof(one)) < 0) { }
+        Thread.join();
+    }
+
+    for (auto &conn: Connections)
+        Close(conn, EError::SocketError, "Pool destroyed", completed);
+
+    for (auto &it: completed)
+        if (it.first)
+            it.first(it.second);
+
+    if (EpollFd >= 0)
+        close(EpollFd);
+    if (EventFd >= 0)
+        close(EventFd);
+}
+
+EError TPortoPool::Connect(TConnection &conn, TString &msg) {
+    struct sockaddr_un peer_addr;
+
+    conn.Fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (conn.Fd < 0) {
+        msg = TString("socket: ") + strerror(errno);
+        return EError::SocketError;
+    }
+
+    memset(&peer_addr, 0, sizeof(struct sockaddr_un));
+    peer_addr.sun_family = AF_UNIX;
+    strncpy(peer_addr.sun_path, SocketPath.c_str(), sizeof(peer_addr.sun_path) - 1);
+
+    if (connect(conn.Fd, (struct sockaddr *) &peer_addr, sizeof(peer_addr)) < 0) {
+        EError error = errno == ENOENT ? EError::SocketUnavailable : EError::SocketError;
+        msg = TString("connect: ") + strerror(errno);
+        close(conn.Fd);
+        conn.Fd = -1;
+        return error;
+    }
+
+    fcntl(conn.Fd, F_SETFL, fcntl(conn.Fd, F_GETFL) | O_NONBLOCK);
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u32 = &conn - Connections.data() + 1;
+    if (epoll_ctl(EpollFd, EPOLL_CTL_ADD, conn.Fd, &ev)) {
+        msg = TString("epoll_ctl: ") + strerror(errno);
+        close(conn.Fd);
+        conn.Fd = -1;
+        return EError::SocketError;
+    }
+
+    conn.WaitOutput = false;
+
+    return EError::Success;
+}
+
+void TPortoPool::Close(TConnection &conn, EError error, const TString &msg, TCompleted &completed) {
+    if (conn.Fd >= 0)
+        close(conn.Fd);
+    conn.Fd = -1;
+    conn.WaitOutput = false;
+    conn.Output.clear();
+    conn.Input.clear();
+
+    for (auto &it: conn.Pending) {
+        TPortoResponse rsp;
+        rsp.set_error(error);
+        rsp.set_errormsg(msg);
+        rsp.set_request_id(it.first);
+        completed.emplace_back(std::move(it.second.Callback), std::move(rsp));
+    }
+    conn.Pending.clear();
+}
+
+void TPortoPool::Watch(TConnection &conn) {
+    bool wait = !conn.Output.empty();
+
+    if (conn.Fd < 0 || wait == conn.WaitOutput)
+        return;
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    if (wait)
+        ev.events |= EPOLLOUT;
+    ev.data.u32 = &conn - Connections.data() + 1;
+    if (!epoll_ctl(EpollFd, EPOLL_CTL_MOD, conn.Fd, &ev))
+        conn.WaitOutput = wait;
+}
+
+void TPortoPool::Flush(TConnection &conn, TCompleted &completed) {
+    size_t done = 0;
+
+    while (conn.Fd >= 0 && done < conn.Output.size()) {
+        ssize_t ret = send(conn.Fd, conn.Output.data() + done,
+                           conn.Output.size() - done, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (ret > 0) {
+            done += ret;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else if (errno != EINTR) {
+            Close(conn, EError::SocketError, TString("send: ") + strerror(errno), completed);
+            return;
+        }
+    }
+
+    conn.Output.erase(0, done);
+    Watch(conn);
+}
+
+void TPortoPool::Receive(TConnection &conn, TCompleted &completed) {
+    TString error;
+    char buf[65536];
+
+    while (conn.Fd >= 0) {
+        ssize_t ret = read(conn.Fd, buf, sizeof(buf));
+        if (ret > 0) {
+            conn.Input.append(buf, ret);
+        } else if (ret == 0) {
+            error = "recv: connection closed";
+            break;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else if (errno != EINTR) {
+            error = TString("recv: ") + strerror(errno);
+            break;
+        }
+    }
+
+    /* Stream might contain several responses and tail of next one */
+    size_t pos = 0;
+    while (pos < conn.Input.size()) {
+        auto data = (const uint8_t *)conn.Input.data() + pos;
+        size_t avail = conn.Input.size() - pos;
+        google::protobuf::io::CodedInputStream input(data, avail);
+        uint32_t size;
+
+        if (!input.ReadVarint32(&size)) {
+            if (avail >= 5)
+                error = "recv: malformed response size";
+            break;
+        }
+
+        size_t head = input.CurrentPosition();
+        if (avail - head < size)
+            break;
+
+        TPortoResponse rsp;
+        if (!rsp.ParseFromArray(data + head, size)) {
+            error = "recv: cannot parse response";
+            break;
+        }
+        pos += head + size;
+
+        auto it = conn.Pending.find(rsp.request_id());
+        if (it == conn.Pending.end())
+            continue;   /* timed out or async event */
+
+        completed.emplace_back(std::move(it->second.Callback), std::move(rsp));
+        conn.Pending.erase(it);
+    }
+
+    conn.Input.erase(0, pos);
+
+    if (!error.empty())
+        Close(conn, EError::SocketError, error, completed);
+}
+
+void TPortoPool::Expire(uint64_t now, TCompleted &completed) {
+    for (auto &conn: Connections) {
+        for (auto it = conn.Pending.begin(); it != conn.Pending.end(); ) {
+            if (it->second.Deadline && it->second.Deadline <= now) {
+                TPortoResponse rsp;
+                rsp.set_error(EError::SocketTimeout);
+                rsp.set_errormsg("recv: timeout");
+                rsp.set_request_id(it->first);
+                completed.emplace_back(std::move(it->second.Callback), std::move(rsp));
+                it = conn.Pending.erase(it);
+            } else
+                ++it;
+        }
+    }
+}
+
+void TPortoPool::Run() {
+    struct epoll_event events[64];
+
+    while (true) {
+        TCompleted completed;
+        int wait = 1000;
+
+        {
+            std::lock_guard<std::mutex> lock(Mutex);
+
+            if (Stopping)
+                break;
+
+            uint64_t now = MonotonicMs();
+            for (auto &conn: Connections)
+                for (auto &it: conn.Pending)
+                    if (it.second.Deadline)
+                        wait = std::min<int64_t>(wait, it.second.Deadline > now ?
+                                                 it.second.Deadline - now : 0);
+        }
+
+        int nr = epoll_wait(EpollFd, events, 64, wait);
+
+        {
+            std::lock_guard<std::mutex> lock(Mutex);
+
+            for (int i = 0; i < nr; i++) {
+                if (!events[i].data.u32) {
+                    uint64_t val;
+                    if (read(EventFd, &val, sizeof(val)) < 0) { }
+                    continue;
+                }
+
+                auto &conn = Connections[events[i].data.u32 - 1];
+
+                if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+                    Receive(conn, completed);
+
+                if (events[i].events & EPOLLOUT)
+                    Flush(conn, completed);
+            }
+
+            Expire(MonotonicMs(), completed);
+        }
+
+        for (auto &it: completed)
+            if (it.first)
+                it.first(it.second);
+    }
+}
+
+EError TPortoPool::Submit(const TPortoRequest &req, TResponseCallback callback,
+                          int extra_timeout, TString &msg) {
+    TCompleted completed;
+    EError error;
+
+    if (EpollFd < 0) {
+        msg = "Pool is not initialized";
+        return EError::SocketError;
+    }
+
+    if (!req.IsInitialized()) {
+        msg = "Request is not initialized";
+        return EError::InvalidMethod;
+    }
+
+    std::unique_lock<std::mutex> lock(Mutex);
+
+    if (Stopping) {
+        msg = "Pool is stopping";
+        return EError::SocketError;
+    }
+
+    /* Least loaded, connections are opened on demand */
+    TConnection *conn = nullptr;
+    for (auto &c: Connections)
+        if (!conn || c.Pending.size() < conn->Pending.size())
+            conn = &c;
+
+    if (conn->Fd < 0) {
+        error = Connect(*conn, msg);
+        if (error)
+            return error;
+    }
+
+    TPortoRequest pipelined(req);
+    uint64_t id = ++LastRequestId;
+    pipelined.set_request_id(id);
+
+    {
+        google::protobuf::io::StringOutputStream stream(&conn->Output);
+        google::protobuf::io::CodedOutputStream output(&stream);
+
+        output.WriteVarint32(pipelined.ByteSize());
+        pipelined.SerializeWithCachedSizes(&output);
+    }
+
+    uint64_t deadline = 0;
+    if (extra_timeout >= 0 && Timeout > 0)
+        deadline = MonotonicMs() + (uint64_t)(Timeout + extra_timeout) * 1000;
+
+    conn->Pending[id] = { std::move(callback), deadline };
+
+    Flush(*conn, completed);
+
+    lock.unlock();
+
+    for (auto &it: completed)
+        if (it.first)
+            it.first(it.second);
+
+    return EError::Success;
+}
+
+EError TPortoPool::CallAsync(const TPortoRequest &req,
+                             TResponseCallback callback,
+                             int extra_timeout) {
+    TString msg;
+    return Submit(req, callback, extra_timeout, msg);
+}
+
+std::future<TPortoResponse> TPortoPool::CallFuture(const TPortoRequest &req,
+                                                   int extra_timeout) {
+    auto promise = std::make_shared<std::promise<TPortoResponse>>();
+    auto future = promise->get_future();
+    TString msg;
+
+    EError error = Submit(req, [promise](const TPortoResponse &rsp) {
+                promise->set_value(rsp);
+            }, extra_timeout, msg);
+
+    if (error) {
+        TPortoResponse rsp;
+        rsp.set_error(error);
+        rsp.set_errormsg(msg);
+        promise->set_value(rsp);
+    }
+
+    return future;
+}
+
+EError TPortoPool::Call(const TPortoRequest &req,
+                        TPortoResponse &rsp,
+                        int extra_timeout) {
+    rsp = CallFuture(req, extra_timeout).get();
+    return rsp.error();
+}
+
+size_t TPortoPool::PendingCallsCount() {
+    std::lock_guard<std::mutex> lock(Mutex);
+    size_t count = 0;
+    for (auto &conn: Connections)
+        count += conn.Pending.size();
+    return count;
+}
+
 } /* namespace Porto */
@@ -4,9 +4,24 @@
 #include <vector>
 #include <string>
 #include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <memory>
+
+#include <google/protobuf/arena.h>
 
 #include "rpc.pb.h"
 
+namespace google {
+namespace protobuf {
+namespace io {
+class FileInputStream;
+}
+}
+}
+
 namespace Porto {
 
 constexpr int INFINITE_TIMEOUT = -1;
@@ -15,19 +30,66 @@ constexpr int DEFAULT_DISK_TIMEOUT = 900;   // 15min
 
 constexpr char SOCKET_PATH[] = "/run/portod.socket";
 
+constexpr size_t ARENA_BLOCK_MIN = 64 << 10;
+constexpr size_t ARENA_BLOCK_MAX = 16 << 20;
+
 typedef std::string TString;
 
 typedef std::function<void(const TWaitResponse &event)> TWaitCallback;
 
+typedef std::function<void(const TPortoResponse &rsp)> TResponseCallback;
+
+typedef std::function<void(const TGetResponse &update)> TSubscribeCallback;
+
 enum {
     GET_NONBLOCK = 1,
     GET_SYNC = 2,
     GET_REAL = 4,
+    GET_COLUMNAR = 8,
+};
+
+/*
+ * Flat container x property view of Get response without copying,
+ * valid until next call of TPortoApi which filled it.
+ */
+class TGetTable {
+    friend class TPortoApi;
+
+    struct TCell {
+        const TString *Text = nullptr;  /* nullptr - number or error */
+        uint64_t Number = 0;
+        EError Error = EError::Unknown;    /* not in response */
+    };
+
+    std::vector<const TString *> Names;
+    std::vector<TString> Properties;
+    std::vector<TCell> Cells;
+
+    void Reset(const std::vector<TString> &properties, size_t rows);
+    TCell &Cell(size_t row, size_t col) { return Cells[row * Properties.size() + col]; }
+
+public:
+    size_t Rows() const { return Names.size(); }
+    size_t Columns() const { return Properties.size(); }
+
+    const TString &Name(size_t row) const { return *Names[row]; }
+    const TString &Property(size_t col) const { return Properties[col]; }
+
+    EError Error(size_t row, size_t col) const {
+        return Cells[row * Properties.size() + col].Error;
+    }
+
+    /* Empty for errors */
+    TString Value(size_t row, size_t col) const;
+
+    EError GetUint(size_t row, size_t col, uint64_t &value) const;
 };
 
 class TPortoApi {
 private:
     int Fd = -1;
+    /* Buffered input stream, keeps read-ahead between calls */
+    std::shared_ptr<google::protobuf::io::FileInputStream> Input;
     int Timeout = DEFAULT_TIMEOUT;
     int DiskTimeout = DEFAULT_DISK_TIMEOUT;
 
@@ -37,15 +99,25 @@ private:
     /*
      * These keep last request and response. Method might return
      * pointers to Rsp innards -> pointers valid until next call.
+     * Response lives in arena which is reset before each call.
      */
     TPortoRequest Req;
-    TPortoResponse Rsp;
+    TPortoResponse *Rsp = nullptr;
+    std::unique_ptr<google::protobuf::Arena> RspArena;
+    std::vector<char> RspBlock;
+
+    void ResetResponse();
 
     std::vector<TString> AsyncWaitNames;
     std::vector<TString> AsyncWaitLabels;
     int AsyncWaitTimeout = INFINITE_TIMEOUT;
     TWaitCallback AsyncWaitCallback;
 
+    TSubscribeCallback SubscribeCallback;
+
+    uint64_t LastRequestId = 0;
+    std::map<uint64_t, TResponseCallback> PendingCalls;
+
     EError SetError(const TString &prefix, int _errno);
 
     EError SetSocketTimeout(int direction, int timeout);
@@ -57,7 +129,7 @@ private:
     EError Call(int extra_timeout = 0);
 
 public:
-    TPortoApi() { }
+    TPortoApi();
     ~TPortoApi();
 
     int GetFd() const { return Fd; }
@@ -85,10 +157,10 @@ public:
 
     /* Returns text protobuf */
     TString GetLastRequest() const { return Req.DebugString(); }
-    TString GetLastResponse() const { return Rsp.DebugString(); }
+    TString GetLastResponse() const { return Rsp->DebugString(); }
 
     /* To be used for next changed_since */
-    uint64_t ResponseTimestamp() const { return Rsp.timestamp(); }
+    uint64_t ResponseTimestamp() const { return Rsp->timestamp(); }
 
     // extra_timeout: 0 - none, -1 - infinite
     EError Call(const TPortoRequest &req,
@@ -99,6 +171,18 @@ public:
                 TString &rsp,
                 int extra_timeout = 0);
 
+    /*
+     * Pipelined call: sends request without waiting response.
+     * Callback is called from Complete() in order of completion,
+     * it must not do synchronous calls.
+     */
+    EError CallAsync(const TPortoRequest &req, TResponseCallback callback);
+
+    /* Receive responses for all pipelined calls */
+    EError Complete();
+
+    size_t PendingCallsCount() const { return PendingCalls.size(); }
+
     /* System */
 
     EError GetVersion(TString &tag, TString &revision);
@@ -138,6 +222,16 @@ public:
 
     EError Respawn(const TString &name);
 
+    // Dump processes with CRIU into directory, stop container unless leave_running
+    EError Checkpoint(const TString &name, const TString &path, bool leave_running = false);
+
+    // Restore processes from checkpoint, create container if missing
+    EError Restore(const TString &name, const TString &path);
+
+    /* Executes items in order, per-item errors are in result */
+    const TBatchResponse *Batch(const TBatchRequest &batch,
+                                int extra_timeout = 0);
+
     // wait_timeout: 0 - nonblock, -1 - infinite
     EError WaitContainer(const TString &name,
                          TString &result_state,
@@ -158,18 +252,38 @@ public:
                      int wait_timeout = INFINITE_TIMEOUT);
 
     void RecvAsyncWait() {
-        Recv(Rsp);
+        Recv(*Rsp);
     }
 
+    /* Updates are delivered while receiving responses or by RecvAsyncWait */
+    EError Subscribe(const std::vector<TString> &names,
+                     const std::vector<TString> &properties,
+                     uint64_t period_ms,
+                     TSubscribeCallback callback);
+
+    EError Unsubscribe();
+
     const TGetResponse *Get(const std::vector<TString> &names,
                             const std::vector<TString> &properties,
                             int flags = 0);
 
+    /* Fills table from columnar or row response */
+    EError GetTable(const std::vector<TString> &names,
+                    const std::vector<TString> &properties,
+                    TGetTable &table,
+                    int flags = 0);
+
     /* Porto v5 api */
     const TContainer *GetContainer(const TString &name);
 
     const TGetContainerResponse *GetContainers(uint64_t changed_since = 0);
 
+    /* offset = UINT64_MAX reads tail, next offset is in response */
+    const TReadStreamResponse *ReadStream(const TString &name,
+                                          const TString &stream = "stdout",
+                                          uint64_t offset = UINT64_MAX,
+                                          uint64_t limit = 0);
+
     EError GetProperty(const TString &name,
                        const TString &property,
                        TString &value,
@@ -279,7 +393,8 @@ public:
 
     EError ExportLayer(const TString &volume,
                        const TString &tarball,
-                       const TString &compress = "");
+                       const TString &compress = "",
+                       uint64_t changed_since = 0);
 
     EError ReExportLayer(const TString &layer,
                          const TString &tarball,
@@ -320,4 +435,75 @@ public:
                          const TString &compression = "");
 };
 
+/*
+ * Thread-safe client with pool of non-blocking connections.
+ *
+ * Requests are pipelined with request_id and spread across connections
+ * by number of calls in flight, one background thread drives all sockets
+ * with epoll and completes calls. Callbacks are called from that thread
+ * and must not block. AsyncWait and Subscribe are not supported here.
+ */
+class TPortoPool {
+private:
+    struct TPendingCall {
+        TResponseCallback Callback;
+        uint64_t Deadline;      /* ms, 0 - infinite */
+    };
+
+    struct TConnection {
+        int Fd = -1;
+        bool WaitOutput = false;
+        TString Output;
+        TString Input;
+        std::map<uint64_t, TPendingCall> Pending;
+    };
+
+    typedef std::vector<std::pair<TResponseCallback, TPortoResponse>> TCompleted;
+
+    TString SocketPath;
+    std::atomic<int> Timeout;
+
+    int EpollFd = -1;
+    int EventFd = -1;
+    std::thread Thread;
+    bool Stopping = false;
+
+    std::mutex Mutex;
+    std::vector<TConnection> Connections;
+    uint64_t LastRequestId = 0;
+
+    EError Submit(const TPortoRequest &req, TResponseCallback callback,
+                  int extra_timeout, TString &msg);
+    EError Connect(TConnection &conn, TString &msg);
+    void Watch(TConnection &conn);
+    void Close(TConnection &conn, EError error, const TString &msg, TCompleted &completed);
+    void Flush(TConnection &conn, TCompleted &completed);
+    void Receive(TConnection &conn, TCompleted &completed);
+    void Expire(uint64_t now, TCompleted &completed);
+    void Run();
+
+public:
+    TPortoPool(int connections = 4, const TString &socket_path = SOCKET_PATH);
+    ~TPortoPool();
+
+    /* Request timeout in seconds, default DEFAULT_TIMEOUT */
+    int GetTimeout() const { return Timeout; }
+    void SetTimeout(int timeout) { Timeout = timeout ? timeout : DEFAULT_TIMEOUT; }
+
+    /* extra_timeout: 0 - none, -1 - infinite */
+    EError CallAsync(const TPortoRequest &req,
+                     TResponseCallback callback,
+                     int extra_timeout = 0);
+
+    /* Errors are reported in response: error and errormsg */
+    std::future<TPortoResponse> CallFuture(const TPortoRequest &req,
+                                           int extra_timeout = 0);
+
+    EError Call(const TPortoRequest &req,
+                TPortoResponse &rsp,
+                int extra_timeout = 0);
+
+    size_t PendingCallsCount();
+};
+
 } /* namespace Porto */
@@ -0,0 +1,395 @@
+package porto
+
+import (
+	"bufio"
+	"encoding/binary"
+	"errors"
+	"net"
+	"sync"
+
+	"github.com/golang/protobuf/proto"
+
+	"rpc"
+)
+
+// Wire field numbers which are used without generated code:
+// request_id is newer than vendored rpc package.
+const (
+	fieldError     = 1
+	fieldErrorMsg  = 2
+	fieldList      = 3
+	fieldGet       = 10
+	fieldRequestId = 1001
+
+	fieldListName = 1
+	fieldGetList  = 1
+)
+
+var errMalformed = errors.New("malformed porto response")
+
+// nextField splits first field from protobuf wire data.
+func nextField(data []byte) (field int, wire int, value uint64, payload []byte, rest []byte, err error) {
+	key, n := binary.Uvarint(data)
+	if n <= 0 {
+		return 0, 0, 0, nil, nil, errMalformed
+	}
+	data = data[n:]
+	field = int(key >> 3)
+	wire = int(key & 7)
+
+	switch wire {
+	case 0:
+		value, n = binary.Uvarint(data)
+		if n <= 0 {
+			return 0, 0, 0, nil, nil, errMalformed
+		}
+		data = data[n:]
+	case 1:
+		if len(data) < 8 {
+			return 0, 0, 0, nil, nil, errMalformed
+		}
+		value = binary.LittleEndian.Uint64(data)
+		data = data[8:]
+	case 2:
+		size, n := binary.Uvarint(data)
+		if n <= 0 || uint64(len(data)-n) < size {
+			return 0, 0, 0, nil, nil, errMalformed
+		}
+		payload = data[n : n+int(size)]
+		data = data[n+int(size):]
+	case 5:
+		if len(data) < 4 {
+			return 0, 0, 0, nil, nil, errMalformed
+		}
+		value = uint64(binary.LittleEndian.Uint32(data))
+		data = data[4:]
+	default:
+		return 0, 0, 0, nil, nil, errMalformed
+	}
+
+	return field, wire, value, payload, data, nil
+}
+
+func responseRequestId(data []byte) uint64 {
+	var id uint64
+	for len(data) > 0 {
+		field, wire, value, _, rest, err := nextField(data)
+		if err != nil {
+			return 0
+		}
+		if field == fieldRequestId && wire == 0 {
+			id = value
+		}
+		data = rest
+	}
+	return id
+}
+
+type muxResult struct {
+	buf *[]byte
+	err error
+}
+
+// MuxConnection is safe for concurrent use: requests from many goroutines
+// are pipelined into one socket and matched to responses by request_id.
+type MuxConnection struct {
+	conn   net.Conn
+	reader *bufio.Reader
+
+	sendLock sync.Mutex
+
+	lock    sync.Mutex
+	lastId  uint64
+	pending map[uint64]chan muxResult
+	err     error
+}
+
+//ConnectMux establishes multiplexed connection to a Porto daemon.
+//Close must be called when the connection is not needed anymore.
+func ConnectMux() (*MuxConnection, error) {
+	c, err := net.Dial("unix", portoSocket)
+	if err != nil {
+		return nil, err
+	}
+
+	m := &MuxConnection{
+		conn:    c,
+		reader:  bufio.NewReaderSize(c, 64<<10),
+		pending: make(map[uint64]chan muxResult),
+	}
+	go m.receive()
+	return m, nil
+}
+
+func (m *MuxConnection) Close() error {
+	// Receiver fails calls in flight
+	return m.conn.Close()
+}
+
+func (m *MuxConnection) receive() {
+	for {
+		buf, err := recvBuffer(m.reader)
+		if err != nil {
+			m.fail(err)
+			return
+		}
+
+		id := responseRequestId(*buf)
+
+		m.lock.Lock()
+		ch, ok := m.pending[id]
+		delete(m.pending, id)
+		m.lock.Unlock()
+
+		if ok {
+			ch <- muxResult{buf: buf}
+		} else {
+			putBuffer(buf)
+		}
+	}
+}
+
+func (m *MuxConnection) fail(err error) {
+	m.lock.Lock()
+	m.err = err
+	pending := m.pending
+	m.pending = make(map[uint64]chan muxResult)
+	m.lock.Unlock()
+
+	for _, ch := range pending {
+		ch <- muxResult{err: err}
+	}
+}
+
+// callRaw returns pooled buffer with response, release it with putBuffer
+func (m *MuxConnection) callRaw(req *rpc.TPortoRequest) (*[]byte, error) {
+	data, err := proto.Marshal(req)
+	if err != nil {
+		return nil, err
+	}
+
+	ch := make(chan muxResult, 1)
+
+	m.lock.Lock()
+	if m.err != nil {
+		err = m.err
+		m.lock.Unlock()
+		return nil, err
+	}
+	m.lastId++
+	id := m.lastId
+	m.pending[id] = ch
+	m.lock.Unlock()
+
+	var idField [2 * binary.MaxVarintLen64]byte
+	n := binary.PutUvarint(idField[:], fieldRequestId<<3)
+	n += binary.PutUvarint(idField[n:], id)
+
+	m.sendLock.Lock()
+	err = sendData(m.conn, data, idField[:n])
+	m.sendLock.Unlock()
+
+	if err != nil {
+		// Partial frame breaks stream for everybody
+		m.conn.Close()
+		m.lock.Lock()
+		delete(m.pending, id)
+		m.lock.Unlock()
+		return nil, err
+	}
+
+	res := <-ch
+	return res.buf, res.err
+}
+
+// Call performs request, it could be called from many goroutines at once.
+func (m *MuxConnection) Call(req *rpc.TPortoRequest) (*rpc.TPortoResponse, error) {
+	buf, err := m.callRaw(req)
+	if err != nil {
+		return nil, err
+	}
+	defer putBuffer(buf)
+
+	resp := new(rpc.TPortoResponse)
+	if err := proto.Unmarshal(*buf, resp); err != nil {
+		return nil, err
+	}
+
+	return resp, responseError(resp)
+}
+
+// rawIterator walks repeated field of response without unmarshalling
+// whole response, response buffer is released at the end or by Close.
+type rawIterator struct {
+	buf   *[]byte
+	rest  []byte
+	field int
+	err   error
+}
+
+func (it *rawIterator) open(buf *[]byte, field int, item int) error {
+	var code rpc.EError
+	var msg string
+
+	it.buf = buf
+	it.field = item
+
+	data := *buf
+	for len(data) > 0 {
+		f, wire, value, payload, rest, err := nextField(data)
+		if err != nil {
+			it.Close()
+			return err
+		}
+		data = rest
+
+		switch {
+		case f == fieldError && wire == 0:
+			code = rpc.EError(value)
+		case f == fieldErrorMsg && wire == 2:
+			msg = string(payload)
+		case f == field && wire == 2:
+			it.rest = payload
+		}
+	}
+
+	if code != rpc.EError_Success {
+		it.Close()
+		return &Error{
+			Errno:   code,
+			ErrName: rpc.EError_name[int32(code)],
+			Message: msg,
+		}
+	}
+
+	return nil
+}
+
+func (it *rawIterator) next() ([]byte, bool) {
+	for it.err == nil && len(it.rest) > 0 {
+		f, wire, _, payload, rest, err := nextField(it.rest)
+		if err != nil {
+			it.err = err
+			break
+		}
+		it.rest = rest
+		if f == it.field && wire == 2 {
+			return payload, true
+		}
+	}
+	it.Close()
+	return nil, false
+}
+
+func (it *rawIterator) Err() error {
+	return it.err
+}
+
+func (it *rawIterator) Close() {
+	if it.buf != nil {
+		putBuffer(it.buf)
+		it.buf = nil
+	}
+	it.rest = nil
+}
+
+// GetIterator decodes Get response one container at a time.
+type GetIterator struct {
+	rawIterator
+	item rpc.TContainerGetResponse_TContainerGetListResponse
+}
+
+func (m *MuxConnection) GetIter(containers []string, variables []string) (*GetIterator, error) {
+	req := &rpc.TPortoRequest{
+		Get: &rpc.TContainerGetRequest{
+			Name:     containers,
+			Variable: variables,
+		},
+	}
+
+	buf, err := m.callRaw(req)
+	if err != nil {
+		return nil, err
+	}
+
+	it := new(GetIterator)
+	if err := it.open(buf, fieldGet, fieldGetList); err != nil {
+		return nil, err
+	}
+	return it, nil
+}
+
+func (it *GetIterator) Next() bool {
+	payload, ok := it.next()
+	if !ok {
+		return false
+	}
+
+	it.item.Reset()
+	if err := proto.Unmarshal(payload, &it.item); err != nil {
+		it.err = err
+		it.Close()
+		return false
+	}
+	return true
+}
+
+// Item is valid until next call of Next
+func (it *GetIterator) Item() *rpc.TContainerGetResponse_TContainerGetListResponse {
+	return &it.item
+}
+
+func (it *GetIterator) Name() string {
+	return it.item.GetName()
+}
+
+func (it *GetIterator) Values() map[string]TPortoGetResponse {
+	ret := make(map[string]TPortoGetResponse, len(it.item.GetKeyval()))
+	for _, value := range it.item.GetKeyval() {
+		ret[value.GetVariable()] = TPortoGetResponse{
+			Value:    value.GetValue(),
+			Error:    int(value.GetError()),
+			ErrorMsg: value.GetErrorMsg(),
+		}
+	}
+	return ret
+}
+
+// ListIterator returns container names one by one.
+type ListIterator struct {
+	rawIterator
+	name string
+}
+
+func (m *MuxConnection) ListIter(mask string) (*ListIterator, error) {
+	req := &rpc.TPortoRequest{
+		List: &rpc.TContainerListRequest{},
+	}
+
+	if mask != "" {
+		req.List.Mask = &mask
+	}
+
+	buf, err := m.callRaw(req)
+	if err != nil {
+		return nil, err
+	}
+
+	it := new(ListIterator)
+	if err := it.open(buf, fieldList, fieldListName); err != nil {
+		return nil, err
+	}
+	return it, nil
+}
+
+func (it *ListIterator) Next() bool {
+	payload, ok := it.next()
+	if ok {
+		it.name = string(payload)
+	}
+	return ok
+}
+
+func (it *ListIterator) Name() string {
+	return it.name
+}
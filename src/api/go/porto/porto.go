@@ -3,11 +3,13 @@
 package porto
 
 import (
+	"bufio"
 	"encoding/binary"
 	"fmt"
 	"io"
 	"math"
 	"net"
+	"sync"
 	"syscall"
 	"time"
 
@@ -18,50 +20,105 @@ import (
 
 const portoSocket = "/run/portod.socket"
 
-func sendData(conn io.Writer, data []byte) error {
-	// First we have to send actual data size,
-	// then the data itself
-	buf := make([]byte, 64)
-	len := binary.PutUvarint(buf, uint64(len(data)))
-	_, err := conn.Write(buf[:len])
-	if err != nil {
-		return err
+// Frames are varint length followed by message, buffers are pooled
+// because polling agents send thousands of requests per second.
+const maxPooledBuffer = 4 << 20
+
+var bufferPool = sync.Pool{
+	New: func() interface{} {
+		buf := make([]byte, 0, 64<<10)
+		return &buf
+	},
+}
+
+func getBuffer(size int) *[]byte {
+	buf := bufferPool.Get().(*[]byte)
+	if cap(*buf) < size {
+		*buf = make([]byte, size)
+	} else {
+		*buf = (*buf)[:size]
 	}
-	_, err = conn.Write(data)
+	return buf
+}
+
+func putBuffer(buf *[]byte) {
+	if cap(*buf) <= maxPooledBuffer {
+		bufferPool.Put(buf)
+	}
+}
+
+func appendVarint(buf []byte, value uint64) []byte {
+	var tmp [binary.MaxVarintLen64]byte
+	n := binary.PutUvarint(tmp[:], value)
+	return append(buf, tmp[:n]...)
+}
+
+func sendData(conn io.Writer, data []byte, extra ...[]byte) error {
+	size := len(data)
+	for _, e := range extra {
+		size += len(e)
+	}
+
+	// Single write keeps frame whole when connection is shared
+	buf := getBuffer(0)
+	frame := appendVarint((*buf)[:0], uint64(size))
+	frame = append(frame, data...)
+	for _, e := range extra {
+		frame = append(frame, e...)
+	}
+
+	_, err := conn.Write(frame)
+
+	*buf = frame
+	putBuffer(buf)
 	return err
 }
 
-func recvData(conn io.Reader) ([]byte, error) {
-	buf := make([]byte, 1024*1024)
+type byteReader interface {
+	io.Reader
+	io.ByteReader
+}
 
-	size, err := conn.Read(buf)
+// recvBuffer returns pooled buffer, caller must release it with putBuffer
+func recvBuffer(conn byteReader) (*[]byte, error) {
+	size, err := binary.ReadUvarint(conn)
 	if err != nil {
 		return nil, err
 	}
 
-	exp, shift := binary.Uvarint(buf)
+	buf := getBuffer(int(size))
+	if _, err := io.ReadFull(conn, *buf); err != nil {
+		putBuffer(buf)
+		return nil, err
+	}
 
-	// length of result is exp,
-	// so preallocate a buffer for it.
-	var ret = make([]byte, exp)
-	// bytes after an encoded uint64 and up to len
-	// are belong to a packed structure, so copy them
-	copy(ret, buf[shift:size])
+	return buf, nil
+}
 
-	// we don't need to check that
-	// size > shift, as we ask to read enough data
-	// to decode uint64. Otherwise we would have an error before.
-	for pos := size - shift; uint64(pos) < exp; {
-		n, err := conn.Read(ret[pos:])
-		if err != nil {
-			return nil, err
-		}
-		pos += n
+func recvData(conn byteReader) ([]byte, error) {
+	buf, err := recvBuffer(conn)
+	if err != nil {
+		return nil, err
 	}
 
+	ret := make([]byte, len(*buf))
+	copy(ret, *buf)
+	putBuffer(buf)
+
 	return ret, nil
 }
 
+func responseError(resp *rpc.TPortoResponse) error {
+	if resp.GetError() != rpc.EError_Success {
+		return &Error{
+			Errno:   resp.GetError(),
+			ErrName: rpc.EError_name[int32(resp.GetError())],
+			Message: resp.GetErrorMsg(),
+		}
+	}
+	return nil
+}
+
 type TProperty struct {
 	Name        string
 	Description string
@@ -176,9 +233,10 @@ type API interface {
 }
 
 type portoConnection struct {
-	conn net.Conn
-	err  rpc.EError
-	msg  string
+	conn   net.Conn
+	reader *bufio.Reader
+	err    rpc.EError
+	msg    string
 }
 
 //Connect establishes connection to a Porto daemon via unix socket.
@@ -191,6 +249,7 @@ func Connect() (API, error) {
 
 	ret := new(portoConnection)
 	ret.conn = c
+	ret.reader = bufio.NewReaderSize(c, 64<<10)
 	return ret, nil
 }
 
@@ -232,14 +291,15 @@ func (conn *portoConnection) performRequest(req *rpc.TPortoRequest) (*rpc.TPorto
 		return nil, err
 	}
 
-	data, err = recvData(conn.conn)
+	buf, err := recvBuffer(conn.reader)
 	if err != nil {
 		return nil, err
 	}
+	defer putBuffer(buf)
 
 	resp := new(rpc.TPortoResponse)
 
-	err = proto.Unmarshal(data, resp)
+	err = proto.Unmarshal(*buf, resp)
 	if err != nil {
 		return nil, err
 	}
@@ -247,15 +307,7 @@ func (conn *portoConnection) performRequest(req *rpc.TPortoRequest) (*rpc.TPorto
 	conn.err = resp.GetError()
 	conn.msg = resp.GetErrorMsg()
 
-	if resp.GetError() != rpc.EError_Success {
-		return resp, &Error{
-			Errno:   conn.err,
-			ErrName: rpc.EError_name[int32(conn.err)],
-			Message: conn.msg,
-		}
-	}
-
-	return resp, nil
+	return resp, responseError(resp)
 }
 
 // ContainerAPI
@@ -3,8 +3,10 @@ package porto
 import (
 	"bytes"
 	"crypto/rand"
+	"errors"
 	"os"
 	"os/exec"
+	"sync"
 	"syscall"
 	"testing"
 	"strings"
@@ -56,7 +58,7 @@ func TestGetVersion(t *testing.T) {
 	defer conn.Close()
 	maj, min, err := conn.GetVersion()
 	FailOnError(t, conn, err)
-	t.Logf("Porto version %d.%d", maj, min)
+	t.Logf("Porto version %s.%s", maj, min)
 }
 
 func TestPlist(t *testing.T) {
@@ -203,6 +205,63 @@ func TestGet(t *testing.T) {
 	}
 }
 
+func TestMux(t *testing.T) {
+	mux, err := ConnectMux()
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer mux.Close()
+
+	var wg sync.WaitGroup
+	errs := make(chan error, 100)
+	for i := 0; i < 100; i++ {
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			resp, err := mux.Call(&rpc.TPortoRequest{
+				Version: new(rpc.TVersionRequest),
+			})
+			if err == nil && resp.GetVersion().GetTag() == "" {
+				err = errors.New("empty version")
+			}
+			if err != nil {
+				errs <- err
+			}
+		}()
+	}
+	wg.Wait()
+	close(errs)
+	for err := range errs {
+		t.Fatal(err)
+	}
+
+	it, err := mux.GetIter([]string{testContainer}, []string{"state", "exit_status"})
+	if err != nil {
+		t.Fatal(err)
+	}
+	found := false
+	for it.Next() {
+		if it.Name() == testContainer && it.Values()["state"].Value == "dead" {
+			found = true
+		}
+	}
+	if it.Err() != nil || !found {
+		t.Fatalf("Get iterator failed: %v", it.Err())
+	}
+
+	list, err := mux.ListIter("")
+	if err != nil {
+		t.Fatal(err)
+	}
+	found = false
+	for list.Next() {
+		found = found || list.Name() == testContainer
+	}
+	if list.Err() != nil || !found {
+		t.Fatalf("List iterator failed: %v", list.Err())
+	}
+}
+
 func TestConvertPath(t *testing.T) {
 	conn := ConnectToPorto(t)
 	defer conn.Close()
@@ -42,7 +42,30 @@ def _decode_message(msg):
             ret[key] = val
     return ret
 
+def _decode_get_response(get):
+    res = {}
+    for container in get.list:
+        var = {}
+        for kv in container.keyval:
+            if kv.HasField('error'):
+                var[kv.variable] = exceptions.PortoException.Create(kv.error, kv.errorMsg)
+                continue
+            if kv.value == 'false':
+                var[kv.variable] = False
+            elif kv.value == 'true':
+                var[kv.variable] = True
+            else:
+                var[kv.variable] = kv.value
+
+        res[container.name] = var
+    return res
+
+
 class _RPC(object):
+    # Responses are received into reusable buffer with recv_into
+    RECV_BUFFER_SIZE = 65536
+    RECV_BUFFER_MAX = 16 << 20
+
     def __init__(self, socket_path, timeout, socket_constructor,
                  lock_constructor, auto_reconnect, reconnect_interval):
         self.lock = lock_constructor()
@@ -59,6 +82,10 @@ class _RPC(object):
         self.async_wait_names = []
         self.async_wait_callback = None
         self.async_wait_timeout = None
+        self.subscribe_callback = None
+        self.recv_buffer = bytearray(self.RECV_BUFFER_SIZE)
+        self.recv_start = 0
+        self.recv_end = 0
 
     def _connect(self):
         if self.connect_time:
@@ -67,6 +94,7 @@ class _RPC(object):
                 time.sleep(self.reconnect_interval - diff)
         SOCK_CLOEXEC = 0o2000000
         self.sock = self.socket_constructor(socket.AF_UNIX, socket.SOCK_STREAM | SOCK_CLOEXEC)
+        self._reset_buffer()
         self._set_socket_timeout()
         self.nr_connects += 1
         self.connect_time = time.time()
@@ -108,28 +136,59 @@ class _RPC(object):
                 self.sock = None
                 raise exceptions.SocketTimeout("Porto connection timeout")
 
-    def _recv_data(self, count):
-        msg = bytearray()
-        while len(msg) < count:
+    def _reset_buffer(self):
+        if len(self.recv_buffer) > self.RECV_BUFFER_MAX:
+            self.recv_buffer = bytearray(self.RECV_BUFFER_SIZE)
+        self.recv_start = 0
+        self.recv_end = 0
+
+    def _recv_fill(self, count):
+        # Make room for count bytes, then receive as much as socket has
+        if self.recv_start + count > len(self.recv_buffer):
+            pending = self.recv_end - self.recv_start
+            if count > len(self.recv_buffer):
+                buf = bytearray(max(count, len(self.recv_buffer) * 2))
+            else:
+                buf = self.recv_buffer
+            buf[:pending] = self.recv_buffer[self.recv_start:self.recv_end]
+            self.recv_buffer = buf
+            self.recv_start = 0
+            self.recv_end = pending
+
+        view = memoryview(self.recv_buffer)
+        while self.recv_end - self.recv_start < count:
             self._set_socket_timeout()
-            chunk = self.sock.recv(count - len(msg))
-            if not chunk:
+            size = self.sock.recv_into(view[self.recv_end:])
+            if not size:
                 raise socket.error(socket.errno.ECONNRESET, os.strerror(socket.errno.ECONNRESET))
-            msg.extend(chunk)
-        return msg
+            self.recv_end += size
+
+    def _recv_data(self, count):
+        if self.recv_end - self.recv_start < count:
+            self._recv_fill(count)
+        start = self.recv_start
+        self.recv_start += count
+        return memoryview(self.recv_buffer)[start:self.recv_start]
 
     def _recv_response(self):
         rsp = rpc_pb2.TPortoResponse()
         while True:
-            length = shift = 0
+            if self.recv_start == self.recv_end:
+                self._reset_buffer()
+
+            length = shift = pos = 0
             while True:
-                b = self._recv_data(1)
-                length |= (b[0] & 0x7f) << shift
+                if self.recv_start + pos >= self.recv_end:
+                    self._recv_fill(pos + 1)
+                b = self.recv_buffer[self.recv_start + pos]
+                pos += 1
+                length |= (b & 0x7f) << shift
                 shift += 7
-                if b[0] <= 0x7f:
+                if b <= 0x7f:
                     break
+            self.recv_start += pos
 
-            rsp.ParseFromString(bytes(self._recv_data(length)))
+            rsp.ParseFromString(self._recv_data(length).tobytes())
 
             if rsp.HasField('AsyncWait'):
                 if self.async_wait_callback is not None:
@@ -137,6 +196,9 @@ class _RPC(object):
                         self.async_wait_callback(name=rsp.AsyncWait.name, state=rsp.AsyncWait.state, when=rsp.AsyncWait.when, label=rsp.AsyncWait.label, value=rsp.AsyncWait.value)
                     else:
                         self.async_wait_callback(name=rsp.AsyncWait.name, state=rsp.AsyncWait.state, when=rsp.AsyncWait.when)
+            elif rsp.HasField('SubscribeUpdate'):
+                if self.subscribe_callback is not None:
+                    self.subscribe_callback(_decode_get_response(rsp.SubscribeUpdate))
             else:
                 return rsp
 
@@ -289,6 +351,12 @@ class Container(object):
     def Resume(self):
         self.conn.Resume(self.name)
 
+    def Checkpoint(self, path, leave_running=False):
+        self.conn.Checkpoint(self.name, path, leave_running)
+
+    def Restore(self, path):
+        self.conn.Restore(self.name, path)
+
     def Get(self, variables, nonblock=False, sync=False):
         return self.conn.Get([self.name], variables, nonblock, sync)[self.name]
 
@@ -316,9 +384,15 @@ class Container(object):
     def GetData(self, data, sync=False):
         return self.conn.GetData(self.name, data, sync)
 
+    def ReadStream(self, stream='stdout', offset=None, limit=None):
+        return self.conn.ReadStream(self.name, stream, offset, limit)
+
     def SetSymlink(self, symlink, target):
         return self.conn.SetSymlink(self.name, symlink, target)
 
+    def Exec(self, commands, wait=False):
+        return self.conn.Exec(self.name, commands, wait)
+
     def WaitContainer(self, timeout=None):
         return self.conn.WaitContainers([self.name], timeout=timeout)
 
@@ -750,6 +824,31 @@ class Connection(object):
         request.Resume.name = name
         self.rpc.call(request)
 
+    def Checkpoint(self, name, path, leave_running=False):
+        request = rpc_pb2.TPortoRequest()
+        request.Checkpoint.name = name
+        request.Checkpoint.path = path
+        if leave_running:
+            request.Checkpoint.leave_running = True
+        self.rpc.call(request)
+
+    def Restore(self, name, path):
+        request = rpc_pb2.TPortoRequest()
+        request.Restore.name = name
+        request.Restore.path = path
+        self.rpc.call(request)
+        return self.Find(name)
+
+    def Batch(self, items, stop_on_error=False, timeout=None):
+        request = rpc_pb2.TPortoRequest()
+        request.Batch.SetInParent()
+        for item in items:
+            _encode_message(request.Batch.item.add(), item)
+        if stop_on_error:
+            request.Batch.stop_on_error = True
+        resp = self.rpc.call(request, timeout)
+        return [exceptions.PortoException.Create(r.error, r.msg) if r.error else None for r in resp.Batch.result]
+
     def Get(self, containers, variables, nonblock=False, sync=False):
         request = rpc_pb2.TPortoRequest()
         request.Get.name.extend(containers)
@@ -758,22 +857,36 @@ class Connection(object):
         if nonblock:
             request.Get.nonblock = nonblock
         resp = self.rpc.call(request)
+        return _decode_get_response(resp.Get)
+
+    def GetColumns(self, containers, variables, sync=False):
+        request = rpc_pb2.TPortoRequest()
+        request.Get.name.extend(containers)
+        request.Get.variable.extend(variables)
+        request.Get.sync = sync
+        request.Get.columnar = True
+        resp = self.rpc.call(request)
         res = {}
-        for container in resp.Get.list:
-            var = {}
-            for kv in container.keyval:
-                if kv.HasField('error'):
-                    var[kv.variable] = exceptions.PortoException.Create(kv.error, kv.errorMsg)
-                    continue
-                if kv.value == 'false':
-                    var[kv.variable] = False
-                elif kv.value == 'true':
-                    var[kv.variable] = True
-                else:
-                    var[kv.variable] = kv.value
+        for col in resp.Get.column:
+            values = list(col.number) if col.number else list(col.text)
+            for row, error, msg in zip(col.error_row, col.error, col.error_msg):
+                values[row] = exceptions.PortoException.Create(error, msg)
+            res[col.variable] = values
+        return list(resp.Get.container), res
+
+    def Subscribe(self, containers, variables, period, callback):
+        request = rpc_pb2.TPortoRequest()
+        request.Subscribe.name.extend(containers)
+        request.Subscribe.variable.extend(variables)
+        request.Subscribe.period_ms = int(period * 1000)
+        self.rpc.subscribe_callback = callback
+        self.rpc.call(request)
 
-            res[container.name] = var
-        return res
+    def Unsubscribe(self):
+        request = rpc_pb2.TPortoRequest()
+        request.Subscribe.period_ms = 0
+        self.rpc.subscribe_callback = None
+        self.rpc.call(request)
 
     def GetProperty(self, name, key, sync=False):
         request = rpc_pb2.TPortoRequest()
@@ -807,6 +920,34 @@ class Connection(object):
         for name, value in kwargs.items():
             self.SetProperty(container, name, value)
 
+    # returns (data, offset of data, offset for next call)
+    def ReadStream(self, name, stream='stdout', offset=None, limit=None):
+        request = rpc_pb2.TPortoRequest()
+        request.ReadStream.name = name
+        request.ReadStream.stream = stream
+        if offset is not None:
+            request.ReadStream.offset = offset
+        if limit is not None:
+            request.ReadStream.limit = limit
+        res = self.rpc.call(request).ReadStream
+        return res.data, res.offset, res.next
+
+    # returns list of (pid, exit status or None, exception or None)
+    def Exec(self, name, commands, wait=False):
+        request = rpc_pb2.TPortoRequest()
+        request.Exec.name = name
+        for argv in commands:
+            request.Exec.command.add().argv.extend(argv)
+        request.Exec.wait = wait
+        result = []
+        for res in self.rpc.call(request).Exec.result:
+            error = None
+            if res.HasField('error'):
+                error = exceptions.PortoException.Create(res.error.error, res.error.msg)
+            status = res.exit_status if res.HasField('exit_status') else None
+            result.append((res.pid, status, error))
+        return result
+
     def GetData(self, name, data, sync=False):
         request = rpc_pb2.TPortoRequest()
         request.GetDataProperty.name = name
@@ -916,7 +1057,7 @@ class Connection(object):
         req.IncLabel.add = add
         return self.rpc.call(req).IncLabel.result
 
-    def CreateVolume(self, path=None, layers=None, storage=None, private_value=None, timeout=None, **properties):
+    def CreateVolume(self, path=None, layers=None, storage=None, private_value=None, timeout=None, async_build=None, **properties):
         if layers:
             layers = [l.name if isinstance(l, Layer) else l for l in layers]
             properties['layers'] = ';'.join(layers)
@@ -931,6 +1072,8 @@ class Connection(object):
         request.CreateVolume.SetInParent()
         if path:
             request.CreateVolume.path = path
+        if async_build is not None:
+            request.CreateVolume.async_build = async_build
         for name, value in properties.items():
             prop = request.CreateVolume.properties.add()
             prop.name, prop.value = name, value
@@ -941,10 +1084,12 @@ class Connection(object):
         pb = self._ListVolumes(path=path)[0]
         return Volume(self, path, pb)
 
-    def NewVolume(self, spec, timeout=None):
+    def NewVolume(self, spec, timeout=None, async_build=None):
         req = rpc_pb2.TPortoRequest()
         req.NewVolume.SetInParent()
         _encode_message(req.NewVolume.volume, spec)
+        if async_build is not None:
+            req.NewVolume.async_build = async_build
         rsp = self.rpc.call(req, timeout or self.disk_timeout)
         return _decode_message(rsp.NewVolume.volume)
 
@@ -985,7 +1130,7 @@ class Connection(object):
             command.required = True
         self.rpc.call(request)
 
-    def UnlinkVolume(self, path, container=None, target=None, strict=None, timeout=None):
+    def UnlinkVolume(self, path, container=None, target=None, strict=None, timeout=None, async_delete=None):
         request = rpc_pb2.TPortoRequest()
         if target is not None:
             command = request.UnlinkVolumeTarget
@@ -998,6 +1143,8 @@ class Connection(object):
             command.target = target
         if strict is not None:
             command.strict = strict
+        if async_delete is not None:
+            command.async_delete = async_delete
         self.rpc.call(request, timeout or self.disk_timeout)
 
     def DestroyVolume(self, volume, strict=None, timeout=None):
@@ -1093,7 +1240,7 @@ class Connection(object):
             request.SetLayerPrivate.place = place
         self.rpc.call(request)
 
-    def ExportLayer(self, volume, tarball, place=None, compress=None, timeout=None):
+    def ExportLayer(self, volume, tarball, place=None, compress=None, timeout=None, changed_since=None):
         request = rpc_pb2.TPortoRequest()
         request.ExportLayer.volume = volume
         request.ExportLayer.tarball = tarball
@@ -1101,6 +1248,8 @@ class Connection(object):
             request.ExportLayer.place = place
         if compress is not None:
             request.ExportLayer.compress = compress
+        if changed_since is not None:
+            request.ExportLayer.changed_since = int(changed_since)
         self.rpc.call(request, timeout or self.disk_timeout)
 
     def ReExportLayer(self, layer, tarball, place=None, compress=None, timeout=None):
@@ -1,10 +1,19 @@
 #include <algorithm>
 #include <cmath>
 #include <csignal>
+#include <cstring>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "cgroup.hpp"
 #include "device.hpp"
 #include "config.hpp"
+#include "trace.hpp"
 #include "util/log.hpp"
 #include "util/string.hpp"
 #include "util/unix.hpp"
@@ -29,18 +38,113 @@ const TFlagsNames ControllersName = {
     { CGROUP_CPUSET,    "cpuset" },
     { CGROUP_PIDS,      "pids" },
     { CGROUP_SYSTEMD,   "systemd" },
+    { CGROUP2,          "cgroup2" },
 };
 
+/* Counters read on each stat request, their descriptors are kept open */
+static const std::unordered_set<std::string> CachedKnobs = {
+    "memory.stat",
+    "memory.usage_in_bytes",
+    "memory.anon.usage",
+    "cpuacct.usage",
+    "cpuacct.stat",
+    "cpuacct.wait",
+    "cpu.stat",
+    "pids.current",
+    "cpu.pressure",
+    "memory.pressure",
+    "io.pressure",
+    "blkio.io_service_bytes_recursive",
+    "blkio.io_serviced_recursive",
+    "blkio.io_service_time_recursive",
+    "blkio.io_wait_time_recursive",
+    "blkio.throttle.io_service_bytes",
+    "blkio.throttle.io_serviced",
+    "blkio.throttle.io_service_bytes_recursive",
+    "blkio.throttle.io_serviced_recursive",
+    "blkio.throttle.io_service_time_recursive",
+    "blkio.throttle.io_wait_time_recursive",
+};
+
+typedef std::list<std::pair<std::string, std::shared_ptr<TFile>>> TKnobLru;
+
+static std::mutex KnobCacheMutex;
+static TKnobLru KnobCacheLru; /* most recent first */
+static std::unordered_map<std::string, TKnobLru::iterator> KnobCache;
+
+static std::shared_ptr<TFile> GetCachedKnob(const std::string &path) {
+    std::lock_guard<std::mutex> guard(KnobCacheMutex);
+    auto it = KnobCache.find(path);
+    if (it == KnobCache.end())
+        return nullptr;
+    KnobCacheLru.splice(KnobCacheLru.begin(), KnobCacheLru, it->second);
+    return it->second->second;
+}
+
+static void PutCachedKnob(const std::string &path, std::shared_ptr<TFile> file) {
+    std::lock_guard<std::mutex> guard(KnobCacheMutex);
+    if (KnobCache.count(path))
+        return;
+    KnobCacheLru.emplace_front(path, file);
+    KnobCache[path] = KnobCacheLru.begin();
+    while (KnobCache.size() > config().container().knob_cache_size()) {
+        KnobCache.erase(KnobCacheLru.back().first);
+        KnobCacheLru.pop_back();
+    }
+}
+
+static void DropCachedKnobs(const std::string &prefix) {
+    std::lock_guard<std::mutex> guard(KnobCacheMutex);
+    for (auto it = KnobCacheLru.begin(); it != KnobCacheLru.end(); ) {
+        if (StringStartsWith(it->first, prefix)) {
+            KnobCache.erase(it->first);
+            it = KnobCacheLru.erase(it);
+        } else
+            ++it;
+    }
+}
+
+/* One pread for cached knob instead of open, fstat, read and close */
+static TError ReadCachedKnob(const TPath &path, std::string &value) {
+    auto file = GetCachedKnob(path.ToString());
+    TError error;
+
+    if (file) {
+        error = file->PreadAll(value, 1 << 20);
+        if (!error)
+            return OK;
+        /* Cgroup was recreated behind our back */
+        DropCachedKnobs(path.ToString());
+    }
+
+    file = std::make_shared<TFile>();
+    error = file->OpenRead(path);
+    if (!error)
+        error = file->PreadAll(value, 1 << 20);
+    if (error)
+        return TError(error, "Cannot read {}", path);
+
+    PutCachedKnob(path.ToString(), file);
+    return OK;
+}
+
 TPath TCgroup::Path() const {
     if (!Subsystem)
         return TPath();
     return Subsystem->Root / Name;
 }
 
+/* Built in one buffer: knob paths are composed for every cgroup access */
 TPath TCgroup::Knob(const std::string &knob) const {
     if (!Subsystem)
         return TPath();
-    return Subsystem->Root / Name / knob;
+
+    TPath path;
+    path.Reserve(Subsystem->Root.ToString().size() + Name.size() + knob.size() + 2);
+    path.AppendComponent(Subsystem->Root.ToString());
+    path.AppendComponent(Name);
+    path.AppendComponent(knob);
+    return path;
 }
 
 bool TCgroup::IsRoot() const {
@@ -54,6 +158,7 @@ bool TCgroup::Exists() const {
 }
 
 TError TCgroup::Create() {
+    TTraceScope trace("CgroupCreate", Name);
     TError error;
 
     if (Secondary())
@@ -75,7 +180,78 @@ TError TCgroup::Create() {
     return error;
 }
 
+/* Warm pool of empty cgroups, start renames one into place instead of mkdir */
+
+static std::mutex CgroupPoolMutex;
+static std::map<const TSubsystem *, std::vector<TCgroup>> CgroupPool;
+static uint64_t CgroupPoolSeq = 0;
+
+static bool CgroupPoolEnabled(const TSubsystem *hy) {
+    /* cpuset copies cpus and mems from parent at creation */
+    return config().container().cgroup_pool_size() &&
+        !(hy->Controllers & (CGROUP_CPUSET | CGROUP_SYSTEMD));
+}
+
+static TCgroup CgroupPoolParent(const TSubsystem *hy) {
+    if (hy->Controllers & CGROUP_FREEZER)
+        return hy->Cgroup(PORTO_CGROUP_PREFIX);
+    return hy->RootCgroup();
+}
+
+TError TCgroup::CreateFromPool() {
+    TCgroup cg;
+
+    if (Secondary() || !CgroupPoolEnabled(Subsystem) ||
+            Path().DirName() != CgroupPoolParent(Subsystem).Path())
+        return TError(EError::NotSupported, "No cgroup pool for {}", *this);
+
+    auto lock = std::unique_lock<std::mutex>(CgroupPoolMutex);
+    auto &pool = CgroupPool[Subsystem];
+    if (pool.empty())
+        return TError(EError::ResourceNotAvailable, "Cgroup pool {} is empty", Type());
+    cg = pool.back();
+    pool.pop_back();
+    lock.unlock();
+
+    TError error = cg.Path().Rename(Path());
+    if (error) {
+        L_WRN("Cannot rename pooled cgroup {} into {} : {}", cg, *this, error);
+        (void)cg.RemoveOne();
+        return error;
+    }
+
+    L_CG("Create cgroup {} from pool", *this);
+    return OK;
+}
+
+void RefillCgroupPool() {
+    for (auto hy: Hierarchies) {
+        if (!CgroupPoolEnabled(hy))
+            continue;
+
+        while (1) {
+            auto lock = std::unique_lock<std::mutex>(CgroupPoolMutex);
+            if (CgroupPool[hy].size() >= config().container().cgroup_pool_size())
+                break;
+            auto seq = ++CgroupPoolSeq;
+            lock.unlock();
+
+            /* names with '%' never clash with containers */
+            TCgroup cg = CgroupPoolParent(hy).Child(hy->Controllers & CGROUP_FREEZER ?
+                    "%pool" + std::to_string(seq) :
+                    std::string(PORTO_CGROUP_PREFIX + 1) + "%%pool" + std::to_string(seq));
+            if (cg.Create() || !cg.Exists())
+                break;
+
+            lock.lock();
+            CgroupPool[hy].push_back(cg);
+        }
+    }
+}
+
 TError TCgroup::Remove() {
+    TTraceScope trace("CgroupRemove", Name);
+
     if (Subsystem->Kind & CGROUP_SYSTEMD) {
         std::vector<TCgroup> children;
 
@@ -101,6 +277,7 @@ TError TCgroup::RemoveOne() {
         return TError("Cannot create secondary cgroup " + Type());
 
     L_CG("Remove cgroup {}", *this);
+    DropCachedKnobs(Path().ToString() + "/");
     error = Path().Rmdir();
 
     /* workaround for bad synchronization */
@@ -136,10 +313,28 @@ bool TCgroup::Has(const std::string &knob) const {
 TError TCgroup::Get(const std::string &knob, std::string &value) const {
     if (!Subsystem)
         return TError("Cannot get from null cgroup");
+    if (config().container().knob_cache_size() && CachedKnobs.count(knob))
+        return ReadCachedKnob(Knob(knob), value);
     return Knob(knob).ReadAll(value);
 }
 
+TError TCgroup::GetLines(const std::string &knob, std::vector<std::string> &lines) const {
+    std::string text, line;
+
+    TError error = Get(knob, text);
+    if (error)
+        return error;
+
+    std::stringstream ss(text);
+    while (std::getline(ss, line))
+        lines.push_back(line);
+
+    return OK;
+}
+
 TError TCgroup::Set(const std::string &knob, const std::string &value) const {
+    TTraceScope trace("CgroupSet", knob);
+
     if (!Subsystem)
         return TError("Cannot set to null cgroup");
     L_CG("Set {} {} = {}", *this, knob, value);
@@ -186,26 +381,26 @@ TError TCgroup::SetBool(const std::string &knob, bool value) const {
 }
 
 TError TCgroup::GetUintMap(const std::string &knob, TUintMap &value) const {
-    if (!Subsystem)
-        return TError("Cannot get from null cgroup");
-
-    FILE *file = fopen(Knob(knob).c_str(), "r");
-    char *key;
-    unsigned long long val;
+    std::vector<std::string> lines;
 
-    if (!file)
-        return TError::System("Cannot open knob " + knob);
+    TError error = GetLines(knob, lines);
+    if (error)
+        return error;
 
-    while (fscanf(file, "%ms %llu\n", &key, &val) == 2) {
-        value[std::string(key)] = val;
-        free(key);
+    for (auto &line: lines) {
+        auto word = SplitString(line, ' ');
+        uint64_t val;
+        if (word.size() != 2 || StringToUint64(word[1], val))
+            break;
+        value[word[0]] = val;
     }
 
-    fclose(file);
     return OK;
 }
 
 TError TCgroup::Attach(pid_t pid, bool thread) const {
+    TTraceScope trace("CgroupAttach", Name);
+
     if (Secondary())
         return TError("Cannot attach to secondary cgroup " + Type());
 
@@ -330,32 +525,50 @@ bool TCgroup::IsEmpty() const {
 }
 
 TError TCgroup::KillAll(int signal) const {
-    std::vector<pid_t> tasks, killed;
-    TError error, error2;
+    std::unordered_set<pid_t> seen, killed;
+    std::vector<pid_t> procs;
+    uint64_t start = GetCurrentTimeMs();
+    TError error;
     bool retry;
     bool frozen = false;
-    int iteration = 0;
 
     L_CG("KillAll {} {}", signal, *this);
 
     if (IsRoot())
         return TError(EError::Permission, "Bad idea");
 
-    do {
-        if (++iteration > 10 && !frozen && FreezerSubsystem.IsBound(*this) &&
-                !FreezerSubsystem.IsFrozen(*this)) {
-            error = FreezerSubsystem.Freeze(*this, false);
-            if (error)
-                L_ERR("Cannot freeze cgroup for killing {} : {}", *this, error);
-            else
-                frozen = true;
+    /* Kernel kills whole subtree at once and new forks cannot escape */
+    if (signal == SIGKILL && Cgroup2Subsystem.Supported) {
+        TCgroup unified = Cgroup2Subsystem.Cgroup(Name);
+        if (unified.Has("cgroup.kill")) {
+            error = unified.Set("cgroup.kill", "1");
+            if (!error) {
+                L_CG("KillAll {} via cgroup.kill in {} ms", *this, GetCurrentTimeMs() - start);
+                return OK;
+            }
+            L_WRN("Cannot kill {} : {}", unified, error);
         }
-        error = GetTasks(tasks);
+    }
+
+    /* Frozen tasks cannot fork or exit, so pids are not reused while we walk */
+    if (FreezerSubsystem.IsBound(*this) && !FreezerSubsystem.IsFrozen(*this)) {
+        error = FreezerSubsystem.Freeze(*this, false);
+        if (error)
+            L_ERR("Cannot freeze cgroup for killing {} : {}", *this, error);
+        else
+            frozen = true;
+    }
+
+    /* Repeat until listing shows no new processes: cgroup might be still freezing */
+    do {
+        error = GetProcesses(procs);
         if (error)
             break;
         retry = false;
-        for (auto pid: tasks) {
-            if (std::find(killed.begin(), killed.end(), pid) == killed.end()) {
+        seen.clear();
+        for (auto pid: procs) {
+            seen.insert(pid);
+            if (!killed.count(pid)) {
                 if (kill(pid, signal) && errno != ESRCH && !error) {
                     error = TError::System("kill");
                     L_ERR("Cannot kill process {} : {}", pid, error);
@@ -363,12 +576,14 @@ TError TCgroup::KillAll(int signal) const {
                 retry = true;
             }
         }
-        killed = tasks;
+        killed.swap(seen);
     } while (retry);
 
     if (frozen)
         (void)FreezerSubsystem.Thaw(*this, false);
 
+    L_CG("KillAll {} {} processes in {} ms", *this, killed.size(), GetCurrentTimeMs() - start);
+
     return error;
 }
 
@@ -381,32 +596,46 @@ TCgroup TSubsystem::Cgroup(const std::string &name) const {
     return TCgroup(this, name);
 }
 
+/* Scan "id:controllers:path" lines in place, without splitting into strings */
 TError TSubsystem::TaskCgroup(pid_t pid, TCgroup &cgroup) const {
-    std::vector<std::string> lines;
+    static thread_local std::string text;
     auto cg_file = TPath("/proc/" + std::to_string(pid) + "/cgroup");
     auto type = TestOption();
 
-    TError error = cg_file.ReadLines(lines);
+    TError error = cg_file.ReadAll(text);
     if (error)
         return error;
 
-    for (auto &line : lines) {
-        auto fields = SplitString(line, ':', 3);
-        if (fields.size() < 2)
-            continue;
-
-        auto cgroups = SplitString(fields[1], ',');
-
-        bool found = false;
-        for (auto &cg : cgroups)
-            if (cg == type)
-                found = true;
+    const char *ptr = text.data(), *end = ptr + text.size();
+
+    while (ptr < end) {
+        const char *eol = (const char *)memchr(ptr, '\n', end - ptr);
+        if (!eol)
+            eol = end;
+        const char *ctl = (const char *)memchr(ptr, ':', eol - ptr);
+        const char *path = ctl ? (const char *)memchr(ctl + 1, ':', eol - ctl - 1) : nullptr;
+
+        if (path) {
+            ctl++;
+
+            /* unified hierarchy has empty list of controllers */
+            bool found = type.empty() && ctl == path;
+            for (const char *p = ctl; !found && p < path; ) {
+                const char *comma = (const char *)memchr(p, ',', path - p);
+                if (!comma)
+                    comma = path;
+                found = (size_t)(comma - p) == type.size() && !type.compare(0, type.size(), p, comma - p);
+                p = comma + 1;
+            }
 
-        if (found) {
-            cgroup.Subsystem = this;
-            cgroup.Name = fields[2];
-            return OK;
+            if (found) {
+                cgroup.Subsystem = this;
+                cgroup.Name.assign(path + 1, eol - path - 1);
+                return OK;
+            }
         }
+
+        ptr = eol + 1;
     }
 
     return TError("Cannot find {} cgroup for process {}", Type, pid);
@@ -417,6 +646,96 @@ bool TSubsystem::IsBound(const TCgroup &cgroup) const {
 }
 
 // Memory
+static thread_local std::map<std::string, TMemoryStat> *MemoryStatCache = nullptr;
+
+TMemoryStatSnapshot::TMemoryStatSnapshot() : Owner(!MemoryStatCache) {
+    if (Owner)
+        MemoryStatCache = new std::map<std::string, TMemoryStat>;
+}
+
+TMemoryStatSnapshot::~TMemoryStatSnapshot() {
+    if (Owner) {
+        delete MemoryStatCache;
+        MemoryStatCache = nullptr;
+    }
+}
+
+static const struct {
+    const char *Key;
+    size_t Len;
+    uint64_t TMemoryStat::*Field;
+} MemoryStatFields[] = {
+#define MEMORY_STAT_FIELD(key, field) { key, sizeof(key) - 1, &TMemoryStat::field }
+    MEMORY_STAT_FIELD("total_inactive_file", InactiveFile),
+    MEMORY_STAT_FIELD("total_active_file", ActiveFile),
+    MEMORY_STAT_FIELD("total_inactive_anon", InactiveAnon),
+    MEMORY_STAT_FIELD("total_active_anon", ActiveAnon),
+    MEMORY_STAT_FIELD("total_unevictable", Unevictable),
+    MEMORY_STAT_FIELD("total_swap", Swap),
+    MEMORY_STAT_FIELD("total_pgfault", PgFault),
+    MEMORY_STAT_FIELD("total_pgmajfault", PgMajFault),
+    MEMORY_STAT_FIELD("total_pgpgout", PgPgOut),
+    MEMORY_STAT_FIELD("total_max_rss", MaxRss),
+    MEMORY_STAT_FIELD("oom_events", OomEvents),
+    MEMORY_STAT_FIELD("fs_io_bytes", FsIoBytes),
+    MEMORY_STAT_FIELD("fs_io_write_bytes", FsIoWriteBytes),
+    MEMORY_STAT_FIELD("fs_io_operations", FsIoOperations),
+    MEMORY_STAT_FIELD("total_rss_huge", RssHuge),
+#undef MEMORY_STAT_FIELD
+};
+
+/* Single pass over "key value" lines without temporary strings */
+static void ParseMemoryStat(const std::string &text, TMemoryStat &stat) {
+    const char *ptr = text.data(), *end = ptr + text.size();
+
+    while (ptr < end) {
+        const char *key = ptr;
+        while (ptr < end && *ptr != ' ' && *ptr != '\n')
+            ptr++;
+        size_t len = ptr - key;
+
+        uint64_t val = 0;
+        if (ptr < end && *ptr == ' ')
+            for (ptr++; ptr < end && *ptr >= '0' && *ptr <= '9'; ptr++)
+                val = val * 10 + (*ptr - '0');
+
+        while (ptr < end && *ptr++ != '\n');
+
+        for (auto &field: MemoryStatFields) {
+            if (field.Len == len && !memcmp(field.Key, key, len)) {
+                stat.*field.Field = val;
+                if (field.Field == &TMemoryStat::MaxRss)
+                    stat.HasMaxRss = true;
+                break;
+            }
+        }
+    }
+}
+
+TError TMemorySubsystem::GetStat(TCgroup &cg, TMemoryStat &stat) const {
+    static thread_local std::string text;
+
+    if (MemoryStatCache) {
+        auto it = MemoryStatCache->find(cg.Name);
+        if (it != MemoryStatCache->end()) {
+            stat = it->second;
+            return OK;
+        }
+    }
+
+    TError error = cg.Get(STAT, text);
+    if (error)
+        return error;
+
+    stat = TMemoryStat();
+    ParseMemoryStat(text, stat);
+
+    if (MemoryStatCache)
+        (*MemoryStatCache)[cg.Name] = stat;
+
+    return OK;
+}
+
 TError TMemorySubsystem::SetLimit(TCgroup &cg, uint64_t limit) {
     uint64_t old_limit, cur_limit, new_limit;
     TError error;
@@ -471,11 +790,10 @@ TError TMemorySubsystem::SetLimit(TCgroup &cg, uint64_t limit) {
 }
 
 TError TMemorySubsystem::GetCacheUsage(TCgroup &cg, uint64_t &usage) const {
-    TUintMap stat;
-    TError error = Statistics(cg, stat);
+    TMemoryStat stat;
+    TError error = GetStat(cg, stat);
     if (!error)
-        usage = stat["total_inactive_file"] +
-                stat["total_active_file"];
+        usage = stat.InactiveFile + stat.ActiveFile;
     return error;
 }
 
@@ -483,16 +801,60 @@ TError TMemorySubsystem::GetAnonUsage(TCgroup &cg, uint64_t &usage) const {
     if (cg.Has(ANON_USAGE))
         return cg.GetUint64(ANON_USAGE, usage);
 
-    TUintMap stat;
-    TError error = Statistics(cg, stat);
+    TMemoryStat stat;
+    TError error = GetStat(cg, stat);
     if (!error)
-        usage = stat["total_inactive_anon"] +
-                stat["total_active_anon"] +
-                stat["total_unevictable"] +
-                stat["total_swap"];
+        usage = stat.InactiveAnon + stat.ActiveAnon +
+                stat.Unevictable + stat.Swap;
     return error;
 }
 
+/* Per-node usage in bytes: anon_N<node>, file_N<node> */
+TError TMemorySubsystem::GetNumaStat(TCgroup &cg, TUintMap &stat) const {
+    std::vector<std::string> lines;
+    uint64_t unit = 1;
+
+    TError error = cg.GetLines(NUMA_STAT, lines);
+    if (error)
+        return error;
+
+    for (auto &line: lines) {
+        auto fields = SplitString(line, ' ');
+        if (fields.size() < 2)
+            continue;
+
+        /* cgroup v1: "name=pages N0=pages ...", v2: "name N0=bytes ..." */
+        std::string name = fields[0];
+        auto sep = name.find('=');
+        if (sep != std::string::npos) {
+            name = name.substr(0, sep);
+            unit = getpagesize();
+        } else
+            unit = 1;
+
+        /* Hierarchical counters in v1 include sub-containers */
+        if (StringStartsWith(name, "hierarchical_"))
+            name = name.substr(13);
+        else if (sep != std::string::npos)
+            continue;
+
+        if (name != "anon" && name != "file")
+            continue;
+
+        for (size_t i = 1; i < fields.size(); i++) {
+            auto &field = fields[i];
+            sep = field.find('=');
+            if (field[0] != 'N' || sep == std::string::npos)
+                continue;
+            uint64_t val;
+            if (!StringToUint64(field.substr(sep + 1), val))
+                stat[name + "_" + field.substr(0, sep)] = val * unit;
+        }
+    }
+
+    return OK;
+}
+
 bool TMemorySubsystem::SupportAnonLimit() const {
     return Cgroup(PORTO_DAEMON_CGROUP).Has(ANON_LIMIT);
 }
@@ -568,19 +930,37 @@ TError TMemorySubsystem::GetOomKills(TCgroup &cg, uint64_t &count) {
 }
 
 uint64_t TMemorySubsystem::GetOomEvents(TCgroup &cg) {
-    TUintMap stat;
-    if (!Statistics(cg, stat))
-        return stat["oom_events"];
+    TMemoryStat stat;
+    if (!GetStat(cg, stat))
+        return stat.OomEvents;
     return 0;
 }
 
 TError TMemorySubsystem::GetReclaimed(TCgroup &cg, uint64_t &count) const {
-    TUintMap stat;
-    Statistics(cg, stat);
-    count = stat["total_pgpgout"] * 4096; /* Best estimation for now */
+    TMemoryStat stat;
+    GetStat(cg, stat);
+    count = stat.PgPgOut * 4096; /* Best estimation for now */
     return OK;
 }
 
+TError TMemorySubsystem::GetThpUsage(TCgroup &cg, uint64_t &usage) const {
+    TMemoryStat stat;
+    TError error = GetStat(cg, stat);
+    if (!error)
+        usage = stat.RssHuge;
+    return error;
+}
+
+TError TMemorySubsystem::GetFaults(TCgroup &cg, uint64_t &minor, uint64_t &major) const {
+    TMemoryStat stat;
+    TError error = GetStat(cg, stat);
+    if (!error) {
+        minor = stat.PgFault - stat.PgMajFault;
+        major = stat.PgMajFault;
+    }
+    return error;
+}
+
 // Freezer
 TError TFreezerSubsystem::WaitState(const TCgroup &cg, const std::string &state) const {
     uint64_t deadline = GetCurrentTimeMs() + config().daemon().freezer_wait_timeout_s() * 1000;
@@ -651,6 +1031,8 @@ TError TCpuSubsystem::InitializeSubsystem() {
                  cg.Has("cpu.cfs_reserve_us") &&
                  cg.Has("cpu.cfs_reserve_shares");
 
+    HasBurst = HasQuota && cg.Has("cpu.cfs_burst_us");
+
     L_SYS("{} cores", GetNumCores());
     if (HasShares)
         L_CG("support shares {}", BaseShares);
@@ -658,6 +1040,8 @@ TError TCpuSubsystem::InitializeSubsystem() {
         L_CG("support rt group");
     if (HasReserve)
         L_CG("support reserves");
+    if (HasBurst)
+        L_CG("support burst");
 
     return OK;
 }
@@ -668,7 +1052,7 @@ TError TCpuSubsystem::InitializeCgroup(TCgroup &cg) {
     return OK;
 }
 
-TError TCpuSubsystem::SetLimit(TCgroup &cg, uint64_t period, uint64_t limit) {
+TError TCpuSubsystem::SetLimit(TCgroup &cg, uint64_t period, uint64_t limit, uint64_t burst) {
     TError error;
 
     period = period / 1000; /* ns -> us */
@@ -682,6 +1066,13 @@ TError TCpuSubsystem::SetLimit(TCgroup &cg, uint64_t period, uint64_t limit) {
         if (!limit)
             quota = -1;
 
+        /* Burst must be dropped before quota could be lowered below it */
+        if (HasBurst) {
+            error = cg.Set("cpu.cfs_burst_us", "0");
+            if (error)
+                return error;
+        }
+
         error = cg.Set("cpu.cfs_period_us", std::to_string(period));
         if (error)
             return error;
@@ -689,6 +1080,15 @@ TError TCpuSubsystem::SetLimit(TCgroup &cg, uint64_t period, uint64_t limit) {
         error = cg.Set("cpu.cfs_quota_us", std::to_string(quota));
         if (error)
             return error;
+
+        /* Kernel accumulates unused quota up to burst, at most quota */
+        if (HasBurst && limit && burst) {
+            int64_t burst_us = std::ceil((double)burst * period / NSEC_PER_SEC);
+
+            error = cg.Set("cpu.cfs_burst_us", std::to_string(std::min(burst_us, quota)));
+            if (error)
+                return error;
+        }
     }
     return OK;
 }
@@ -878,6 +1278,14 @@ TError TCpusetSubsystem::InitializeCgroup(TCgroup &cg) {
     if (error)
         return error;
 
+    /* Move pages together with change of mems */
+    if (config().container().cpuset_memory_migrate() &&
+            cg.Has("cpuset.memory_migrate")) {
+        error = cg.SetBool("cpuset.memory_migrate", true);
+        if (error)
+            return error;
+    }
+
     return OK;
 }
 
@@ -910,6 +1318,75 @@ TError TNetclsSubsystem::SetClass(TCgroup &cg, uint32_t classid) const {
 
 // Blkio
 
+/* Non-zero counter from blkio stat knob */
+struct TIoStatEntry {
+    std::string Disk;
+    char Op;            /* r|w|d|s */
+    bool Summ;          /* counted into "hw" */
+    uint64_t Value;
+};
+
+typedef std::vector<TIoStatEntry> TIoStatEntries;
+
+static thread_local std::map<std::pair<std::string, std::string>, TIoStatEntries> *IoStatCache = nullptr;
+
+TIoStatSnapshot::TIoStatSnapshot() : Owner(!IoStatCache) {
+    if (Owner)
+        IoStatCache = new std::map<std::pair<std::string, std::string>, TIoStatEntries>;
+}
+
+TIoStatSnapshot::~TIoStatSnapshot() {
+    if (Owner) {
+        delete IoStatCache;
+        IoStatCache = nullptr;
+    }
+}
+
+/*
+ * Numbers of removed block devices are reused, thus cached entry is valid
+ * only while sysfs node is the same. Name lookup is a single readlink.
+ */
+constexpr size_t DISK_CACHE_SIZE = 4096;
+
+struct TDiskCacheEntry {
+    std::string Disk;
+    ino_t Inode;
+};
+
+static std::mutex DiskCacheMutex;
+static std::unordered_map<std::string, TDiskCacheEntry> WholeDiskCache;  /* major:minor -> disk major:minor */
+
+static ino_t DiskInode(const std::string &disk) {
+    struct stat st;
+    if (TPath("/sys/dev/block/" + disk).StatStrict(st))
+        return 0;
+    return st.st_ino;
+}
+
+static bool GetDiskCache(const std::string &part, std::string &disk) {
+    ino_t inode = DiskInode(part);
+    std::lock_guard<std::mutex> guard(DiskCacheMutex);
+    auto it = WholeDiskCache.find(part);
+    if (it == WholeDiskCache.end())
+        return false;
+    if (!inode || it->second.Inode != inode) {
+        WholeDiskCache.erase(it);
+        return false;
+    }
+    disk = it->second.Disk;
+    return true;
+}
+
+static void PutDiskCache(const std::string &part, const std::string &disk) {
+    ino_t inode = DiskInode(part);
+    if (!inode)
+        return;
+    std::lock_guard<std::mutex> guard(DiskCacheMutex);
+    if (WholeDiskCache.size() >= DISK_CACHE_SIZE)
+        WholeDiskCache.clear();
+    WholeDiskCache[part] = { disk, inode };
+}
+
 TError TBlkioSubsystem::DiskName(const std::string &disk, std::string &name) const {
     TPath sym("/sys/dev/block/" + disk), dev;
     TError error = sym.ReadLink(dev);
@@ -941,6 +1418,10 @@ TError TBlkioSubsystem::ResolveDisk(const TPath &root, const std::string &key, s
         disk = StringFormat("%d:%d", major(dev), minor(dev));
     }
 
+    std::string part = disk;
+    if (GetDiskCache(part, disk))
+        return OK;
+
     if (!TPath("/sys/dev/block/" + disk).Exists())
         return TError(EError::InvalidValue, "Disk not found:  " + disk);
 
@@ -954,13 +1435,57 @@ TError TBlkioSubsystem::ResolveDisk(const TPath &root, const std::string &key, s
         }
     }
 
+    PutDiskCache(part, disk);
+
     return OK;
 }
 
+static void ParseIoStat(const TBlkioSubsystem &blkio, const std::vector<std::string> &lines,
+                        TIoStatEntries &entries) {
+    std::string prev, name;
+    bool summ = false, hide = false;
+
+    for (auto &line: lines) {
+        auto word = SplitString(line, ' ');
+        if (word.size() != 3)
+            continue;
+
+        char op;
+        if (word[1] == "Read")
+            op = 'r';
+        else if (word[1] == "Write")
+            op = 'w';
+        else if (word[1] == "Discard")
+            op = 'd';
+        else if (word[1] == "Sync")
+            op = 's';
+        else
+            continue;
+
+        uint64_t val;
+        if (StringToUint64(word[2], val) || !val)
+            continue;
+
+        if (word[0] != prev) {
+            if (blkio.DiskName(word[0], name))
+                continue;
+            prev = word[0];
+            summ = StringStartsWith(name, "sd") ||
+                   StringStartsWith(name, "nvme") ||
+                   StringStartsWith(name, "vd");
+            hide = StringStartsWith(name, "ram");
+        }
+
+        if (!hide)
+            entries.push_back({name, op, summ, val});
+    }
+}
+
 TError TBlkioSubsystem::GetIoStat(TCgroup &cg, enum IoStat stat, TUintMap &map) const {
     std::vector<std::string> lines;
-    std::string knob, prev, name;
-    bool summ = false, hide = false;
+    TIoStatEntries parsed;
+    const TIoStatEntries *entries = nullptr;
+    std::string knob;
     bool recursive = true;
     TError error;
 
@@ -997,22 +1522,37 @@ TError TBlkioSubsystem::GetIoStat(TCgroup &cg, enum IoStat stat, TUintMap &map)
             knob = "blkio.io_service_bytes_recursive"; /* cfq only */
     }
 
-    error = cg.Knob(knob).ReadLines(lines);
-    if (error)
-        return error;
-
-    if (!recursive) {
-        std::vector<TCgroup> list;
+    if (IoStatCache) {
+        auto it = IoStatCache->find({cg.Name, knob});
+        if (it != IoStatCache->end())
+            entries = &it->second;
+    }
 
-        error = cg.ChildsAll(list);
+    if (!entries) {
+        error = cg.GetLines(knob, lines);
         if (error)
             return error;
 
-        for (auto &child_cg: list) {
-            error = child_cg.Knob(knob).ReadLines(lines);
-            if (error && error.Errno != ENOENT)
+        if (!recursive) {
+            std::vector<TCgroup> list;
+
+            error = cg.ChildsAll(list);
+            if (error)
                 return error;
+
+            for (auto &child_cg: list) {
+                error = child_cg.GetLines(knob, lines);
+                if (error && error.Errno != ENOENT)
+                    return error;
+            }
         }
+
+        ParseIoStat(*this, lines, parsed);
+
+        if (IoStatCache)
+            entries = &((*IoStatCache)[{cg.Name, knob}] = std::move(parsed));
+        else
+            entries = &parsed;
     }
 
     uint64_t hw_read = 0;
@@ -1020,55 +1560,37 @@ TError TBlkioSubsystem::GetIoStat(TCgroup &cg, enum IoStat stat, TUintMap &map)
     uint64_t hw_discard = 0;
     uint64_t hw_sync = 0;
 
-    for (auto &line: lines) {
-        auto word = SplitString(line, ' ');
-        if (word.size() != 3)
-            continue;
-
-        uint64_t val;
-        if (StringToUint64(word[2], val) || !val)
-            continue;
-
-        if (word[0] != prev) {
-            if (DiskName(word[0], name))
-                continue;
-            prev = word[0];
-            summ = StringStartsWith(name, "sd") ||
-                   StringStartsWith(name, "nvme") ||
-                   StringStartsWith(name, "vd");
-            hide = StringStartsWith(name, "ram");
-        }
-
-        if (hide)
-            continue;
+    for (auto &entry: *entries) {
+        auto &name = entry.Disk;
+        uint64_t val = entry.Value;
 
-        if (word[1] == "Read") {
+        if (entry.Op == 'r') {
             if (stat & (IoStat::Read | IoStat::Full))
                 map[name] += val;
             if (stat & IoStat::Full)
                 map[name + " r"] += val;
-            if (summ)
+            if (entry.Summ)
                 hw_read += val;
-        } else if (word[1] == "Write") {
+        } else if (entry.Op == 'w') {
             if (stat & (IoStat::Write | IoStat::Full))
                 map[name] += val;
             if (stat & IoStat::Full)
                 map[name + " w"] += val;
-            if (summ)
+            if (entry.Summ)
                 hw_write += val;
-        } else if (word[1] == "Discard") {
+        } else if (entry.Op == 'd') {
             if (stat & (IoStat::Discard | IoStat::Full))
                 map[name] += val;
             if (stat & IoStat::Full)
                 map[name + " d"] += val;
-            if (summ)
+            if (entry.Summ)
                 hw_discard += val;
-        } else if (word[1] == "Sync") {
+        } else if (entry.Op == 's') {
             if (stat & IoStat::Sync)
                 map[name] += val;
             if (stat & IoStat::Full)
                 map[name + " s"] += val;
-            if (summ)
+            if (entry.Summ)
                 hw_sync += val;
         }
     }
@@ -1205,6 +1727,58 @@ TError TSystemdSubsystem::InitializeSubsystem() {
     return error;
 }
 
+// Cgroup2
+
+bool TCgroup2Subsystem::SupportPressure() const {
+    return TPath("/proc/pressure/cpu").Exists();
+}
+
+/* "some avg10=0.00 avg60=0.00 avg300=0.00 total=0" -> some_avg10: 0.00; ... */
+TError TCgroup2Subsystem::GetPressure(TCgroup &cg, const std::string &resource,
+                                      TStringMap &stat) const {
+    std::vector<std::string> lines;
+    TError error;
+
+    /* root cgroup has no pressure files, system-wide are the same */
+    if (cg.IsRoot())
+        error = TPath("/proc/pressure/" + resource).ReadLines(lines);
+    else
+        error = cg.GetLines(resource + ".pressure", lines);
+    if (error)
+        return error;
+
+    for (auto &line: lines) {
+        auto word = SplitString(line, ' ');
+        for (size_t i = 1; i < word.size(); i++) {
+            auto sep = word[i].find('=');
+            if (sep != std::string::npos)
+                stat[word[0] + "_" + word[i].substr(0, sep)] = word[i].substr(sep + 1);
+        }
+    }
+
+    return OK;
+}
+
+/* Trigger "some|full <stall_us> <window_us>" lives while fd is open, fires EPOLLPRI */
+TError TCgroup2Subsystem::SetupPressureTrigger(TCgroup &cg, const std::string &resource,
+                                               const std::string &trigger, TFile &event) const {
+    TError error;
+
+    event.Close();
+    error = event.Open(cg.Knob(resource + ".pressure"), O_RDWR | O_NONBLOCK | O_CLOEXEC | O_NOCTTY);
+    if (error)
+        return error;
+
+    PORTO_ASSERT(event.Fd > 2);
+
+    if (write(event.Fd, trigger.c_str(), trigger.size() + 1) < 0) {
+        error = TError::System("Cannot setup {} pressure trigger {}", resource, trigger);
+        event.Close();
+    }
+
+    return error;
+}
+
 TMemorySubsystem    MemorySubsystem;
 TFreezerSubsystem   FreezerSubsystem;
 TCpuSubsystem       CpuSubsystem;
@@ -1216,6 +1790,7 @@ TDevicesSubsystem   DevicesSubsystem;
 THugetlbSubsystem   HugetlbSubsystem;
 TPidsSubsystem      PidsSubsystem;
 TSystemdSubsystem   SystemdSubsystem;
+TCgroup2Subsystem   Cgroup2Subsystem;
 
 std::vector<TSubsystem *> AllSubsystems = {
     &FreezerSubsystem,
@@ -1229,6 +1804,7 @@ std::vector<TSubsystem *> AllSubsystems = {
     &HugetlbSubsystem,
     &PidsSubsystem,
     &SystemdSubsystem,
+    &Cgroup2Subsystem,
 };
 
 std::vector<TSubsystem *> Subsystems;
@@ -1268,7 +1844,8 @@ TError InitializeCgroups() {
 
     for (auto subsys: AllSubsystems) {
         for (auto &mnt: mounts) {
-            if (mnt.Type == "cgroup" && mnt.HasOption(subsys->TestOption())) {
+            if (mnt.Type == subsys->MountType() &&
+                    (subsys->TestOption().empty() || mnt.HasOption(subsys->TestOption()))) {
                 subsys->Root = mnt.Target;
                 L_CG("Found cgroup subsystem {} mounted at {}", subsys->Type, subsys->Root);
                 break;
@@ -1299,7 +1876,7 @@ TError InitializeCgroups() {
         if (subsys->IsDisabled() || subsys->Root)
             continue;
 
-        TPath path = root / subsys->Type;
+        TPath path = root / subsys->MountPoint();
 
         L_CG("Mount cgroup subsysem {} at {}", subsys->Type, path);
         if (!path.Exists()) {
@@ -1310,7 +1887,7 @@ TError InitializeCgroups() {
             }
         }
 
-        error = path.Mount("cgroup", "cgroup", 0, subsys->MountOptions() );
+        error = path.Mount(subsys->MountType(), subsys->MountType(), 0, subsys->MountOptions());
         if (error) {
             (void)path.Rmdir();
             L_ERR("Cannot mount cgroup: {}", error);
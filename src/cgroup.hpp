@@ -20,6 +20,7 @@ class TCgroup;
 #define CGROUP_CPUSET   0x0100ull
 #define CGROUP_PIDS     0x0200ull
 #define CGROUP_SYSTEMD  0x1000ull
+#define CGROUP2         0x2000ull
 
 extern const TFlagsNames ControllersName;
 
@@ -37,6 +38,8 @@ public:
     virtual bool IsDisabled() { return false; }
     virtual bool IsOptional() { return false; }
     virtual std::string TestOption() const { return Type; }
+    virtual std::string MountType() const { return "cgroup"; }
+    virtual std::string MountPoint() const { return Type; }
     virtual std::vector<std::string> MountOptions() { return {Type}; }
 
     virtual TError InitializeSubsystem() {
@@ -96,6 +99,7 @@ public:
     bool Exists() const;
 
     TError Create();
+    TError CreateFromPool();
     TError Remove();
     TError RemoveOne();
 
@@ -121,6 +125,7 @@ public:
     TError Get(const std::string &knob, std::string &value) const;
     TError Set(const std::string &knob, const std::string &value) const;
 
+    TError GetLines(const std::string &knob, std::vector<std::string> &lines) const;
     TError GetPids(const std::string &knob, std::vector<pid_t> &pids) const;
 
     TError GetInt64(const std::string &knob, int64_t &value) const;
@@ -136,9 +141,38 @@ public:
     TError SetSuffix(const std::string suffix);
 };
 
+/* Counters from memory.stat used by container properties */
+struct TMemoryStat {
+    uint64_t InactiveFile = 0;
+    uint64_t ActiveFile = 0;
+    uint64_t InactiveAnon = 0;
+    uint64_t ActiveAnon = 0;
+    uint64_t Unevictable = 0;
+    uint64_t Swap = 0;
+    uint64_t PgFault = 0;
+    uint64_t PgMajFault = 0;
+    uint64_t PgPgOut = 0;
+    uint64_t MaxRss = 0;
+    uint64_t OomEvents = 0;
+    uint64_t FsIoBytes = 0;
+    uint64_t FsIoWriteBytes = 0;
+    uint64_t FsIoOperations = 0;
+    uint64_t RssHuge = 0;
+    bool HasMaxRss = false;
+};
+
+/* While alive memory.stat is parsed once per cgroup in current thread */
+class TMemoryStatSnapshot {
+    bool Owner;
+public:
+    TMemoryStatSnapshot();
+    ~TMemoryStatSnapshot();
+};
+
 class TMemorySubsystem : public TSubsystem {
 public:
     const std::string STAT = "memory.stat";
+    const std::string NUMA_STAT = "memory.numa_stat";
     const std::string OOM_CONTROL = "memory.oom_control";
     const std::string EVENT_CONTROL = "cgroup.event_control";
     const std::string USE_HIERARCHY = "memory.use_hierarchy";
@@ -156,6 +190,8 @@ public:
     const std::string ANON_MAX_USAGE = "memory.anon.max_usage";
     const std::string ANON_LIMIT = "memory.anon.limit";
     const std::string ANON_ONLY = "memory.anon.only";
+    const std::string RECLAIM = "memory.reclaim";
+    const std::string FORCE_EMPTY = "memory.force_empty";
 
     TMemorySubsystem() : TSubsystem(CGROUP_MEMORY, "memory") {}
 
@@ -163,6 +199,8 @@ public:
         return cg.GetUintMap(STAT, stat);
     }
 
+    TError GetStat(TCgroup &cg, TMemoryStat &stat) const;
+
     TError Usage(TCgroup &cg, uint64_t &value) const {
         return cg.GetUint64(USAGE, value);
     }
@@ -207,8 +245,20 @@ public:
         return cg.SetBool(RECHARGE_ON_PAGE_FAULT, enable);
     }
 
+    bool SupportReclaim() const {
+        return RootCgroup().Has(RECLAIM);
+    }
+
+    /* Without memory.reclaim drops everything, only for cgroup without tasks */
+    TError Reclaim(TCgroup &cg, uint64_t size) const {
+        if (SupportReclaim())
+            return cg.SetUint64(RECLAIM, size);
+        return cg.Set(FORCE_EMPTY, "0");
+    }
+
     TError GetCacheUsage(TCgroup &cg, uint64_t &usage) const;
     TError GetAnonUsage(TCgroup &cg, uint64_t &usage) const;
+    TError GetNumaStat(TCgroup &cg, TUintMap &stat) const;
 
     TError GetAnonMaxUsage(TCgroup &cg, uint64_t &usage) const {
         return cg.GetUint64(ANON_MAX_USAGE, usage);
@@ -231,6 +281,8 @@ public:
     uint64_t GetOomEvents(TCgroup &cg);
     TError GetOomKills(TCgroup &cg, uint64_t &count);
     TError GetReclaimed(TCgroup &cg, uint64_t &count) const;
+    TError GetFaults(TCgroup &cg, uint64_t &minor, uint64_t &major) const;
+    TError GetThpUsage(TCgroup &cg, uint64_t &usage) const;
 };
 
 class TFreezerSubsystem : public TSubsystem {
@@ -251,6 +303,7 @@ public:
     bool HasQuota = false;
     bool HasReserve = false;
     bool HasRtGroup = false;
+    bool HasBurst = false;
 
     uint64_t BaseShares = 0ull;
     uint64_t MinShares = 0ull;
@@ -259,7 +312,7 @@ public:
     TCpuSubsystem() : TSubsystem(CGROUP_CPU, "cpu") { }
     TError InitializeSubsystem() override;
     TError InitializeCgroup(TCgroup &cg) override;
-    TError SetLimit(TCgroup &cg, uint64_t period, uint64_t limit);
+    TError SetLimit(TCgroup &cg, uint64_t period, uint64_t limit, uint64_t burst);
     TError SetRtLimit(TCgroup &cg, uint64_t period, uint64_t limit);
     TError SetGuarantee(TCgroup &cg, const std::string &policy, double weight, uint64_t period, uint64_t guarantee);
 };
@@ -289,6 +342,14 @@ public:
     TError SetClass(TCgroup &cg, uint32_t classid) const;
 };
 
+/* While alive blkio stat knobs are parsed once per cgroup in current thread */
+class TIoStatSnapshot {
+    bool Owner;
+public:
+    TIoStatSnapshot();
+    ~TIoStatSnapshot();
+};
+
 class TBlkioSubsystem : public TSubsystem {
 public:
     bool HasWeight = false;
@@ -383,6 +444,23 @@ public:
     std::vector<std::string> MountOptions() override { return { "none", "name=" + Type }; }
 };
 
+/* Unified hierarchy next to v1 controllers, provides pressure stall information */
+class TCgroup2Subsystem : public TSubsystem {
+public:
+    TCgroup2Subsystem() : TSubsystem(CGROUP2, "cgroup2") {}
+    bool IsDisabled() override { return !config().container().enable_cgroup2(); }
+    bool IsOptional() override { return true; }
+    std::string TestOption() const override { return ""; }
+    std::string MountType() const override { return "cgroup2"; }
+    std::string MountPoint() const override { return "unified"; }
+    std::vector<std::string> MountOptions() override { return {}; }
+
+    bool SupportPressure() const;
+    TError GetPressure(TCgroup &cg, const std::string &resource, TStringMap &stat) const;
+    TError SetupPressureTrigger(TCgroup &cg, const std::string &resource,
+                                const std::string &trigger, TFile &event) const;
+};
+
 extern TMemorySubsystem     MemorySubsystem;
 extern TFreezerSubsystem    FreezerSubsystem;
 extern TCpuSubsystem        CpuSubsystem;
@@ -394,10 +472,12 @@ extern TDevicesSubsystem    DevicesSubsystem;
 extern THugetlbSubsystem    HugetlbSubsystem;
 extern TPidsSubsystem       PidsSubsystem;
 extern TSystemdSubsystem    SystemdSubsystem;
+extern TCgroup2Subsystem    Cgroup2Subsystem;
 
 extern std::vector<TSubsystem *> AllSubsystems;
 extern std::vector<TSubsystem *> Subsystems;
 extern std::vector<TSubsystem *> Hierarchies;
 
 TError InitializeCgroups();
+void RefillCgroupPool();
 TError InitializeDaemonCgroups();
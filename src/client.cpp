@@ -21,6 +21,7 @@ extern "C" {
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <unistd.h>
+#include <string.h>
 }
 
 TClient SystemClient("<system>");
@@ -41,22 +42,48 @@ TClient::TClient(const std::string &special) {
     AccessLevel = EAccessLevel::Internal;
 }
 
+/* Pipelined request runs in its own client with identity of connection */
+TClient::TClient(std::shared_ptr<TClient> connection) : Connection(connection) {
+    Id = connection->Id;
+    Cred = connection->Cred;
+    TaskCred = connection->TaskCred;
+    Pid = connection->Pid;
+    Comm = connection->Comm;
+    UserCtGroup = connection->UserCtGroup;
+    ClientContainer = connection->ClientContainer;
+    ActivityTimeMs = connection->ActivityTimeMs;
+    AccessLevel = connection->AccessLevel;
+    PortoNamespace = connection->PortoNamespace;
+    WriteNamespace = connection->WriteNamespace;
+}
+
 TClient::~TClient() {
     CloseConnection();
 }
 
-void TClient::CloseConnection() {
+void TClient::CloseConnection(const TUnixSocket *handoff) {
     auto lock = Lock();
 
+    /* Sent under lock, so no request could be read from connection after */
+    if (handoff && Fd >= 0 && CanHandoff()) {
+        TError error = handoff->SendFd(Fd);
+        if (error)
+            L_WRN("Cannot hand off {}: {}", Id, error);
+        else
+            L_VERBOSE("Hand off {}", Id);
+    }
+
     if (SyncWaiter)
         SyncWaiter->Deactivate();
 
     if (AsyncWaiter)
         AsyncWaiter->Deactivate();
 
+    Subscription = nullptr;
+
     if (Fd >= 0) {
         if (InEpoll)
-            EpollLoop->RemoveSource(Fd);
+            Loop->RemoveSource(Fd);
         ConnectionTime = GetCurrentTimeMs() - ConnectionTime;
         L_VERBOSE("Disconnected {} time={} ms", Id, ConnectionTime);
         close(Fd);
@@ -77,6 +104,17 @@ void TClient::CloseConnection() {
     WeakContainers.clear();
 }
 
+bool TClient::CanReceive() const {
+    return !Processing && Pipelined < (int)config().daemon().max_pipelined_requests();
+}
+
+/* Weak containers are destroyed when connection is closed */
+void TClient::AddWeakContainer(std::shared_ptr<TContainer> &ct) {
+    TClient *conn = Connection ? Connection.get() : this;
+    auto lock = conn->Lock();
+    conn->WeakContainers.emplace_back(ct);
+}
+
 void TClient::StartRequest() {
     ActivityTimeMs = GetCurrentTimeMs();
     PORTO_ASSERT(CL == nullptr);
@@ -140,11 +178,17 @@ TError TClient::IdentifyClient(bool initial) {
     if (ct->ClientsCount < 0)
         L_ERR("Client count underflow");
 
+    bool moved = !initial && ClientContainer != ct;
+
     if (ClientContainer)
         ClientContainer->ClientsCount--;
     ClientContainer = ct;
     ct->ClientsCount++;
 
+    /* Requeue needs ClientsMutex, it cannot be taken under client lock */
+    if (moved)
+        Moved = true;
+
     /* requests from containers are executed in behalf of their owners */
     if (!ct->IsRoot())
         Cred = ct->OwnerCred;
@@ -236,6 +280,15 @@ TError TClient::ResolveContainer(const std::string &relative_name,
     return TContainer::Find(name, ct);
 }
 
+TError TClient::LookupContainer(const std::string &relative_name,
+                                std::shared_ptr<TContainer> &ct) const {
+    std::string name;
+    TError error = ResolveName(relative_name, name);
+    if (error)
+        return error;
+    return TContainer::Lookup(name, ct);
+}
+
 TError TClient::ControlVolume(const TPath &path, std::shared_ptr<TVolume> &volume, bool read_only) {
     if (AccessLevel <= EAccessLevel::ReadOnly)
         return TError(EError::Permission, "Write access to porto denied");
@@ -252,13 +305,12 @@ TError TClient::ControlVolume(const TPath &path, std::shared_ptr<TVolume> &volum
 
 TError TClient::ReadContainer(const std::string &relative_name,
                               std::shared_ptr<TContainer> &ct) {
-    auto lock = LockContainers();
-    TError error = ResolveContainer(relative_name, ct);
+    TError error = LookupContainer(relative_name, ct);
     if (error)
         return error;
     if (LockedContainer) {
         L_WRN("Stale locked container CT{}:{}", LockedContainer->Id, LockedContainer->Name);
-        ReleaseContainer(true);
+        ReleaseContainer();
     }
     return OK;
 }
@@ -274,9 +326,15 @@ TError TClient::WriteContainer(const std::string &relative_name,
     error = CanControl(*ct, child);
     if (error)
         return error;
+    /* batch keeps lock between operations with the same container */
+    if (LockedContainer == ct)
+        return OK;
     if (LockedContainer) {
         L_WRN("Stale locked container CT{}:{}", LockedContainer->Id, LockedContainer->Name);
-        ReleaseContainer(true);
+        /* Save delayed changes before switching, flush needs unlocked containers */
+        lock.unlock();
+        ReleaseContainer();
+        lock.lock();
     }
     error = ct->LockAction(lock);
     if (error)
@@ -286,6 +344,8 @@ TError TClient::WriteContainer(const std::string &relative_name,
 }
 
 TError TClient::LockContainer(std::shared_ptr<TContainer> &ct) {
+    (void)FlushContainer();
+
     auto lock = LockContainers();
     if (LockedContainer) {
         L_WRN("Stale locked container CT{}:{}", LockedContainer->Id, LockedContainer->Name);
@@ -299,11 +359,25 @@ TError TClient::LockContainer(std::shared_ptr<TContainer> &ct) {
 
 void TClient::ReleaseContainer(bool containers_locked) {
     if (LockedContainer) {
+        if (!containers_locked)
+            (void)FlushContainer();
         LockedContainer->UnlockAction(containers_locked);
         LockedContainer = nullptr;
     }
 }
 
+/* Save changes delayed by TContainer::SaveLater */
+TError TClient::FlushContainer() {
+    if (!LockedContainer || !LockedContainer->SavePending)
+        return OK;
+
+    TError error = LockedContainer->Save();
+    if (error)
+        L_WRN("Cannot save CT{}:{}: {}", LockedContainer->Id,
+              LockedContainer->Name, error);
+    return error;
+}
+
 TPath TClient::ComposePath(const TPath &path) {
     return ClientContainer->RootPath.InnerPath(path);
 }
@@ -425,55 +499,110 @@ TError TClient::WriteAccess(const TFile &file) {
     return error;
 }
 
-TError TClient::ReadRequest(Porto::TPortoRequest &request) {
-    if (Fd < 0)
-        return TError("Connection closed");
+/* Receive buffers are recycled between clients */
+constexpr size_t RECV_BUFFER_SIZE = 16384;
+constexpr size_t RECV_BUFFER_POOL = 256;
 
-    if (Offset >= Buffer.size())
-        Buffer.resize(Offset + 4096);
+static std::mutex RecvBufferMutex;
+static std::vector<std::vector<uint8_t>> RecvBufferPool;
 
-    ssize_t len = recv(Fd, &Buffer[Offset], Length ? (Length - Offset) : 1, MSG_DONTWAIT);
-    if (len > 0)
-        Offset += len;
-    else if (len == 0)
-        return TError("recv return zero");
-    else if (errno != EAGAIN && errno != EWOULDBLOCK)
-        return TError::System("recv request failed");
+static void AcquireRecvBuffer(std::vector<uint8_t> &buffer) {
+    std::lock_guard<std::mutex> lock(RecvBufferMutex);
+    if (RecvBufferPool.empty()) {
+        buffer.resize(RECV_BUFFER_SIZE);
+    } else {
+        buffer.swap(RecvBufferPool.back());
+        RecvBufferPool.pop_back();
+    }
+}
 
-    ActivityTimeMs = GetCurrentTimeMs();
+static void ReleaseRecvBuffer(std::vector<uint8_t> &buffer) {
+    std::lock_guard<std::mutex> lock(RecvBufferMutex);
+    /* Drop buffers grown by oversized requests */
+    if (buffer.size() == RECV_BUFFER_SIZE && RecvBufferPool.size() < RECV_BUFFER_POOL) {
+        RecvBufferPool.emplace_back();
+        RecvBufferPool.back().swap(buffer);
+    }
+    std::vector<uint8_t>().swap(buffer);
+}
 
-    if (Length && Offset < Length)
+TError TClient::ParseRequest(Porto::TPortoRequest &request) {
+    size_t size = RecvTail - RecvHead;
+
+    if (!size)
         return TError::Queued();
 
+    const uint8_t *data = &RecvBuffer[RecvHead];
+
     Receiving = true;
-    google::protobuf::io::CodedInputStream input(&Buffer[0], Offset);
 
-    uint32_t length;
-    if (!input.ReadVarint32(&length))
-        return TError::Queued();
+    if (!RecvLength) {
+        google::protobuf::io::CodedInputStream input(data, size);
+        uint32_t length;
+
+        if (!input.ReadVarint32(&length))
+            return TError::Queued();
 
-    if (!Length) {
         if (length > config().daemon().max_msg_len())
             return TError("oversized request: {}", length);
 
-        Length = length + google::protobuf::io::CodedOutputStream::VarintSize32(length);
-        if (Buffer.size() < Length)
-            Buffer.resize(Length + 4096);
-
-        if (Offset < Length)
-            return TError::Queued();
+        RecvLength = length + google::protobuf::io::CodedOutputStream::VarintSize32(length);
     }
 
-    if (!request.ParseFromCodedStream(&input))
-        return TError("cannot parse request");
+    if (size < RecvLength)
+        return TError::Queued();
 
-    if (Offset > Length)
-        return TError("garbage after request");
+    google::protobuf::io::CodedInputStream input(data, RecvLength);
+    uint32_t length;
 
-    Length = Offset = 0;
+    if (!input.ReadVarint32(&length) || !request.ParseFromCodedStream(&input))
+        return TError("cannot parse request");
+
+    RecvHead += RecvLength;
+    RecvLength = 0;
     Receiving = false;
 
-    return EpollLoop->StopInput(Fd);
+    if (RecvHead == RecvTail) {
+        RecvHead = RecvTail = 0;
+        ReleaseRecvBuffer(RecvBuffer);
+    }
+
+    return Loop->StopInput(Fd);
+}
+
+TError TClient::ReadRequest(Porto::TPortoRequest &request) {
+    if (Fd < 0)
+        return TError("Connection closed");
+
+    /* Pipelined request could be already received */
+    TError error = ParseRequest(request);
+    if (error != EError::Queued)
+        return error;
+
+    if (RecvBuffer.empty())
+        AcquireRecvBuffer(RecvBuffer);
+
+    /* Move partial request to the head and make room for whole */
+    if (RecvHead) {
+        memmove(&RecvBuffer[0], &RecvBuffer[RecvHead], RecvTail - RecvHead);
+        RecvTail -= RecvHead;
+        RecvHead = 0;
+    }
+
+    if (RecvBuffer.size() < RecvLength)
+        RecvBuffer.resize(RecvLength);
+
+    ssize_t len = recv(Fd, &RecvBuffer[RecvTail], RecvBuffer.size() - RecvTail, MSG_DONTWAIT);
+    if (len > 0)
+        RecvTail += len;
+    else if (len == 0)
+        return TError("recv return zero");
+    else if (errno != EAGAIN && errno != EWOULDBLOCK)
+        return TError::System("recv request failed");
+
+    ActivityTimeMs = GetCurrentTimeMs();
+
+    return ParseRequest(request);
 }
 
 TError TClient::SendResponse(bool first) {
@@ -511,15 +640,28 @@ next:
         Sending = false;
 
         /* Out of order message */
-        if (Processing)
+        if (!CanReceive())
             return OK;
 
-        return EpollLoop->StartInput(Fd);
+        /* Pipelined request might be already received */
+        if (RecvTail > RecvHead) {
+            TError error = ReceiveRequest();
+            if (!error)
+                return OK;
+            if (error != EError::Queued) {
+                L_WRN("Cannot receive request from {}: {}", Id, error);
+                /* Connection will be closed by event loop */
+                if (shutdown(Fd, SHUT_RDWR))
+                    L_ERR("Cannot shutdown client: {}", TError::System("shutdown"));
+            }
+        }
+
+        return Loop->StartInput(Fd);
     }
 
     if (first) {
         Sending = true;
-        return EpollLoop->StartOutput(Fd);
+        return Loop->StartOutput(Fd);
     }
 
     return TError::Queued();
@@ -527,9 +669,6 @@ next:
 
 TError TClient::QueueResponse(Porto::TPortoResponse &response) {
 
-    if (Receiving)
-        return TError(EError::Busy, "QueueResponse while Receiving");
-
     uint32_t length = response.ByteSize();
     size_t lengthSize = google::protobuf::io::CodedOutputStream::VarintSize32(length);
 
@@ -603,39 +742,60 @@ TError TClient::Event(uint32_t events) {
             return error;
     }
 
-    if ((!Processing && !Sending) && (events & EPOLLIN)) {
+    if (CanReceive() && !Sending && (events & EPOLLIN)) {
+        error = ReceiveRequest();
+        if (error && error != EError::Queued)
+            return error;
+    }
+
+    if (events & (EPOLLHUP | EPOLLERR))
+        return TError::System("Connection lost");
+
+    return OK;
+}
+
+TError TClient::ReceiveRequest() {
+    bool queued = false;
+    TError error;
+
+    /* Pipelined requests are received until limit */
+    do {
         if (!Request)
             Request = std::unique_ptr<TRequest>(new TRequest());
 
         error = ReadRequest(Request->Req);
-        if (!error) {
+        if (!error)
             error = IdentifyClient(false);
-            if (!error)
-                QueueRequest();
+        if (error)
+            break;
 
-            if (!error && !ReportQueue.empty()) {
-                QueueReport(ReportQueue.front(), true);
-                ReportQueue.pop_front();
-                error = SendResponse(true);
-            }
-        }
+        QueueRequest();
+        queued = true;
+    } while (CanReceive());
 
-        if (error && error != EError::Queued)
-            return error;
-    }
+    if (queued && error == EError::Queued)
+        error = Loop->StartInput(Fd);
 
-    if (events & (EPOLLHUP | EPOLLERR))
-        return TError::System("Connection lost");
+    if (!error && queued && !ReportQueue.empty()) {
+        QueueReport(ReportQueue.front(), true);
+        ReportQueue.pop_front();
+        error = SendResponse(true);
+    }
 
-    return OK;
+    return error;
 }
 
 void TClient::QueueRequest() {
-    Request->Client = shared_from_this();
+    if (Request->Req.has_request_id()) {
+        Request->Client = std::make_shared<TClient>(shared_from_this());
+        Pipelined++;
+    } else {
+        Request->Client = shared_from_this();
+        Processing = true;
+        WaitRequest = Request->Req.has_wait() || Request->Req.has_asyncwait();
+    }
 
     ClientContainer->ContainerRequests++;
-    Processing = true;
-    WaitRequest = Request->Req.has_wait() || Request->Req.has_asyncwait();
 
     QueueRpcRequest(Request);
     Request = nullptr;
@@ -3,6 +3,7 @@
 #include <string>
 #include <mutex>
 #include <list>
+#include <atomic>
 
 #include "container.hpp"
 #include "waiter.hpp"
@@ -34,9 +35,20 @@ public:
     bool Receiving = false;
     bool WaitRequest = false;
     bool InEpoll = false;
+    TEpollLoop *Loop = nullptr;     /* epoll thread serving connection */
+
+    /* Re-identified into another container, requeued after event */
+    std::atomic<bool> Moved{false};
+
+    /* Pipelined requests in flight */
+    int Pipelined = 0;
+
+    /* Connection for pipelined request */
+    std::shared_ptr<TClient> Connection;
 
     TClient(int fd);
     TClient(const std::string &special);
+    TClient(std::shared_ptr<TClient> connection);
     ~TClient();
 
     std::unique_lock<std::mutex> Lock() {
@@ -54,9 +66,18 @@ public:
     }
 
     bool IsBlockShutdown() const {
-        return (Processing && !WaitRequest) || Offset;
+        return (Processing && !WaitRequest) || Pipelined || Offset || RecvTail;
+    }
+
+    /* Idle connection without state in memory could be passed to next portod */
+    bool CanHandoff() const {
+        return !Processing && !Pipelined && !Sending && !Receiving && !Offset && !RecvTail &&
+               !SyncWaiter && !AsyncWaiter && !Subscription && ReportQueue.empty() &&
+               WeakContainers.empty();
     }
 
+    bool CanReceive() const;
+
     bool CanSetUidGid() const;
     TError CanControl(const TCred &cred);
     TError CanControl(const TContainer &ct, bool child = false);
@@ -64,7 +85,7 @@ public:
     TError ReadAccess(const TFile &file);
     TError WriteAccess(const TFile &file);
 
-    void CloseConnection();
+    void CloseConnection(const TUnixSocket *handoff = nullptr);
 
     void StartRequest();
     void FinishRequest();
@@ -77,6 +98,10 @@ public:
     TError ResolveContainer(const std::string &relative_name,
                             std::shared_ptr<TContainer> &ct) const;
 
+    /* Same as ResolveContainer but without ContainersMutex */
+    TError LookupContainer(const std::string &relative_name,
+                           std::shared_ptr<TContainer> &ct) const;
+
     TError ReadContainer(const std::string &relative_name,
                          std::shared_ptr<TContainer> &ct);
     TError WriteContainer(const std::string &relative_name,
@@ -84,6 +109,7 @@ public:
 
     TError LockContainer(std::shared_ptr<TContainer> &ct);
     void ReleaseContainer(bool locked = false);
+    TError FlushContainer();
 
     TPath ComposePath(const TPath &path);
     TPath ResolvePath(const TPath &path);
@@ -93,10 +119,13 @@ public:
 
     std::shared_ptr<TContainerWaiter> SyncWaiter;
     std::shared_ptr<TContainerWaiter> AsyncWaiter;
+    std::shared_ptr<TSubscription> Subscription;
     std::list<TContainerReport> ReportQueue;
 
     TError Event(uint32_t events);
+    TError ParseRequest(Porto::TPortoRequest &request);
     TError ReadRequest(Porto::TPortoRequest &request);
+    TError ReceiveRequest();
     void QueueRequest();
     TError SendResponse(bool first);
     TError QueueResponse(Porto::TPortoResponse &response);
@@ -105,6 +134,7 @@ public:
                       const std::string &label = "", const std::string &value = "");
 
     std::list<std::weak_ptr<TContainer>> WeakContainers;
+    void AddWeakContainer(std::shared_ptr<TContainer> &ct);
 
 private:
     std::mutex Mutex;
@@ -113,6 +143,12 @@ private:
     uint64_t Length = 0;
     uint64_t Offset = 0;
     std::vector<uint8_t> Buffer;
+
+    /* Received data, might contain several pipelined requests */
+    uint64_t RecvLength = 0;
+    uint64_t RecvHead = 0;
+    uint64_t RecvTail = 0;
+    std::vector<uint8_t> RecvBuffer;
     std::unique_ptr<TRequest> Request;
 };
 
@@ -76,6 +76,9 @@ constexpr uint64_t PORTO_SOCKET_MODE = 0666;
 constexpr int  REAP_EVT_FD = 128;
 constexpr int  REAP_ACK_FD = 129;
 constexpr int  PORTO_SK_FD = 130;
+constexpr int  PORTO_HANDOFF_FD = 131;   /* clients for next portod */
+constexpr int  PORTO_ADOPT_FD = 132;     /* clients from previous portod */
+constexpr int  PORTO_HELPER_FD = 133;    /* requests for helper server */
 
 constexpr const char *PORTO_VERSION_FILE = "/run/portod.version";
 constexpr const char *PORTO_BINARY_PATH = "/run/portod";
@@ -92,6 +95,10 @@ constexpr const char *PORTO_LOG = "/var/log/portod.log";
 
 constexpr const char *PORTO_CONTAINERS_KV = "/run/porto/kvs";
 constexpr const char *PORTO_VOLUMES_KV = "/run/porto/pkvs";
+constexpr const char *PORTO_SHARED_FILES = "/run/porto/shared";
+constexpr const char *PORTO_LAYER_STACKS = "/run/porto/stacks";
+constexpr const char *PORTO_LOG_RELAY = "/run/porto/relay";
+constexpr const char *PORTO_CORE_LOCK = "/run/porto/core.lock";
 
 constexpr const char *PORTO_WORKDIR = "/place/porto";
 constexpr const char *PORTO_PLACE = "/place";
@@ -2,6 +2,7 @@
 #include "util/unix.hpp"
 #include "util/log.hpp"
 #include "util/namespace.hpp"
+#include "util/cred.hpp"
 
 #include <google/protobuf/text_format.h>
 #include <google/protobuf/io/tokenizer.h>
@@ -52,9 +53,13 @@ static void DefaultConfig() {
 
     config().mutable_log()->set_verbose(false);
     config().mutable_log()->set_debug(false);
+    config().mutable_log()->set_async(false);
+    config().mutable_log()->set_rate_limit(0);
 
     config().set_keyvalue_limit(1 << 20);
     config().set_keyvalue_size(32 << 20);
+    config().set_keyvalue_format(1);
+    config().set_keyvalue_index(false);
 
     config().mutable_daemon()->set_rw_threads(20);
     config().mutable_daemon()->set_ro_threads(10);
@@ -79,6 +84,15 @@ static void DefaultConfig() {
     config().mutable_daemon()->set_portod_shutdown_timeout(60);
     config().mutable_daemon()->set_merge_memory_blkio_controllers(false);
     config().mutable_daemon()->set_client_idle_timeout(60);
+    config().mutable_daemon()->set_max_pipelined_requests(16);
+    config().mutable_daemon()->set_event_threads(1);
+    config().mutable_daemon()->set_restore_threads(4);
+    config().mutable_daemon()->set_trace_spans(16384);
+    config().mutable_daemon()->set_trace_slow_ms(3000);
+    config().mutable_daemon()->set_client_handoff(true);
+    config().mutable_daemon()->set_nss_cache_ms(5000);
+    config().mutable_daemon()->set_nss_negative_cache_ms(1000);
+    config().mutable_daemon()->set_helper_server(true);
 
     config().mutable_container()->set_default_aging_time_s(60 * 60 * 24);
     config().mutable_container()->set_respawn_delay_ms(1000);
@@ -114,6 +128,23 @@ static void DefaultConfig() {
     config().mutable_container()->set_dead_memory_soft_limit(1 << 20); /* 1Mb */
     config().mutable_container()->set_pressurize_on_death(false);
 
+    config().mutable_container()->set_memory_reclaim_period_ms(0);
+    config().mutable_container()->set_memory_reclaim_bytes(64ull << 20); /* 64Mb */
+    config().mutable_container()->set_memory_reclaim_watermark(0);
+    config().mutable_container()->set_cpu_throttle_sample_ms(0);
+    config().mutable_container()->set_cpu_throttle_history(60);
+    config().mutable_container()->set_criu_path("criu");
+    config().mutable_container()->set_subtree_stat_ms(5000);
+    config().mutable_container()->set_exec_timeout_ms(60000);
+    config().mutable_container()->set_share_etc_hosts(false);
+
+    config().mutable_container()->set_stat_cache_ms(0);
+    config().mutable_container()->set_knob_cache_size(4096);
+    config().mutable_container()->set_enable_cgroup2(false);
+    config().mutable_container()->set_stop_threads(8);
+    config().mutable_container()->set_cgroup_pool_size(0);
+    config().mutable_container()->set_log_relay_timeout_ms(100);
+
     config().mutable_container()->set_default_ulimit("core: 0 unlimited; nofile: 8K 1M");
     config().mutable_container()->set_default_thread_limit(10000);
 
@@ -125,6 +156,16 @@ static void DefaultConfig() {
 
     config().mutable_volumes()->set_enable_quota(true);
     config().mutable_volumes()->set_keep_project_quota_id(true);
+    config().mutable_volumes()->set_layer_dedup(false);
+    config().mutable_volumes()->set_checksum_threads(4);
+    config().mutable_volumes()->set_layer_threads(4);
+    config().mutable_volumes()->set_build_threads(4);
+    config().mutable_volumes()->set_squash_prefetch(false);
+    config().mutable_volumes()->set_async_remove(true);
+    config().mutable_volumes()->set_remove_iops_limit("");
+    config().mutable_volumes()->set_remove_bps_limit("");
+    config().mutable_volumes()->set_place_queue_max_wait_ms(60000);
+    config().mutable_volumes()->set_loop_pool_size(0);
 
     if (CompareVersions(config().linux_version(), "4.4") >= 0)
         config().mutable_volumes()->set_direct_io_loop(true);
@@ -149,7 +190,9 @@ static void DefaultConfig() {
     config().mutable_network()->set_autoconf_timeout_s(120);
     config().mutable_network()->set_proxy_ndp(true);
     config().mutable_network()->set_proxy_ndp_max_range(16);
+    config().mutable_network()->set_l3_pool_size(0);
     config().mutable_network()->set_proxy_ndp_watchdog_ms(60000);
+    config().mutable_network()->set_tcp_stat_watchdog_ms(0);
     config().mutable_network()->set_watchdog_ms(5000);
     config().mutable_network()->set_resolv_conf_watchdog_ms(5000);
 
@@ -170,6 +213,9 @@ static void DefaultConfig() {
     config().mutable_core()->set_space_limit_mb(102400); /* 100Gb */
     config().mutable_core()->set_slot_space_limit_mb(10240); /* 10Gb */
     config().mutable_core()->set_sync_size(4ull << 20); /* 4Mb */
+    config().mutable_core()->set_max_dumpers(4);
+    config().mutable_core()->set_rate_limit(0); /* per minute */
+    config().mutable_core()->set_slot_rate_limit(0);
 
     NetSysctl("net.ipv6.conf.all.accept_dad", "0");
     NetSysctl("net.ipv6.conf.default.accept_dad", "0");
@@ -205,6 +251,8 @@ static int ReadConfig(const TPath &path, bool silent) {
 }
 
 int ReadConfigs(bool silent) {
+    FlushNssCache();
+
     Config.Clear();
     DefaultConfig();
 
@@ -225,6 +273,9 @@ int ReadConfigs(bool silent) {
 
     Debug |= config().log().debug();
     Verbose |= Debug | config().log().verbose();
+    LogRateLimit = config().log().rate_limit();
+    NssCacheMs = config().daemon().nss_cache_ms();
+    NssNegativeCacheMs = config().daemon().nss_negative_cache_ms();
 
     return ret;
 }
@@ -1,11 +1,15 @@
 #include <sstream>
 #include <fstream>
 #include <memory>
+#include <unordered_map>
+#include <unordered_set>
 #include <csignal>
 #include <cstdlib>
 #include <algorithm>
 #include <condition_variable>
 
+#include <google/protobuf/text_format.h>
+
 #include "portod.hpp"
 #include "container.hpp"
 #include "config.hpp"
@@ -24,14 +28,18 @@
 #include "util/cred.hpp"
 #include "util/unix.hpp"
 #include "util/proc.hpp"
+#include "util/worker.hpp"
 #include "client.hpp"
 #include "filesystem.hpp"
 #include "rpc.hpp"
+#include "helpers.hpp"
+#include "trace.hpp"
 
 extern "C" {
 #include <sys/sysinfo.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <sys/syscall.h>
 #include <sys/time.h>
 #include <sys/reboot.h>
 #include <fcntl.h>
@@ -43,18 +51,54 @@ extern "C" {
 }
 
 std::mutex ContainersMutex;
+TLockStat ContainersLockStat;
 static std::condition_variable ContainersCV;
 std::shared_ptr<TContainer> RootContainer;
 std::map<std::string, std::shared_ptr<TContainer>> Containers;
+TLabelIndex LabelIndex;
+static std::mutex MemGuaranteeMutex;
+static std::mutex SubtreeStatMutex;
+static std::condition_variable SubtreeStatCV;
+static uint64_t SubtreeStatTime = 0;
+static uint64_t SubtreeStatReadTime = 0;
+static bool SubtreeStatSampling = false;
+static std::mutex CpuThrottleMutex;
+static std::shared_ptr<const TContainersIndex> ContainersSnapshot = std::make_shared<const TContainersIndex>();
+
+/* Freezer cgroup name -> container, published together with snapshot */
+typedef std::unordered_map<std::string, std::shared_ptr<TContainer>> TCgroupIndex;
+static std::shared_ptr<const TCgroupIndex> CgroupSnapshot = std::make_shared<const TCgroupIndex>();
 TPath ContainersKV;
 TIdMap ContainerIdMap(1, CONTAINER_ID_MAX);
 
 std::mutex CpuAffinityMutex;
+TLockStat CpuAffinityLockStat;
+
+/* Sum over all containers */
+static TLockStat ActionLockStat;
+static TLockStat StateLockStat;
 static std::vector<TPortoBitMap> CoreThreads;
+static std::vector<TPortoBitMap> CacheThreads;  /* sharing last level cache */
 
 static TPortoBitMap NumaNodes;
 static std::vector<TPortoBitMap> NodeThreads;
 
+/* Memory nodes local for cpus, empty string inherits parent */
+static std::string CpuMemNodes(const TPortoBitMap &cpus) {
+    TPortoBitMap nodes;
+
+    for (unsigned node = 0; node < NodeThreads.size(); node++) {
+        for (unsigned cpu = 0; cpu < cpus.Size(); cpu++) {
+            if (cpus.Get(cpu) && NodeThreads[node].Get(cpu)) {
+                nodes.Set(node);
+                break;
+            }
+        }
+    }
+
+    return nodes.Weight() ? nodes.Format() : "";
+}
+
 TError TContainer::ValidName(const std::string &name, bool superuser) {
 
     if (name.length() == 0)
@@ -130,6 +174,38 @@ TError TContainer::Find(const std::string &name, std::shared_ptr<TContainer> &ct
     return TError(EError::ContainerDoesNotExist, "container " + name + " not found");
 }
 
+std::shared_ptr<const TContainersIndex> ContainersIndex() {
+    return std::atomic_load(&ContainersSnapshot);
+}
+
+static void PublishContainers() {
+    PORTO_LOCKED(ContainersMutex);
+    auto cgroups = std::make_shared<TCgroupIndex>();
+
+    cgroups->reserve(Containers.size());
+    for (auto &it: Containers)
+        if (!it.second->IsRoot())
+            cgroups->emplace(std::string(PORTO_CGROUP_PREFIX) + "/" + it.first, it.second);
+
+    std::atomic_store(&ContainersSnapshot, std::make_shared<const TContainersIndex>(Containers));
+    std::atomic_store(&CgroupSnapshot, std::shared_ptr<const TCgroupIndex>(cgroups));
+}
+
+std::shared_ptr<TContainer> TContainer::Lookup(const std::string &name) {
+    auto index = ContainersIndex();
+    auto it = index->find(name);
+    if (it == index->end())
+        return nullptr;
+    return it->second;
+}
+
+TError TContainer::Lookup(const std::string &name, std::shared_ptr<TContainer> &ct) {
+    ct = Lookup(name);
+    if (ct)
+        return OK;
+    return TError(EError::ContainerDoesNotExist, "container " + name + " not found");
+}
+
 TError TContainer::FindTaskContainer(pid_t pid, std::shared_ptr<TContainer> &ct) {
     TError error;
     TCgroup cg;
@@ -141,20 +217,28 @@ TError TContainer::FindTaskContainer(pid_t pid, std::shared_ptr<TContainer> &ct)
     if (cg.Name == PORTO_DAEMON_CGROUP)
         return TError(EError::NotSupported, "Recursion?");
 
+    auto cgroups = std::atomic_load(&CgroupSnapshot);
+    auto it = cgroups->find(cg.Name);
+    if (it != cgroups->end()) {
+        ct = it->second;
+        return OK;
+    }
+
     std::string prefix = std::string(PORTO_CGROUP_PREFIX) + "/";
     std::string name = cg.Name;
     std::replace(name.begin(), name.end(), '%', '/');
 
-    auto containers_lock = LockContainers();
-
     if (!StringStartsWith(name, prefix))
-        return TContainer::Find(ROOT_CONTAINER, ct);
+        return TContainer::Lookup(ROOT_CONTAINER, ct);
 
-    return TContainer::Find(name.substr(prefix.length()), ct);
+    return TContainer::Lookup(name.substr(prefix.length()), ct);
 }
 
 /* lock subtree shared or exclusive */
 TError TContainer::LockAction(std::unique_lock<std::mutex> &containers_lock, bool shared) {
+    TTraceScope trace("LockAction", Name);
+    uint64_t waitStart = 0;
+
     L_DBG("LockAction{} CT{}:{}", (shared ? "Shared" : ""), Id, Name);
 
     while (1) {
@@ -173,8 +257,15 @@ TError TContainer::LockAction(std::unique_lock<std::mutex> &containers_lock, boo
             break;
         if (!shared)
             PendingWrite = true;
+        if (!waitStart)
+            waitStart = GetCurrentTimeUs();
         ContainersCV.wait(containers_lock);
     }
+    if (waitStart) {
+        uint64_t waitUs = GetCurrentTimeUs() - waitStart;
+        ActionLockStat.Account(waitUs);
+        ::ActionLockStat.Account(waitUs);
+    }
     PendingWrite = false;
     ActionLocked += shared ? 1 : -1;
     LastActionPid = GetTid();
@@ -252,42 +343,57 @@ void TContainer::UpgradeActionLock() {
     PendingWrite = false;
 }
 
+void TContainer::AccountStateWait(uint64_t waitStart) {
+    uint64_t waitUs = GetCurrentTimeUs() - waitStart;
+    StateLockStat.Account(waitUs);
+    ::StateLockStat.Account(waitUs);
+}
+
 void TContainer::LockStateRead() {
-    auto lock = LockContainers();
+    std::unique_lock<std::mutex> lock(StateMutex);
     L_DBG("LockStateRead CT{}:{}", Id, Name);
-    while (StateLocked < 0)
-        ContainersCV.wait(lock);
+    if (StateLocked < 0) {
+        uint64_t waitStart = GetCurrentTimeUs();
+        while (StateLocked < 0)
+            StateCV.wait(lock);
+        AccountStateWait(waitStart);
+    }
     StateLocked++;
     LastStatePid = GetTid();
 }
 
 void TContainer::LockStateWrite() {
-    auto lock = LockContainers();
+    std::unique_lock<std::mutex> lock(StateMutex);
     L_DBG("LockStateWrite CT{}:{}", Id, Name);
-    while (StateLocked < 0)
-        ContainersCV.wait(lock);
-    StateLocked = -1 - StateLocked;
-    while (StateLocked != -1)
-        ContainersCV.wait(lock);
+    if (StateLocked) {
+        uint64_t waitStart = GetCurrentTimeUs();
+        while (StateLocked < 0)
+            StateCV.wait(lock);
+        StateLocked = -1 - StateLocked;
+        while (StateLocked != -1)
+            StateCV.wait(lock);
+        AccountStateWait(waitStart);
+    } else
+        StateLocked = -1;
     LastStatePid = GetTid();
 }
 
 void TContainer::DowngradeStateLock() {
-    auto lock = LockContainers();
+    std::unique_lock<std::mutex> lock(StateMutex);
     L_DBG("DowngradeStateLock CT{}:{}", Id, Name);
     PORTO_ASSERT(StateLocked == -1);
     StateLocked = 1;
-    ContainersCV.notify_all();
+    StateCV.notify_all();
 }
 
 void TContainer::UnlockState() {
-    auto lock = LockContainers();
+    std::unique_lock<std::mutex> lock(StateMutex);
     L_DBG("UnlockState CT{}:{}", Id, Name);
     PORTO_ASSERT(StateLocked);
     if (StateLocked > 0)
         --StateLocked;
     else if (++StateLocked >= -1)
-        ContainersCV.notify_all();
+        StateCV.notify_all();
 }
 
 void TContainer::DumpLocks() {
@@ -304,19 +410,34 @@ void TContainer::DumpLocks() {
     }
 }
 
+void TContainer::LockStat(TUintMap &stat) {
+    ContainersLockStat.Dump(stat, "lock_containers");
+    CpuAffinityLockStat.Dump(stat, "lock_cpu_affinity");
+    ::ActionLockStat.Dump(stat, "lock_action");
+    ::StateLockStat.Dump(stat, "lock_state");
+    VolumesLockStat.Dump(stat, "lock_volumes");
+    NetLockStat.Dump(stat, "lock_net");
+}
+
 void TContainer::Register() {
     PORTO_LOCKED(ContainersMutex);
     Containers[Name] = shared_from_this();
     if (Parent)
         Parent->Children.emplace_back(shared_from_this());
+    for (auto &it: Labels)
+        IndexLabel(it.first, true);
+    PublishContainers();
     Statistics->ContainersCreated++;
 }
 
 void TContainer::Unregister() {
     PORTO_LOCKED(ContainersMutex);
+    for (auto &it: Labels)
+        IndexLabel(it.first, false);
     Containers.erase(Name);
     if (Parent)
         Parent->Children.remove(shared_from_this());
+    PublishContainers();
 
     TError error = ContainerIdMap.Put(Id);
     if (error)
@@ -330,7 +451,7 @@ TContainer::TContainer(std::shared_ptr<TContainer> parent, int id, const std::st
     Parent(parent), Level(parent ? parent->Level + 1 : 0), Id(id), Name(name),
     FirstName(!parent ? "" : parent->IsRoot() ? name : name.substr(parent->Name.length() + 1)),
     Stdin(0), Stdout(1), Stderr(2),
-    ClientsCount(0), ContainerRequests(0), OomEvents(0)
+    ClientsCount(0), ContainerRequests(0), ContainerRequestsCpuUs(0), MemoryReclaimed(0), OomEvents(0)
 {
     Statistics->ContainersCount++;
     RealCreationTime = time(nullptr);
@@ -409,6 +530,9 @@ TContainer::TContainer(std::shared_ptr<TContainer> parent, int id, const std::st
 
     Controllers |= CGROUP_FREEZER;
 
+    if (Cgroup2Subsystem.Supported)
+        Controllers |= CGROUP2;
+
     if (CpuacctSubsystem.Controllers == CGROUP_CPUACCT)
         Controllers |= CGROUP_CPUACCT;
 
@@ -596,7 +720,7 @@ TError TContainer::Restore(const TKeyValue &kv, std::shared_ptr<TContainer> &ct)
 
     lock.unlock();
 
-    error = SystemClient.LockContainer(ct);
+    error = CL->LockContainer(ct);
     if (error)
         goto err;
 
@@ -680,6 +804,12 @@ TError TContainer::Restore(const TKeyValue &kv, std::shared_ptr<TContainer> &ct)
         error = ct->SyncCgroups();
         if (error)
             goto err;
+
+        for (auto stream: {&ct->Stdout, &ct->Stderr}) {
+            error = stream->RestoreRelay(*ct);
+            if (error)
+                L_WRN("Cannot restore log relay of CT{}:{}: {}", ct->Id, ct->Name, error);
+        }
     }
 
     if (ct->State == EContainerState::DEAD && ct->AutoRespawn)
@@ -696,7 +826,7 @@ TError TContainer::Restore(const TKeyValue &kv, std::shared_ptr<TContainer> &ct)
     if (ct->State == EContainerState::STOPPED)
         ct->RemoveWorkDir();
 
-    SystemClient.ReleaseContainer();
+    CL->ReleaseContainer();
 
     return OK;
 
@@ -705,7 +835,7 @@ err:
     ct->SetState(EContainerState::STOPPED);
     ct->RemoveWorkDir();
     lock.lock();
-    SystemClient.ReleaseContainer(true);
+    CL->ReleaseContainer(true);
     ct->Unregister();
     ct = nullptr;
     return error;
@@ -802,13 +932,78 @@ TError TContainer::GetLabel(const std::string &label, std::string &value) const
 }
 
 void TContainer::SetLabel(const std::string &label, const std::string &value) {
-    if (value.empty())
-        Labels.erase(label);
-    else
-        Labels[label] = value;
+    if (value.empty()) {
+        if (Labels.erase(label))
+            IndexLabel(label, false);
+    } else {
+        auto it = Labels.emplace(label, value);
+        if (it.second)
+            IndexLabel(label, true);
+        else
+            it.first->second = value;
+    }
     SetProp(EProperty::LABELS);
 }
 
+void TContainer::IndexLabel(const std::string &label, bool add) {
+    /* Not registered or already unregistered */
+    if (State == EContainerState::DESTROYED ||
+            Containers.find(Name) == Containers.end())
+        return;
+
+    if (add) {
+        LabelIndex[label][Name] = this;
+    } else {
+        auto it = LabelIndex.find(label);
+        if (it != LabelIndex.end()) {
+            it->second.erase(Name);
+            if (it->second.empty())
+                LabelIndex.erase(it);
+        }
+    }
+}
+
+void TContainer::FindLabels(const std::vector<std::string> &masks, const std::string &ns,
+                            std::vector<std::pair<TContainer *, std::string>> &found) {
+    PORTO_LOCKED(ContainersMutex);
+
+    found.clear();
+
+    auto addLabel = [&](const TLabelIndex::value_type &label) {
+        for (auto it = label.second.lower_bound(ns);
+                it != label.second.end() && StringStartsWith(it->first, ns); ++it)
+            found.emplace_back(it->second, label.first);
+    };
+
+    for (auto &mask: masks) {
+        auto wild = mask.find_first_of("*?[\\");
+
+        if (wild == std::string::npos) {
+            auto it = LabelIndex.find(mask);
+            if (it != LabelIndex.end())
+                addLabel(*it);
+            continue;
+        }
+
+        /* Literal prefix of mask narrows range of labels, usually it is "PREFIX.*" */
+        auto prefix = mask.substr(0, wild);
+        for (auto it = LabelIndex.lower_bound(prefix);
+                it != LabelIndex.end() && StringStartsWith(it->first, prefix); ++it)
+            if (StringMatch(it->first, mask))
+                addLabel(*it);
+    }
+
+    std::sort(found.begin(), found.end(),
+              [](const std::pair<TContainer *, std::string> &a,
+                 const std::pair<TContainer *, std::string> &b) {
+                  int cmp = a.first->Name.compare(b.first->Name);
+                  return cmp < 0 || (cmp == 0 && a.second < b.second);
+              });
+
+    if (masks.size() > 1)
+        found.erase(std::unique(found.begin(), found.end()), found.end());
+}
+
 TError TContainer::IncLabel(const std::string &label, int64_t &result, int64_t add) {
     int64_t val;
     result = 0;
@@ -833,9 +1028,10 @@ TError TContainer::IncLabel(const std::string &label, int64_t &result, int64_t a
 
     val += add;
 
-    if (it == Labels.end())
+    if (it == Labels.end()) {
         Labels[label] = std::to_string(val);
-    else
+        IndexLabel(label, true);
+    } else
         it->second = std::to_string(val);
 
     result = val;
@@ -971,6 +1167,72 @@ TError TContainer::UpdateSoftLimit() {
     return OK;
 }
 
+/* Drain page cache of dead and hollow meta containers, largest first */
+void TContainer::ReclaimMemory() {
+    uint64_t budget = config().container().memory_reclaim_bytes();
+    uint64_t watermark = config().container().memory_reclaim_watermark();
+    std::vector<std::pair<uint64_t, std::shared_ptr<TContainer>>> idle;
+    bool partial = MemorySubsystem.SupportReclaim();
+
+    if (watermark && GetAvailableMemory() >= watermark)
+        return;
+
+    auto lock = LockContainers();
+    for (auto &it: Containers) {
+        auto &ct = it.second;
+        if (ct->IsRoot() || !(ct->Controllers & CGROUP_MEMORY))
+            continue;
+        /* Without memory.reclaim cgroup could be emptied only without tasks */
+        if (ct->State == EContainerState::DEAD ||
+                (partial && ct->State == EContainerState::META &&
+                 !ct->RunningChildren && !ct->StartingChildren))
+            idle.emplace_back(0, ct);
+    }
+    lock.unlock();
+
+    for (auto &it: idle) {
+        auto cg = it.second->GetCgroup(MemorySubsystem);
+        if (MemorySubsystem.GetCacheUsage(cg, it.first))
+            it.first = 0;
+    }
+
+    std::sort(idle.begin(), idle.end(),
+              [](const std::pair<uint64_t, std::shared_ptr<TContainer>> &a,
+                 const std::pair<uint64_t, std::shared_ptr<TContainer>> &b) {
+                  return a.first > b.first;
+              });
+
+    for (auto &it: idle) {
+        auto &ct = it.second;
+        uint64_t cache = it.first, before, after;
+
+        if (!budget || !cache)
+            break;
+
+        /* Do not drop more than budget at once */
+        if (!partial && cache > budget)
+            continue;
+
+        auto cg = ct->GetCgroup(MemorySubsystem);
+        if (MemorySubsystem.Usage(cg, before))
+            continue;
+
+        uint64_t size = std::min(cache, budget);
+        TError error = MemorySubsystem.Reclaim(cg, size);
+        budget -= size;
+
+        /* memory.reclaim fails with EAGAIN when reclaimed less than asked */
+        if (error && error.Errno != EAGAIN)
+            L_VERBOSE("Cannot reclaim memory in CT{}:{}: {}", ct->Id, ct->Name, error);
+
+        if (!MemorySubsystem.Usage(cg, after) && after < before) {
+            ct->MemoryReclaimed += before - after;
+            Statistics->MemoryReclaimed += before - after;
+            L_VERBOSE("Reclaimed {} bytes in CT{}:{}", before - after, ct->Id, ct->Name);
+        }
+    }
+}
+
 void TContainer::SetState(EContainerState next) {
     if (State == next)
         return;
@@ -982,6 +1244,11 @@ void TContainer::SetState(EContainerState next) {
     auto prev = State;
     State = next;
 
+    DropStatCache();
+
+    if (prev == EContainerState::STOPPED || next == EContainerState::STOPPED)
+        UpdateMemGuarantee();
+
     if (prev == EContainerState::STARTING || next == EContainerState::STARTING) {
         for (auto p = Parent; p; p = p->Parent)
             p->StartingChildren += next == EContainerState::STARTING ? 1 : -1;
@@ -1044,8 +1311,11 @@ TError TContainer::Destroy(std::list<std::shared_ptr<TVolume>> &unlinked) {
         }
     }
 
+    ReleaseWarm();
+
     TVolume::UnlinkAllVolumes(shared_from_this(), unlinked);
 
+    SavePending = false;
     TPath path(ContainersKV / std::to_string(Id));
     error = path.Unlink();
     if (error)
@@ -1275,25 +1545,250 @@ TError TContainer::CheckMemGuarantee() const {
     return OK;
 }
 
-uint64_t TContainer::GetTotalMemGuarantee(bool containers_locked) const {
-    uint64_t sum = 0lu;
+/* Sampling of subtree totals stops after that many periods without readers */
+constexpr uint64_t SUBTREE_STAT_IDLE_PERIODS = 10;
+
+/* Counters which are taken from own cgroup or summed from children */
+static const struct {
+    const char *Name;
+    const TSubsystem *Subsystem;
+    TError (*Get)(TCgroup &cg, uint64_t &val);
+} SubtreeStats[] = {
+    { P_CPU_USAGE, &CpuacctSubsystem, [](TCgroup &cg, uint64_t &val) {
+        return CpuacctSubsystem.Usage(cg, val); } },
+    { P_CPU_SYSTEM, &CpuacctSubsystem, [](TCgroup &cg, uint64_t &val) {
+        return CpuacctSubsystem.SystemUsage(cg, val); } },
+    { P_MEMORY_USAGE, &MemorySubsystem, [](TCgroup &cg, uint64_t &val) {
+        return MemorySubsystem.Usage(cg, val); } },
+    { P_ANON_USAGE, &MemorySubsystem, [](TCgroup &cg, uint64_t &val) {
+        return MemorySubsystem.GetAnonUsage(cg, val); } },
+    { P_CACHE_USAGE, &MemorySubsystem, [](TCgroup &cg, uint64_t &val) {
+        return MemorySubsystem.GetCacheUsage(cg, val); } },
+    { P_IO_READ, &BlkioSubsystem, [](TCgroup &cg, uint64_t &val) {
+        TUintMap map;
+        TError error = BlkioSubsystem.GetIoStat(cg, TBlkioSubsystem::IoStat::Read, map);
+        val = map["hw"];
+        return error; } },
+    { P_IO_WRITE, &BlkioSubsystem, [](TCgroup &cg, uint64_t &val) {
+        TUintMap map;
+        TError error = BlkioSubsystem.GetIoStat(cg, TBlkioSubsystem::IoStat::Write, map);
+        val = map["hw"];
+        return error; } },
+    { P_IO_OPS, &BlkioSubsystem, [](TCgroup &cg, uint64_t &val) {
+        TUintMap map;
+        TError error = BlkioSubsystem.GetIoStat(cg, TBlkioSubsystem::IoStat::Iops, map);
+        val = map["hw"];
+        return error; } },
+};
+
+/*
+ * Kernel counters are hierarchical, container without own cgroup gets
+ * totals of children which have it. Children go before parents in
+ * reversed subtree, so each container is read once.
+ */
+void TContainer::UpdateSubtreeStat() {
+    auto subtree = RootContainer->Subtree();
+    std::map<TContainer *, TUintMap> sums;
+    std::map<TContainer *, TUintMap> totals;
+    TIoStatSnapshot ioStat;
 
-    /* Stopped container doesn't have memory guarantees */
-    if (State == EContainerState::STOPPED)
-        return 0;
+    for (auto it = subtree.rbegin(); it != subtree.rend(); ++it) {
+        auto ct = it->get();
+        auto &children = sums[ct];
+        auto &total = totals[ct];
 
-    if (!containers_locked)
-        ContainersMutex.lock();
+        if (ct->State & (EContainerState::STOPPED | EContainerState::DESTROYED))
+            continue;
 
-    for (auto &child : Children)
-        sum += child->GetTotalMemGuarantee(true);
+        for (auto &desc: SubtreeStats) {
+            uint64_t val;
 
-    sum = std::max(NewMemGuarantee, sum);
+            if (ct->IsRoot() || (ct->Controllers & desc.Subsystem->Kind)) {
+                auto cg = ct->GetCgroup(*desc.Subsystem);
+                if (!desc.Get(cg, val))
+                    total[desc.Name] = val;
+            } else if (children.count(desc.Name))
+                total[desc.Name] = children[desc.Name];
+        }
 
-    if (!containers_locked)
-        ContainersMutex.unlock();
+        auto netLock = TNetwork::LockNetState();
+        if (ct->NetClass.Fold == &ct->NetClass) {
+            auto stat = ct->NetClass.ClassStat.find("Uplink");
+            if (stat != ct->NetClass.ClassStat.end()) {
+                total[P_NET_BYTES] = stat->second.TxBytes;
+                total[P_NET_RX_BYTES] = stat->second.RxBytes;
+            }
+        } else {
+            for (auto key: { P_NET_BYTES, P_NET_RX_BYTES })
+                if (children.count(key))
+                    total[key] = children[key];
+        }
+        netLock.unlock();
+
+        if (ct->Parent) {
+            auto &parent = sums[ct->Parent.get()];
+            for (auto &kv: total)
+                parent[kv.first] += kv.second;
+        }
+    }
+
+    auto lock = std::unique_lock<std::mutex>(SubtreeStatMutex);
+    for (auto &ct: subtree)
+        ct->SubtreeStat = std::move(totals[ct.get()]);
+    SubtreeStatTime = GetCurrentTimeMs();
+    SubtreeStatCV.notify_all();
+}
+
+/*
+ * Totals are recomputed for all containers at once by periodic event,
+ * which is started by first reader and stops when nobody reads them.
+ */
+TError TContainer::GetSubtreeStat(TUintMap &stat) const {
+    uint64_t period = config().container().subtree_stat_ms();
+    bool start = false;
 
-    return sum;
+    if (!period)
+        return TError(EError::NotSupported, "Subtree statistics are disabled");
+
+    auto lock = std::unique_lock<std::mutex>(SubtreeStatMutex);
+    SubtreeStatReadTime = GetCurrentTimeMs();
+    if (!SubtreeStatSampling) {
+        SubtreeStatSampling = true;
+        start = true;
+    }
+
+    if (start) {
+        lock.unlock();
+        UpdateSubtreeStat();
+        EventQueue->Add(period, TEvent(EEventType::SampleSubtreeStat));
+        lock.lock();
+    } else {
+        /* First sweep is done by reader which started sampling */
+        SubtreeStatCV.wait(lock, [] { return SubtreeStatTime != 0; });
+    }
+
+    stat = SubtreeStat;
+    return OK;
+}
+
+/* Returns false when sampling stopped */
+bool TContainer::SampleSubtreeStat() {
+    uint64_t period = config().container().subtree_stat_ms();
+
+    auto lock = std::unique_lock<std::mutex>(SubtreeStatMutex);
+    if (GetCurrentTimeMs() - SubtreeStatReadTime > period * SUBTREE_STAT_IDLE_PERIODS) {
+        SubtreeStatSampling = false;
+        SubtreeStatTime = 0;
+        return false;
+    }
+    lock.unlock();
+
+    UpdateSubtreeStat();
+    return true;
+}
+
+/*
+ * Each sample keeps deltas of bandwidth periods and throttled periods since
+ * previous one, thus history shows how often and how badly limit was hit.
+ */
+void TContainer::SampleCpuThrottle() {
+    size_t size = config().container().cpu_throttle_history();
+
+    for (auto &it: *ContainersIndex()) {
+        auto &ct = it.second;
+        TCpuThrottleSample cur, delta;
+        TUintMap stat;
+
+        if (ct->IsRoot() || !(ct->Controllers & CGROUP_CPU) ||
+                !(ct->State & (EContainerState::RUNNING | EContainerState::META)))
+            continue;
+
+        auto cg = ct->GetCgroup(CpuSubsystem);
+        if (cg.GetUintMap("cpu.stat", stat))
+            continue;
+
+        cur.Periods = stat["nr_periods"];
+        cur.Throttled = stat["nr_throttled"];
+        cur.ThrottledTime = stat["throttled_time"];
+
+        auto lock = std::unique_lock<std::mutex>(CpuThrottleMutex);
+        auto &last = ct->CpuThrottleLast;
+
+        /* Counters restart with new cgroup */
+        if (last.Periods && cur.Periods >= last.Periods &&
+                cur.Throttled >= last.Throttled &&
+                cur.ThrottledTime >= last.ThrottledTime) {
+            delta.Periods = cur.Periods - last.Periods;
+            delta.Throttled = cur.Throttled - last.Throttled;
+            delta.ThrottledTime = cur.ThrottledTime - last.ThrottledTime;
+            ct->CpuThrottleHistory.push_back(delta);
+        }
+        last = cur;
+
+        while (ct->CpuThrottleHistory.size() > size)
+            ct->CpuThrottleHistory.pop_front();
+    }
+}
+
+/* Histogram buckets by percent of throttled periods, rounded up */
+static const uint64_t CpuThrottleBuckets[] = { 0, 1, 5, 10, 25, 50, 100 };
+
+void TContainer::GetCpuThrottleStat(TUintMap &stat) const {
+    stat.clear();
+
+    stat["samples"] = 0;
+    stat["periods"] = 0;
+    stat["throttled"] = 0;
+    stat["throttled_time"] = 0;
+    stat["max_ratio"] = 0;
+    for (auto bucket: CpuThrottleBuckets)
+        stat[fmt::format("ratio_{}", bucket)] = 0;
+
+    auto lock = std::unique_lock<std::mutex>(CpuThrottleMutex);
+    for (auto &sample: CpuThrottleHistory) {
+        uint64_t ratio = 0;
+
+        if (sample.Periods)
+            ratio = (sample.Throttled * 100 + sample.Periods - 1) / sample.Periods;
+
+        stat["samples"]++;
+        stat["periods"] += sample.Periods;
+        stat["throttled"] += sample.Throttled;
+        stat["throttled_time"] += sample.ThrottledTime;
+        stat["max_ratio"] = std::max(stat["max_ratio"], ratio);
+
+        for (auto bucket: CpuThrottleBuckets) {
+            if (ratio <= bucket) {
+                stat[fmt::format("ratio_{}", bucket)]++;
+                break;
+            }
+        }
+    }
+}
+
+uint64_t TContainer::GetTotalMemGuarantee() const {
+    auto lock = std::unique_lock<std::mutex>(MemGuaranteeMutex);
+    return TotalMemGuarantee;
+}
+
+/* Propagate change of guarantee or state up to the root, O(depth) */
+void TContainer::UpdateMemGuarantee() {
+    auto lock = std::unique_lock<std::mutex>(MemGuaranteeMutex);
+
+    for (auto ct = this; ct; ct = ct->Parent.get()) {
+        uint64_t total = 0;
+
+        /* Stopped container doesn't have memory guarantees */
+        if (!(ct->State & (EContainerState::STOPPED | EContainerState::DESTROYED)))
+            total = std::max(ct->NewMemGuarantee, ct->ChildrenMemGuarantee);
+
+        if (total == ct->TotalMemGuarantee)
+            break;
+
+        if (ct->Parent)
+            ct->Parent->ChildrenMemGuarantee += total - ct->TotalMemGuarantee;
+        ct->TotalMemGuarantee = total;
+    }
 }
 
 uint64_t TContainer::GetMemLimit(bool effective) const {
@@ -1435,6 +1930,83 @@ TError TContainer::ApplyIoPolicy() const {
     return OK;
 }
 
+/*
+ * Read-only files shared by bind-mount between containers.
+ * Immutable content lives in "<kind>-<hash>", files which are not used by
+ * running containers are unlinked after stop, mounts keep them alive.
+ */
+
+static TPath SharedFilePath(const std::string &kind, const std::string &text) {
+    return TPath(PORTO_SHARED_FILES) / fmt::format("{}-{:016x}", kind, std::hash<std::string>()(text));
+}
+
+static TError OpenSharedFile(const std::string &kind, const std::string &text, TFile &file) {
+    TPath dir(PORTO_SHARED_FILES);
+    TPath path = SharedFilePath(kind, text);
+    std::string prev;
+    TError error;
+
+    error = file.OpenRead(path);
+    if (!error) {
+        error = file.ReadAll(prev, 1 << 20);
+        if (!error && prev != text)
+            error = TError(EError::Busy, "Hash collision for shared file {}", path);
+        if (error)
+            file.Close();
+        return error;
+    }
+
+    if (!dir.Exists()) {
+        error = dir.MkdirAll(0755);
+        if (error)
+            return error;
+    }
+
+    TPath temp = dir / ("." + kind + ".XXXXXX");
+    error = file.CreateTemporary(temp);
+    if (!error) {
+        error = file.WriteAll(text);
+        if (!error)
+            error = file.Chmod(0644);
+        if (!error)
+            error = temp.Rename(path);
+        if (error)
+            (void)temp.Unlink();
+        file.Close();
+    }
+
+    if (!error)
+        error = file.OpenRead(path);
+
+    return error;
+}
+
+void TContainer::CleanupSharedFiles() {
+    std::unordered_set<std::string> used;
+    std::vector<std::string> names;
+    TPath dir(PORTO_SHARED_FILES);
+
+    auto lock = LockContainers();
+    for (auto &it: Containers) {
+        auto &ct = it.second;
+        if (ct->EtcHosts.size() &&
+                !(ct->State & (EContainerState::STOPPED | EContainerState::DEAD)))
+            used.insert(SharedFilePath("hosts", ct->EtcHosts).BaseName());
+    }
+    lock.unlock();
+
+    if (!dir.Exists() || dir.ReadDirectory(names))
+        return;
+
+    for (auto &name: names) {
+        if (!StringStartsWith(name, "hosts-") || used.count(name))
+            continue;
+        TError error = (dir / name).Unlink();
+        if (error && error.Errno != ENOENT)
+            L_WRN("Cannot remove shared {}: {}", dir / name, error);
+    }
+}
+
 TError TContainer::ApplyResolvConf() const {
     TError error;
     TFile file;
@@ -1462,44 +2034,89 @@ TError TContainer::ApplyResolvConf() const {
 
 TError TContainer::ReserveCpus(unsigned nr_threads, unsigned nr_cores,
                                TPortoBitMap &threads, TPortoBitMap &cores) {
-    bool try_thread = true;
 
-    threads.Clear();
-    cores.Clear();
+    /* Reserve cpus only in domain if set, rollback if not enough */
+    auto reserve = [&](const TPortoBitMap *domain) {
+        unsigned need_threads = nr_threads, need_cores = nr_cores;
+        bool try_thread = true;
 
-again:
-    for (unsigned cpu = 0; cpu < CpuVacant.Size(); cpu++) {
-        if (!CpuVacant.Get(cpu))
-            continue;
+        threads.Clear();
+        cores.Clear();
 
-        if (CoreThreads[cpu].IsSubsetOf(CpuVacant)) {
-            if (nr_cores) {
-                nr_cores--;
-                cores.Set(cpu);
-                threads.Set(CoreThreads[cpu]);
-                CpuVacant.Set(CoreThreads[cpu], false);
-            } else if (!try_thread) {
-                nr_threads--;
+    again:
+        for (unsigned cpu = 0; cpu < CpuVacant.Size(); cpu++) {
+            if (!CpuVacant.Get(cpu) || (domain && !domain->Get(cpu)))
+                continue;
+
+            if (CoreThreads[cpu].IsSubsetOf(CpuVacant)) {
+                if (need_cores) {
+                    need_cores--;
+                    cores.Set(cpu);
+                    threads.Set(CoreThreads[cpu]);
+                    CpuVacant.Set(CoreThreads[cpu], false);
+                } else if (!try_thread) {
+                    need_threads--;
+                    threads.Set(cpu);
+                    CpuVacant.Set(cpu, false);
+                    try_thread = true;
+                }
+            } else if (need_threads) {
+                need_threads--;
                 threads.Set(cpu);
                 CpuVacant.Set(cpu, false);
-                try_thread = true;
             }
-        } else if (nr_threads) {
-            nr_threads--;
-            threads.Set(cpu);
-            CpuVacant.Set(cpu, false);
+
+            if (!need_threads && !need_cores)
+                break;
         }
 
-        if (!nr_threads && !nr_cores)
-            break;
+        if (try_thread && need_threads) {
+            try_thread = false;
+            goto again;
+        }
+
+        if (need_threads || need_cores) {
+            CpuVacant.Set(threads);
+            threads.Clear();
+            cores.Clear();
+            return false;
+        }
+
+        return true;
+    };
+
+    /* Best fit into one last level cache domain, least vacant first */
+    std::vector<std::pair<unsigned, unsigned>> domains;
+    TPortoBitMap seen;
+
+    for (unsigned cpu = 0; cpu < CpuVacant.Size() && cpu < CacheThreads.size(); cpu++) {
+        if (!CpuVacant.Get(cpu) || seen.Get(cpu))
+            continue;
+
+        auto &domain = CacheThreads[cpu];
+        unsigned vacant = 0;
+
+        for (unsigned i = 0; i < domain.Size(); i++)
+            vacant += domain.Get(i) && CpuVacant.Get(i);
+        seen.Set(domain);
+
+        if (vacant >= nr_threads + nr_cores)
+            domains.emplace_back(vacant, cpu);
     }
 
-    if (try_thread && nr_threads) {
-        try_thread = false;
-        goto again;
+    std::sort(domains.begin(), domains.end());
+
+    bool found = false;
+    for (auto &it: domains) {
+        found = reserve(&CacheThreads[it.second]);
+        if (found)
+            break;
     }
 
-    if (nr_threads || nr_cores || (IsRoot() && !CpuVacant.Weight())) {
+    if (!found)
+        found = reserve(nullptr);
+
+    if (!found || (IsRoot() && !CpuVacant.Weight())) {
         CpuVacant.Set(threads);
         threads.Clear();
         cores.Clear();
@@ -1509,27 +2126,85 @@ again:
     return OK;
 }
 
-TError TContainer::DistributeCpus() {
+/* Return reserved cpus into parent without redistribution of siblings */
+TError TContainer::ReleaseCpus() {
     auto lock = LockCpuAffinity();
+    bool nested = false;
     TError error;
 
-    if (IsRoot()) {
-        error = CpuAffinity.Read("/sys/devices/system/cpu/online");
-        if (error)
-            return error;
+    L_ACT("Release CPUs {} reserved for CT{}:{}", CpuReserve.Format(), Id, Name);
 
-        CoreThreads.clear();
-        CoreThreads.resize(CpuAffinity.Size());
+    Parent->CpuVacant.Set(CpuReserve);
+    CpuReserve.Clear();
 
-        for (unsigned cpu = 0; cpu < CpuAffinity.Size(); cpu++) {
-            if (!CpuAffinity.Get(cpu))
-                continue;
-            error = CoreThreads[cpu].Read(StringFormat("/sys/devices/system/cpu/cpu%u/topology/thread_siblings_list", cpu));
-            if (error)
-                return error;
+    for (auto &ct: Parent->Childs()) {
+        if (ct->CpuSetType != ECpuSetType::Inherit ||
+                (ct->State & (EContainerState::STOPPED |
+                              EContainerState::DEAD)))
+            continue;
+
+        /* Affinity of grandchildren depends on it */
+        if (!ct->Childs().empty()) {
+            nested = true;
+            break;
         }
 
-        error = NumaNodes.Read("/sys/devices/system/node/online");
+        if (ct->CpuAffinity.IsEqual(Parent->CpuVacant))
+            continue;
+
+        ct->CpuAffinity.Clear();
+        ct->CpuAffinity.Set(Parent->CpuVacant);
+        ct->CpuVacant.Clear();
+        ct->CpuVacant.Set(ct->CpuAffinity);
+
+        if (!(ct->Controllers & CGROUP_CPUSET)) {
+            ct->SetProp(EProperty::CPU_SET_AFFINITY);
+            continue;
+        }
+
+        auto cg = ct->GetCgroup(CpusetSubsystem);
+        error = CpusetSubsystem.SetCpus(cg, ct->CpuAffinity.Format());
+        if (error) {
+            L_ERR("Cannot set cpu affinity: {}", error);
+            nested = true;
+            break;
+        }
+
+        /* Changed and applied */
+        ct->SetProp(EProperty::CPU_SET_AFFINITY);
+        ct->TestClearPropDirty(EProperty::CPU_SET_AFFINITY);
+    }
+
+    lock.unlock();
+
+    if (nested)
+        return Parent->DistributeCpus();
+
+    return OK;
+}
+
+TError TContainer::DistributeCpus() {
+    auto lock = LockCpuAffinity();
+    TError error;
+
+    /* Topology is read once at start */
+    if (IsRoot() && CoreThreads.empty()) {
+        error = CpuAffinity.Read("/sys/devices/system/cpu/online");
+        if (error)
+            return error;
+
+        CoreThreads.clear();
+        CoreThreads.resize(CpuAffinity.Size());
+
+        for (unsigned cpu = 0; cpu < CpuAffinity.Size(); cpu++) {
+            if (!CpuAffinity.Get(cpu))
+                continue;
+            error = CoreThreads[cpu].Read(StringFormat("/sys/devices/system/cpu/cpu%u/topology/thread_siblings_list", cpu));
+            if (error)
+                return error;
+        }
+
+        error = NumaNodes.Read("/sys/devices/system/node/online");
         if (error)
             return error;
 
@@ -1543,6 +2218,30 @@ TError TContainer::DistributeCpus() {
             if (error)
                 return error;
         }
+
+        /* Without L3 cache use numa node as domain */
+        CacheThreads.clear();
+        CacheThreads.resize(CpuAffinity.Size());
+
+        for (unsigned cpu = 0; cpu < CpuAffinity.Size(); cpu++) {
+            if (!CpuAffinity.Get(cpu))
+                continue;
+            error = CacheThreads[cpu].Read(StringFormat("/sys/devices/system/cpu/cpu%u/cache/index3/shared_cpu_list", cpu));
+            if (!error)
+                continue;
+            for (auto &threads: NodeThreads) {
+                if (threads.Get(cpu))
+                    CacheThreads[cpu].Set(threads);
+            }
+            if (!CacheThreads[cpu].Weight())
+                CacheThreads[cpu].Set(CpuAffinity);
+        }
+
+        if (Verbose) {
+            for (unsigned cpu = 0; cpu < CacheThreads.size(); cpu++)
+                if (CacheThreads[cpu].Weight() && CacheThreads[cpu].Get(cpu))
+                    L("CPU{} cache domain {}", cpu, CacheThreads[cpu].Format());
+        }
     }
 
     CpuVacant.Clear();
@@ -1685,7 +2384,18 @@ TError TContainer::DistributeCpus() {
             return error;
         }
 
-        error = CpusetSubsystem.SetMems(cg, "");
+        /* Bind memory to numa nodes of packed cpus */
+        std::string mems;
+        if (ct->CpuSetType == ECpuSetType::Node ||
+                ct->CpuSetType == ECpuSetType::Cores ||
+                ct->CpuSetType == ECpuSetType::Threads)
+            mems = CpuMemNodes(ct->CpuAffinity);
+
+        error = CpusetSubsystem.SetMems(cg, mems);
+        if (error && mems != "") {
+            L("Cannot set mem affinity {}: {}", mems, error);
+            error = CpusetSubsystem.SetMems(cg, "");
+        }
         if (error) {
             L("Cannot set mem affinity: {}", error);
             return error;
@@ -1772,7 +2482,7 @@ TError TContainer::SetCpuLimit(uint64_t limit) {
         L_WRN("Cannot set rt cpu limit: {}", error);
     }
 
-    error = CpuSubsystem.SetLimit(cpucg, CpuPeriod, limit);
+    error = CpuSubsystem.SetLimit(cpucg, CpuPeriod, limit, CpuLimitBurst);
     if (error)
         return error;
 
@@ -1823,6 +2533,18 @@ TError TContainer::ApplyCpuLimit() {
 }
 
 
+/* Own limits and limits of own disks of linked volumes */
+TError TContainer::ApplyIoLimit(bool iops) {
+    auto blkcg = GetCgroup(BlkioSubsystem);
+    TUintMap map = iops ? IoOpsLimit : IoBpsLimit;
+
+    auto volumes_lock = LockVolumes();
+    TVolume::GetIoLimits(*this, iops, map);
+    volumes_lock.unlock();
+
+    return BlkioSubsystem.SetIoLimit(blkcg, RootPath, map, iops);
+}
+
 TError TContainer::ApplyDynamicProperties() {
     auto memcg = GetCgroup(MemorySubsystem);
     auto blkcg = GetCgroup(BlkioSubsystem);
@@ -1904,7 +2626,7 @@ TError TContainer::ApplyDynamicProperties() {
                 return error;
             }
         }
-        error = BlkioSubsystem.SetIoLimit(blkcg, RootPath, IoBpsLimit);
+        error = ApplyIoLimit(false);
         if (error)
             return error;
     }
@@ -1918,7 +2640,7 @@ TError TContainer::ApplyDynamicProperties() {
                 return error;
             }
         }
-        error = BlkioSubsystem.SetIoLimit(blkcg, RootPath, IoOpsLimit, true);
+        error = ApplyIoLimit(true);
         if (error)
             return error;
     }
@@ -1958,6 +2680,14 @@ TError TContainer::ApplyDynamicProperties() {
         }
     }
 
+    if (TestClearPropDirty(EProperty::HUGETLB_RESERVE)) {
+        error = ReserveHugetlb();
+        if (error) {
+            L_ERR("Cannot reserve hugepages: {}", error);
+            return error;
+        }
+    }
+
     if ((Controllers & CGROUP_CPU) &&
             (TestPropDirty(EProperty::CPU_PERIOD) |
              TestClearPropDirty(EProperty::CPU_GUARANTEE))) {
@@ -1977,6 +2707,7 @@ TError TContainer::ApplyDynamicProperties() {
             (TestPropDirty(EProperty::CPU_POLICY) |
              TestPropDirty(EProperty::CPU_WEIGHT) |
              TestClearPropDirty(EProperty::CPU_LIMIT) |
+             TestClearPropDirty(EProperty::CPU_LIMIT_BURST) |
              TestClearPropDirty(EProperty::CPU_PERIOD))) {
         error = ApplyCpuLimit();
         if (error)
@@ -2058,6 +2789,15 @@ TError TContainer::ApplyDynamicProperties() {
         }
     }
 
+    if (TestClearPropDirty(EProperty::PRESSURE_TRIGGERS) &&
+            State != EContainerState::DEAD) {
+        error = PreparePressureTriggers();
+        if (error) {
+            L_ERR("Cannot setup pressure triggers: {}", error);
+            return error;
+        }
+    }
+
     return OK;
 }
 
@@ -2089,6 +2829,87 @@ TError TContainer::PrepareOomMonitor() {
     return error;
 }
 
+#ifndef __NR_pidfd_open
+# define __NR_pidfd_open 434
+#endif
+
+#ifndef __NR_pidfd_send_signal
+# define __NR_pidfd_send_signal 424
+#endif
+
+/*
+ * Exit of main task is seen via pidfd right away, without waiting for
+ * relay from master. Master still reaps zombie after ack of its report.
+ */
+void TContainer::PrepareExitMonitor() {
+    ShutdownExitMonitor();
+
+    if (!WaitTask.Pid)
+        return;
+
+    auto source = std::make_shared<TExitSource>(WaitTask.Pid, shared_from_this());
+    int fd = syscall(__NR_pidfd_open, WaitTask.Pid, 0);
+    if (fd < 0) {
+        if (errno != ENOSYS)
+            L_WRN("Cannot open pidfd for task {}: {}", WaitTask.Pid,
+                  TError::System("pidfd_open"));
+        return;
+    }
+    source->PidFd.SetFd = fd;
+    source->Fd = fd;
+
+    TError error = EpollLoop->AddSource(source);
+    if (error) {
+        L_WRN("Cannot watch task {}: {}", WaitTask.Pid, error);
+        return;
+    }
+
+    ExitSource = source;
+}
+
+void TContainer::ShutdownExitMonitor() {
+    if (ExitSource)
+        EpollLoop->RemoveSource(ExitSource->Fd);
+    ExitSource = nullptr;
+}
+
+void TContainer::ShutdownPressureTriggers() {
+    for (auto &source: PressureSources)
+        EpollLoop->RemoveSource(source->Fd);
+    PressureSources.clear();
+}
+
+TError TContainer::PreparePressureTriggers() {
+    TError error;
+
+    ShutdownPressureTriggers();
+
+    if (IsRoot() || !(Controllers & CGROUP2) || PressureTriggers.empty())
+        return OK;
+
+    TCgroup cg = GetCgroup(Cgroup2Subsystem);
+
+    for (auto &it: PressureTriggers) {
+        auto source = std::make_shared<TPressureSource>(it.first, it.second, shared_from_this());
+
+        error = Cgroup2Subsystem.SetupPressureTrigger(cg, it.first, it.second, source->Event);
+        if (error)
+            break;
+
+        source->Fd = source->Event.Fd;
+        error = EpollLoop->AddSource(source);
+        if (error)
+            break;
+
+        PressureSources.push_back(source);
+    }
+
+    if (error)
+        ShutdownPressureTriggers();
+
+    return error;
+}
+
 TError TContainer::ApplyDeviceConf() const {
     TError error;
 
@@ -2188,6 +3009,7 @@ TError TContainer::PrepareCgroups() {
     }
 
     auto missing = Controllers | RequiredControllers;
+    bool pooled = false;
 
     for (auto hy: Hierarchies) {
         TCgroup cg = GetCgroup(*hy);
@@ -2205,11 +3027,21 @@ TError TContainer::PrepareCgroups() {
         if (cg.Exists())
             continue;
 
+        if (!cg.CreateFromPool()) {
+            pooled = true;
+            continue;
+        }
+
         error = cg.Create();
         if (error)
             return error;
     }
 
+    if (pooled) {
+        TEvent ev(EEventType::RefillCgroupPool);
+        EventQueue->Add(0, ev);
+    }
+
     if (missing) {
         std::string types;
         for (auto subsys: Subsystems)
@@ -2344,6 +3176,12 @@ TError TContainer::PrepareTask(TTaskEnv &TaskEnv) {
     if (OsMode && Isolate && (Controllers & CGROUP_SYSTEMD))
         TaskEnv.Mnt.Systemd = GetCgroup(SystemdSubsystem).Name;
 
+    error = TaskEnv.PrepareSysctl();
+    if (error)
+        return error;
+
+    TaskEnv.PrepareUlimit();
+
     TaskEnv.Cred = TaskCred;
 
     TaskEnv.LoginUid = OsMode ? -1 : OwnerCred.Uid;
@@ -2421,6 +3259,12 @@ TError TContainer::PrepareTask(TTaskEnv &TaskEnv) {
         }
     }
 
+    if (EtcHosts.size() && config().container().share_etc_hosts()) {
+        TError error = OpenSharedFile("hosts", EtcHosts, TaskEnv.EtcHosts);
+        if (error)
+            L_WRN("Cannot share /etc/hosts: {}", error);
+    }
+
     TaskEnv.Mnt.IsolateRun = TaskEnv.Mnt.Root.IsRoot() && OsMode && Isolate;
 
     // Create new mount namespaces if we have to make any changes
@@ -2501,6 +3345,78 @@ void TContainer::SanitizeCapabilitiesAll() {
         ct->SanitizeCapabilities();
 }
 
+/* Task inherits mode from nearest parent which has it */
+std::string TContainer::GetThpMode() const {
+    for (auto ct = this; ct; ct = ct->Parent.get())
+        if (!ct->ThpMode.empty())
+            return ct->ThpMode;
+    return "";
+}
+
+/* 2Mb hugepages reserved for container but not used yet */
+static int HugetlbReservedPages(TContainer &ct) {
+    uint64_t usage = 0;
+
+    if (ct.Controllers & CGROUP_HUGETLB) {
+        auto cg = ct.GetCgroup(HugetlbSubsystem);
+        (void)HugetlbSubsystem.GetHugeUsage(cg, usage);
+    }
+
+    if (usage >= ct.HugetlbReserve)
+        return 0;
+
+    return (ct.HugetlbReserve - usage + (1 << 21) - 1) >> 21;
+}
+
+/*
+ * Grow pool of 2Mb hugepages until free pages cover unused parts of
+ * reservations of all running containers, not only this one.
+ */
+TError TContainer::ReserveHugetlb() {
+    static std::mutex reserveMutex;
+    int total, free, need = 0;
+    TError error;
+
+    if (!HugetlbReserve)
+        return OK;
+
+    auto lock = std::unique_lock<std::mutex>(reserveMutex);
+
+    for (auto &it: *ContainersIndex()) {
+        auto &ct = it.second;
+        if (!ct->HugetlbReserve)
+            continue;
+        if (ct.get() != this && ct->State != EContainerState::RUNNING &&
+                ct->State != EContainerState::META &&
+                ct->State != EContainerState::PAUSED)
+            continue;
+        need += HugetlbReservedPages(*ct);
+    }
+
+    if (!need)
+        return OK;
+
+    error = GetHugetlbPages(total, free);
+    if (error)
+        return error;
+
+    if (free >= need)
+        return OK;
+
+    L_ACT("Reserve {} hugepages for CT{}:{} pool {} free {}", need, Id, Name, total, free);
+
+    error = SetHugetlbPages(total + need - free);
+    if (!error)
+        error = GetHugetlbPages(total, free);
+    if (error)
+        return error;
+
+    if (free < need)
+        return TError(EError::ResourceNotAvailable, "Cannot reserve {} hugepages, only {} free", need, free);
+
+    return OK;
+}
+
 TUlimit TContainer::GetUlimit() const {
     TUlimit res = Ulimit;
 
@@ -2527,6 +3443,7 @@ TError TContainer::StartTask() {
     error = TNetwork::StartNetwork(*this, TaskEnv);
     if (error)
         return error;
+    TraceStart("network");
 
     if (IsRoot())
         return OK;
@@ -2540,6 +3457,10 @@ TError TContainer::StartTask() {
     error = ApplyDynamicProperties();
     if (error)
         return error;
+    TraceStart("apply");
+
+    if (!CheckpointDir.IsEmpty())
+        return RestoreTask();
 
     error = TaskEnv.OpenNamespaces(*this);
     if (error)
@@ -2548,12 +3469,25 @@ TError TContainer::StartTask() {
     error = PrepareTask(TaskEnv);
     if (error)
         return error;
+    TraceStart("namespaces");
 
     /* Meta container without namespaces don't need task */
     if (IsMeta() && !Isolate && NetInherit && !TaskEnv.NewMountNs)
         return OK;
 
-    error = TaskEnv.Start();
+    error = Stdout.OpenRelay(*this);
+    if (!error)
+        error = Stderr.OpenRelay(*this);
+
+    if (!error)
+        error = TaskEnv.Start();
+
+    /* Task holds its own copies of relay pipes */
+    Stdout.CloseRelay();
+    Stderr.CloseRelay();
+
+    if (!error)
+        PrepareExitMonitor();
 
     /* Always report OOM stuation if any */
     if (error && RecvOomEvents())
@@ -2747,15 +3681,55 @@ TError TContainer::PrepareStart() {
     return OK;
 }
 
+/* Protects traces of containers and aggregated histogram of start phases */
+static std::mutex StartTraceMutex;
+static const std::vector<uint64_t> StartTraceBuckets = {1, 10, 100, 1000, 10000};
+static std::map<std::string, std::vector<uint64_t>> StartTraceHistogram;
+
+/* Task is started under shared action lock, readers could see trace */
+void TContainer::TraceStart(const std::string &phase) {
+    std::lock_guard<std::mutex> guard(StartTraceMutex);
+    uint64_t now = GetCurrentTimeUs();
+    StartTrace[phase] += now - StartTraceMark;
+    StartTraceMark = now;
+}
+
+TUintMap TContainer::GetStartTrace() const {
+    std::lock_guard<std::mutex> guard(StartTraceMutex);
+    return StartTrace;
+}
+
+void TContainer::StartTraceStat(TUintMap &stat) {
+    std::lock_guard<std::mutex> guard(StartTraceMutex);
+    for (auto &it: StartTraceHistogram) {
+        for (size_t i = 0; i < it.second.size(); i++) {
+            std::string bucket = i < StartTraceBuckets.size() ?
+                std::to_string(StartTraceBuckets[i]) : "inf";
+            stat["start_" + it.first + "_ms_" + bucket] = it.second[i];
+        }
+    }
+}
+
 TError TContainer::Start() {
+    uint64_t start = GetCurrentTimeUs();
     TError error;
 
     if (State != EContainerState::STOPPED)
         return TError(EError::InvalidState, "Cannot start container {} in state {}", Name, StateName(State));
 
+    {
+        std::lock_guard<std::mutex> guard(StartTraceMutex);
+        StartTrace.clear();
+        StartTraceMark = start;
+    }
+
+    if (!Warm)
+        ReleaseWarm();
+
     error = StartParents();
     if (error)
         return error;
+    TraceStart("parents");
 
     StartError = OK;
 
@@ -2764,6 +3738,7 @@ TError TContainer::Start() {
         error = TError(error, "Cannot prepare start for container {}", Name);
         goto err_prepare;
     }
+    TraceStart("prepare");
 
     L_ACT("Start CT{}:{}", Id, Name);
 
@@ -2773,13 +3748,36 @@ TError TContainer::Start() {
     RealStartTime = time(nullptr);
     SetProp(EProperty::START_TIME);
 
-    error = PrepareResources();
-    if (error)
-        goto err_prepare;
+    if (WarmResources) {
+        /* Cgroups and workdir are kept since warm stop */
+        error = CheckMemGuarantee();
+        if (error) {
+            Statistics->FailMemoryGuarantee++;
+            goto err_prepare;
+        }
+        TNetwork::InitClass(*this);
+
+        /* Controllers and required volumes might be changed since stop */
+        error = PrepareCgroups();
+        if (!error && RequiredVolumes.size())
+            error = TVolume::CheckRequired(*this);
+        if (error) {
+            L_ERR("Cannot reuse warm resources: {}", error);
+            ReleaseWarm();
+            goto err_prepare;
+        }
+        TraceStart("warm");
+    } else {
+        error = PrepareResources();
+        if (error)
+            goto err_prepare;
+        TraceStart("cgroups");
+    }
 
     error = PrepareRuntimeResources();
     if (error)
         goto err;
+    TraceStart("runtime");
 
     /* Complain about insecure misconfiguration */
     for (auto &taint: Taint()) {
@@ -2815,18 +3813,34 @@ TError TContainer::Start() {
         (void)Reap(false);
         goto err;
     }
+    TraceStart("save");
+
+    {
+        std::lock_guard<std::mutex> guard(StartTraceMutex);
+        StartTrace["total"] = GetCurrentTimeUs() - start;
+        for (auto &it: StartTrace) {
+            auto &hist = StartTraceHistogram[it.first];
+            size_t i = 0;
+            hist.resize(StartTraceBuckets.size() + 1);
+            while (i < StartTraceBuckets.size() && it.second > StartTraceBuckets[i] * 1000)
+                i++;
+            hist[i]++;
+        }
+    }
 
     Statistics->ContainersStarted++;
 
     return OK;
 
 err:
+    WarmResources = false;
     TNetwork::StopNetwork(*this);
     FreeRuntimeResources();
     FreeResources();
 err_prepare:
     StartError = error;
     SetState(EContainerState::STOPPED);
+    CleanupSharedFiles();
     Statistics->ContainersFailedStart++;
 
     return error;
@@ -2883,12 +3897,24 @@ TError TContainer::PrepareRuntimeResources() {
         return error;
     }
 
+    error = PreparePressureTriggers();
+    if (error) {
+        L_ERR("Cannot prepare pressure triggers: {}", error);
+        return error;
+    }
+
     error = UpdateSoftLimit();
     if (error) {
         L_ERR("Cannot update memory soft limit: {}", error);
         return error;
     }
 
+    error = ReserveHugetlb();
+    if (error) {
+        L_ERR("Cannot reserve hugepages: {}", error);
+        return error;
+    }
+
     PropagateCpuLimit();
 
     return OK;
@@ -2899,14 +3925,14 @@ void TContainer::FreeRuntimeResources() {
 
     CollectOomKills();
     ShutdownOom();
+    ShutdownPressureTriggers();
 
     error = UpdateSoftLimit();
     if (error)
         L_ERR("Cannot update memory soft limit: {}", error);
 
     if (Parent && CpuReserve.Weight()) {
-        L_ACT("Release CPUs reserved for CT{}:{}", Id, Name);
-        error = Parent->DistributeCpus();
+        error = ReleaseCpus();
         if (error)
             L_ERR("Cannot redistribute CPUs: {}", error);
     }
@@ -2919,7 +3945,27 @@ void TContainer::FreeRuntimeResources() {
     }
 }
 
-void TContainer::FreeResources() {
+/* Removes cgroups of all controllers in parallel, deeper levels first */
+void TContainer::RemoveCgroups(const std::vector<std::shared_ptr<TContainer>> &list) {
+    std::map<int, std::vector<TCgroup>, std::greater<int>> levels;
+
+    for (auto &ct: list) {
+        if (ct->IsRoot())
+            continue;
+        for (auto hy: Hierarchies)
+            if (ct->Controllers & hy->Controllers)
+                levels[ct->Level].push_back(ct->GetCgroup(*hy));
+    }
+
+    for (auto &it: levels) {
+        auto &cgroups = it.second;
+        ParallelFor(cgroups.size(), config().container().stop_threads(), [&](size_t index) {
+            (void)cgroups[index].Remove(); //Logged inside
+        });
+    }
+}
+
+void TContainer::FreeResources(bool cgroups) {
     TError error;
 
     if (IsRoot())
@@ -2929,24 +3975,261 @@ void TContainer::FreeResources() {
     OomKillsRaw = 0;
     ClearProp(EProperty::OOM_KILLS);
 
-    for (auto hy: Hierarchies) {
-        if (Controllers & hy->Controllers) {
-            auto cg = GetCgroup(*hy);
-            (void)cg.Remove(); //Logged inside
-        }
+    if (!WarmResources) {
+        if (cgroups)
+            RemoveCgroups({shared_from_this()});
+        RemoveWorkDir();
     }
 
-    RemoveWorkDir();
-
     Stdout.Remove(*this);
     Stderr.Remove(*this);
 }
 
+void TContainer::ReleaseWarm() {
+    if (!WarmResources)
+        return;
+
+    L_ACT("Release warm resources of CT{}:{}", Id, Name);
+    WarmResources = false;
+    RemoveCgroups({shared_from_this()});
+    RemoveWorkDir();
+}
+
+/* Run command in namespaces and cgroups of running container */
+TError TContainer::Exec(const std::vector<std::string> &command, bool wait,
+                        TTask &task, pid_t &pid) {
+    TTaskEnv taskEnv;
+    TUnixSocket sock, sock2;
+    TFile in, out, err;
+    TEnv env;
+    TError error;
+
+    pid = 0;
+
+    if (IsRoot())
+        return TError(EError::Permission, "Cannot exec in root container");
+
+    if (State != EContainerState::RUNNING && State != EContainerState::META)
+        return TError(EError::InvalidState, "Cannot exec in {} container", StateName(State));
+
+    if (command.empty() || command[0].empty())
+        return TError(EError::InvalidValue, "Empty command");
+
+    error = taskEnv.OpenNamespaces(*this);
+    if (error)
+        return error;
+
+    if (taskEnv.PidFd.GetFd() < 0)
+        return TError(EError::InvalidState, "Container has no task");
+
+    for (auto hy: Hierarchies)
+        taskEnv.Cgroups.push_back(GetCgroup(*hy));
+
+    error = GetEnvironment(env);
+    if (error)
+        return error;
+
+    error = in.Open("/dev/null", O_RDONLY | O_NOCTTY | O_CLOEXEC);
+    if (error)
+        return error;
+
+    /* Append into default streams outside, like task does */
+    TPath outPath = Stdout.ResolveOutside(*this);
+    TPath errPath = Stderr.ResolveOutside(*this);
+
+    error = out.Open(outPath ? outPath : TPath("/dev/null"),
+                     O_WRONLY | O_APPEND | O_NOCTTY | O_CLOEXEC);
+    if (error)
+        return error;
+
+    error = err.Open(errPath ? errPath : TPath("/dev/null"),
+                     O_WRONLY | O_APPEND | O_NOCTTY | O_CLOEXEC);
+    if (error)
+        return error;
+
+    error = TUnixSocket::SocketPair(sock, sock2);
+    if (error)
+        return error;
+
+    L_ACT("Exec {} in CT{}:{}", command[0], Id, Name);
+
+    error = task.Fork();
+    if (error)
+        return error;
+
+    if (task.Pid) {
+        sock2.Close();
+
+        error = sock.SetRecvTimeout(config().container().start_timeout_ms());
+        if (!error)
+            error = sock.RecvInt(pid);
+        if (!error)
+            error = sock.RecvError();
+
+        if (error || !wait) {
+            TError error2 = task.Wait();
+            if (!error && error2)
+                error = error2;
+        }
+
+        return error;
+    }
+
+    /* Intermediate process: enters container and forks command */
+
+    sock.Close();
+
+    ResetBlockedSignals();
+
+    SetDieOnParentExit(SIGKILL);
+
+    SetProcessName("portod-EX" + std::to_string(Id));
+
+    auto abort = [&](const TError &error) {
+        sock2.SendInt(0);
+        sock2.SendError(error);
+        _exit(EXIT_FAILURE);
+    };
+
+    for (auto &cg: taskEnv.Cgroups) {
+        error = cg.Attach(GetPid());
+        if (error)
+            abort(error);
+    }
+
+    error = TPath("/proc/self/oom_score_adj").WriteAll(std::to_string(OomScoreAdj));
+    if (error && OomScoreAdj)
+        abort(error);
+
+    /* Scheduler settings are inherited by command, like task does */
+    if (setpriority(PRIO_PROCESS, 0, SchedNice))
+        abort(TError::System("setpriority"));
+
+    struct sched_param param;
+    param.sched_priority = SchedPrio;
+    if (sched_setscheduler(0, SchedPolicy, &param))
+        abort(TError::System("sched_setparm"));
+
+    if (SetIoPrio(0, IoPrio))
+        abort(TError::System("ioprio"));
+
+    error = taskEnv.IpcFd.SetNs(CLONE_NEWIPC);
+    if (!error)
+        error = taskEnv.UtsFd.SetNs(CLONE_NEWUTS);
+    if (!error)
+        error = taskEnv.NetFd.SetNs(CLONE_NEWNET);
+    if (!error)
+        error = taskEnv.PidFd.SetNs(CLONE_NEWPID);
+    if (!error)
+        error = taskEnv.MntFd.SetNs(CLONE_NEWNS);
+    if (!error)
+        error = taskEnv.RootFd.Chroot();
+    if (!error)
+        error = taskEnv.CwdFd.Chdir();
+    if (error)
+        abort(error);
+
+    /* Do not keep descriptors of portod while command is running */
+    TFile::CloseAll({in.Fd, out.Fd, err.Fd, sock2.GetFd(), LogFile.Fd});
+
+    pid_t child = fork();
+    if (child < 0)
+        abort(TError::System("fork"));
+
+    if (child) {
+        sock2.SendInt(child);
+        if (!wait)
+            _exit(EXIT_SUCCESS);
+
+        /* Command reports exec error by itself */
+        sock2.Close();
+
+        int status;
+        if (waitpid(child, &status, 0) != child)
+            _exit(EXIT_FAILURE);
+        if (WIFEXITED(status))
+            _exit(WEXITSTATUS(status));
+
+        /* Forward death by signal as is */
+        SetDieOnParentExit(0);
+        Signal(WTERMSIG(status), SIG_DFL);
+        raise(WTERMSIG(status));
+        _exit(128 + WTERMSIG(status));
+    }
+
+    /* Command process */
+
+    auto fail = [&](const TError &error) {
+        sock2.SendError(error);
+        _exit(EXIT_FAILURE);
+    };
+
+    SetDieOnParentExit(0);
+
+    if (dup2(in.Fd, STDIN_FILENO) != STDIN_FILENO ||
+            dup2(out.Fd, STDOUT_FILENO) != STDOUT_FILENO ||
+            dup2(err.Fd, STDERR_FILENO) != STDERR_FILENO)
+        fail(TError::System("dup2"));
+
+    error = GetUlimit().Apply();
+    if (error)
+        fail(error);
+
+    error = SetThpMode(GetThpMode());
+    if (error)
+        fail(error);
+
+    /* Portod runs with zero umask */
+    umask(Umask);
+
+    error = TaskCred.Apply();
+    if (error)
+        fail(error);
+
+    error = CapAmbient.ApplyAmbient();
+    if (error)
+        fail(error);
+
+    error = CapBound.ApplyLimit();
+    if (error)
+        fail(error);
+
+    if (!TaskCred.IsRootUser()) {
+        error = CapAmbient.ApplyEffective();
+        if (error)
+            fail(error);
+    }
+
+    error = env.Apply();
+    if (error)
+        fail(error);
+
+    TFile::CloseAll({STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO, sock2.GetFd()});
+
+    std::vector<const char *> argv;
+    for (auto &arg: command)
+        argv.push_back(arg.c_str());
+    argv.push_back(nullptr);
+
+    execvpe(argv[0], (char *const *)argv.data(), env.Envp());
+
+    fail(TError::System("exec " + command[0]));
+    return OK;
+}
+
 TError TContainer::Kill(int sig) {
     if (State != EContainerState::RUNNING)
         return TError(EError::InvalidState, "invalid container state ");
 
     L_ACT("Kill task {} in CT{}:{}", Task.Pid, Id, Name);
+
+    /* Pidfd cannot hit recycled pid */
+    if (ExitSource && ExitSource->Pid == Task.Pid) {
+        if (syscall(__NR_pidfd_send_signal, ExitSource->Fd, sig, nullptr, 0))
+            return TError::System("pidfd_send_signal");
+        return OK;
+    }
+
     return Task.Kill(sig);
 }
 
@@ -3015,6 +4298,7 @@ TError TContainer::Terminate(uint64_t deadline) {
 }
 
 void TContainer::ForgetPid() {
+    ShutdownExitMonitor();
     Task.Pid = 0;
     TaskVPid = 0;
     WaitTask.Pid = 0;
@@ -3024,12 +4308,17 @@ void TContainer::ForgetPid() {
 }
 
 TError TContainer::Stop(uint64_t timeout) {
-    uint64_t deadline = timeout ? GetCurrentTimeMs() + timeout : 0;
+    uint64_t start = GetCurrentTimeMs();
+    uint64_t deadline = timeout ? start + timeout : 0;
     auto freezer = GetCgroup(FreezerSubsystem);
+    bool frozen = false;
     TError error;
 
-    if (State == EContainerState::STOPPED)
+    if (State == EContainerState::STOPPED) {
+        if (!Warm)
+            ReleaseWarm();
         return OK;
+    }
 
     if (!(Controllers & CGROUP_FREEZER) && !JobMode) {
         if (Task.Pid)
@@ -3048,35 +4337,62 @@ TError TContainer::Stop(uint64_t timeout) {
         for (auto it = subtree.rbegin(); it != subtree.rend(); ++it)
             if ((*it)->Isolate && (*it)->WaitTask.Pid)
                 (void)(*it)->WaitTask.Kill(SIGKILL);
+
+        /* Freeze whole subtree once, then each container kills own tasks */
+        if ((Controllers & CGROUP_FREEZER) && !JobMode && !IsRoot() &&
+                !FreezerSubsystem.IsFrozen(freezer)) {
+            error = FreezerSubsystem.Freeze(freezer, false);
+            if (error)
+                L_ERR("Cannot freeze CT{}:{} for killing: {}", Id, Name, error);
+            else
+                frozen = true;
+        }
     }
 
+    std::vector<std::shared_ptr<TContainer>> terminate;
     for (auto &ct : subtree) {
-        auto cg = ct->GetCgroup(FreezerSubsystem);
-
         if (ct->IsRoot() || ct->State == EContainerState::STOPPED)
             continue;
-
         ct->SetState(EContainerState::STOPPING);
-        error = ct->Terminate(deadline);
+        terminate.push_back(ct);
+    }
+
+    /* Containers are terminated independently, waits for tasks overlap */
+    ParallelFor(terminate.size(), config().container().stop_threads(), [&](size_t index) {
+        auto &ct = terminate[index];
+        auto cg = ct->GetCgroup(FreezerSubsystem);
+
+        TError error = ct->Terminate(deadline);
         if (error)
             L_ERR("Cannot terminate tasks in CT{}:{}: {}", ct->Id, ct->Name, error);
 
-        if (FreezerSubsystem.IsSelfFreezing(cg) && !JobMode) {
+        if (FreezerSubsystem.IsSelfFreezing(cg) && !JobMode &&
+                !(frozen && ct.get() == this)) {
             L_ACT("Thaw terminated paused CT{}:{}", ct->Id, ct->Name);
             error = FreezerSubsystem.Thaw(cg, false);
             if (error)
                 L_ERR("Cannot thaw CT{}:{}: {}", ct->Id, ct->Name, error);
         }
+    });
+
+    if (frozen) {
+        error = FreezerSubsystem.Thaw(freezer, false);
+        if (error)
+            L_ERR("Cannot thaw killed CT{}:{}: {}", Id, Name, error);
     }
 
     if (timeout)
         CL->LockedContainer->UpgradeActionLock();
 
-    for (auto &ct: subtree) {
+    /* Children before parents */
+    std::vector<std::shared_ptr<TContainer>> stopping;
+    for (auto it = subtree.rbegin(); it != subtree.rend(); ++it) {
+        auto &ct = *it;
+
         if (ct->State == EContainerState::STOPPED)
             continue;
 
-        L_ACT("Stop CT{}:{}", Id, Name);
+        L_ACT("Stop CT{}:{}", ct->Id, ct->Name);
 
         ct->LockStateWrite();
 
@@ -3103,15 +4419,46 @@ TError TContainer::Stop(uint64_t timeout) {
 
         TNetwork::StopNetwork(*ct);
         ct->FreeRuntimeResources();
-        ct->FreeResources();
+        stopping.push_back(ct);
+    }
+
+    /* Warm container keeps cgroups and workdir, but not under stopped parent */
+    std::vector<std::shared_ptr<TContainer>> cgroups;
+    for (auto it = subtree.rbegin(); it != subtree.rend(); ++it) {
+        auto &ct = *it;
+        if (ct.get() == this && Warm && !IsRoot() && State == EContainerState::STOPPING)
+            ct->WarmResources = true;
+        else if (ct->WarmResources) {
+            ct->WarmResources = false;
+            cgroups.push_back(ct);
+            ct->RemoveWorkDir();
+        } else if (ct->State == EContainerState::STOPPING)
+            cgroups.push_back(ct);
+    }
+
+    RemoveCgroups(cgroups);
+
+    for (auto &ct: stopping) {
+        ct->FreeResources(false);
 
         ct->SetState(EContainerState::STOPPED);
 
         error = ct->Save();
         if (error)
             return error;
+
+        L_ACT("Stopped CT{}:{} after {} ms", ct->Id, ct->Name, GetCurrentTimeMs() - start);
     }
 
+    CleanupSharedFiles();
+
+    uint64_t elapsed = GetCurrentTimeMs() - start;
+    L_ACT("Stopped {} containers in CT{}:{} in {} ms", subtree.size(), Id, Name, elapsed);
+    Statistics->ContainersStopped += subtree.size();
+    Statistics->StopTimeMs += elapsed;
+    if (elapsed > Statistics->LongestStopMs)
+        Statistics->LongestStopMs = elapsed;
+
     return OK;
 }
 
@@ -3244,6 +4591,176 @@ TError TContainer::Resume() {
     return OK;
 }
 
+/*
+ * Checkpoint and restore with CRIU. Images and container.spec with saved
+ * properties go into directory, which could be volume and then exported as
+ * layer. Task is restored into cgroups with the same names, thus restore
+ * requires the same container name.
+ */
+
+static const std::string CHECKPOINT_SPEC = "container.spec";
+
+static const std::vector<std::string> CriuOptions = {
+    "--manage-cgroups",
+    "--tcp-established",
+    "--file-locks",
+    "--ext-unix-sk",
+};
+
+TError TContainer::Checkpoint(const TPath &dir, bool leaveRunning) {
+    std::string text;
+    TError error;
+
+    if (config().container().criu_path().empty())
+        return TError(EError::NotSupported, "Checkpoint is disabled");
+
+    if (State != EContainerState::RUNNING)
+        return TError(EError::InvalidState, "Cannot checkpoint container {} in state {}", Name, StateName(State));
+
+    if (!(Controllers & CGROUP_FREEZER) || !Task.Pid)
+        return TError(EError::NotSupported, "Cannot checkpoint container without own task and freezer");
+
+    if (RunningChildren || StartingChildren)
+        return TError(EError::NotSupported, "Cannot checkpoint container with running children");
+
+    for (auto ct = this; !ct->IsRoot(); ct = ct->Parent.get())
+        if (!ct->NetInherit)
+            return TError(EError::NotSupported, "Cannot checkpoint container with own network namespace");
+
+    error = dir.MkdirAll(0700);
+    if (error)
+        return error;
+
+    Porto::TContainer spec;
+    Dump({}, spec);
+    spec.clear_name();
+    if (!google::protobuf::TextFormat::PrintToString(spec, &text))
+        return TError("Cannot format container spec");
+
+    error = (dir / CHECKPOINT_SPEC).WriteAll(text);
+    if (error)
+        return error;
+
+    auto cg = GetCgroup(FreezerSubsystem);
+    error = FreezerSubsystem.Freeze(cg);
+    if (error)
+        return error;
+
+    std::vector<std::string> cmd = {
+        config().container().criu_path(), "dump",
+        "--tree", std::to_string(Task.Pid),
+        "--images-dir", dir.ToString(),
+        "--freeze-cgroup", cg.Path().ToString(),
+    };
+    cmd.insert(cmd.end(), CriuOptions.begin(), CriuOptions.end());
+    if (leaveRunning)
+        cmd.push_back("--leave-running");
+
+    L_ACT("Checkpoint CT{}:{} into {}", Id, Name, dir);
+
+    error = RunCommand(cmd, TFile(), TFile(), TFile(), AllCapabilities);
+
+    if (error || leaveRunning) {
+        TError error2 = FreezerSubsystem.Thaw(cg);
+        if (error2)
+            L_WRN("Cannot thaw after checkpoint: {}", error2);
+        return error;
+    }
+
+    /* CRIU kills tasks after dump */
+    return Stop(0);
+}
+
+TError TContainer::LoadCheckpointSpec(const TPath &dir, Porto::TContainer &spec) {
+    std::string text;
+
+    TError error = (dir / CHECKPOINT_SPEC).ReadAll(text);
+    if (error)
+        return error;
+
+    if (!google::protobuf::TextFormat::ParseFromString(text, &spec))
+        return TError(EError::InvalidData, "Cannot parse {}", dir / CHECKPOINT_SPEC);
+
+    spec.clear_name();
+    return OK;
+}
+
+TError TContainer::RestoreCheckpoint(const TPath &dir) {
+    TError error;
+
+    if (config().container().criu_path().empty())
+        return TError(EError::NotSupported, "Checkpoint is disabled");
+
+    if (!(dir / CHECKPOINT_SPEC).Exists())
+        return TError(EError::InvalidPath, "No checkpoint at {}", dir);
+
+    CheckpointDir = dir;
+    error = Start();
+    CheckpointDir = TPath();
+
+    return error;
+}
+
+/* Called from StartTask instead of starting new task */
+TError TContainer::RestoreTask() {
+    TPath pidFile = CheckpointDir / "restore.pid";
+    std::string text;
+    pid_t pid;
+    TError error;
+
+    if (!(Controllers & CGROUP_FREEZER))
+        return TError(EError::NotSupported, "Cannot restore container without freezer");
+
+    std::vector<std::string> cmd = {
+        config().container().criu_path(), "restore",
+        "--images-dir", CheckpointDir.ToString(),
+        "--restore-detached",
+        "--pidfile", pidFile.ToString(),
+    };
+    cmd.insert(cmd.end(), CriuOptions.begin(), CriuOptions.end());
+
+    L_ACT("Restore CT{}:{} from {}", Id, Name, CheckpointDir);
+
+    (void)pidFile.Unlink();
+
+    error = RunCommand(cmd, TFile(), TFile(), TFile(), AllCapabilities);
+    if (error)
+        return error;
+
+    error = pidFile.ReadAll(text);
+    if (!error)
+        error = StringToInt(StringTrim(text), pid);
+    (void)pidFile.Unlink();
+    if (error)
+        return error;
+
+    Task.Pid = pid;
+    WaitTask.Pid = pid;
+    TaskVPid = pid;
+
+    /* Last NSpid is pid inside restored pid namespace */
+    if (!TPath(fmt::format("/proc/{}/status", pid)).ReadAll(text)) {
+        for (auto &line: SplitString(text, '\n')) {
+            if (StringStartsWith(line, "NSpid:")) {
+                auto pids = SplitString(line.substr(6), '\t');
+                if (!pids.empty())
+                    (void)StringToInt(StringTrim(pids.back()), TaskVPid);
+            }
+        }
+    }
+
+    /* Restored task is not child of portod master, wait it via portoinit */
+    error = Seize();
+    if (error) {
+        (void)kill(pid, SIGKILL);
+        Task.Pid = 0;
+        TaskVPid = 0;
+        WaitTask.Pid = 0;
+    }
+
+    return error;
+}
+
 TError TContainer::MayRespawn() {
     if (!(State & (EContainerState::DEAD |
                    EContainerState::RESPAWNING)))
@@ -3374,7 +4891,7 @@ err_prepare:
 void TContainer::SyncProperty(const std::string &name) {
     PORTO_ASSERT(IsStateLockedRead());
     if (StringStartsWith(name, "net_") && Net)
-        Net->SyncStat();
+        TNetwork::SyncStat({Net});
     if (StringStartsWith(name, "oom_kills"))
         CollectOomKills();
 }
@@ -3384,6 +4901,35 @@ void TContainer::SyncPropertiesAll() {
     RootContainer->CollectOomKills();
 }
 
+/* Sync only networks and cgroups behind requested properties */
+void TContainer::SyncProperties(const std::list<std::shared_ptr<TContainer>> &cts,
+                                const std::vector<std::string> &vars) {
+    std::vector<std::shared_ptr<TNetwork>> nets;
+    bool net = false, oom = false;
+
+    for (auto &var: vars) {
+        if (StringStartsWith(var, "net_"))
+            net = true;
+        if (StringStartsWith(var, "oom_kills"))
+            oom = true;
+    }
+
+    if (!net && !oom)
+        return;
+
+    for (auto &ct: cts) {
+        ct->LockStateRead();
+        if (net && ct->Net)
+            nets.push_back(ct->Net);
+        if (oom)
+            ct->CollectOomKills();
+        ct->UnlockState();
+    }
+
+    if (net)
+        TNetwork::SyncStat(nets);
+}
+
 /* return true if index specified for property */
 static bool ParsePropertyName(std::string &name, std::string &idx) {
     if (name.size() && name.back() == ']') {
@@ -3455,51 +5001,75 @@ TError TContainer::HasProperty(const std::string &property) const {
     return error;
 }
 
-TError TContainer::GetProperty(const std::string &origProperty, std::string &value) const {
-    TError error;
-    std::string property = origProperty;
-    std::string idx;
+void TPropertyName::Resolve(const std::string &name) {
+    Name = name;
+    Property = name;
+    Index.clear();
+    Prop = nullptr;
+    Label = false;
+    Knob = false;
+
+    Indexed = ParsePropertyName(Property, Index);
+    if (!Indexed) {
+        auto dot = Property.find('.');
+        if (dot != std::string::npos) {
+            Property.resize(dot);
+            Label = Property.find_first_not_of(PORTO_LABEL_PREFIX_CHARS) == std::string::npos;
+            Knob = !Label;
+        }
+    }
 
-    if (!ParsePropertyName(property, idx)) {
-        auto dot = property.find('.');
+    if (!Label && !Knob) {
+        auto it = ContainerProperties.find(Property);
+        if (it != ContainerProperties.end())
+            Prop = it->second;
+    }
 
-        if (dot != std::string::npos) {
-            std::string type = property.substr(0, dot);
+    /* cgroup attributes and read-only counters which requires controllers */
+    Stat = Knob || (Prop && Prop->IsReadOnly && Prop->RequireControllers);
+}
 
-            if (type.find_first_not_of(PORTO_LABEL_PREFIX_CHARS) == std::string::npos) {
-                auto lock = LockContainers();
-                return GetLabel(property, value);
-            }
+TError TContainer::GetProperty(const std::string &property, std::string &value) const {
+    return GetProperty(TPropertyName(property), value);
+}
 
-            if (State == EContainerState::STOPPED)
-                return TError(EError::InvalidState,
-                        "Not available in stopped state: " + property);
-            for (auto subsys: Subsystems) {
-                if (subsys->Type == type) {
-                    auto cg = GetCgroup(*subsys);
-                    if (!cg.Has(property))
-                        break;
-                    return cg.Get(property, value);
-                }
+TError TContainer::GetProperty(const TPropertyName &property, std::string &value) const {
+    TError error;
+
+    if (property.Label) {
+        auto lock = LockContainers();
+        return GetLabel(property.Name, value);
+    }
+
+    if (property.Knob) {
+        if (State == EContainerState::STOPPED)
+            return TError(EError::InvalidState,
+                    "Not available in stopped state: " + property.Name);
+        for (auto subsys: Subsystems) {
+            if (subsys->Type == property.Property) {
+                auto cg = GetCgroup(*subsys);
+                if (!cg.Has(property.Name))
+                    break;
+                return cg.Get(property.Name, value);
             }
-            return TError(EError::InvalidProperty,
-                    "Unknown cgroup attribute: " + property);
         }
-    } else if (!idx.length()) {
-        return TError(EError::InvalidProperty, "Empty property index");
+        return TError(EError::InvalidProperty,
+                "Unknown cgroup attribute: " + property.Name);
     }
 
-    auto it = ContainerProperties.find(property);
-    if (it == ContainerProperties.end())
+    if (property.Indexed && !property.Index.length())
+        return TError(EError::InvalidProperty, "Empty property index");
+
+    auto prop = property.Prop;
+    if (!prop)
         return TError(EError::InvalidProperty,
-                              "Unknown container property: " + property);
-    auto prop = it->second;
+                              "Unknown container property: " + property.Property);
 
     CT = const_cast<TContainer *>(this);
     error = prop->CanGet();
     if (!error) {
-        if (idx.length())
-            error = prop->GetIndexed(idx, value);
+        if (property.Indexed)
+            error = prop->GetIndexed(property.Index, value);
         else
             error = prop->Get(value);
     }
@@ -3508,6 +5078,46 @@ TError TContainer::GetProperty(const std::string &origProperty, std::string &val
     return error;
 }
 
+TError TContainer::GetCachedProperty(const std::string &property, std::string &value,
+                                     uint64_t &timestamp) const {
+    return GetCachedProperty(TPropertyName(property), value, timestamp);
+}
+
+TError TContainer::GetCachedProperty(const TPropertyName &property, std::string &value,
+                                     uint64_t &timestamp) const {
+    uint64_t ttl = config().container().stat_cache_ms();
+    uint64_t now = GetCurrentTimeMs();
+    TError error;
+
+    if (!ttl || !property.Stat) {
+        timestamp = GetRealTimeMs();
+        return GetProperty(property, value);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(StatCacheMutex);
+        auto it = StatCache.find(property.Name);
+        if (it != StatCache.end() && now - it->second.Time < ttl) {
+            value = it->second.Value;
+            timestamp = it->second.RealTime;
+            return it->second.Error;
+        }
+    }
+
+    error = GetProperty(property, value);
+    timestamp = GetRealTimeMs();
+
+    std::lock_guard<std::mutex> lock(StatCacheMutex);
+    StatCache[property.Name] = { now, timestamp, error, value };
+
+    return error;
+}
+
+void TContainer::DropStatCache() {
+    std::lock_guard<std::mutex> lock(StatCacheMutex);
+    StatCache.clear();
+}
+
 TError TContainer::SetProperty(const std::string &origProperty,
                                const std::string &origValue) {
     if (IsRoot())
@@ -3537,7 +5147,7 @@ TError TContainer::SetProperty(const std::string &origProperty,
                 SetLabel(property, value);
                 lock.unlock();
                 TContainerWaiter::ReportAll(*this, property, value);
-                return Save();
+                return SaveLater();
             }
         }
 
@@ -3574,7 +5184,7 @@ TError TContainer::SetProperty(const std::string &origProperty,
     CT = nullptr;
 
     if (!error)
-        error = Save();
+        error = SaveLater();
 
     return error;
 }
@@ -3605,6 +5215,8 @@ TError TContainer::Load(const Porto::TContainer &spec) {
 }
 
 void TContainer::Dump(const std::vector<std::string> &props, Porto::TContainer &spec) {
+    TMemoryStatSnapshot memStat;
+    TIoStatSnapshot ioStat;
     PORTO_ASSERT(!CT);
     CT = this;
     LockStateRead();
@@ -3634,7 +5246,7 @@ TError TContainer::Save(void) {
     TKeyValue node(ContainersKV / std::to_string(Id));
     TError error;
 
-    ChangeTime = time(nullptr);
+    SavePending = false;
 
     /* These are not properties */
     node.Set(P_RAW_ID, std::to_string(Id));
@@ -3667,7 +5279,19 @@ TError TContainer::Save(void) {
     if (error)
         return error;
 
-    return node.Save();
+    if (!KvState.Valid || node.Data != KvState.Data)
+        ChangeTime = time(nullptr);
+
+    return node.Save(KvState);
+}
+
+/* Coalesce saves while container is locked by current client */
+TError TContainer::SaveLater(void) {
+    if (CL && CL->LockedContainer.get() == this) {
+        SavePending = true;
+        return OK;
+    }
+    return Save();
 }
 
 TError TContainer::Load(const TKeyValue &node) {
@@ -3829,9 +5453,13 @@ void TContainer::SyncState() {
 
     if (State & (EContainerState::STOPPED |
                  EContainerState::STOPPING)) {
-        if (State == EContainerState::STOPPED)
-            L("Found unexpected freezer");
-        Stop(0);
+        if (State == EContainerState::STOPPED && Warm)
+            WarmResources = true;
+        else {
+            if (State == EContainerState::STOPPED)
+                L("Found unexpected freezer");
+            Stop(0);
+        }
     } else if (State == EContainerState::META && !WaitTask.Pid && !Isolate) {
         /* meta container */
     } else if (!WaitTask.Exists()) {
@@ -3864,6 +5492,11 @@ void TContainer::SyncState() {
         }
     }
 
+    if (WaitTask.Pid && !SeizeTask.Pid && (State & (EContainerState::RUNNING |
+                                                     EContainerState::META |
+                                                     EContainerState::PAUSED)))
+        PrepareExitMonitor();
+
     switch (Parent ? Parent->State : EContainerState::META) {
         case EContainerState::STOPPED:
             if (State != EContainerState::STOPPED)
@@ -4002,6 +5635,20 @@ void TContainer::Event(const TEvent &event) {
         break;
     }
 
+    case EEventType::TaskExit:
+    {
+        int status;
+
+        /* Zombie is kept by master until exit report is acked */
+        if (ct && !CL->LockContainer(ct)) {
+            if (ct->WaitTask.Pid == event.Exit.Pid &&
+                    !ct->WaitTask.GetExitStatus(status))
+                ct->Exit(status, false);
+            CL->ReleaseContainer();
+        }
+        break;
+    }
+
     case EEventType::Exit:
     case EEventType::ChildExit:
     {
@@ -4045,6 +5692,15 @@ void TContainer::Event(const TEvent &event) {
         break;
     }
 
+    case EEventType::ReportSubscription:
+    {
+        /* Values are collected in read-only worker, not in event thread */
+        auto sub = event.ReportSubscription.Subscription.lock();
+        if (sub)
+            QueueRoTask([sub] { sub->Report(); });
+        break;
+    }
+
     case EEventType::DestroyAgedContainer:
     {
         if (ct && !CL->LockContainer(ct)) {
@@ -4074,6 +5730,10 @@ void TContainer::Event(const TEvent &event) {
         }
         break;
 
+    case EEventType::RefillCgroupPool:
+        RefillCgroupPool();
+        break;
+
     case EEventType::RotateLogs:
     {
         for (auto &ct: RootContainer->Subtree()) {
@@ -4097,6 +5757,27 @@ void TContainer::Event(const TEvent &event) {
         EventQueue->Add(config().daemon().log_rotate_ms(), event);
         break;
     }
+
+    case EEventType::ReclaimMemory:
+    {
+        ReclaimMemory();
+        EventQueue->Add(config().container().memory_reclaim_period_ms(), event);
+        break;
+    }
+
+    case EEventType::SampleCpuThrottle:
+    {
+        SampleCpuThrottle();
+        EventQueue->Add(config().container().cpu_throttle_sample_ms(), event);
+        break;
+    }
+
+    case EEventType::SampleSubtreeStat:
+    {
+        if (SampleSubtreeStat())
+            EventQueue->Add(config().container().subtree_stat_ms(), event);
+        break;
+    }
     }
 }
 
@@ -15,6 +15,9 @@
 #include "property.hpp"
 #include "network.hpp"
 #include "device.hpp"
+#include "kvalue.hpp"
+#include "epoll.hpp"
+#include "util/locks.hpp"
 
 class TEpollSource;
 class TCgroup;
@@ -42,11 +45,61 @@ enum class ECpuSetType {
 
 class TProperty;
 
+/* Armed pressure stall trigger, reported to waiters as PORTO.<resource>_pressure */
+class TPressureSource : public TEpollSource {
+public:
+    std::string Resource;
+    std::string Trigger;
+    TFile Event;
+
+    TPressureSource(const std::string &resource, const std::string &trigger,
+                    std::weak_ptr<TContainer> container) :
+        TEpollSource(-1, EPOLL_EVENT_PRESSURE, container),
+        Resource(resource), Trigger(trigger) {}
+};
+
+/* Pidfd of main task, readable when task exits */
+class TExitSource : public TEpollSource {
+public:
+    pid_t Pid;
+    TFile PidFd;
+
+    TExitSource(pid_t pid, std::weak_ptr<TContainer> container) :
+        TEpollSource(-1, EPOLL_EVENT_EXIT, container), Pid(pid) {}
+};
+
+/* Cpu bandwidth counters from cpu.stat, or their deltas for one sample */
+struct TCpuThrottleSample {
+    uint64_t Periods = 0;
+    uint64_t Throttled = 0;
+    uint64_t ThrottledTime = 0;     /* nsec */
+};
+
+/* Property name parsed and looked up once, reused for many containers */
+struct TPropertyName {
+    std::string Name;           /* as requested */
+    std::string Property;       /* without index, controller for cgroup knob */
+    std::string Index;
+    TProperty *Prop = nullptr;
+    bool Indexed = false;
+    bool Label = false;
+    bool Knob = false;          /* cgroup attribute "controller.knob" */
+    bool Stat = false;          /* served from stat cache */
+
+    TPropertyName() {}
+    TPropertyName(const std::string &name) { Resolve(name); }
+    void Resolve(const std::string &name);
+};
+
 class TContainer : public std::enable_shared_from_this<TContainer>,
                    public TPortoNonCopyable {
     friend class TProperty;
 
+    /* State lock has own mutex, it never nests into ContainersMutex */
+    std::mutex StateMutex;
+    std::condition_variable StateCV;
     int StateLocked = 0;
+
     int ActionLocked = 0;
     int SubtreeRead = 0;
     int SubtreeWrite = 0;
@@ -56,7 +109,22 @@ class TContainer : public std::enable_shared_from_this<TContainer>,
 
     TFile OomEvent;
 
+    /* Recently read cgroup counters, dropped at state change */
+    struct TStatCacheEntry {
+        uint64_t Time;
+        uint64_t RealTime;
+        TError Error;
+        std::string Value;
+    };
+    mutable std::mutex StatCacheMutex;
+    mutable std::map<std::string, TStatCacheEntry> StatCache;
+    void DropStatCache();
+
+    TKeyValueState KvState;
+
     std::shared_ptr<TEpollSource> Source;
+    std::vector<std::shared_ptr<TPressureSource>> PressureSources;
+    std::shared_ptr<TExitSource> ExitSource;
 
     // data
     TError UpdateSoftLimit();
@@ -69,11 +137,17 @@ class TContainer : public std::enable_shared_from_this<TContainer>,
     TError ApplyDynamicProperties();
     TError PrepareOomMonitor();
     void ShutdownOom();
+    TError PreparePressureTriggers();
+    void ShutdownPressureTriggers();
+    void PrepareExitMonitor();
+    void ShutdownExitMonitor();
     TError PrepareCgroups();
     TError PrepareTask(TTaskEnv &TaskEnv);
 
     TError PrepareResources();
-    void FreeResources();
+    void FreeResources(bool cgroups = true);
+    void ReleaseWarm();
+    static void RemoveCgroups(const std::vector<std::shared_ptr<TContainer>> &list);
 
     TError PrepareRuntimeResources();
     void FreeRuntimeResources();
@@ -83,6 +157,7 @@ class TContainer : public std::enable_shared_from_this<TContainer>,
 
     TError ReserveCpus(unsigned nr_threads, unsigned nr_cores,
                        TPortoBitMap &threads, TPortoBitMap &cores);
+    TError ReleaseCpus();
     TError DistributeCpus();
     TError SetCpuLimit(uint64_t limit);
     TError ApplyCpuLimit();
@@ -96,6 +171,10 @@ public:
     const std::string Name;
     const std::string FirstName;
 
+    /* Time spent waiting for this container locks */
+    TLockStat ActionLockStat;
+    TLockStat StateLockStat;
+
     EContainerState State = EContainerState::STOPPED;
     std::atomic<int> RunningChildren;
     std::atomic<int> StartingChildren;
@@ -150,6 +229,7 @@ public:
     std::string EtcHosts;
     TDevices Devices;
     TStringMap Sysctl;
+    TStringMap PressureTriggers;
 
     time_t RealCreationTime;
     time_t RealStartTime = 0;
@@ -168,10 +248,22 @@ public:
     uint64_t MemLimit = 0;
     uint64_t MemGuarantee = 0;
     uint64_t NewMemGuarantee = 0;
+    /* Totals of hot counters for subtree, protected with SubtreeStatMutex */
+    TUintMap SubtreeStat;
+
+    /* Deltas of cpu.stat between samples, protected with CpuThrottleMutex */
+    std::list<TCpuThrottleSample> CpuThrottleHistory;
+    TCpuThrottleSample CpuThrottleLast;
+
+    /* Cached sums, protected with MemGuaranteeMutex */
+    uint64_t TotalMemGuarantee = 0;     /* max(new guarantee, children), 0 if stopped */
+    uint64_t ChildrenMemGuarantee = 0;  /* sum of totals of children */
     int64_t MemSoftLimit = 0;
     uint64_t AnonMemLimit = 0;
     uint64_t DirtyMemLimit = 0;
     uint64_t HugetlbLimit = 0;
+    uint64_t HugetlbReserve = 0;
+    std::string ThpMode;
     uint64_t ThreadLimit = 0;
 
     bool AnonOnly = false;
@@ -192,6 +284,7 @@ public:
     int SchedNice;
 
     uint64_t CpuLimit = 0;
+    uint64_t CpuLimitBurst = 0;
     uint64_t CpuGuarantee = 0;
     double CpuWeight = 1;
     uint64_t CpuPeriod;
@@ -209,7 +302,16 @@ public:
     uint64_t CpuLimitSum = 0;
     uint64_t CpuLimitCur = 0;
 
+    /* Time spent in start phases, usec, under StartTraceMutex */
+    TUintMap StartTrace;
+    uint64_t StartTraceMark = 0;
+    void TraceStart(const std::string &phase);
+    TUintMap GetStartTrace() const;
+    static void StartTraceStat(TUintMap &stat);
+
     bool AutoRespawn = false;
+    bool Warm = false;
+    bool WarmResources = false;     /* stopped, but cgroups and workdir kept */
     uint64_t RespawnLimit = 0;
     uint64_t RespawnCount = 0;
     uint64_t RespawnDelay;
@@ -223,8 +325,11 @@ public:
     EAccessLevel AccessLevel;
     std::atomic<int> ClientsCount;
     std::atomic<uint64_t> ContainerRequests;
+    std::atomic<uint64_t> ContainerRequestsCpuUs;
+    std::atomic<uint64_t> MemoryReclaimed;
 
     bool IsWeak = false;
+    bool SavePending = false;
     bool OomIsFatal = true;
     int OomScoreAdj = 0;
     std::atomic<uint64_t> OomEvents;
@@ -254,6 +359,10 @@ public:
     TTask WaitTask;
     TTask SeizeTask;
 
+    /* CRIU images for task restored instead of start */
+    TPath CheckpointDir;
+    TError RestoreTask();
+
     /* Protected with container state lock */
     std::shared_ptr<TNetwork> Net;
 
@@ -317,6 +426,7 @@ public:
     void DowngradeActionLock();
     void UpgradeActionLock();
 
+    void AccountStateWait(uint64_t waitStart);
     void LockStateRead();
     void LockStateWrite();
     void DowngradeStateLock();
@@ -325,16 +435,25 @@ public:
     bool IsStateLockedWrite() { return StateLocked == -1; }
 
     static void DumpLocks();
+    static void LockStat(TUintMap &stat);
 
     TTuple Taint();
 
 
     TUlimit GetUlimit() const;
+    std::string GetThpMode() const;
+    TError ReserveHugetlb();
     void SanitizeCapabilities();
     void SanitizeCapabilitiesAll();
 
+    TError GetSubtreeStat(TUintMap &stat) const;
+    static void UpdateSubtreeStat();
+
+    void GetCpuThrottleStat(TUintMap &stat) const;
+
     TError CheckMemGuarantee() const;
-    uint64_t GetTotalMemGuarantee(bool containers_locked = false) const;
+    uint64_t GetTotalMemGuarantee() const;
+    void UpdateMemGuarantee();
     uint64_t GetMemLimit(bool effective = true) const;
     uint64_t GetAnonMemLimit(bool effective = true) const;
 
@@ -362,20 +481,35 @@ public:
     TError Stop(uint64_t timeout);
     TError Pause();
     TError Resume();
+    TError Checkpoint(const TPath &dir, bool leaveRunning);
+    TError RestoreCheckpoint(const TPath &dir);
+    static TError LoadCheckpointSpec(const TPath &dir, Porto::TContainer &spec);
     TError Terminate(uint64_t deadline);
     TError Kill(int sig);
+    TError Exec(const std::vector<std::string> &command, bool wait,
+                TTask &task, pid_t &pid);
     TError Destroy(std::list<std::shared_ptr<TVolume>> &unlinked);
 
     /* Refresh cached counters */
     void SyncProperty(const std::string &name);
     static void SyncPropertiesAll();
+    static void SyncProperties(const std::list<std::shared_ptr<TContainer>> &cts,
+                               const std::vector<std::string> &vars);
 
     TError ApplyResolvConf() const;
+    TError ApplyIoLimit(bool iops);
+    static void CleanupSharedFiles();
     TError SetSymlink(const TPath &symlink, const TPath &target);
 
     TError EnableControllers(uint64_t controllers);
     TError HasProperty(const std::string &property) const;
     TError GetProperty(const std::string &property, std::string &value) const;
+    TError GetProperty(const TPropertyName &property, std::string &value) const;
+    /* Serve counters from cache if they are not older than stat_cache_ms */
+    TError GetCachedProperty(const std::string &property, std::string &value,
+                             uint64_t &timestamp) const;
+    TError GetCachedProperty(const TPropertyName &property, std::string &value,
+                             uint64_t &timestamp) const;
     TError SetProperty(const std::string &property, const std::string &value);
 
     TError Load(const Porto::TContainer &spec);
@@ -386,6 +520,11 @@ public:
     TError GetLabel(const std::string &label, std::string &value) const;
     void SetLabel(const std::string &label, const std::string &value);
     TError IncLabel(const std::string &label, int64_t &result, int64_t add = 1);
+    void IndexLabel(const std::string &label, bool add);
+
+    /* Labels matching any of masks in containers of namespace, ordered by name */
+    static void FindLabels(const std::vector<std::string> &masks, const std::string &ns,
+                           std::vector<std::pair<TContainer *, std::string>> &found);
 
     void ForgetPid();
     void SyncState();
@@ -393,6 +532,7 @@ public:
     TError SyncCgroups();
 
     TError Save(void);
+    TError SaveLater(void);
     TError Load(const TKeyValue &node);
 
     TCgroup GetCgroup(const TSubsystem &subsystem) const;
@@ -419,26 +559,47 @@ public:
 
     static std::shared_ptr<TContainer> Find(const std::string &name);
     static TError Find(const std::string &name, std::shared_ptr<TContainer> &ct);
+
+    /* Lookup in published index, without ContainersMutex */
+    static std::shared_ptr<TContainer> Lookup(const std::string &name);
+    static TError Lookup(const std::string &name, std::shared_ptr<TContainer> &ct);
     static TError FindTaskContainer(pid_t pid, std::shared_ptr<TContainer> &ct);
 
     static TError Create(const std::string &name, std::shared_ptr<TContainer> &ct);
     static TError Restore(const TKeyValue &kv, std::shared_ptr<TContainer> &ct);
 
     static void Event(const TEvent &event);
+    static void ReclaimMemory();
+    static void SampleCpuThrottle();
+    static bool SampleSubtreeStat();
 };
 
 extern std::mutex ContainersMutex;
 extern std::shared_ptr<TContainer> RootContainer;
 extern std::map<std::string, std::shared_ptr<TContainer>> Containers;
+
+/* Label -> containers with it by name, protected with ContainersMutex */
+typedef std::map<std::string, std::map<std::string, TContainer *>> TLabelIndex;
+extern TLabelIndex LabelIndex;
+
+/*
+ * Read-only copy of Containers republished after each Register/Unregister.
+ * Snapshot might contain just destroyed containers, check State if needed.
+ */
+typedef std::map<std::string, std::shared_ptr<TContainer>> TContainersIndex;
+std::shared_ptr<const TContainersIndex> ContainersIndex();
 extern TPath ContainersKV;
 extern TIdMap ContainerIdMap;
 
+extern TLockStat ContainersLockStat;
+
 static inline std::unique_lock<std::mutex> LockContainers() {
-    return std::unique_lock<std::mutex>(ContainersMutex);
+    return LockWithStat(ContainersMutex, ContainersLockStat);
 }
 
 extern std::mutex CpuAffinityMutex;
+extern TLockStat CpuAffinityLockStat;
 
 static inline std::unique_lock<std::mutex> LockCpuAffinity() {
-    return std::unique_lock<std::mutex>(CpuAffinityMutex);
+    return LockWithStat(CpuAffinityMutex, CpuAffinityLockStat);
 }
@@ -9,8 +9,11 @@ extern "C" {
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/file.h>
 }
 
+#include <unordered_set>
+
 TError TCore::Register(const TPath &portod) {
     std::string limit, pattern;
     TError error;
@@ -93,6 +96,13 @@ TError TCore::Handle(const TTuple &args) {
         return OK;
     }
 
+    error = LockDumper();
+    if (error) {
+        L_CORE("Ignore core from CT:{} {} {}:{} thread {}:{} signal {}: {}",
+                Container, ExeName, Pid, ProcessName, Tid, ThreadName, Signal, error);
+        return error;
+    }
+
     if (CoreCommand != "") {
         L_CORE("Forward core from CT:{} {} {}:{} thread {}:{} signal {} dumpable {}",
                 Container, ExeName, Pid, ProcessName, Tid, ThreadName, Signal, Dumpable);
@@ -168,6 +178,30 @@ TError TCore::Identify() {
     return OK;
 }
 
+/* Lock is inherited by filter and released when it exits */
+TError TCore::LockDumper() {
+    uint64_t max = config().core().max_dumpers();
+    TError error;
+
+    if (!max)
+        return OK;
+
+    for (uint64_t i = 0; i < max; i++) {
+        error = DumperLock.Create(fmt::format("{}.{}", PORTO_CORE_LOCK, i),
+                                  O_RDWR | O_CREAT | O_NOFOLLOW, 0600);
+        if (error) {
+            L("Cannot lock core dumper: {}", error);
+            return OK;
+        }
+        if (!flock(DumperLock.Fd, LOCK_EX | LOCK_NB))
+            return OK;
+        DumperLock.Close();
+    }
+
+    return TError(EError::ResourceNotAvailable,
+                  "Too many core dumps in progress: {}", max);
+}
+
 TError TCore::Forward() {
     std::string core = Container + "/core-" + std::to_string(Pid);
     TMultiTuple env = {
@@ -230,6 +264,9 @@ TError TCore::Save() {
 
     uint64_t TotalSize = 0;
     uint64_t SlotSize = 0;
+    uint64_t SlotRecent = 0;
+    std::unordered_set<ino_t> Recent;
+    time_t now = time(nullptr);
 
     for (auto &name: names) {
         struct stat st;
@@ -237,9 +274,16 @@ TError TCore::Save() {
         if (!(dir / name).StatStrict(st)) {
             TotalSize += st.st_blocks * 512 / st.st_nlink;
 
+            /* Cores written during last minute, each has two links */
+            bool recent = st.st_ctime + 60 > now;
+            if (recent)
+                Recent.insert(st.st_ino);
+
             auto sep = name.find('%');
-            if (sep != std::string::npos && name.substr(0, sep) == Slot)
+            if (sep != std::string::npos && name.substr(0, sep) == Slot) {
                 SlotSize += st.st_blocks * 512;
+                SlotRecent += recent;
+            }
         }
 
         if ((TotalSize >> 20) >= config().core().space_limit_mb())
@@ -253,6 +297,16 @@ TError TCore::Save() {
                         Slot, SlotSize >> 20, config().core().slot_space_limit_mb()));
     }
 
+    if (config().core().rate_limit() && Recent.size() >= config().core().rate_limit())
+        return TError(EError::ResourceNotAvailable,
+                      "Total core rate reached limit: {} per minute",
+                      config().core().rate_limit());
+
+    if (config().core().slot_rate_limit() && SlotRecent >= config().core().slot_rate_limit())
+        return TError(EError::ResourceNotAvailable,
+                      "Slot {} core rate reached limit: {} per minute",
+                      Slot, config().core().slot_rate_limit());
+
     std::string filter = "";
     std::string format = ".core";
 
@@ -266,6 +320,11 @@ TError TCore::Save() {
         format = ".core.xz";
     }
 
+    if (StringEndsWith(DefaultPattern.ToString(), ".zst")) {
+        filter = "zstd";
+        format = ".core.zst";
+    }
+
     Pattern = dir / ( Prefix + ExeName + "." + std::to_string(Pid) +
               ".S" + std::to_string(Signal) + "." +
               FormatTime(time(nullptr), "%Y%m%dT%H%M%S") + format);
@@ -297,7 +356,10 @@ TError TCore::Save() {
         if (file.Fd != STDOUT_FILENO &&
                 dup2(file.Fd, STDOUT_FILENO) != STDOUT_FILENO)
             return TError::System("dup2");
-        execlp(filter.c_str(), filter.c_str(), nullptr);
+        if (filter == "zstd")
+            execlp(filter.c_str(), filter.c_str(), "-q", "-T0", nullptr);
+        else
+            execlp(filter.c_str(), filter.c_str(), nullptr);
         error = TError::System("cannot execute filter " + filter);
     } else {
         uint64_t buf[512];
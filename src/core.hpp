@@ -36,12 +36,14 @@ struct TCore {
 	std::string Slot;
 
 	Porto::TPortoApi Conn;
+	TFile DumperLock;
 
 	static TError Register(const TPath &portod);
 	static TError Unregister();
 
 	TError Handle(const TTuple &args);
 	TError Identify();
+	TError LockDumper();
 	TError Forward();
 	TError Save();
 };
@@ -1,3 +1,5 @@
+#include <unordered_set>
+
 #include "device.hpp"
 #include "cgroup.hpp"
 #include "util/log.hpp"
@@ -6,6 +8,7 @@ extern "C" {
 #include <sys/stat.h>
 #include <linux/kdev_t.h>
 #include <sys/sysmacros.h>
+#include <unistd.h>
 }
 
 TError TDevice::CheckPath(const TPath &path) {
@@ -195,14 +198,16 @@ std::string TDevice::CgroupRule(bool allow) const {
     return rule;
 }
 
-TError TDevice::Makedev(const TPath &root) const {
+TError TDevice::Makedev(const TPath &root, bool mkdir) const {
     TPath path = root / PathInside;
     struct stat st;
     TError error;
 
-    error = path.DirName().MkdirAll(0755);
-    if (error)
-        return error;
+    if (mkdir) {
+        error = path.DirName().MkdirAll(0755);
+        if (error)
+            return error;
+    }
 
     if (Wildcard || !MayMknod)
         return OK;
@@ -215,9 +220,12 @@ TError TDevice::Makedev(const TPath &root) const {
         error = path.Mknod(Mode, Node);
         if (error)
             return error;
-        error = path.Chown(Uid, Gid);
-        if (error)
-            return error;
+        /* node is created with our owner */
+        if (Uid != geteuid() || Gid != getegid()) {
+            error = path.Chown(Uid, Gid);
+            if (error)
+                return error;
+        }
     } else {
         if ((st.st_mode & S_IFMT) != (Mode & S_IFMT) || st.st_rdev != Node)
             return TError(EError::Busy, "Different device node {} {:#o} {}:{} in container",
@@ -303,11 +311,14 @@ std::string TDevices::Format() const {
 }
 
 TError TDevices::Makedev(const TPath &root) const {
+    std::unordered_set<std::string> dirs;
     TError error;
 
     for (auto &device: Devices) {
         if (device.MayRead || device.MayWrite || device.MayMknod) {
-            error = device.Makedev(root);
+            /* most nodes are in /dev, check directory once */
+            bool mkdir = dirs.insert(device.PathInside.DirName().ToString()).second;
+            error = device.Makedev(root, mkdir);
             if (error)
                 return error;
         } else if (!root.IsRoot() && !device.Wildcard) {
@@ -321,11 +332,28 @@ TError TDevices::Makedev(const TPath &root) const {
     return OK;
 }
 
+static TError WriteRule(const TCgroup &cg, const TFile &file,
+                        const char *knob, const std::string &rule) {
+    L_CG("Set {} {} = {}", cg, knob, rule);
+    TError error = file.WriteAll(rule);
+    if (error)
+        error = TError(error, "Cannot set cgroup {} = {}", knob, rule);
+    return error;
+}
+
+/* Kernel parses one rule per write, knobs are opened once for all rules */
 TError TDevices::Apply(const TCgroup &cg, bool reset) const {
+    TFile allow, deny;
     TError error;
 
+    error = allow.OpenWrite(cg.Knob("devices.allow"));
+    if (!error)
+        error = deny.OpenWrite(cg.Knob("devices.deny"));
+    if (error)
+        return TError(error, "Cannot open devices cgroup {}", cg);
+
     if (reset) {
-        error = cg.Set("devices.deny", "a");
+        error = WriteRule(cg, deny, "devices.deny", "a");
         if (error)
             return error;
     }
@@ -335,7 +363,7 @@ TError TDevices::Apply(const TCgroup &cg, bool reset) const {
 
         rule = device.CgroupRule(true);
         if (rule != "") {
-            error = cg.Set("devices.allow", rule);
+            error = WriteRule(cg, allow, "devices.allow", rule);
             if (error) {
                 if (error.Errno == EPERM)
                     return TError(EError::Permission, "Device {} is not pertmitted for parent container", device.Path);
@@ -345,7 +373,7 @@ TError TDevices::Apply(const TCgroup &cg, bool reset) const {
 
         rule = device.CgroupRule(false);
         if (rule != "") {
-            error = cg.Set("devices.deny", rule);
+            error = WriteRule(cg, deny, "devices.deny", rule);
             if (error)
                 return error;
         }
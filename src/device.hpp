@@ -32,7 +32,7 @@ struct TDevice {
     std::string FormatAccess() const;
     std::string Format() const;
     std::string CgroupRule(bool allow) const;
-    TError Makedev(const TPath &root = "/") const;
+    TError Makedev(const TPath &root = "/", bool mkdir = true) const;
 
     TError Load(const Porto::TContainerDevice &dev, const TCred &cred);
     void Dump(Porto::TContainerDevice &dev) const;
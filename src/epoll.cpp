@@ -16,13 +16,7 @@ static TError EpollCreate(int &epfd) {
 }
 
 TError TEpollLoop::Create() {
-    TError error = EpollCreate(EpollFd);
-    if (error)
-        return error;
-
-    Statistics->EpollSources = 0;
-
-    return OK;
+    return EpollCreate(EpollFd);
 }
 
 void TEpollLoop::Destroy() {
@@ -74,7 +68,13 @@ TError TEpollLoop::AddSource(std::shared_ptr<TEpollSource> source) {
     Statistics->EpollSources++;
 
     struct epoll_event ev;
-    ev.events = EPOLLIN | EPOLLHUP;
+    /* pressure triggers signal only EPOLLPRI */
+    if (source->Flags & EPOLL_EVENT_PRESSURE)
+        ev.events = EPOLLPRI;
+    else
+        ev.events = EPOLLIN | EPOLLHUP;
+    if (source->Flags & EPOLL_EVENT_EXCLUSIVE)
+        ev.events |= EPOLLEXCLUSIVE;
     ev.data.fd = fd;
     if (epoll_ctl(EpollFd, EPOLL_CTL_ADD, fd, &ev) < 0)
         return TError::System("epoll_add {}", fd);
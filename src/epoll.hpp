@@ -7,6 +7,9 @@
 #include "util/locks.hpp"
 
 constexpr int EPOLL_EVENT_OOM = 1;
+constexpr int EPOLL_EVENT_PRESSURE = 2;
+constexpr int EPOLL_EVENT_EXIT = 4;
+constexpr int EPOLL_EVENT_EXCLUSIVE = 8;    /* listener shared between loops */
 
 class TContainer;
 class TEpollLoop;
@@ -1,48 +1,223 @@
+#include <list>
+#include <thread>
+#include <unordered_map>
+#include <condition_variable>
+
 #include "config.hpp"
 #include "event.hpp"
 #include "util/log.hpp"
 #include "util/unix.hpp"
-#include "util/worker.hpp"
+#include "util/locks.hpp"
 #include "container.hpp"
 #include "client.hpp"
 
-class TEventWorker : public TWorker<TEvent, std::priority_queue<TEvent>> {
-public:
-    TEventWorker(const size_t nr) : TWorker("portod-EV", nr), client("<event>") {}
+/* Hierarchical timer wheel: O(1) insert and cancel */
+constexpr uint64_t EVENT_TICK_MS = 10;
+constexpr int EVENT_WHEEL_BITS = 6;
+constexpr int EVENT_WHEEL_SIZE = 1 << EVENT_WHEEL_BITS;
+constexpr int EVENT_WHEEL_LEVELS = 4;
+constexpr uint64_t EVENT_WHEEL_RANGE = 1ull << (EVENT_WHEEL_BITS * EVENT_WHEEL_LEVELS);
+
+struct TEventTimer {
+    TEvent Event;
+    uint64_t Id;
+    uint64_t DueTick;
+    std::list<TEventTimer *> *Slot = nullptr;
+    std::list<TEventTimer *>::iterator Pos;
+
+    TEventTimer(const TEvent &event, uint64_t id, uint64_t due) :
+        Event(event), Id(id), DueTick(due) {}
+};
+
+class TEventWorker : public TLockable {
+    bool Valid = true;
+    const size_t Nr;
+    std::condition_variable Cv;
+    std::vector<std::thread> Threads;
+
+    std::unordered_map<uint64_t, std::unique_ptr<TEventTimer>> Timers;
+    std::list<TEventTimer *> Wheel[EVENT_WHEEL_LEVELS][EVENT_WHEEL_SIZE];
+    std::list<TEventTimer *> Ready;
+    size_t Pending = 0;     /* timers in wheel */
+    uint64_t Tick = 0;      /* next tick to process */
+    uint64_t LastId = 0;
 
-    TClient client;
+    void Insert(TEventTimer *timer) {
+        std::list<TEventTimer *> *slot;
 
-    const TEvent &Top() override {
-        return Queue.top();
+        if (timer->DueTick < Tick) {
+            slot = &Ready;
+        } else {
+            uint64_t delta = timer->DueTick - Tick;
+            uint64_t due = timer->DueTick;
+            int level = 0;
+
+            /* Far timers are parked at top level and inserted again at cascade */
+            if (delta >= EVENT_WHEEL_RANGE)
+                due = Tick + EVENT_WHEEL_RANGE - 1;
+
+            while (level < EVENT_WHEEL_LEVELS - 1 &&
+                    delta >= (1ull << (EVENT_WHEEL_BITS * (level + 1))))
+                level++;
+
+            slot = &Wheel[level][(due >> (EVENT_WHEEL_BITS * level)) & (EVENT_WHEEL_SIZE - 1)];
+            Pending++;
+        }
+
+        timer->Slot = slot;
+        timer->Pos = slot->insert(slot->end(), timer);
     }
 
-    void Wait(TScopedLock &lock) override {
-        if (!Valid)
+    void Remove(TEventTimer *timer) {
+        if (timer->Slot != &Ready)
+            Pending--;
+        timer->Slot->erase(timer->Pos);
+        timer->Slot = nullptr;
+    }
+
+    void Cascade(int level, int index) {
+        std::list<TEventTimer *> list;
+
+        list.swap(Wheel[level][index]);
+        Pending -= list.size();
+        for (auto timer: list)
+            Insert(timer);
+    }
+
+    void Advance(uint64_t now) {
+        if (!Pending) {
+            Tick = std::max(Tick, now + 1);
             return;
+        }
 
-        Statistics->QueuedEvents = Queue.size();
+        while (Tick <= now) {
+            int index = Tick & (EVENT_WHEEL_SIZE - 1);
 
-        if (Queue.size()) {
-            auto now = GetCurrentTimeMs();
-            if (Top().DueMs <= now)
-                return;
-            auto timeout = Top().DueMs - now;
-            Cv.wait_for(lock, std::chrono::milliseconds(timeout));
-        } else {
-            TWorker::Wait(lock);
+            if (!index) {
+                for (int level = 1; level < EVENT_WHEEL_LEVELS; level++) {
+                    int i = (Tick >> (EVENT_WHEEL_BITS * level)) & (EVENT_WHEEL_SIZE - 1);
+                    Cascade(level, i);
+                    if (i)
+                        break;
+                }
+            }
+
+            auto &slot = Wheel[0][index];
+            for (auto timer: slot)
+                timer->Slot = &Ready;
+            Pending -= slot.size();
+            Ready.splice(Ready.end(), slot);
+
+            Tick++;
         }
     }
 
-    bool Handle(const TEvent &event) override {
-        if (event.DueMs <= GetCurrentTimeMs()) {
+    /* Milliseconds until next tick which might have due timers, -1 - none */
+    int64_t NextTimeout(uint64_t nowMs) {
+        if (!Pending)
+            return -1;
+
+        /* First non-empty slot or next cascade */
+        uint64_t next = Tick;
+        while ((next & (EVENT_WHEEL_SIZE - 1)) &&
+                Wheel[0][next & (EVENT_WHEEL_SIZE - 1)].empty())
+            next++;
+
+        uint64_t dueMs = next * EVENT_TICK_MS;
+        return dueMs > nowMs ? dueMs - nowMs : 0;
+    }
+
+    void WorkerFn(const std::string &name) {
+        TClient client("<event>");
+
+        SetProcessName(name);
+
+        auto lock = ScopedLock();
+        while (Valid) {
+            uint64_t now = GetCurrentTimeMs();
+
+            Advance(now / EVENT_TICK_MS);
+
+            if (Ready.empty()) {
+                int64_t timeout = NextTimeout(now);
+                if (timeout < 0)
+                    Cv.wait(lock);
+                else
+                    Cv.wait_for(lock, std::chrono::milliseconds(timeout));
+                continue;
+            }
+
+            auto timer = Ready.front();
+            Remove(timer);
+            if (!Ready.empty())
+                Cv.notify_one();
+            auto it = Timers.find(timer->Id);
+            auto owned = std::move(it->second);
+            Timers.erase(it);
+
+            Statistics->QueuedEvents = Timers.size();
+
+            lock.unlock();
             client.ClientContainer = RootContainer;
             client.StartRequest();
-            TContainer::Event(event);
+            TContainer::Event(owned->Event);
             client.FinishRequest();
-            return true;
+            owned.reset();
+            lock.lock();
         }
+    }
+
+public:
+    TEventWorker(size_t nr) : Nr(nr) {
+        Tick = GetCurrentTimeMs() / EVENT_TICK_MS;
+    }
+
+    void Start() {
+        for (size_t i = 0; i < Nr; i++)
+            Threads.emplace_back(&TEventWorker::WorkerFn, this, "portod-EV" + std::to_string(i));
+    }
+
+    void Stop() {
+        {
+            auto lock = ScopedLock();
+            if (!Valid)
+                return;
+            Valid = false;
+            Cv.notify_all();
+        }
+        for (auto &thread: Threads)
+            thread.join();
+        Threads.clear();
+    }
+
+    uint64_t Add(uint64_t timeoutMs, const TEvent &event) {
+        uint64_t due = (GetCurrentTimeMs() + timeoutMs + EVENT_TICK_MS - 1) / EVENT_TICK_MS;
+        auto lock = ScopedLock();
+        uint64_t id = ++LastId;
+        auto timer = new TEventTimer(event, id, due);
+
+        Advance(GetCurrentTimeMs() / EVENT_TICK_MS);
+
+        Timers[id] = std::unique_ptr<TEventTimer>(timer);
+        Insert(timer);
+
+        Statistics->QueuedEvents = Timers.size();
+        Cv.notify_one();
+
+        return id;
+    }
+
+    void Cancel(uint64_t id) {
+        auto lock = ScopedLock();
+        auto it = Timers.find(id);
+
+        if (it == Timers.end())
+            return;
+
+        Remove(it->second.get());
+        Timers.erase(it);
 
-        return false;
+        Statistics->QueuedEvents = Timers.size();
     }
 };
 
@@ -54,6 +229,8 @@ std::string TEvent::GetMsg() const {
         case EEventType::Exit:
             return "exit status " + std::to_string(Exit.Status)
                 + " for pid " + std::to_string(Exit.Pid);
+        case EEventType::TaskExit:
+            return "exit of task " + std::to_string(Exit.Pid);
         case EEventType::RotateLogs:
             return "rotate logs";
         case EEventType::Respawn:
@@ -66,23 +243,31 @@ std::string TEvent::GetMsg() const {
             return "destroy aged container";
         case EEventType::DestroyWeakContainer:
             return "destroy weak container";
+        case EEventType::ReportSubscription:
+            return "report subscription";
+        case EEventType::RefillCgroupPool:
+            return "refill cgroup pool";
+        case EEventType::ReclaimMemory:
+            return "reclaim memory";
+        case EEventType::SampleCpuThrottle:
+            return "sample cpu throttle";
+        case EEventType::SampleSubtreeStat:
+            return "sample subtree stat";
         default:
             return "unknown event";
     }
 }
 
-bool TEvent::operator<(const TEvent& rhs) const {
-    return DueMs >= rhs.DueMs;
+uint64_t TEventQueue::Add(uint64_t timeoutMs, const TEvent &e) {
+    return Worker->Add(timeoutMs, e);
 }
 
-void TEventQueue::Add(uint64_t timeoutMs, const TEvent &e) {
-    TEvent copy = e;
-    copy.DueMs = GetCurrentTimeMs() + timeoutMs;
-    Worker->Push(copy);
+void TEventQueue::Cancel(uint64_t id) {
+    Worker->Cancel(id);
 }
 
 TEventQueue::TEventQueue() {
-    Worker = std::make_shared<TEventWorker>(1);
+    Worker = std::make_shared<TEventWorker>(std::max(config().daemon().event_threads(), 1u));
 }
 
 void TEventQueue::Start() {
@@ -3,10 +3,10 @@
 #include <string>
 #include <memory>
 
-#include "util/worker.hpp"
 
 class TContainer;
 class TContainerWaiter;
+class TSubscription;
 
 enum class EEventType {
     Exit,
@@ -17,6 +17,12 @@ enum class EEventType {
     WaitTimeout,
     DestroyAgedContainer,
     DestroyWeakContainer,
+    ReportSubscription,
+    RefillCgroupPool,
+    TaskExit,
+    ReclaimMemory,
+    SampleCpuThrottle,
+    SampleSubtreeStat,
 };
 
 class TEventWorker;
@@ -35,13 +41,13 @@ public:
         std::weak_ptr<TContainerWaiter> Waiter;
     } WaitTimeout;
 
-    uint64_t DueMs = 0;
+    struct {
+        std::weak_ptr<TSubscription> Subscription;
+    } ReportSubscription;
 
     TEvent(EEventType type, std::shared_ptr<TContainer> container = nullptr) :
         Type(type), Container(container) {}
 
-    bool operator<(const TEvent& rhs) const;
-
     std::string GetMsg() const;
 };
 
@@ -53,5 +59,7 @@ public:
     void Start();
     void Stop();
 
-    void Add(uint64_t timeoutMs, const TEvent &e);
+    /* Returns handle for Cancel */
+    uint64_t Add(uint64_t timeoutMs, const TEvent &e);
+    void Cancel(uint64_t id);
 };
@@ -3,12 +3,19 @@
 #include "util/path.hpp"
 #include "util/log.hpp"
 #include "util/unix.hpp"
+#include "trace.hpp"
+#include "config.hpp"
+#include "util/signal.hpp"
+
+#include <mutex>
 
 extern "C" {
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/prctl.h>
 #include <linux/loop.h>
 }
 
@@ -20,51 +27,19 @@ static void HelperError(TFile &err, const std::string &text, TError error) {
     _exit(EXIT_FAILURE);
 }
 
-TError RunCommand(const std::vector<std::string> &command,
-                  const TFile &dir, const TFile &in, const TFile &out,
-                  const TCapabilities &caps) {
-    TCgroup memcg = MemorySubsystem.Cgroup(PORTO_HELPERS_CGROUP);
-    TError error;
-    TFile err;
-    TTask task;
-    TPath path = dir.RealPath();
-
-    if (!command.size())
-        return TError("External command is empty");
-
-    error = err.CreateUnnamed("/tmp", O_APPEND);
-    if (error)
-        return error;
+/* Runs in forked child, never returns */
+static void RunHelper(const std::vector<std::string> &command,
+                      const TFile &dir, const TFile &in, const TFile &out,
+                      TFile &err, const TCapabilities &caps) __attribute__ ((noreturn));
 
-    std::string cmdline;
-
-    for (auto &arg : command)
-        cmdline += arg + " ";
-
-    L_ACT("Call helper: {} in {}", cmdline, path);
-
-    error = task.Fork();
-    if (error)
-        return error;
-
-    if (task.Pid) {
-        error = task.Wait();
-        if (error) {
-            std::string text;
-            TError error2 = err.ReadEnds(text, TError::MAX_LENGTH - 1024);
-            if (error2)
-                text = "Cannot read stderr: " + error2.ToString();
-            error = TError(error, "helper: {} stderr: {}", cmdline, text);
-        }
-        return error;
-    }
+static void RunHelper(const std::vector<std::string> &command,
+                      const TFile &dir, const TFile &in, const TFile &out,
+                      TFile &err, const TCapabilities &caps) {
+    TPath path = dir.RealPath();
+    TError error;
 
     SetProcessName("portod-" + command[0]);
 
-    error = memcg.Attach(GetPid());
-    if (error)
-        HelperError(err, "Cannot attach to helper cgroup: {}", error);
-
     SetDieOnParentExit(SIGKILL);
 
     if (!in) {
@@ -126,6 +101,12 @@ TError RunCommand(const std::vector<std::string> &command,
     if (error)
         HelperError(err, "caps", error);
 
+    /* Bounding set must be the same for server and fallback fork path */
+    for (int cap = 0; cap < 64; cap++) {
+        if (!(caps.Permitted & BIT(cap)) && prctl(PR_CAPBSET_READ, cap, 0, 0, 0) > 0)
+            HelperError(err, "caps", TError(EError::Unknown, "Capability {} is not dropped", cap));
+    }
+
     TFile::CloseAll({STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO});
 
     const char **argv = (const char **)malloc(sizeof(*argv) * (command.size() + 1));
@@ -139,7 +120,334 @@ TError RunCommand(const std::vector<std::string> &command,
     HelperError(err, fmt::format("Cannot execute {}", argv[0]), TError::System("exec"));
 }
 
-TError CopyRecursive(const TPath &src, const TPath &dst) {
+/*
+ * Helper server is small long-lived process in helpers cgroup which spawns
+ * helpers for portod: fork of multithreaded portod with large address space
+ * is much more expensive. Request is one packet with header and command
+ * arguments separated by zeros, it carries descriptors for reply, stderr
+ * and optionally working directory, stdin and stdout. For each request
+ * server forks waiter which forks helper and sends its exit status back.
+ */
+struct THelperRequest {
+    uint64_t Caps;
+    uint32_t Flags;
+};
+
+enum {
+    HELPER_DIR = 1,
+    HELPER_IN = 2,
+    HELPER_OUT = 4,
+};
+
+struct THelperReply {
+    int Status;
+    int Errno;      /* cannot fork helper */
+};
+
+constexpr size_t HELPER_REQUEST_MAX = 65536;
+constexpr int HELPER_REQUEST_FDS = 5;
+
+static std::mutex HelperServerMutex;
+static int HelperServerFd = -1;
+static pid_t HelperServerPid = 0;
+
+static void HelperWaiter(int reply, const std::vector<std::string> &command,
+                         const TFile &dir, const TFile &in, const TFile &out,
+                         TFile &err, const TCapabilities &caps) {
+    THelperReply rep = { 0, 0 };
+
+    SetDieOnParentExit(SIGKILL);
+    signal(SIGCHLD, SIG_DFL);
+
+    pid_t pid = fork();
+    if (!pid)
+        RunHelper(command, dir, in, out, err, caps);
+
+    if (pid < 0)
+        rep.Errno = errno;
+    else if (waitpid(pid, &rep.Status, 0) != pid)
+        rep.Errno = errno;
+
+    (void)send(reply, &rep, sizeof(rep), MSG_NOSIGNAL);
+    _exit(EXIT_SUCCESS);
+}
+
+/*
+ * Entry point of "portod helper-server": fresh image executed by portod,
+ * already attached into helpers cgroup, waits requests at PORTO_HELPER_FD.
+ */
+int HelperServerMain() {
+    std::vector<char> buf(HELPER_REQUEST_MAX);
+    char cbuf[CMSG_SPACE(sizeof(int) * HELPER_REQUEST_FDS)];
+    int sock = PORTO_HELPER_FD;
+
+    SetProcessName("portod-HS");
+    TFile::CloseAll({STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO, sock});
+    ResetBlockedSignals();
+
+    /* Fresh image, ApplyLimit needs cap_last_cap */
+    InitCapabilities();
+
+    /* Waiters are reaped by kernel */
+    signal(SIGCHLD, SIG_IGN);
+
+    while (true) {
+        struct iovec iov = { buf.data(), buf.size() };
+        struct msghdr msg = {};
+        int fds[HELPER_REQUEST_FDS];
+        int nr_fds = 0;
+
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = cbuf;
+        msg.msg_controllen = sizeof(cbuf);
+
+        ssize_t len = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+        if (len < 0 && errno == EINTR)
+            continue;
+        if (len <= 0)
+            return EXIT_SUCCESS; /* portod is gone */
+
+        for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+                continue;
+            int nr = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (int i = 0; i < nr && nr_fds < HELPER_REQUEST_FDS; i++)
+                memcpy(&fds[nr_fds++], CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+        }
+
+        THelperRequest req;
+        std::vector<std::string> command;
+        TCapabilities caps;
+        TFile dir, in, out, err;
+        int reply = -1, idx = 0;
+
+        if ((size_t)len < sizeof(req) || nr_fds < 2)
+            goto next;
+
+        memcpy(&req, buf.data(), sizeof(req));
+        caps.Permitted = req.Caps;
+
+        for (size_t off = sizeof(req); off < (size_t)len; ) {
+            const char *arg = buf.data() + off;
+            size_t arg_len = strnlen(arg, len - off);
+            command.emplace_back(arg, arg_len);
+            off += arg_len + 1;
+        }
+
+        if (command.empty() ||
+                nr_fds != 2 + !!(req.Flags & HELPER_DIR) +
+                !!(req.Flags & HELPER_IN) + !!(req.Flags & HELPER_OUT))
+            goto next;
+
+        reply = fds[idx++];
+        err.SetFd = fds[idx++];
+        if (req.Flags & HELPER_DIR)
+            dir.SetFd = fds[idx++];
+        if (req.Flags & HELPER_IN)
+            in.SetFd = fds[idx++];
+        if (req.Flags & HELPER_OUT)
+            out.SetFd = fds[idx++];
+        nr_fds = 0;
+
+        if (!fork()) {
+            close(sock);
+            HelperWaiter(reply, command, dir, in, out, err, caps);
+        }
+        close(reply);
+next:
+        for (int i = 0; i < nr_fds; i++)
+            close(fds[i]);
+    }
+}
+
+/* Under HelperServerMutex */
+static TError StartHelperServer() {
+    TCgroup memcg = MemorySubsystem.Cgroup(PORTO_HELPERS_CGROUP);
+    const char *argv[] = { "portod-HS", "helper-server", nullptr };
+    TError error;
+    TTask task;
+
+    if (HelperServerFd >= 0) {
+        close(HelperServerFd);
+        HelperServerFd = -1;
+        if (HelperServerPid)
+            (void)waitpid(HelperServerPid, nullptr, WNOHANG);
+        HelperServerPid = 0;
+    }
+
+    int sk[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sk))
+        return TError::System("socketpair");
+
+    error = task.Fork(true);
+    if (error) {
+        close(sk[0]);
+        close(sk[1]);
+        return error;
+    }
+
+    /* Re-exec, forked copy of multithreaded portod must not run for long */
+    if (!task.Pid) {
+        if (dup2(sk[1], PORTO_HELPER_FD) == PORTO_HELPER_FD &&
+                (LogFile.Fd < 0 || dup2(LogFile.Fd, STDERR_FILENO) == STDERR_FILENO))
+            execv("/proc/self/exe", (char **)argv);
+        _exit(EXIT_FAILURE);
+    }
+
+    close(sk[1]);
+    HelperServerFd = sk[0];
+    HelperServerPid = task.Pid;
+
+    /* Server does not fork before first request, helpers inherit cgroup */
+    error = memcg.Attach(task.Pid);
+    if (error)
+        L_WRN("Cannot attach helper server to helper cgroup: {}", error);
+
+    L_SYS("Start helper server {}", task.Pid);
+    return OK;
+}
+
+/* Returns error only if request was not sent: helper hasn't been started */
+static TError SendHelperRequest(const std::vector<std::string> &command,
+                                const TFile &dir, const TFile &in, const TFile &out,
+                                const TFile &err, const TCapabilities &caps,
+                                TUnixSocket &reply) {
+    THelperRequest req = { caps.Permitted, 0 };
+    char cbuf[CMSG_SPACE(sizeof(int) * HELPER_REQUEST_FDS)];
+    int fds[HELPER_REQUEST_FDS];
+    int nr_fds = 0;
+    TUnixSocket remote;
+    std::string data;
+    TError error;
+
+    error = TUnixSocket::SocketPair(reply, remote);
+    if (error)
+        return error;
+
+    fds[nr_fds++] = remote.GetFd();
+    fds[nr_fds++] = err.Fd;
+    if (dir) {
+        req.Flags |= HELPER_DIR;
+        fds[nr_fds++] = dir.Fd;
+    }
+    if (in) {
+        req.Flags |= HELPER_IN;
+        fds[nr_fds++] = in.Fd;
+    }
+    if (out) {
+        req.Flags |= HELPER_OUT;
+        fds[nr_fds++] = out.Fd;
+    }
+
+    data.append((const char *)&req, sizeof(req));
+    for (auto &arg: command)
+        data.append(arg.c_str(), arg.size() + 1);
+
+    if (data.size() > HELPER_REQUEST_MAX)
+        return TError(EError::InvalidValue, "Helper command is too long");
+
+    struct iovec iov = { &data[0], data.size() };
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * nr_fds);
+
+    auto cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * nr_fds);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * nr_fds);
+
+    auto lock = std::unique_lock<std::mutex>(HelperServerMutex);
+
+    for (int retry = 0; retry < 2; retry++) {
+        if (HelperServerFd < 0 || retry) {
+            error = StartHelperServer();
+            if (error)
+                return error;
+        }
+        if (sendmsg(HelperServerFd, &msg, MSG_NOSIGNAL) == (ssize_t)data.size())
+            return OK;
+        error = TError::System("Cannot send helper request");
+    }
+
+    return error;
+}
+
+/* Without memcg helper runs in helpers cgroup, otherwise it is charged into memcg */
+TError RunCommand(const std::vector<std::string> &command,
+                  const TFile &dir, const TFile &in, const TFile &out,
+                  const TCapabilities &caps, const TCgroup &memcg) {
+    TTraceScope trace("RunCommand", command.empty() ? "" : command[0]);
+    TError error;
+    TFile err;
+    TTask task;
+    TPath path = dir.RealPath();
+
+    if (!command.size())
+        return TError("External command is empty");
+
+    error = err.CreateUnnamed("/tmp", O_APPEND);
+    if (error)
+        return error;
+
+    std::string cmdline;
+
+    for (auto &arg : command)
+        cmdline += arg + " ";
+
+    L_ACT("Call helper: {} in {}", cmdline, path);
+
+    TUnixSocket reply;
+    /* Helper server lives in helpers cgroup */
+    if (config().daemon().helper_server() && !memcg.Subsystem) {
+        error = SendHelperRequest(command, dir, in, out, err, caps, reply);
+        if (error)
+            L_WRN("Cannot use helper server: {}", error);
+    }
+
+    if (reply.GetFd() >= 0 && !error) {
+        THelperReply rep;
+        ssize_t len = recv(reply.GetFd(), &rep, sizeof(rep), 0);
+
+        if (len != sizeof(rep))
+            error = TError(EError::Unknown, "helper server died");
+        else if (rep.Errno)
+            error = TError(EError::Unknown, rep.Errno, "Cannot spawn helper");
+        else if (rep.Status)
+            error = TError(EError::Unknown, FormatExitStatus(rep.Status));
+    } else {
+        error = task.Fork();
+        if (error)
+            return error;
+
+        if (!task.Pid) {
+            TCgroup cg = memcg.Subsystem ? memcg : MemorySubsystem.Cgroup(PORTO_HELPERS_CGROUP);
+            error = cg.Attach(GetPid());
+            if (error)
+                HelperError(err, "Cannot attach to helper cgroup", error);
+            RunHelper(command, dir, in, out, err, caps);
+        }
+
+        error = task.Wait();
+    }
+
+    if (error) {
+        std::string text;
+        TError error2 = err.ReadEnds(text, TError::MAX_LENGTH - 1024);
+        if (error2)
+            text = "Cannot read stderr: " + error2.ToString();
+        error = TError(error, "helper: {} stderr: {}", cmdline, text);
+    }
+
+    return error;
+}
+
+/* With reflink tries clone whole tree first and reports whether it succeeded */
+TError CopyRecursive(const TPath &src, const TPath &dst, bool *reflink,
+                     const TCgroup &memcg) {
     TError error;
     TFile dir;
 
@@ -147,9 +455,21 @@ TError CopyRecursive(const TPath &src, const TPath &dst) {
     if (error)
         return error;
 
-    return RunCommand({ "cp", "--archive", "--force",
+    if (reflink && *reflink) {
+        error = RunCommand({ "cp", "--archive", "--force", "--reflink=always",
+                             "--one-file-system", "--no-target-directory",
+                             src.ToString(), "." }, dir, TFile(), TFile(),
+                           HelperCapabilities, memcg);
+        if (!error)
+            return OK;
+        L("Cannot clone {}, fallback to copy: {}", src, error);
+        *reflink = false;
+    }
+
+    return RunCommand({ "cp", "--archive", "--force", "--reflink=auto",
                         "--one-file-system", "--no-target-directory",
-                        src.ToString(), "." }, dir);
+                        src.ToString(), "." }, dir, TFile(), TFile(),
+                      HelperCapabilities, memcg);
 }
 
 TError ClearRecursive(const TPath &path) {
@@ -7,7 +7,10 @@ TError RunCommand(const std::vector<std::string> &command,
                   const TFile &dir = TFile(),
                   const TFile &input = TFile(),
                   const TFile &output = TFile(),
-                  const TCapabilities &caps = HelperCapabilities);
-TError CopyRecursive(const TPath &src, const TPath &dst);
+                  const TCapabilities &caps = HelperCapabilities,
+                  const TCgroup &memcg = TCgroup());
+int HelperServerMain();
+TError CopyRecursive(const TPath &src, const TPath &dst, bool *reflink = nullptr,
+                     const TCgroup &memcg = TCgroup());
 TError ClearRecursive(const TPath &path);
 TError RemoveRecursive(const TPath &path);
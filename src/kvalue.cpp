@@ -4,10 +4,13 @@
 #include "util/log.hpp"
 
 #include <google/protobuf/io/coded_stream.h>
+#include <unordered_map>
 
 extern "C" {
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 }
 
 TError TKeyValue::Load() {
@@ -25,12 +28,24 @@ TError TKeyValue::Load() {
     while (size) {
         uint32_t len;
 
-        if (!input.ReadVarint32(&len))
-            return TError("KeyValue: corrupted storage");
+        if (!input.ReadVarint32(&len)) {
+            /* Length itself was cut by crash, varint32 takes up to 5 bytes */
+            if (size < 5 && (uint8_t)buf.back() & 0x80) {
+                L_WRN("KeyValue: {} truncated record ignored", Path);
+                break;
+            }
+            return TError("KeyValue: corrupted record length");
+        }
 
         size -= google::protobuf::io::CodedOutputStream::VarintSize32(len);
         size -= len;
 
+        /* Journal record was cut by crash, previous content is consistent */
+        if (size < 0) {
+            L_WRN("KeyValue: {} truncated record ignored", Path);
+            break;
+        }
+
         node.Clear();
         auto limit = input.PushLimit(len);
         if (!node.ParseFromCodedStream(&input))
@@ -39,24 +54,18 @@ TError TKeyValue::Load() {
             return TError("KeyValue: corrupted record");
         input.PopLimit(limit);
 
-        for (const auto &pair: node.pairs())
-            Data[pair.key()] = pair.val();
+        for (const auto &pair: node.pairs()) {
+            if (pair.deleted())
+                Data.erase(pair.key());
+            else
+                Data[pair.key()] = pair.val();
+        }
     }
 
     return OK;
 }
 
-TError TKeyValue::Save() {
-    std::string buf;
-    kv::TNode node;
-    TError error;
-
-    for (const auto &pair: Data) {
-        auto kv = node.add_pairs();
-        kv->set_key(pair.first);
-        kv->set_val(pair.second);
-    }
-
+static TError SerializeRecord(const kv::TNode &node, std::string &buf) {
     uint32_t len = node.ByteSize();
     size_t lenLen = google::protobuf::io::CodedOutputStream::VarintSize32(len);
 
@@ -69,6 +78,24 @@ TError TKeyValue::Save() {
     if (!node.SerializeToArray((uint8_t *)&buf[lenLen], len))
         return TError("KeyValue: cannot serialize");
 
+    return OK;
+}
+
+TError TKeyValue::Save() {
+    std::string buf;
+    kv::TNode node;
+    TError error;
+
+    for (const auto &pair: Data) {
+        auto kv = node.add_pairs();
+        kv->set_key(pair.first);
+        kv->set_val(pair.second);
+    }
+
+    error = SerializeRecord(node, buf);
+    if (error)
+        return error;
+
     TPath tmpPath(Path.ToString() + ".tmp");
     error = tmpPath.Mkfile(0640);
     if (!error)
@@ -84,6 +111,85 @@ TError TKeyValue::Save() {
     return error;
 }
 
+/*
+ * Append record with changed and deleted keys to the node.
+ * Node is rewritten when journal outgrows compacted content.
+ * Older versions do not know deleted keys: before keyvalue_format 2
+ * deletion rewrites node.
+ */
+TError TKeyValue::Save(TKeyValueState &state) {
+    std::string buf;
+    kv::TNode node;
+    TError error;
+
+    if (!state.Valid)
+        goto compact;
+
+    for (const auto &pair: Data) {
+        auto it = state.Data.find(pair.first);
+        if (it == state.Data.end() || it->second != pair.second) {
+            auto kv = node.add_pairs();
+            kv->set_key(pair.first);
+            kv->set_val(pair.second);
+        }
+    }
+
+    for (const auto &pair: state.Data) {
+        if (!Data.count(pair.first)) {
+            if (config().keyvalue_format() < 2)
+                goto compact;
+            auto kv = node.add_pairs();
+            kv->set_key(pair.first);
+            kv->set_val("");
+            kv->set_deleted(true);
+        }
+    }
+
+    if (!node.pairs_size())
+        return OK;
+
+    error = SerializeRecord(node, buf);
+    if (error || state.Journal + buf.size() > state.Size ||
+            state.Size + state.Journal + buf.size() > config().keyvalue_limit())
+        goto compact;
+
+    {
+        TFile file;
+
+        error = file.OpenAppend(Path);
+        if (!error)
+            error = file.WriteAll(buf);
+        if (error) {
+            L_WRN("KeyValue: cannot append {}: {}", Path, error);
+            goto compact;
+        }
+    }
+
+    state.Journal += buf.size();
+    state.Data = Data;
+    return OK;
+
+compact:
+    state.Valid = false;
+
+    error = Save();
+    if (error)
+        return error;
+
+    node.Clear();
+    for (const auto &pair: Data) {
+        auto kv = node.add_pairs();
+        kv->set_key(pair.first);
+        kv->set_val(pair.second);
+    }
+
+    state.Data = Data;
+    state.Size = node.ByteSize();
+    state.Journal = 0;
+    state.Valid = true;
+    return OK;
+}
+
 TError TKeyValue::Mount(const TPath &root) {
     TError error;
     TMount mount;
@@ -121,13 +227,163 @@ TError TKeyValue::Mount(const TPath &root) {
     return error;
 }
 
+/*
+ * Index next to kvalue mount holds file name, inode and name of nodes.
+ * It is written at shutdown and consumed at start: restore builds tree
+ * of containers without reading nodes and loads them lazily. Nodes
+ * rewritten in between have another inode and are read as usual.
+ */
+
+struct TKeyValueIndexHeader {
+    char Magic[8];
+    uint32_t Version;
+    uint32_t Count;
+};
+
+struct TKeyValueIndexRecord {
+    uint64_t Inode;
+    uint32_t FileLen;
+    uint32_t NameLen;
+};
+
+static const char KEYVALUE_INDEX_MAGIC[8] = { 'P', 'O', 'R', 'T', 'O', 'K', 'V', 'I' };
+static constexpr uint32_t KEYVALUE_INDEX_VERSION = 1;
+
+typedef std::unordered_map<std::string, std::pair<uint64_t, std::string>> TKeyValueIndex;
+
+static TPath IndexPath(const TPath &root) {
+    return TPath(root.ToString() + ".index");
+}
+
+static TError LoadIndex(const TPath &root, TKeyValueIndex &index) {
+    TKeyValueIndexHeader hdr;
+    struct stat st;
+    TError error;
+    TFile file;
+
+    error = file.OpenRead(IndexPath(root));
+    if (error)
+        return error;
+
+    error = file.Stat(st);
+    if (error)
+        return error;
+
+    size_t size = st.st_size;
+    if (size < sizeof(hdr))
+        return TError("KeyValue: index too short");
+
+    void *map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file.Fd, 0);
+    if (map == MAP_FAILED)
+        return TError::System("mmap");
+
+    const char *ptr = (const char *)map, *end = ptr + size;
+
+    memcpy(&hdr, ptr, sizeof(hdr));
+    ptr += sizeof(hdr);
+
+    if (memcmp(hdr.Magic, KEYVALUE_INDEX_MAGIC, sizeof(hdr.Magic)) ||
+            hdr.Version != KEYVALUE_INDEX_VERSION)
+        error = TError("KeyValue: unknown index format");
+
+    index.reserve(hdr.Count);
+
+    for (uint32_t i = 0; !error && i < hdr.Count; i++) {
+        TKeyValueIndexRecord rec;
+
+        if ((size_t)(end - ptr) < sizeof(rec)) {
+            error = TError("KeyValue: index truncated");
+            break;
+        }
+        memcpy(&rec, ptr, sizeof(rec));
+        ptr += sizeof(rec);
+
+        if ((size_t)(end - ptr) < (size_t)rec.FileLen + rec.NameLen) {
+            error = TError("KeyValue: index truncated");
+            break;
+        }
+        index[std::string(ptr, rec.FileLen)] =
+            std::make_pair(rec.Inode, std::string(ptr + rec.FileLen, rec.NameLen));
+        ptr += rec.FileLen + rec.NameLen;
+    }
+
+    munmap(map, size);
+
+    if (error)
+        index.clear();
+
+    return error;
+}
+
+TError TKeyValue::SaveIndex(const TPath &root, const std::map<std::string, std::string> &names) {
+    TKeyValueIndexHeader hdr;
+    std::string buf;
+    TError error;
+
+    memcpy(hdr.Magic, KEYVALUE_INDEX_MAGIC, sizeof(hdr.Magic));
+    hdr.Version = KEYVALUE_INDEX_VERSION;
+    hdr.Count = 0;
+    buf.append((const char *)&hdr, sizeof(hdr));
+
+    for (auto &it: names) {
+        struct stat st;
+
+        if ((root / it.first).StatStrict(st))
+            continue;
+
+        TKeyValueIndexRecord rec = { (uint64_t)st.st_ino,
+                                     (uint32_t)it.first.size(),
+                                     (uint32_t)it.second.size() };
+        buf.append((const char *)&rec, sizeof(rec));
+        buf.append(it.first);
+        buf.append(it.second);
+        hdr.Count++;
+    }
+
+    memcpy(&buf[0], &hdr, sizeof(hdr));
+
+    TPath tmpPath(IndexPath(root).ToString() + ".tmp");
+    error = tmpPath.Mkfile(0640);
+    if (!error)
+        error = tmpPath.Chown(RootUser, PortoGroup);
+    if (!error)
+        error = tmpPath.WriteAll(buf);
+    if (!error)
+        error = tmpPath.Rename(IndexPath(root));
+
+    if (error)
+        (void)tmpPath.Unlink();
+
+    return error;
+}
+
 TError TKeyValue::ListAll(const TPath &root, std::list<TKeyValue> &nodes) {
     std::vector<std::string> names;
+    TKeyValueIndex index;
+
+    if (IndexPath(root).Exists()) {
+        if (config().keyvalue_index()) {
+            TError error = LoadIndex(root, index);
+            if (error)
+                L_WRN("Cannot load index of {}: {}", root, error);
+        }
+        /* Index is stale once nodes are changed */
+        (void)IndexPath(root).Unlink();
+    }
+
     TError error = root.ReadDirectory(names);
     if (!error) {
         for (auto &name : names) {
-            if (!StringEndsWith(name, ".tmp"))
-                nodes.emplace_back(root / name);
+            if (StringEndsWith(name, ".tmp"))
+                continue;
+            nodes.emplace_back(root / name);
+            auto it = index.find(name);
+            struct stat st;
+            if (it != index.end() && !nodes.back().Path.StatStrict(st) &&
+                    st.st_ino == it->second.first) {
+                nodes.back().Name = it->second.second;
+                nodes.back().Indexed = true;
+            }
         }
     }
     return error;
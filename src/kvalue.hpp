@@ -6,12 +6,21 @@
 #include "common.hpp"
 #include "util/path.hpp"
 
+/* Content of node on disk, allows appending only changed keys */
+struct TKeyValueState {
+    std::map<std::string, std::string> Data;
+    size_t Size = 0;        /* compacted node */
+    size_t Journal = 0;     /* appended since last compaction */
+    bool Valid = false;
+};
+
 class TKeyValue {
 public:
     TPath Path;
     int Id = 0;
     std::string Name;
     std::map<std::string, std::string> Data;
+    bool Indexed = false;   /* Name is taken from index, Data is not loaded yet */
 
     TKeyValue(const TPath &path) : Path(path) { }
 
@@ -38,8 +47,10 @@ public:
 
     TError Load();
     TError Save();
+    TError Save(TKeyValueState &state);
 
     static TError Mount(const TPath &root);
     static TError ListAll(const TPath &root, std::list<TKeyValue> &nodes);
+    static TError SaveIndex(const TPath &root, const std::map<std::string, std::string> &names);
     static void DumpAll(const TPath &root);
 };
@@ -0,0 +1,257 @@
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <unordered_map>
+
+#include "metrics.hpp"
+#include "container.hpp"
+#include "property.hpp"
+#include "client.hpp"
+#include "config.hpp"
+#include "util/log.hpp"
+#include "util/string.hpp"
+#include "util/unix.hpp"
+#include "util/cred.hpp"
+
+extern "C" {
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+}
+
+/* Counters served from container stat cache */
+static const struct {
+    const char *Property;
+    bool Counter;
+} MetricsContainerStats[] = {
+    { P_CPU_USAGE, true },
+    { P_CPU_SYSTEM, true },
+    { P_CPU_WAIT, true },
+    { P_CPU_THROTTLED, true },
+    { P_MEMORY_USAGE, false },
+    { P_ANON_USAGE, false },
+    { P_CACHE_USAGE, false },
+    { P_MAX_RSS, false },
+    { P_MINOR_FAULTS, true },
+    { P_MAJOR_FAULTS, true },
+    { P_OOM_KILLS, true },
+    { P_PROCESS_COUNT, false },
+    { P_THREAD_COUNT, false },
+};
+
+constexpr int METRICS_READ_TIMEOUT_MS = 200;
+constexpr int METRICS_WRITE_TIMEOUT_S = 5;
+
+static std::thread MetricsThread;
+static std::atomic<bool> MetricsRunning(false);
+static int MetricsSock = -1;
+
+static TClient MetricsClient("<metrics>");
+
+/* Label set for each container is formatted once */
+static std::unordered_map<std::string, std::string> MetricsLabels;
+
+static std::string MetricName(const std::string &name) {
+    std::string metric = name;
+    for (auto &c: metric)
+        if (!isalnum((unsigned char)c) && c != '_')
+            c = '_';
+    return metric;
+}
+
+static std::string LabelValue(const std::string &value) {
+    std::string label = "\"";
+    for (auto c: value) {
+        if (c == '"' || c == '\\')
+            label += '\\';
+        if (c == '\n')
+            label += "\\n";
+        else
+            label += c;
+    }
+    return label + "\"";
+}
+
+static const std::string &MetricLabels(const std::string &name) {
+    auto it = MetricsLabels.find(name);
+    if (it != MetricsLabels.end())
+        return it->second;
+
+    std::string label = "{container=" + LabelValue(name) + "}";
+    return MetricsLabels.emplace(name, label).first->second;
+}
+
+void GenerateMetrics(std::string &out) {
+    constexpr int nr_stats = sizeof(MetricsContainerStats) / sizeof(MetricsContainerStats[0]);
+    std::vector<std::string> samples(nr_stats);
+    std::vector<TPropertyName> props;
+    std::unordered_map<std::string, std::string> labels;
+    TUintMap stat;
+
+    out.clear();
+
+    for (int i = 0; i < nr_stats; i++)
+        props.emplace_back(MetricsContainerStats[i].Property);
+
+    GetPortoStat(*RootContainer, stat);
+    for (auto &it: stat) {
+        /* Client names are shown only to superuser, socket is for porto group */
+        if (StringStartsWith(it.first, "client_cpu_us_") ||
+                StringStartsWith(it.first, "client_requests_"))
+            continue;
+        auto name = "porto_" + MetricName(it.first);
+        out += fmt::format("# TYPE {} unknown\n{} {}\n", name, name, it.second);
+    }
+
+    for (auto &it: *ContainersIndex()) {
+        auto &ct = it.second;
+        auto &label = MetricLabels(ct->Name);
+
+        labels[ct->Name] = label;
+
+        ct->LockStateRead();
+        if (ct->State != EContainerState::DESTROYED) {
+            for (int i = 0; i < nr_stats; i++) {
+                auto &desc = MetricsContainerStats[i];
+                std::string value;
+                uint64_t timestamp, number;
+
+                if (ct->GetCachedProperty(props[i], value, timestamp) ||
+                        StringToUint64(value, number))
+                    continue;
+
+                samples[i] += fmt::format("porto_container_{}{}{} {}\n", desc.Property,
+                                          desc.Counter ? "_total" : "", label, number);
+            }
+        }
+        ct->UnlockState();
+    }
+
+    /* Forget destroyed containers */
+    MetricsLabels.swap(labels);
+
+    for (int i = 0; i < nr_stats; i++) {
+        auto &desc = MetricsContainerStats[i];
+        out += fmt::format("# TYPE porto_container_{} {}\n", desc.Property,
+                           desc.Counter ? "counter" : "gauge");
+        out += samples[i];
+    }
+
+    out += "# EOF\n";
+}
+
+static void MetricsServe(int fd) {
+    struct timeval tv = { METRICS_WRITE_TIMEOUT_S, 0 };
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    std::string body, rsp;
+    char buf[4096];
+    bool http = false;
+
+    (void)setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    /* HTTP request from scraper, or nothing from plain socket reader */
+    if (poll(&pfd, 1, METRICS_READ_TIMEOUT_MS) == 1) {
+        ssize_t len = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+        http = len >= 4 && !strncmp(buf, "GET ", 4);
+    }
+
+    MetricsClient.StartRequest();
+    GenerateMetrics(body);
+    MetricsClient.FinishRequest();
+
+    if (http)
+        rsp = fmt::format("HTTP/1.0 200 OK\r\n"
+                          "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+                          "Content-Length: {}\r\n\r\n", body.size());
+    rsp += body;
+
+    for (size_t off = 0; off < rsp.size(); ) {
+        ssize_t len = send(fd, rsp.data() + off, rsp.size() - off, MSG_NOSIGNAL);
+        if (len <= 0) {
+            if (len < 0 && errno == EINTR)
+                continue;
+            L_VERBOSE("Cannot send metrics: {}", TError::System("send"));
+            break;
+        }
+        off += len;
+    }
+}
+
+static void MetricsLoop() {
+    struct pollfd pfd = { MetricsSock, POLLIN, 0 };
+
+    SetProcessName("portod-MT");
+
+    while (MetricsRunning) {
+        if (poll(&pfd, 1, 1000) != 1)
+            continue;
+
+        int fd = accept4(MetricsSock, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0)
+            continue;
+
+        MetricsServe(fd);
+        close(fd);
+    }
+}
+
+void StartMetrics() {
+    TPath path = config().daemon().metrics_socket();
+    struct sockaddr_un addr;
+    TError error;
+
+    if (path.IsEmpty())
+        return;
+
+    if (path.ToString().size() >= sizeof(addr.sun_path)) {
+        L_ERR("Metrics socket path too long: {}", path);
+        return;
+    }
+
+    MetricsSock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (MetricsSock < 0) {
+        L_ERR("Cannot start metrics: {}", TError::System("socket"));
+        return;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    (void)path.Unlink();
+
+    if (bind(MetricsSock, (struct sockaddr *)&addr, sizeof(addr)))
+        error = TError::System("bind");
+    if (!error)
+        error = path.Chown(RootUser, PortoGroup);
+    if (!error)
+        error = path.Chmod(0660);
+    if (!error && listen(MetricsSock, 16))
+        error = TError::System("listen");
+    if (error) {
+        L_ERR("Cannot start metrics at {}: {}", path, error);
+        close(MetricsSock);
+        MetricsSock = -1;
+        return;
+    }
+
+    MetricsClient.ClientContainer = RootContainer;
+
+    MetricsRunning = true;
+    MetricsThread = std::thread(MetricsLoop);
+}
+
+void StopMetrics() {
+    if (!MetricsRunning)
+        return;
+
+    MetricsRunning = false;
+    MetricsThread.join();
+
+    close(MetricsSock);
+    MetricsSock = -1;
+
+    (void)TPath(config().daemon().metrics_socket()).Unlink();
+    MetricsClient.ClientContainer = nullptr;
+}
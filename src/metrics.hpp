@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+
+/*
+ * OpenMetrics text exposition of porto statistics and per-container
+ * counters on separate unix socket, served by own thread.
+ */
+
+void StartMetrics();
+void StopMetrics();
+
+/* One scrape: porto_stat and cached container counters */
+void GenerateMetrics(std::string &out);
@@ -8,6 +8,7 @@
 #include "config.hpp"
 #include "client.hpp"
 #include "helpers.hpp"
+#include "trace.hpp"
 #include "util/log.hpp"
 #include "util/string.hpp"
 #include "util/crc32.hpp"
@@ -23,6 +24,7 @@ extern "C" {
 #include <netlink/route/tc.h>
 #include <netlink/route/addr.h>
 #include <netlink/route/class.h>
+#include <netlink/route/qdisc.h>
 #include <netlink/route/neighbour.h>
 #include <netlink/route/qdisc/htb.h>
 }
@@ -31,6 +33,7 @@ static std::shared_ptr<TNetwork> HostNetwork;
 
 std::mutex TNetwork::NetworksMutex;
 std::mutex TNetwork::NetStateMutex;
+TLockStat NetLockStat;
 int TNetwork::DefaultTos = 0;
 
 std::unordered_map<ino_t, std::shared_ptr<TNetwork>> TNetwork::NetworksIndex;
@@ -41,6 +44,7 @@ static std::thread NetThread;
 static std::condition_variable NetThreadCv;
 static uint64_t NetWatchdogPeriod;
 static uint64_t NetProxyNeighbourPeriod;
+static uint64_t NetTcpStatPeriod;
 
 static std::string ResolvConfCurrent;
 static std::string ResolvConfPrev;
@@ -51,6 +55,10 @@ static std::vector<int> UnmanagedGroups;
 static std::map<int, std::string> DeviceGroups;
 static int VirtualDeviceGroup = 0;
 
+/* Pre-created L3 veth pairs: host side, pooled side. Under HostNetwork lock. */
+static std::vector<std::pair<std::string, std::string>> L3Pool;
+static bool L3PoolCleaned = false;
+
 static uint64_t CsWeight[NR_TC_CLASSES];
 static uint64_t CsTotalWeight;
 static uint64_t CsLimit[NR_TC_CLASSES];
@@ -189,6 +197,9 @@ TNetDevice::TNetDevice(struct rtnl_link *link) {
     Uplink = false;
     Prepared = false;
     Missing = false;
+
+    MultiQueue = GetConfig(DeviceQdisc) == "mq";
+    TxQueues = rtnl_link_get_num_tx_queues(link);
 }
 
 uint64_t TNetDevice::GetConfig(const TUintMap &cfg, uint64_t def, int cs) const {
@@ -312,6 +323,8 @@ void TNetwork::InitializeConfig() {
 
     NetProxyNeighbourPeriod = config().network().proxy_ndp_watchdog_ms();
 
+    NetTcpStatPeriod = config().network().tcp_stat_watchdog_ms();
+
     /* Load default net sysctl from host config */
     for (const auto &p: NetSysctls) {
         auto &key = p.first;
@@ -432,7 +445,7 @@ TError TNetwork::New(TNamespaceFd &netns, std::shared_ptr<TNetwork> &net) {
 
     net = std::make_shared<TNetwork>();
 
-    error = net->Nl->Connect();
+    error = net->Nl->Connect(true);
     if (error) {
         netns.Close();
         net = nullptr;
@@ -481,7 +494,7 @@ TError TNetwork::Open(const TPath &path, TNamespaceFd &netns,
 
     net = std::make_shared<TNetwork>();
 
-    error = net->Nl->Connect();
+    error = net->Nl->Connect(true);
     if (error) {
         netns.Close();
         net = nullptr;
@@ -671,6 +684,14 @@ TError TNetwork::SetupQueue(TNetDevice &dev, bool force) {
     //             +- Container + CSn:0 container CSn leaf qdisc (fq_codel)
     //
 
+    //
+    // device_qdisc "mq" has no shaping and keeps tx queues independent
+    //
+    // 1:0 qdisc (mq)
+    //  |
+    //  +- 1:1..N tx queue, leaf qdisc (default_qdisc)
+    //
+
     L_NET("Setup queue for network {} device {}:{}", NetName, dev.Index, dev.Name);
 
     TNlQdisc qdisc(dev.Index, TC_H_ROOT, TC_HANDLE(ROOT_TC_MAJOR, 0));
@@ -688,6 +709,22 @@ TError TNetwork::SetupQueue(TNetDevice &dev, bool force) {
         dev.Qdisc = qdisc.Kind;
     }
 
+    if (dev.MultiQueue) {
+        for (int queue = 1; queue <= dev.TxQueues; queue++) {
+            TNlQdisc leaf(dev.Index, TC_HANDLE(ROOT_TC_MAJOR, queue), 0);
+            leaf.Kind = dev.GetConfig(DefaultQdisc);
+            leaf.Limit = dev.GetConfig(DefaultQdiscLimit);
+            leaf.Quantum = dev.GetConfig(DefaultQdiscQuantum);
+
+            error = leaf.Create(*Nl);
+            if (error) {
+                L_ERR("Cannot create tx queue {} qdisc: {}", queue, error);
+                return error;
+            }
+        }
+        return OK;
+    }
+
     TNlClass cls;
 
     cls.Kind = dev.GetConfig(DeviceQdisc);
@@ -758,6 +795,7 @@ void TNetwork::SetDeviceOwner(const std::string &name, int owner) {
 }
 
 TError TNetwork::SyncDevices() {
+    TTraceScope trace("NetworkSyncDevices", NetName);
     struct nl_cache *cache;
     TError error;
     int ret;
@@ -998,8 +1036,9 @@ TError TNetwork::GetL3Gate(TNetDeviceConfig &dev) {
 }
 
 TError TNetwork::SetupProxyNeighbour(const std::vector <TNlAddr> &ips,
-                                     const std::string &master) {
+                                     const std::string &master, bool rollback) {
     struct nl_cache *cache;
+    TNlBatch batch(Nl);
     TError error;
     int ret;
 
@@ -1007,13 +1046,14 @@ TError TNetwork::SetupProxyNeighbour(const std::vector <TNlAddr> &ips,
         for (auto &dev : Devices) {
             if (StringMatch(dev.Name, master)) {
                 for (auto &ip: ips) {
-                    error = Nl->ProxyNeighbour(dev.Index, ip, true);
+                    error = Nl->ProxyNeighbour(dev.Index, ip, true, &batch);
                     if (error)
                         goto err;
                 }
             }
         }
-        return OK;
+        error = batch.Commit();
+        goto err;
     }
 
     ret = rtnl_addr_alloc_cache(GetSock(), &cache);
@@ -1038,25 +1078,35 @@ TError TNetwork::SetupProxyNeighbour(const std::vector <TNlAddr> &ips,
 
             /* Add proxy entry only if address is directly reachable */
             if (reachable) {
-                error = Nl->ProxyNeighbour(dev.Index, ip, true);
+                error = Nl->ProxyNeighbour(dev.Index, ip, true, &batch);
                 if (error)
                     goto err_addr;
             }
         }
     }
 
+    error = batch.Commit();
+
 err_addr:
     nl_cache_free(cache);
 
 err:
-    if (error)
+    if (error && rollback) {
+        TNlBatch cleanup(Nl);
         for (auto &dev: Devices)
             for (auto &ip: ips)
-                Nl->ProxyNeighbour(dev.Index, ip, false);
+                (void)Nl->ProxyNeighbour(dev.Index, ip, false, &cleanup);
+        (void)cleanup.Commit();
+    }
 
     return error;
 }
 
+static std::string NeighbourKey(const TNlAddr &addr) {
+    return std::to_string(addr.Family()) + ":" +
+        std::string((const char *)addr.Binary(), addr.Length());
+}
+
 TError TNetwork::AddProxyNeightbour(const std::vector<TNlAddr> &ips,
                                     const std::string &master) {
     TError error;
@@ -1074,7 +1124,7 @@ TError TNetwork::AddProxyNeightbour(const std::vector<TNlAddr> &ips,
             return error;
 
         for (auto ip: addrs)
-            Neighbours.emplace_back(TNetProxyNeighbour{ip, master});
+            Neighbours[NeighbourKey(ip)] = TNetProxyNeighbour{ip, master};
     }
     return error;
 }
@@ -1095,7 +1145,7 @@ void TNetwork::DelProxyNeightbour(const std::vector<TNlAddr> &ips) {
                 if (error)
                     L_ERR("Cannot remove proxy neighbour: {}", error);
             }
-            Neighbours.remove_if([&](TNetProxyNeighbour &np) { return ip.IsEqual(np.Ip); });
+            Neighbours.erase(NeighbourKey(ip));
         }
     }
 }
@@ -1124,29 +1174,34 @@ void TNetwork::RepairProxyNeightbour() {
         return;
     }
 
-    for (auto &nb: Neighbours) {
-        bool found = false;
-
-        for (auto obj = nl_cache_get_first(cache); obj;
-                obj = nl_cache_get_next(obj)) {
-            auto neigh = (struct rtnl_neigh *)obj;
-            auto dst = rtnl_neigh_get_dst(neigh);
+    std::unordered_set<std::string> present;
 
-            if (dst && !nl_addr_cmp(nb.Ip.Addr, dst) &&
-                    (rtnl_neigh_get_flags(neigh) & NTF_PROXY)) {
-                found = true;
-                break;
-            }
-        }
+    for (auto obj = nl_cache_get_first(cache); obj;
+            obj = nl_cache_get_next(obj)) {
+        auto neigh = (struct rtnl_neigh *)obj;
+        auto dst = rtnl_neigh_get_dst(neigh);
 
-        if (!found) {
-            error = SetupProxyNeighbour({nb.Ip}, nb.Master);
-            if (error)
-                L_ERR("Cannot setup proxy neighbour: {}", error);
+        if (dst && (rtnl_neigh_get_flags(neigh) & NTF_PROXY)) {
+            TNlAddr addr(dst);
+            present.insert(NeighbourKey(addr));
         }
     }
 
     nl_cache_free(cache);
+
+    /* Re-add only missing entries, one batch per master */
+    std::map<std::string, std::vector<TNlAddr>> missing;
+
+    for (auto &it: Neighbours)
+        if (!present.count(it.first))
+            missing[it.second.Master].push_back(it.second.Ip);
+
+    for (auto &it: missing) {
+        L_NET("Restore {} proxy neighbours master={}", it.second.size(), it.first);
+        error = SetupProxyNeighbour(it.second, it.first, false);
+        if (error)
+            L_ERR("Cannot setup proxy neighbour: {}", error);
+    }
 }
 
 TError TNetwork::GetNatAddress(std::vector<TNlAddr> &addrs) {
@@ -1213,7 +1268,12 @@ std::string TNetwork::MatchDevice(const std::string &pattern) {
     return pattern;
 }
 
-TError TNetwork::SetupClass(TNetDevice &dev, TNetClass &cfg, int cs) {
+static std::string ClassSignature(const TNlClass &cls) {
+    return fmt::format("{} {:x}:{:x} {} {} {} {} {} {}", cls.Kind, cls.Parent, cls.Handle,
+                       cls.Rate, cls.defRate, cls.Ceil, cls.RateBurst, cls.CeilBurst, cls.Quantum);
+}
+
+TError TNetwork::SetupClass(TNetDevice &dev, TNetClass &cfg, int cs, bool cached) {
     TError error;
 
     PORTO_LOCKED(NetMutex);
@@ -1244,32 +1304,22 @@ TError TNetwork::SetupClass(TNetDevice &dev, TNetClass &cfg, int cs) {
     } else
         cls.defRate = dev.GetConfig(ContainerRate, 0, cs);
 
-    if (cfg.MetaHandle != cfg.BaseHandle) {
-        L_NET_VERBOSE("Setup CS{} meta class {:x} {} {}:{}", cs, cls.Handle, NetName, dev.Index, dev.Name);
-        error = cls.Create(*Nl);
-        if (error) {
-            (void)cls.Delete(*Nl);
-            error = cls.Create(*Nl);
-        }
-        if (error)
-            return TError(error, "tc class");
-    }
-
+    TNlClass leaf = cls;
     TNlQdisc ctq(dev.Index, cfg.LeafHandle + cs, TC_HANDLE(TC_H_MIN(cfg.LeafHandle + cs), 0));
 
-    cls.Parent = cfg.MetaHandle + cs;
-    cls.Handle = cfg.LeafHandle + cs;
+    leaf.Parent = cfg.MetaHandle + cs;
+    leaf.Handle = cfg.LeafHandle + cs;
 
     if (cfg.LeafHandle == TC_HANDLE(ROOT_TC_MAJOR, ROOT_TC_MINOR) ||
             cfg.LeafHandle == TC_HANDLE(ROOT_TC_MAJOR, DEFAULT_TC_MINOR)) {
-        cls.Rate = dev.GetConfig(DefaultClassRate, 0, cs);
-        cls.Ceil = dev.GetConfig(DefaultClassCeil, 0, cs);
-        cls.defRate = cls.Rate;
+        leaf.Rate = dev.GetConfig(DefaultClassRate, 0, cs);
+        leaf.Ceil = dev.GetConfig(DefaultClassCeil, 0, cs);
+        leaf.defRate = leaf.Rate;
 
         ctq.Kind = dev.GetConfig(DefaultQdisc, "", cs);
         ctq.Limit = dev.GetConfig(DefaultQdiscLimit, 0, cs);
         ctq.Quantum = dev.GetConfig(DefaultQdiscQuantum, dev.MTU * 2, cs);
-    } else if (cls.Ceil == 1) {
+    } else if (leaf.Ceil == 1) {
         ctq.Kind = "blackhole";
     } else {
         ctq.Kind = dev.GetConfig(ContainerQdisc, "", cs);
@@ -1277,9 +1327,44 @@ TError TNetwork::SetupClass(TNetDevice &dev, TNetClass &cfg, int cs) {
         ctq.Quantum = dev.GetConfig(ContainerQdiscQuantum, dev.MTU * 2, cs);
     }
 
-    L_NET_VERBOSE("Setup CS{} leaf class {:x} {} {}:{}", cs, cls.Handle, NetName, dev.Index, dev.Name);
+    /* Skip netlink round trips if nothing changed since last setup */
+    std::string signature = fmt::format("{} {}", dev.Name, ClassSignature(leaf));
+    if (cfg.MetaHandle != cfg.BaseHandle)
+        signature += " " + ClassSignature(cls);
+    signature += fmt::format(" {} {} {}", ctq.Kind, ctq.Limit, ctq.Quantum);
 
-    error = cls.Create(*Nl);
+    uint64_t key = (uint64_t)dev.Index << 8 | cs;
+    auto applied = cfg.Applied.find(key);
+
+    if (cached && applied != cfg.Applied.end() && applied->second == signature &&
+            !dev.ClassCache)
+        return OK;
+
+    /* Reconcile with kernel state dumped by repair */
+    if (cached && dev.ClassCache && QdiscCache &&
+            (applied == cfg.Applied.end() || applied->second == signature) &&
+            leaf.Matches(dev.ClassCache) && ctq.Matches(QdiscCache) &&
+            (cfg.MetaHandle == cfg.BaseHandle || cls.Matches(dev.ClassCache))) {
+        cfg.Applied[key] = signature;
+        return OK;
+    }
+
+    cfg.Applied.erase(key);
+
+    if (cfg.MetaHandle != cfg.BaseHandle) {
+        L_NET_VERBOSE("Setup CS{} meta class {:x} {} {}:{}", cs, cls.Handle, NetName, dev.Index, dev.Name);
+        error = cls.Create(*Nl);
+        if (error) {
+            (void)cls.Delete(*Nl);
+            error = cls.Create(*Nl);
+        }
+        if (error)
+            return TError(error, "tc class");
+    }
+
+    L_NET_VERBOSE("Setup CS{} leaf class {:x} {} {}:{}", cs, leaf.Handle, NetName, dev.Index, dev.Name);
+
+    error = leaf.Create(*Nl);
     if (error)
         return TError(error, "leaf tc class");
 
@@ -1291,6 +1376,8 @@ TError TNetwork::SetupClass(TNetDevice &dev, TNetClass &cfg, int cs) {
     if (error)
         return TError(error, "leaf tc qdisc");
 
+    cfg.Applied[key] = signature;
+
     return OK;
 }
 
@@ -1305,6 +1392,8 @@ TError TNetwork::DeleteClass(TNetDevice &dev, TNetClass &cfg, int cs) {
     if (cfg.LeafHandle == cfg.BaseHandle)
         return OK; /* Fold */
 
+    cfg.Applied.erase((uint64_t)dev.Index << 8 | cs);
+
     TNlQdisc ctq(dev.Index, cfg.LeafHandle + cs,
                  TC_HANDLE(TC_H_MIN(cfg.LeafHandle + cs), 0));
     (void)ctq.Delete(*Nl);
@@ -1328,11 +1417,11 @@ TError TNetwork::TrySetupClasses(TNetClass &cls) {
     TError error;
 
     for (auto &dev: Devices) {
-        if (!dev.Managed || !dev.Prepared)
+        if (!dev.Managed || !dev.Prepared || dev.MultiQueue)
             continue;
 
         for (int cs = 0; cs < NR_TC_CLASSES; cs++) {
-            error = SetupClass(dev, cls, cs);
+            error = SetupClass(dev, cls, cs, true);
             if (error)
                 return error;
         }
@@ -1345,6 +1434,7 @@ TError TNetwork::TrySetupClasses(TNetClass &cls) {
 }
 
 TError TNetwork::SetupClasses(TNetClass &cls) {
+    TTraceScope trace("NetworkSetupClasses", NetName);
     TError error;
 
     if (this != HostNetwork.get()) {
@@ -1434,7 +1524,7 @@ TError TNetwork::Reconnect() {
     TError error;
 
     if (this == HostNetwork.get())
-        return Nl->Connect();
+        return Nl->Connect(true);
 
     error = cur_ns.Open("/proc/thread-self/ns/net");
     if (error)
@@ -1448,7 +1538,7 @@ TError TNetwork::Reconnect() {
         if (!error)
             error = netns.SetNs(CLONE_NEWNET);
         if (!error)
-            error = Nl->Connect();
+            error = Nl->Connect(true);
         if (!error)
             break;
     }
@@ -1460,6 +1550,7 @@ TError TNetwork::Reconnect() {
 }
 
 TError TNetwork::RepairLocked() {
+    TTraceScope trace("NetworkRepair", NetName);
     TError error;
 
     L_NET("Repair network {}", NetName);
@@ -1482,6 +1573,9 @@ TError TNetwork::RepairLocked() {
         goto out;
 
 retry:
+    if (force || rtnl_qdisc_alloc_cache(GetSock(), &QdiscCache))
+        QdiscCache = nullptr;
+
     for (auto &dev: Devices) {
         if (dev.Uplink)
             SetupPolice(dev);
@@ -1496,32 +1590,52 @@ retry:
             continue;
         }
 
+        /* Without queue rebuild change only classes which differ from kernel */
+        bool reconcile = false;
+
         if (!dev.Prepared || force) {
             error = SetupQueue(dev, force);
             if (error)
                 break;
             dev.Prepared = true;
-        }
+        } else if (dev.MultiQueue) {
+            /* Leaf qdiscs are not tracked, nothing to reconcile */
+        } else if (QdiscCache && !rtnl_class_alloc_cache(GetSock(), dev.Index, &dev.ClassCache)) {
+            reconcile = true;
+        } else
+            dev.ClassCache = nullptr;
+
+        if (dev.MultiQueue)
+            continue;
 
         for (int cs = 0; cs < NR_TC_CLASSES; cs++) {
-            error = SetupClass(dev, DefaultClass, cs);
+            error = SetupClass(dev, DefaultClass, cs, reconcile);
             if (error)
                 break;
         }
 
         for (auto cls: NetClasses) {
+            if (error)
+                break;
             for (int cs = 0; cs < NR_TC_CLASSES; cs++) {
-                error = SetupClass(dev, *cls, cs);
+                error = SetupClass(dev, *cls, cs, reconcile);
                 if (error)
                     break;
             }
-            if (error)
-                break;
         }
+
+        if (dev.ClassCache)
+            nl_cache_free(dev.ClassCache);
+        dev.ClassCache = nullptr;
+
         if (error)
             break;
     }
 
+    if (QdiscCache)
+        nl_cache_free(QdiscCache);
+    QdiscCache = nullptr;
+
     if (error) {
         if (!force) {
             force = true;
@@ -1587,6 +1701,44 @@ TError TNetwork::SyncResolvConf() {
     return OK;
 }
 
+/* Keep network.l3_pool_size veth pairs ready for ConfigureL3 */
+void TNetwork::RefillL3Pool() {
+    size_t size = config().network().l3_pool_size();
+    TError error;
+
+    PORTO_LOCKED(NetMutex);
+
+    if (!L3PoolCleaned) {
+        struct nl_cache *cache;
+
+        /* Pooled pairs left by previous instance */
+        if (!rtnl_link_alloc_cache(GetSock(), AF_UNSPEC, &cache)) {
+            for (auto obj = nl_cache_get_first(cache); obj; obj = nl_cache_get_next(obj)) {
+                TNlLink link(Nl, (struct rtnl_link *)obj);
+                if (StringStartsWith(link.GetName(), "L3-p"))
+                    (void)link.Remove();
+            }
+            nl_cache_free(cache);
+        }
+        L3PoolCleaned = true;
+    }
+
+    while (L3Pool.size() < size) {
+        std::string peerName = NewDeviceName("L3-");
+        std::string poolName = NewDeviceName("L3-p");
+        TNlLink peer(Nl, peerName);
+
+        error = peer.AddVeth(poolName, "", config().network().l3_default_mtu(),
+                             VirtualDeviceGroup, -1);
+        if (error) {
+            L_WRN("Cannot refill L3 pool: {}", error);
+            break;
+        }
+
+        L3Pool.emplace_back(peerName, poolName);
+    }
+}
+
 void TNetwork::NetWatchdog() {
     auto LastProxyNeighbour = GetCurrentTimeMs();
     auto LastResolvConf = LastProxyNeighbour;
@@ -1594,6 +1746,7 @@ void TNetwork::NetWatchdog() {
 
     SetProcessName("portod-NET");
     while (HostNetwork) {
+        std::vector<std::shared_ptr<TNetwork>> tcpStat;
         auto nets = Networks();
         for (auto &net: *nets) {
             auto lock = net->LockNet();
@@ -1601,9 +1754,18 @@ void TNetwork::NetWatchdog() {
                 GlobalStatGen++;
                 net->SyncStatLocked();
             }
+            if (NetTcpStatPeriod && GetCurrentTimeMs() - net->TcpStatTime >= NetTcpStatPeriod)
+                tcpStat.push_back(net);
             if (net->NetError)
                 net->RepairLocked();
         }
+        /* Socket dump could be long, it holds only diag socket of TNl */
+        for (auto &net: tcpStat)
+            net->SyncTcpStat();
+        if (L3Pool.size() < config().network().l3_pool_size()) {
+            auto lock = HostNetwork->LockNet();
+            HostNetwork->RefillL3Pool();
+        }
         if (GetCurrentTimeMs() - LastProxyNeighbour >= NetProxyNeighbourPeriod) {
             auto lock = HostNetwork->LockNet();
             HostNetwork->RepairProxyNeightbour();
@@ -1641,6 +1803,71 @@ TError TNetwork::WaitRepair() {
     return NetError;
 }
 
+void TNetwork::SyncTcpStat() {
+    TNlTcpStat tcp;
+    TUintMap stat;
+    TError error;
+
+    TcpStatTime = GetCurrentTimeMs();
+
+    error = Nl->GetTcpStat(tcp);
+    if (error) {
+        if (error != EError::NotSupported)
+            L_NET_VERBOSE("Cannot get tcp stat for {}: {}", NetName, error);
+        return;
+    }
+
+    stat["connections"] = tcp.Connections;
+    stat["established"] = tcp.Established;
+    stat["retransmits"] = tcp.Retransmits;
+
+    auto &rtt = tcp.Rtt;
+    if (rtt.size()) {
+        std::sort(rtt.begin(), rtt.end());
+        stat["rtt_p50"] = rtt[(rtt.size() - 1) * 50 / 100];
+        stat["rtt_p90"] = rtt[(rtt.size() - 1) * 90 / 100];
+        stat["rtt_p99"] = rtt[(rtt.size() - 1) * 99 / 100];
+        stat["rtt_max"] = rtt.back();
+    }
+
+    auto state_lock = LockNetState();
+    TcpStat = std::move(stat);
+}
+
+TError TNetwork::SyncDeviceStat() {
+    std::unordered_map<int, struct rtnl_link_stats64> stats;
+    TError error;
+
+    error = Nl->GetLinkStats(stats);
+    if (error) {
+        L_NET_VERBOSE("Fallback to full sync of network {} devices: {}", NetName, error);
+        return SyncDevices();
+    }
+
+    auto net_state_lock = LockNetState();
+
+    for (auto &dev: Devices) {
+        auto it = stats.find(dev.Index);
+        if (it == stats.end()) {
+            net_state_lock.unlock();
+            return SyncDevices();
+        }
+
+        auto &st = it->second;
+        dev.DeviceStat.RxBytes = st.rx_bytes;
+        dev.DeviceStat.RxPackets = st.rx_packets;
+        dev.DeviceStat.RxDrops = st.rx_dropped;
+        dev.DeviceStat.RxOverruns = st.rx_over_errors + st.rx_errors;
+
+        dev.DeviceStat.TxBytes = st.tx_bytes;
+        dev.DeviceStat.TxPackets = st.tx_packets;
+        dev.DeviceStat.TxDrops = st.tx_dropped;
+        dev.DeviceStat.TxOverruns = st.tx_errors;
+    }
+
+    return OK;
+}
+
 void TNetwork::InitStat(TNetClass &cls) {
     cls.ClassStat.clear();
     for (auto &dev: Devices) {
@@ -1660,7 +1887,10 @@ void TNetwork::SyncStatLocked() {
     L_NET_VERBOSE("Sync network {} statistics generation {} after {} ms",
           NetName, (unsigned)curGen, curTime - StatTime);
 
-    error = SyncDevices();
+    if (Nl->TopologyChanged())
+        error = SyncDevices();
+    else
+        error = SyncDeviceStat();
     if (error) {
         StartRepair();
         return;
@@ -1669,7 +1899,7 @@ void TNetwork::SyncStatLocked() {
     for (auto &dev: Devices) {
         dev.ClassCache = nullptr;
 
-        if (!dev.Managed || !dev.Prepared)
+        if (!dev.Managed || !dev.Prepared || dev.MultiQueue)
             continue;
 
         int ret = rtnl_class_alloc_cache(GetSock(), dev.Index, &dev.ClassCache);
@@ -1693,6 +1923,23 @@ void TNetwork::SyncStatLocked() {
 
     for (auto &dev: Devices) {
 
+        /* Without classes device counters summed over all tx queues belong to host */
+        if (dev.MultiQueue && dev.Managed) {
+            TNetStat stat;
+            stat.TxBytes = dev.DeviceStat.TxBytes;
+            stat.TxPackets = dev.DeviceStat.TxPackets;
+            stat.TxDrops = dev.DeviceStat.TxDrops;
+            stat.TxOverruns = dev.DeviceStat.TxOverruns;
+            for (auto cls: NetClasses) {
+                if (cls->LeafHandle != TC_HANDLE(ROOT_TC_MAJOR, ROOT_TC_MINOR))
+                    continue;
+                cls->ClassStat[dev.Name] += stat;
+                cls->ClassStat["group " + dev.GroupName] += stat;
+                if (dev.Uplink)
+                    cls->ClassStat["Uplink"] += stat;
+            }
+        }
+
         if (!dev.ClassCache)
             continue;
 
@@ -1781,6 +2028,9 @@ void TNetwork::SyncStatLocked() {
         }
     }
 
+    if (this == HostNetwork.get())
+        UpdateStatRates(curTime);
+
     StatTime = curTime;
     StatGen = curGen;
 
@@ -1800,6 +2050,55 @@ void TNetwork::SyncStat() {
         SyncStatLocked();
 }
 
+/* Classes of all containers are registered in host network */
+void TNetwork::SyncStat(const std::vector<std::shared_ptr<TNetwork>> &nets) {
+    auto ourGen = GlobalStatGen.fetch_add(1) + 1;
+    std::vector<TNetwork *> plan;
+
+    if (HostNetwork)
+        plan.push_back(HostNetwork.get());
+    for (auto &net: nets)
+        if (net && std::find(plan.begin(), plan.end(), net.get()) == plan.end())
+            plan.push_back(net.get());
+
+    for (auto net: plan) {
+        if (ourGen - net->StatGen > 0) {
+            auto lock = net->LockNet();
+            if (ourGen - net->StatGen > 0)
+                net->SyncStatLocked();
+        }
+    }
+}
+
+/* Called under NetStateMutex */
+void TNetwork::UpdateStatRates(uint64_t now) {
+    for (auto cls: NetClasses) {
+        uint64_t period = now - cls->RateTime;
+
+        if (cls->RateTime && period < NetWatchdogPeriod / 2)
+            continue;
+
+        if (cls->RateTime && period) {
+            cls->BytesRate.clear();
+            cls->PacketsRate.clear();
+            for (auto &it: cls->ClassStat) {
+                auto base = cls->RateBase.find(it.first);
+                if (base == cls->RateBase.end() || StringStartsWith(it.first, "Saved "))
+                    continue;
+                auto &cur = it.second;
+                auto &old = base->second;
+                cls->BytesRate[it.first] = cur.TxBytes > old.TxBytes ?
+                    (cur.TxBytes - old.TxBytes) * 1000 / period : 0;
+                cls->PacketsRate[it.first] = cur.TxPackets > old.TxPackets ?
+                    (cur.TxPackets - old.TxPackets) * 1000 / period : 0;
+            }
+        }
+
+        cls->RateBase = cls->ClassStat;
+        cls->RateTime = now;
+    }
+}
+
 void TNetwork::SyncAllStat() {
     auto nets = Networks();
     auto ourGen = GlobalStatGen.fetch_add(1) + 1;
@@ -1813,6 +2112,7 @@ void TNetwork::SyncAllStat() {
 }
 
 TError TNetwork::StartNetwork(TContainer &ct, TTaskEnv &task) {
+    TTraceScope trace("NetworkStart", ct.Name);
     TNetEnv env;
 
     TError error = env.Parse(ct);
@@ -1909,7 +2209,7 @@ void TNetwork::StopNetwork(TContainer &ct) {
     if (ct.Controllers & CGROUP_NETCLS) {
         auto net_lock = HostNetwork->LockNet();
         for (auto &dev: HostNetwork->Devices) {
-            if (!dev.Managed || !dev.Prepared)
+            if (!dev.Managed || !dev.Prepared || dev.MultiQueue)
                 continue;
 
             for (int cs = 0; cs < NR_TC_CLASSES; cs++) {
@@ -1972,6 +2272,7 @@ void TNetwork::StopNetwork(TContainer &ct) {
 }
 
 TError TNetwork::RestoreNetwork(TContainer &ct) {
+    TTraceScope trace("NetworkRestore", ct.Name);
     std::shared_ptr<TNetwork> net;
     TNamespaceFd netNs;
     TError error;
@@ -2402,12 +2703,20 @@ TError TNetEnv::ParseGw(TMultiTuple &gw_settings) {
 
 TError TNetEnv::ConfigureL3(TNetDeviceConfig &dev) {
     auto lock = HostNetwork->LockNet();
-    std::string peerName = HostNetwork->NewDeviceName("L3-");
+    std::string peerName, poolName;
     auto parentNl = HostNetwork->GetNl();
     auto Nl = Net->GetNl();
-    TNlLink peer(parentNl, peerName);
     TError error;
 
+    if (!L3Pool.empty()) {
+        std::tie(peerName, poolName) = L3Pool.back();
+        L3Pool.pop_back();
+        NetThreadCv.notify_all();
+    } else
+        peerName = HostNetwork->NewDeviceName("L3-");
+
+    TNlLink peer(parentNl, peerName);
+
     if (dev.Mode == "NAT" && dev.Ip.empty()) {
         error = HostNetwork->GetNatAddress(dev.Ip);
         if (error)
@@ -2429,15 +2738,43 @@ TError TNetEnv::ConfigureL3(TNetDeviceConfig &dev) {
             dev.Gate4.Format(), dev.GateMtu4,
             dev.Gate6.Format(), dev.GateMtu6);
 
-    error = peer.AddVeth(dev.Name, "", dev.Mtu, VirtualDeviceGroup, NetNs.GetFd());
-    if (error)
-        return error;
+    if (!poolName.empty()) {
+        TNlLink pooled(parentNl, poolName);
+
+        error = pooled.Load();
+        if (!error)
+            error = pooled.ChangeNs(dev.Name, NetNs.GetFd());
+        if (error) {
+            /* Removes whole pair, peer name could be reused */
+            L_NET("Cannot use pooled L3 pair {} {}: {}", peerName, poolName, error);
+            (void)pooled.Remove();
+            poolName = "";
+        } else {
+            error = peer.Load();
+            if (!error && dev.Mtu > 0 && peer.GetMtu() != dev.Mtu)
+                error = peer.SetMtu(dev.Mtu);
+            if (error)
+                return error;
+        }
+    }
+
+    if (poolName.empty()) {
+        error = peer.AddVeth(dev.Name, "", dev.Mtu, VirtualDeviceGroup, NetNs.GetFd());
+        if (error)
+            return error;
+    }
 
     TNlLink link(Nl, dev.Name);
     error = link.Load();
     if (error)
         return error;
 
+    if (!poolName.empty() && dev.Mtu > 0 && link.GetMtu() != dev.Mtu) {
+        error = link.SetMtu(dev.Mtu);
+        if (error)
+            return error;
+    }
+
     error = link.SetGroup(VirtualDeviceGroup);
     if (error)
         return error;
@@ -2447,31 +2784,40 @@ TError TNetEnv::ConfigureL3(TNetDeviceConfig &dev) {
         return error;
 
     auto peerAddr = peer.GetAddr();
+    TNlBatch batch(Nl), peerBatch(parentNl);
 
     if (!dev.Gate4.IsEmpty()) {
-        error = Nl->PermanentNeighbour(link.GetIndex(), dev.Gate4, peerAddr, true);
+        error = Nl->PermanentNeighbour(link.GetIndex(), dev.Gate4, peerAddr, true, &batch);
         if (error)
             return error;
-        error = link.AddDirectRoute(dev.Gate4, EnableECN || dev.EnableECN);
+        error = link.AddDirectRoute(dev.Gate4, EnableECN || dev.EnableECN, &batch);
         if (error)
             return error;
     }
 
     if (!dev.Gate6.IsEmpty()) {
-        error = Nl->PermanentNeighbour(link.GetIndex(), dev.Gate6, peerAddr, true);
+        error = Nl->PermanentNeighbour(link.GetIndex(), dev.Gate6, peerAddr, true, &batch);
         if (error)
             return error;
-        error = link.AddDirectRoute(dev.Gate6, EnableECN || dev.EnableECN);
+        error = link.AddDirectRoute(dev.Gate6, EnableECN || dev.EnableECN, &batch);
         if (error)
             return error;
     }
 
+    error = batch.Commit();
+    if (error)
+        return error;
+
     for (auto &ip: dev.Ip) {
-        error = peer.AddDirectRoute(ip);
+        error = peer.AddDirectRoute(ip, false, &peerBatch);
         if (error)
             return error;
     }
 
+    error = peerBatch.Commit();
+    if (error)
+        return error;
+
     if (dev.Mode != "NAT") {
         error = HostNetwork->AddProxyNeightbour(dev.Ip, dev.Master);
         if (error)
@@ -2681,6 +3027,9 @@ TError TNetEnv::SetupInterfaces() {
     if (error)
         return error;
 
+    /* Addresses and routes for all devices go in one netlink batch */
+    TNlBatch batch(target_nl);
+
     for (auto &dev: Devices) {
         int index = Net->DeviceIndex(dev.Name);
 
@@ -2716,21 +3065,21 @@ TError TNetEnv::SetupInterfaces() {
 
         bool DefaultRoute = false;
         for (auto &ip: dev.Ip) {
-            error = link.AddAddress(ip.Addr);
+            error = link.AddAddress(ip.Addr, &batch);
             if (error)
                 return error;
             DefaultRoute |= ip.IsHost();
         }
 
         if (!dev.Gate4.IsEmpty()) {
-            error = link.SetDefaultGw(dev.Gate4, EnableECN || dev.EnableECN, dev.GateMtu4);
+            error = link.SetDefaultGw(dev.Gate4, EnableECN || dev.EnableECN, dev.GateMtu4, &batch);
             if (error)
                 return error;
             DefaultRoute = false;
         }
 
         if (!dev.Gate6.IsEmpty()) {
-            error = link.SetDefaultGw(dev.Gate6, EnableECN || dev.EnableECN, dev.GateMtu6);
+            error = link.SetDefaultGw(dev.Gate6, EnableECN || dev.EnableECN, dev.GateMtu6, &batch);
             if (error)
                 return error;
         }
@@ -2738,13 +3087,13 @@ TError TNetEnv::SetupInterfaces() {
         if (dev.Type == "ipip6" && DefaultRoute) {
             TNlAddr ip;
             ip.Parse(AF_INET, "default");
-            error = link.AddDirectRoute(ip, dev.EnableECN);
+            error = link.AddDirectRoute(ip, dev.EnableECN, &batch);
             if (error)
                 return error;
         }
     }
 
-    return OK;
+    return batch.Commit();
 }
 
 TError TNetEnv::ApplySysctl() {
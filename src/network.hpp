@@ -6,6 +6,7 @@
 #include <mutex>
 #include <thread>
 #include <unordered_map>
+#include <unordered_set>
 #include <condition_variable>
 
 #include "common.hpp"
@@ -13,6 +14,7 @@
 #include "util/namespace.hpp"
 #include "util/cred.hpp"
 #include "util/idmap.hpp"
+#include "util/locks.hpp"
 
 class TContainer;
 class TNetwork;
@@ -69,6 +71,15 @@ struct TNetClass {
     std::map<std::string, TNetStat> ClassStat;
     std::shared_ptr<TNetwork> OriginNet;
 
+    /* Last applied tc setup per device index and CS */
+    std::map<uint64_t, std::string> Applied;
+
+    /* Updated by network watchdog, per second */
+    uint64_t RateTime = 0;
+    std::map<std::string, TNetStat> RateBase;
+    TUintMap BytesRate;
+    TUintMap PacketsRate;
+
     TNetClass *Fold;
     TNetClass *Parent;
 };
@@ -90,6 +101,10 @@ public:
     bool Prepared;
     bool Missing;
 
+    /* Root mq qdisc with leaf per tx queue, no tc classes */
+    bool MultiQueue;
+    int TxQueues;
+
     TNetStat DeviceStat;
 
     struct nl_cache *ClassCache = nullptr;
@@ -105,6 +120,9 @@ struct TNetProxyNeighbour {
     std::string Master;
 };
 
+/* Sum over all networks */
+extern TLockStat NetLockStat;
+
 class TNetwork : public TPortoNonCopyable {
     friend struct TNetEnv;
 
@@ -180,7 +198,7 @@ public:
     void Destroy();
 
     std::unique_lock<std::mutex> LockNet() {
-        return std::unique_lock<std::mutex>(NetMutex);
+        return LockWithStat(NetMutex, NetLockStat);
     }
 
     static inline std::unique_lock<std::mutex> LockNetState() {
@@ -192,13 +210,23 @@ public:
 
     std::vector<TNetDevice> Devices;
 
+    /* Dumped by repair for reconciling classes */
+    struct nl_cache *QdiscCache = nullptr;
+
     std::map<std::string, TNetStat> DeviceStat;
 
-    std::list<TNetProxyNeighbour> Neighbours;
+    /* Sampled from sock_diag by network watchdog without NetMutex, under NetStateMutex */
+    TUintMap TcpStat;
+    uint64_t TcpStatTime = 0;
+
+    /* Indexed by NeighbourKey() */
+    std::unordered_map<std::string, TNetProxyNeighbour> Neighbours;
 
     std::map<std::string, int> DeviceOwners;
 
     TError SyncDevices();
+    TError SyncDeviceStat();
+    void SyncTcpStat();
     std::string NewDeviceName(const std::string &prefix);
     std::string MatchDevice(const std::string &pattern);
     int DeviceIndex(const std::string &name);
@@ -212,18 +240,21 @@ public:
 
     static void InitClass(TContainer &ct);
 
-    TError SetupClass(TNetDevice &dev, TNetClass &cls, int cs);
+    TError SetupClass(TNetDevice &dev, TNetClass &cls, int cs, bool cached = false);
     TError DeleteClass(TNetDevice &dev, TNetClass &cls, int cs);
     TError SetupClasses(TNetClass &cls);
     TError SetupPolice(TNetDevice &dev);
 
     void SyncStat();
+    static void SyncStat(const std::vector<std::shared_ptr<TNetwork>> &nets);
     static void SyncAllStat();
+    void UpdateStatRates(uint64_t now);
+    void RefillL3Pool();
 
     TError GetL3Gate(TNetDeviceConfig &dev);
 
     TError SetupProxyNeighbour(const std::vector <TNlAddr> &ip,
-                               const std::string &master);
+                               const std::string &master, bool rollback = true);
 
     TError AddProxyNeightbour(const std::vector<TNlAddr> &ip,
                               const std::string &master);
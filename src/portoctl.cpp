@@ -4,6 +4,9 @@
 #include <algorithm>
 #include <csignal>
 #include <cmath>
+#include <mutex>
+#include <condition_variable>
+#include <set>
 
 #include "libporto.hpp"
 #include "cli.hpp"
@@ -846,17 +849,207 @@ public:
     }
 };
 
+/*
+ * Bulk mode of simple container commands: containers are selected by
+ * names, wildcards and labels, requests are spread over pool of
+ * connections and results are printed as they arrive.
+ */
+constexpr int BULK_MAX_CONNECTIONS = 16;
+
+static const char BULK_HELP[] =
+    "    -j <jobs>         run up to <jobs> requests in parallel\n"
+    "    -L <label>[=val]  select containers with label, could be repeated\n"
+    "    -J                print results as json lines\n";
+
+class TBulkCmd {
+public:
+    int Jobs = 0;
+    bool JsonLines = false;
+    std::vector<std::string> Labels;
+
+    std::vector<Option> Options(std::vector<Option> options) {
+        options.push_back({ 'j', true, [&](const char *arg) { Jobs = std::max(1, std::stoi(arg)); } });
+        options.push_back({ 'L', true, [&](const char *arg) { Labels.push_back(arg); } });
+        options.push_back({ 'J', false, [&](const char *) { JsonLines = true; } });
+        return options;
+    }
+
+    bool Enabled(const std::vector<std::string> &args) const {
+        if (Jobs || JsonLines || !Labels.empty())
+            return true;
+        for (auto &arg: args)
+            if (arg.find_first_of("*?") != std::string::npos)
+                return true;
+        return false;
+    }
+
+    /* Without nested drops containers whose parent is selected too */
+    int Select(Porto::TPortoApi *api, const std::vector<std::string> &args,
+               bool nested, std::vector<std::string> &names) {
+        std::set<std::string> selected;
+
+        /* Never fall back to all containers */
+        if (args.empty() && Labels.empty()) {
+            fmt::print(stderr, "Container name, mask or label required\n");
+            return EXIT_FAILURE;
+        }
+
+        if (Labels.empty()) {
+            for (auto &mask: args) {
+                if (mask.find_first_of("*?") == std::string::npos) {
+                    selected.insert(mask);
+                    continue;
+                }
+                std::vector<std::string> list;
+                int ret = api->List(list, mask);
+                if (ret) {
+                    fmt::print(stderr, "Can't list containers: {}\n", api->GetLastError());
+                    return ret;
+                }
+                selected.insert(list.begin(), list.end());
+            }
+        }
+
+        for (size_t i = 0; i < Labels.size(); i++) {
+            auto sep = Labels[i].find('=');
+            std::set<std::string> found;
+
+            /* Without masks label alone selects */
+            for (size_t m = 0; m < std::max(args.size(), (size_t)1); m++) {
+                Porto::TPortoRequest req;
+                Porto::TPortoResponse rsp;
+                auto find = req.mutable_findlabel();
+
+                if (m < args.size())
+                    find->set_mask(args[m]);
+                find->set_label(Labels[i].substr(0, sep));
+                if (sep != std::string::npos)
+                    find->set_value(Labels[i].substr(sep + 1));
+
+                int ret = api->Call(req, rsp);
+                if (ret) {
+                    fmt::print(stderr, "Can't find label: {}\n", api->GetLastError());
+                    return ret;
+                }
+                for (auto &entry: rsp.findlabel().list())
+                    if (!i || selected.count(entry.name()))
+                        found.insert(entry.name());
+            }
+
+            selected.swap(found);
+        }
+
+        names.clear();
+        for (auto &name: selected) {
+            bool parent = false;
+            for (auto sep = name.rfind('/'); !nested && !parent && sep &&
+                    sep != std::string::npos; sep = name.rfind('/', sep - 1))
+                parent = selected.count(name.substr(0, sep));
+            if (!parent)
+                names.push_back(name);
+        }
+
+        return 0;
+    }
+
+    int Run(const std::vector<std::string> &names,
+            std::function<void(const std::string &, Porto::TPortoRequest &)> fill,
+            int extra_timeout = 0) {
+        int jobs = Jobs ?: 1;
+        Porto::TPortoPool pool(std::min(jobs, BULK_MAX_CONNECTIONS));
+        std::condition_variable cv;
+        std::mutex mutex;
+        int inflight = 0;
+        int result = 0;
+
+        auto report = [&](const std::string &name, int error, const std::string &msg) {
+            if (JsonLines)
+                fmt::print("{{\"name\":{},\"error\":\"{}\",\"message\":{}}}\n",
+                           JsonString(name), Porto::EError_Name((Porto::EError)error),
+                           JsonString(msg));
+            else if (error)
+                fmt::print("{} {}: {}\n", name, Porto::EError_Name((Porto::EError)error), msg);
+            else
+                fmt::print("{} OK\n", name);
+            fflush(stdout);
+            if (error)
+                result = error;
+        };
+
+        for (auto &name: names) {
+            Porto::TPortoRequest req;
+            fill(name, req);
+
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&] { return inflight < jobs; });
+            inflight++;
+            lock.unlock();
+
+            int error = pool.CallAsync(req, [&, name](const Porto::TPortoResponse &rsp) {
+                std::unique_lock<std::mutex> lock(mutex);
+                report(name, rsp.error(), rsp.errormsg());
+                inflight--;
+                cv.notify_one();
+            }, extra_timeout);
+
+            if (error) {
+                lock.lock();
+                report(name, error, "Cannot send request");
+                inflight--;
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&] { return !inflight; });
+
+        return result;
+    }
+
+private:
+    static std::string JsonString(const std::string &str) {
+        std::string out = "\"";
+        for (unsigned char c: str) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += c;
+            } else if (c < 0x20) {
+                out += fmt::format("\\u{:04x}", c);
+            } else
+                out += c;
+        }
+        return out + "\"";
+    }
+};
+
 class TStopCmd final : public ICmd {
 public:
-    TStopCmd(Porto::TPortoApi *api) : ICmd(api, "stop", 1, "[-T <seconds>] <container1> [container2...]", "stop container",
-             "    -T <seconds> per-container stop timeout\n") {}
+    TStopCmd(Porto::TPortoApi *api) : ICmd(api, "stop", 0, "[-T <seconds>] [-j <jobs>] [-L <label>] [-J] <container|mask>...", "stop container",
+             std::string("    -T <seconds> per-container stop timeout\n") + BULK_HELP) {}
 
     int Execute(TCommandEnviroment *env) final override {
         int timeout = -1;
+        TBulkCmd bulk;
 
-        const auto &containers = env->GetOpts({
+        const auto &containers = env->GetOpts(bulk.Options({
             { 'T', true, [&](const char *arg) { timeout = std::stoi(arg); } },
-        });
+        }));
+
+        if (containers.empty() && bulk.Labels.empty()) {
+            PrintUsage();
+            return EXIT_FAILURE;
+        }
+
+        if (bulk.Enabled(containers)) {
+            std::vector<std::string> names;
+            int ret = bulk.Select(Api, containers, false, names);
+            if (ret)
+                return ret;
+            return bulk.Run(names, [&](const std::string &name, Porto::TPortoRequest &req) {
+                req.mutable_stop()->set_name(name);
+                if (timeout >= 0)
+                    req.mutable_stop()->set_timeout_ms(timeout * 1000);
+            }, timeout > 0 ? timeout : 0);
+        }
 
         for (const auto &arg : containers) {
             int ret = Api->Stop(arg, timeout);
@@ -895,10 +1088,28 @@ public:
 
 class TPauseCmd final : public ICmd {
 public:
-    TPauseCmd(Porto::TPortoApi *api) : ICmd(api, "pause", 1, "<container> [name...]", "pause container") {}
+    TPauseCmd(Porto::TPortoApi *api) : ICmd(api, "pause", 0, "[-j <jobs>] [-L <label>] [-J] <container|mask>...", "pause container", BULK_HELP) {}
 
     int Execute(TCommandEnviroment *env) final override {
-        for (const auto &arg : env->GetArgs()) {
+        TBulkCmd bulk;
+        const auto &containers = env->GetOpts(bulk.Options({}));
+
+        if (containers.empty() && bulk.Labels.empty()) {
+            PrintUsage();
+            return EXIT_FAILURE;
+        }
+
+        if (bulk.Enabled(containers)) {
+            std::vector<std::string> names;
+            int ret = bulk.Select(Api, containers, false, names);
+            if (ret)
+                return ret;
+            return bulk.Run(names, [](const std::string &name, Porto::TPortoRequest &req) {
+                req.mutable_pause()->set_name(name);
+            });
+        }
+
+        for (const auto &arg : containers) {
             int ret = Api->Pause(arg);
             if (ret) {
                 PrintError("Can't pause container");
@@ -912,10 +1123,28 @@ public:
 
 class TResumeCmd final : public ICmd {
 public:
-    TResumeCmd(Porto::TPortoApi *api) : ICmd(api, "resume", 1, "<container1> [container2...]", "resume container") {}
+    TResumeCmd(Porto::TPortoApi *api) : ICmd(api, "resume", 0, "[-j <jobs>] [-L <label>] [-J] <container|mask>...", "resume container", BULK_HELP) {}
 
     int Execute(TCommandEnviroment *env) final override {
-        for (const auto &arg : env->GetArgs()) {
+        TBulkCmd bulk;
+        const auto &containers = env->GetOpts(bulk.Options({}));
+
+        if (containers.empty() && bulk.Labels.empty()) {
+            PrintUsage();
+            return EXIT_FAILURE;
+        }
+
+        if (bulk.Enabled(containers)) {
+            std::vector<std::string> names;
+            int ret = bulk.Select(Api, containers, true, names);
+            if (ret)
+                return ret;
+            return bulk.Run(names, [](const std::string &name, Porto::TPortoRequest &req) {
+                req.mutable_resume()->set_name(name);
+            });
+        }
+
+        for (const auto &arg : containers) {
             int ret = Api->Resume(arg);
             if (ret) {
                 PrintError("Can't resume container");
@@ -942,6 +1171,44 @@ public:
     }
 };
 
+class TCheckpointCmd final : public ICmd {
+public:
+    TCheckpointCmd(Porto::TPortoApi *api) : ICmd(api, "checkpoint", 2, "[-L] <container> <path>",
+            "dump container processes with CRIU",
+            "    -L        leave container running\n") {}
+
+    int Execute(TCommandEnviroment *env) final override {
+        bool leave = false;
+
+        const auto &args = env->GetOpts({
+            { 'L', false, [&](const char *) { leave = true; } },
+        });
+
+        if (args.size() < 2)
+            return EXIT_FAILURE;
+
+        const auto path = TPath(args[1]).AbsolutePath().NormalPath().ToString();
+        int ret = Api->Checkpoint(args[0], path, leave);
+        if (ret)
+            PrintError("Cannot checkpoint container");
+        return ret;
+    }
+};
+
+class TRestoreCmd final : public ICmd {
+public:
+    TRestoreCmd(Porto::TPortoApi *api) : ICmd(api, "restore", 2, "<container> <path>",
+            "restore container processes from checkpoint") {}
+
+    int Execute(TCommandEnviroment *env) final override {
+        const auto path = TPath(env->GetArgs()[1]).AbsolutePath().NormalPath().ToString();
+        int ret = Api->Restore(env->GetArgs()[0], path);
+        if (ret)
+            PrintError("Cannot restore container");
+        return ret;
+    }
+};
+
 class TGetCmd final : public ICmd {
 public:
     TGetCmd(Porto::TPortoApi *api) : ICmd(api, "get", 1,
@@ -1308,6 +1575,153 @@ public:
     }
 };
 
+class TLocksCmd final : public ICmd {
+public:
+    TLocksCmd(Porto::TPortoApi *api) : ICmd(api, "locks", 0, "[container]", "show lock contention statistics") {}
+
+    int Execute(TCommandEnviroment *env) final override {
+        const auto &args = env->GetArgs();
+        std::string name = args.size() ? args[0] : "/";
+        std::string value;
+
+        int ret = Api->GetProperty(name, "porto_stat", value);
+        if (ret) {
+            PrintError("Can't get porto statistics");
+            return ret;
+        }
+
+        TUintMap stat;
+        TError error = StringToUintMap(value, stat);
+        if (error) {
+            PrintError("Can't parse porto statistics", error);
+            return EXIT_FAILURE;
+        }
+
+        for (auto &it: stat) {
+            if (StringStartsWith(it.first, "lock_") ||
+                    StringStartsWith(it.first, "container_lock_"))
+                std::cout << std::left << std::setw(40) << it.first
+                          << " " << it.second << std::endl;
+        }
+
+        return EXIT_SUCCESS;
+    }
+};
+
+class TRpcCmd final : public ICmd {
+public:
+    TRpcCmd(Porto::TPortoApi *api) : ICmd(api, "rpc", 0, "[-f]",
+        "show cpu time of requests per type and client",
+        "    -f        print collapsed stacks for flamegraph.pl\n"
+        ) {}
+
+    int Execute(TCommandEnviroment *env) final override {
+        bool flame = false;
+        env->GetOpts({
+            { 'f', false, [&](const char *) { flame = true; } },
+        });
+        std::string value;
+
+        int ret = Api->GetProperty("/", "porto_stat", value);
+        if (ret) {
+            PrintError("Can't get porto statistics");
+            return ret;
+        }
+
+        TUintMap stat;
+        TError error = StringToUintMap(value, stat);
+        if (error) {
+            PrintError("Can't parse porto statistics", error);
+            return EXIT_FAILURE;
+        }
+
+        /* client_cpu_us_<comm>@<container>@<type> */
+        struct TEntry {
+            std::string Comm, Container, Type;
+            uint64_t Requests, CpuUs;
+        };
+        std::vector<TEntry> clients;
+
+        for (auto &it: stat) {
+            if (!StringStartsWith(it.first, "client_cpu_us_"))
+                continue;
+            std::string key = it.first.substr(std::string("client_cpu_us_").size());
+            auto first = key.find('@');
+            auto last = key.rfind('@');
+            if (first == last)
+                continue;
+            clients.push_back({key.substr(0, first),
+                               key.substr(first + 1, last - first - 1),
+                               key.substr(last + 1),
+                               stat["client_requests_" + key], it.second});
+        }
+
+        std::sort(clients.begin(), clients.end(), [](const TEntry &a, const TEntry &b) {
+            return a.CpuUs > b.CpuUs;
+        });
+
+        if (flame) {
+            for (auto &c: clients)
+                fmt::print("{};{};{} {}\n", c.Comm, c.Container, c.Type, c.CpuUs);
+            return EXIT_SUCCESS;
+        }
+
+        fmt::print("{:<20} {:>10} {:>12}\n", "TYPE", "REQUESTS", "CPU_MS");
+        for (auto &it: stat) {
+            if (!StringStartsWith(it.first, "rpc_") || !StringEndsWith(it.first, "_cpu_us"))
+                continue;
+            std::string type = it.first.substr(4, it.first.size() - 4 - 7);
+            fmt::print("{:<20} {:>10} {:>12.1f}\n", type,
+                       stat["rpc_" + type + "_count"], it.second / 1000.);
+        }
+
+        if (clients.empty())
+            return EXIT_SUCCESS;
+
+        fmt::print("\n{:<16} {:<30} {:<16} {:>10} {:>12}\n",
+                   "COMM", "CONTAINER", "TYPE", "REQUESTS", "CPU_MS");
+        for (auto &c: clients)
+            fmt::print("{:<16} {:<30} {:<16} {:>10} {:>12.1f}\n",
+                       c.Comm, c.Container, c.Type, c.Requests, c.CpuUs / 1000.);
+
+        return EXIT_SUCCESS;
+    }
+};
+
+class TTraceCmd final : public ICmd {
+public:
+    TTraceCmd(Porto::TPortoApi *api) : ICmd(api, "trace", 0, "[-O] [-m <ms>]",
+        "dump spans of recent requests in chrome trace format",
+        "    -O        use OTLP json format\n"
+        "    -m <ms>   only requests longer than given time\n"
+        ) {}
+
+    int Execute(TCommandEnviroment *env) final override {
+        Porto::TPortoRequest req;
+        Porto::TPortoResponse rsp;
+        auto trace = req.mutable_gettrace();
+        uint64_t min_ms = 0;
+
+        env->GetOpts({
+            { 'O', false, [&](const char *) { trace->set_format("otlp"); } },
+            { 'm', true, [&](const char *arg) { min_ms = std::stoull(arg); } },
+        });
+
+        if (min_ms)
+            trace->set_min_duration_ms(min_ms);
+
+        int ret = Api->Call(req, rsp);
+        if (ret) {
+            PrintError("Can't get trace");
+            return ret;
+        }
+
+        std::cout << rsp.gettrace().trace() << std::endl;
+
+        return EXIT_SUCCESS;
+    }
+};
+
 class TFindCmd final : public ICmd {
 public:
     TFindCmd(Porto::TPortoApi *api) : ICmd(api, "find", 1, "<pid> [comm]", "find container for given process id") {}
@@ -1341,11 +1755,29 @@ public:
 
 class TDestroyCmd final : public ICmd {
 public:
-    TDestroyCmd(Porto::TPortoApi *api) : ICmd(api, "destroy", 1, "<container1> [container2...]", "destroy container") {}
+    TDestroyCmd(Porto::TPortoApi *api) : ICmd(api, "destroy", 0, "[-j <jobs>] [-L <label>] [-J] <container|mask>...", "destroy container", BULK_HELP) {}
 
     int Execute(TCommandEnviroment *env) final override {
         int exitStatus = EXIT_SUCCESS;
-        for (const auto &arg : env->GetArgs()) {
+        TBulkCmd bulk;
+        const auto &containers = env->GetOpts(bulk.Options({}));
+
+        if (containers.empty() && bulk.Labels.empty()) {
+            PrintUsage();
+            return EXIT_FAILURE;
+        }
+
+        if (bulk.Enabled(containers)) {
+            std::vector<std::string> names;
+            int ret = bulk.Select(Api, containers, false, names);
+            if (ret)
+                return ret;
+            return bulk.Run(names, [](const std::string &name, Porto::TPortoRequest &req) {
+                req.mutable_destroy()->set_name(name);
+            });
+        }
+
+        for (const auto &arg : containers) {
             int ret = Api->Destroy(arg);
             if (ret) {
                 PrintError("Can't destroy container");
@@ -2068,6 +2500,16 @@ public:
                 fmt::print("\n");
             }
 
+            if (rsp->has_queue() && (rsp->queue().running() || rsp->queue().queued())) {
+                auto &q = rsp->queue();
+                fmt::print("queue\n");
+                fmt::print("\trunning\t{}\n", q.running());
+                fmt::print("\tqueued\t{} {}\n", q.queued(), StringFormatSize(q.queued_bytes()));
+                fmt::print("\trate\t{}/s\n", StringFormatSize(q.rate()));
+                fmt::print("\teta\t{}\n", StringFormatDuration(q.eta()));
+                fmt::print("\n");
+            }
+
         } else if (import) {
             if (args.size() < 2)
                 return EXIT_FAILURE;
@@ -2841,6 +3283,8 @@ int main(int argc, char *argv[]) {
     handler.RegisterCommand<TPauseCmd>();
     handler.RegisterCommand<TResumeCmd>();
     handler.RegisterCommand<TRespawnCmd>();
+    handler.RegisterCommand<TCheckpointCmd>();
+    handler.RegisterCommand<TRestoreCmd>();
     handler.RegisterCommand<TGetPropertyCmd>();
     handler.RegisterCommand<TSetPropertyCmd>();
     handler.RegisterCommand<TGetDataCmd>();
@@ -2850,6 +3294,9 @@ int main(int argc, char *argv[]) {
     handler.RegisterCommand<TExecCmd>();
     handler.RegisterCommand<TShellCmd>();
     handler.RegisterCommand<TGcCmd>();
+    handler.RegisterCommand<TLocksCmd>();
+    handler.RegisterCommand<TRpcCmd>();
+    handler.RegisterCommand<TTraceCmd>();
     handler.RegisterCommand<TFindCmd>();
     handler.RegisterCommand<TWaitCmd>();
 
@@ -1,5 +1,10 @@
 #include <vector>
 #include <string>
+#include <thread>
+#include <mutex>
+#include <list>
+#include <unordered_map>
+#include <atomic>
 #include <algorithm>
 #include <csignal>
 #include <iostream>
@@ -14,6 +19,7 @@
 #include "client.hpp"
 #include "epoll.hpp"
 #include "container.hpp"
+#include "waiter.hpp"
 #include "volume.hpp"
 #include "storage.hpp"
 #include "helpers.hpp"
@@ -26,6 +32,7 @@
 #include "util/worker.hpp"
 #include "property.hpp"
 #include "portod.hpp"
+#include "metrics.hpp"
 #include "libporto.hpp"
 
 extern "C" {
@@ -62,6 +69,16 @@ static ino_t SocketIno = 0;
 static bool RespawnPortod = true;
 static bool DiscardState = false;
 
+/*
+ * Idle client connections survive update: slave sends them to master at
+ * PORTO_HANDOFF_FD, they stay queued in socket across master re-exec and
+ * next slave receives them at PORTO_ADOPT_FD.
+ */
+static bool HandoffClients = false;
+static TUnixSocket HandoffSock;
+static int HandoffFd = -1;      /* master side of current slave */
+static int AdoptFd = -1;        /* master side of previous slave */
+
 static int CmdTimeout = -1;
 
 static std::map<pid_t, int> Zombies;
@@ -249,27 +266,119 @@ retry:
 }
 
 static std::map<int, std::shared_ptr<TClient>> Clients;
+static std::mutex ClientsMutex;
+
+/*
+ * Client connections could be served by separate epoll threads, listener
+ * is shared between them with EPOLLEXCLUSIVE and each client stays in loop
+ * which accepted it. Main loop then handles only signals, master events
+ * and container OOM, exit and pressure events.
+ */
+static std::vector<std::unique_ptr<TEpollLoop>> ClientLoops;
+static std::vector<std::shared_ptr<TEpollSource>> ClientAcceptSources;
+static std::vector<std::thread> ClientThreads;
+static std::atomic<bool> ClientThreadsStop(false);
+
+/*
+ * Clients in order of acceptance or last look, globally and for each
+ * container. Activity is not tracked here: client which became active
+ * since it was queued gets second chance at tail when it reaches head.
+ * Closed clients are dropped lazily. Under ClientsMutex.
+ */
+struct TClientLruEntry {
+    std::weak_ptr<TClient> Client;
+    uint64_t ActivityTimeMs;
+};
+
+typedef std::list<TClientLruEntry> TClientLru;
+
+static TClientLru ClientsLru;
+static std::unordered_map<int, TClientLru> ContainerClientsLru;
+
+/* Bounds work for each accept when many clients are busy */
+constexpr int CLIENT_LRU_SCAN = 64;
+
+static void CompactClientLru(TClientLru &lru) {
+    for (auto it = lru.begin(); it != lru.end(); ) {
+        auto client = it->Client.lock();
+        if (!client || client->Fd < 0)
+            it = lru.erase(it);
+        else
+            ++it;
+    }
+}
 
-static TError DropIdleClient(std::shared_ptr<TContainer> from = nullptr) {
-    uint64_t idle = config().daemon().client_idle_timeout() * 1000;
+static void AddClientLru(std::shared_ptr<TClient> &client) {
+    ClientsLru.push_back({client, client->ActivityTimeMs});
+    ContainerClientsLru[client->ClientContainer->Id].push_back({client, client->ActivityTimeMs});
+
+    if (ClientsLru.size() > 2 * Clients.size() + CLIENT_LRU_SCAN) {
+        CompactClientLru(ClientsLru);
+        for (auto it = ContainerClientsLru.begin(); it != ContainerClientsLru.end(); ) {
+            CompactClientLru(it->second);
+            if (it->second.empty())
+                it = ContainerClientsLru.erase(it);
+            else
+                ++it;
+        }
+    }
+}
+
+/* Client re-identified into another container joins its queue */
+static void RequeueClient(std::shared_ptr<TClient> client) {
+    auto lock = std::unique_lock<std::mutex>(ClientsMutex);
+    auto it = Clients.find(client->Fd);
+    if (it != Clients.end() && it->second == client && client->ClientContainer)
+        ContainerClientsLru[client->ClientContainer->Id].push_back({client, client->ActivityTimeMs});
+}
+
+static std::shared_ptr<TClient> PopIdleClient(TClientLru &lru, std::shared_ptr<TContainer> from,
+                                              uint64_t &idle) {
     uint64_t now = GetCurrentTimeMs();
-    std::shared_ptr<TClient> victim;
 
-    for (auto &it: Clients) {
-        auto &client = it.second;
+    for (int scan = 0; scan < CLIENT_LRU_SCAN && !lru.empty(); scan++) {
+        auto entry = lru.front();
+        auto client = entry.Client.lock();
+        lru.pop_front();
 
-        if (client->Processing || client->Sending)
+        /* Closed or moved into another container */
+        if (!client || client->Fd < 0 || (from && client->ClientContainer != from))
             continue;
 
-        if (from && client->ClientContainer != from)
+        if (client->ActivityTimeMs != entry.ActivityTimeMs ||
+                client->Processing || client->Pipelined || client->Sending) {
+            lru.push_back({client, client->ActivityTimeMs});
             continue;
+        }
 
         if (now - client->ActivityTimeMs > idle) {
-            victim = client;
             idle = now - client->ActivityTimeMs;
+            return client;
         }
+
+        /* Rest were active even later */
+        lru.push_front(entry);
+        break;
     }
 
+    return nullptr;
+}
+
+/* Under ClientsMutex */
+static TError DropIdleClient(std::shared_ptr<TContainer> from = nullptr) {
+    uint64_t idle = config().daemon().client_idle_timeout() * 1000;
+    std::shared_ptr<TClient> victim;
+
+    if (from) {
+        auto it = ContainerClientsLru.find(from->Id);
+        if (it != ContainerClientsLru.end()) {
+            victim = PopIdleClient(it->second, from, idle);
+            if (it->second.empty())
+                ContainerClientsLru.erase(it);
+        }
+    } else
+        victim = PopIdleClient(ClientsLru, nullptr, idle);
+
     if (!victim)
         return TError(EError::ResourceNotAvailable,
                       "All client slots are active: " +
@@ -281,7 +390,9 @@ static TError DropIdleClient(std::shared_ptr<TContainer> from = nullptr) {
     return OK;
 }
 
-static TError AcceptConnection(int listenFd) {
+static TError AddClient(TEpollLoop *loop, int clientFd);
+
+static TError AcceptConnection(TEpollLoop *loop, int listenFd) {
     struct sockaddr_un peer_addr;
     socklen_t peer_addr_size;
     TError error;
@@ -298,11 +409,17 @@ static TError AcceptConnection(int listenFd) {
 
     Statistics->ClientsConnected++;
 
+    return AddClient(loop, clientFd);
+}
+
+static TError AddClient(TEpollLoop *loop, int clientFd) {
     auto client = std::make_shared<TClient>(clientFd);
-    error = client->IdentifyClient(true);
+    TError error = client->IdentifyClient(true);
     if (error)
         return error;
 
+    auto lock = std::unique_lock<std::mutex>(ClientsMutex);
+
     unsigned max_clients = config().daemon().max_clients_in_container();
     if (client->IsSuperUser())
         max_clients += NR_SUPERUSER_CLIENTS;
@@ -323,12 +440,14 @@ static TError AcceptConnection(int listenFd) {
             return error;
     }
 
-    error = EpollLoop->AddSource(client);
+    client->Loop = loop;
+    error = loop->AddSource(client);
     if (error)
         return error;
 
     client->InEpoll = true; /* FIXME cleanup this crap */
     Clients[client->Fd] = client;
+    AddClientLru(client);
 
     return OK;
 }
@@ -339,9 +458,13 @@ static void StartShutdown() {
     ShutdownDeadline = ShutdownStart + config().daemon().portod_shutdown_timeout() * 1000;
 
     /* Stop accepting new clients */
-    EpollLoop->RemoveSource(PORTO_SK_FD);
+    if (ClientLoops.empty())
+        EpollLoop->RemoveSource(PORTO_SK_FD);
+    for (auto &loop: ClientLoops)
+        loop->RemoveSource(PORTO_SK_FD);
 
     /* Kick idle clients */
+    auto lock = std::unique_lock<std::mutex>(ClientsMutex);
     for (auto it = Clients.begin(); it != Clients.end(); ) {
         auto client = it->second;
 
@@ -349,22 +472,148 @@ static void StartShutdown() {
             L_SYS("Client blocks shutdown: {}", client->Id);
             ++it;
         } else {
-            client->CloseConnection();
+            client->CloseConnection(HandoffClients ? &HandoffSock : nullptr);
             it = Clients.erase(it);
         }
     }
 }
 
-static void PortodServer() {
+static void ClientEvent(std::shared_ptr<TClient> client, uint32_t events) {
+    TError error = client->Event(events);
+    if (!error && client->Moved.exchange(false))
+        RequeueClient(client);
+    if (error) {
+        auto lock = std::unique_lock<std::mutex>(ClientsMutex);
+        auto it = Clients.find(client->Fd);
+        if (it != Clients.end() && it->second == client)
+            Clients.erase(it);
+        lock.unlock();
+        client->CloseConnection();
+    }
+}
+
+static void ClientLoop(TEpollLoop *loop) {
+    std::vector<struct epoll_event> events;
     TError error;
 
-    auto AcceptSource = std::make_shared<TEpollSource>(PORTO_SK_FD);
-    error = EpollLoop->AddSource(AcceptSource);
-    if (error) {
-        L_ERR("Can't add RPC server fd to epoll: {}", error);
+    SetProcessName("portod-EP");
+
+    while (!ClientThreadsStop) {
+        error = loop->GetEvents(events, 1000);
+        if (error) {
+            L_ERR("epoll error {}", error);
+            break;
+        }
+
+        for (auto ev : events) {
+            auto source = loop->GetSource(ev.data.fd);
+            if (!source)
+                continue;
+
+            if (source->Fd == PORTO_SK_FD) {
+                error = AcceptConnection(loop, source->Fd);
+                if (error && Verbose)
+                    L_SYS("Cannot accept connection: {}", error);
+            } else
+                ClientEvent(std::static_pointer_cast<TClient>(source), ev.events);
+        }
+    }
+}
+
+static TError StartClientThreads() {
+    TError error;
+
+    for (unsigned i = 0; i < config().daemon().epoll_threads(); i++) {
+        auto loop = std::unique_ptr<TEpollLoop>(new TEpollLoop());
+        error = loop->Create();
+        if (error)
+            return error;
+
+        auto source = std::make_shared<TEpollSource>(PORTO_SK_FD, EPOLL_EVENT_EXCLUSIVE,
+                                                     std::weak_ptr<TContainer>());
+        error = loop->AddSource(source);
+        if (error)
+            return error;
+
+        ClientAcceptSources.push_back(source);
+        ClientLoops.push_back(std::move(loop));
+    }
+
+    for (auto &loop: ClientLoops)
+        ClientThreads.emplace_back(ClientLoop, loop.get());
+
+    return OK;
+}
+
+static void StopClientThreads() {
+    ClientThreadsStop = true;
+    for (auto &thread: ClientThreads)
+        thread.join();
+    ClientThreads.clear();
+}
+
+/* After all clients are closed */
+static void DestroyClientLoops() {
+    for (auto &loop: ClientLoops)
+        loop->Destroy();
+    ClientLoops.clear();
+    ClientAcceptSources.clear();
+}
+
+static void AdoptClients() {
+    TEpollLoop *loop = EpollLoop.get();
+    TUnixSocket sock;
+    unsigned adopted = 0;
+    TError error;
+    int fd;
+
+    if (fcntl(PORTO_ADOPT_FD, F_GETFD) < 0)
         return;
+
+    /* Previous slave is gone, queue is complete */
+    sock = PORTO_ADOPT_FD;
+
+    while (!sock.RecvFd(fd)) {
+        if (fcntl(fd, F_SETFD, FD_CLOEXEC) < 0)
+            L_WRN("Can't set close-on-exec flag on client fd: {}", strerror(errno));
+
+        if (!ClientLoops.empty())
+            loop = ClientLoops[adopted % ClientLoops.size()].get();
+
+        error = AddClient(loop, fd);
+        if (error)
+            L_WRN("Cannot adopt client: {}", error);
+        else
+            adopted++;
     }
 
+    if (adopted)
+        L_SYS("Adopted {} clients", adopted);
+}
+
+static void PortodServer() {
+    TError error;
+
+    if (config().daemon().epoll_threads()) {
+        error = StartClientThreads();
+        if (error) {
+            L_ERR("Can't start epoll threads: {}", error);
+            StopClientThreads();
+            DestroyClientLoops();
+            return;
+        }
+    } else {
+        auto AcceptSource = std::make_shared<TEpollSource>(PORTO_SK_FD);
+        error = EpollLoop->AddSource(AcceptSource);
+        if (error) {
+            L_ERR("Can't add RPC server fd to epoll: {}", error);
+            return;
+        }
+        ClientAcceptSources.push_back(AcceptSource);
+    }
+
+    AdoptClients();
+
     auto MasterSource = std::make_shared<TEpollSource>(REAP_EVT_FD);
     error = EpollLoop->AddSource(MasterSource);
     if (error) {
@@ -384,13 +633,38 @@ static void PortodServer() {
 
     StartRpcQueue();
     EventQueue->Start();
+    TStorage::StartRemover();
+    TVolume::StartBuilder();
+    StartLogRelay();
+    StartMetrics();
+
+    if (config().log().async())
+        StartLogWriter();
 
     if (config().daemon().log_rotate_ms()) {
         TEvent ev(EEventType::RotateLogs);
         EventQueue->Add(config().daemon().log_rotate_ms(), ev);
     }
 
+    if (config().container().cgroup_pool_size()) {
+        TEvent ev(EEventType::RefillCgroupPool);
+        EventQueue->Add(0, ev);
+    }
+
+    if (config().container().memory_reclaim_period_ms()) {
+        TEvent ev(EEventType::ReclaimMemory);
+        EventQueue->Add(config().container().memory_reclaim_period_ms(), ev);
+    }
+
+    if (config().container().cpu_throttle_sample_ms()) {
+        TEvent ev(EEventType::SampleCpuThrottle);
+        EventQueue->Add(config().container().cpu_throttle_sample_ms(), ev);
+    }
+
     std::vector<struct epoll_event> events;
+    uint64_t statSyncMs = 0;
+
+    EnableStatShards(true);
 
     while (true) {
         error = EpollLoop->GetEvents(events, 1000);
@@ -399,6 +673,12 @@ static void PortodServer() {
             goto exit;
         }
 
+        /* Refresh PORTOD_STAT_FILE for outside readers */
+        if (GetCurrentTimeMs() - statSyncMs >= 1000) {
+            statSyncMs = GetCurrentTimeMs();
+            SyncStatistics();
+        }
+
         if (RecvExitEvents(REAP_EVT_FD))
             goto exit;
 
@@ -429,6 +709,7 @@ static void PortodServer() {
                         break;
                     case SIGHUP:
                         L_SYS("Updating...");
+                        HandoffClients = config().daemon().client_handoff();
                         StartShutdown();
                         break;
                     case SIGUSR1:
@@ -450,7 +731,7 @@ static void PortodServer() {
                         break;
                 }
             } else if (source->Fd == PORTO_SK_FD) {
-                error = AcceptConnection(source->Fd);
+                error = AcceptConnection(EpollLoop.get(), source->Fd);
                 if (error && Verbose)
                     L_SYS("Cannot accept connection: {}", error);
             } else if (source->Fd == REAP_EVT_FD) {
@@ -470,13 +751,31 @@ static void PortodServer() {
                     EventQueue->Add(0, e);
                 }
 
-            } else if (Clients.find(source->Fd) != Clients.end()) {
-                auto client = Clients[source->Fd];
-                error = client->Event(ev.events);
-                if (error) {
-                    Clients.erase(source->Fd);
-                    client->CloseConnection();
+            } else if (source->Flags & EPOLL_EVENT_EXIT) {
+                auto exit = std::static_pointer_cast<TExitSource>(source);
+
+                /* Source is removed when container forgets task */
+                EpollLoop->StopInput(source->Fd);
+                TEvent e(EEventType::TaskExit, source->Container.lock());
+                e.Exit.Pid = exit->Pid;
+                EventQueue->Add(0, e);
+
+            } else if (source->Flags & EPOLL_EVENT_PRESSURE) {
+                auto container = source->Container.lock();
+                auto pressure = std::static_pointer_cast<TPressureSource>(source);
+
+                if (!container || (ev.events & EPOLLERR)) {
+                    /* cgroup is gone, trigger is disarmed by container */
+                    EpollLoop->StopInput(source->Fd);
+                } else {
+                    L_EVT("Pressure {} {} in CT{}:{}", pressure->Resource,
+                          pressure->Trigger, container->Id, container->Name);
+                    TContainerWaiter::ReportAll(*container, "PORTO." + pressure->Resource +
+                                                "_pressure", pressure->Trigger);
                 }
+
+            } else if (ClientLoops.empty() && Clients.count(source->Fd)) {
+                ClientEvent(std::static_pointer_cast<TClient>(source), ev.events);
             } else {
                 L_WRN("Unknown event {}", source->Fd);
                 EpollLoop->RemoveSource(source->Fd);
@@ -484,6 +783,7 @@ static void PortodServer() {
         }
 
         if (ShutdownPortod) {
+            auto lock = std::unique_lock<std::mutex>(ClientsMutex);
             if (Clients.empty()) {
                 L_SYS("All clients are gone");
                 break;
@@ -498,13 +798,27 @@ static void PortodServer() {
 
 exit:
 
+    StopClientThreads();
+
     for (auto c : Clients)
-        c.second->CloseConnection();
+        c.second->CloseConnection(HandoffClients ? &HandoffSock : nullptr);
     Clients.clear();
+    ClientsLru.clear();
+    ContainerClientsLru.clear();
+    DestroyClientLoops();
+    HandoffSock.Close();
 
     L_SYS("Stop threads...");
+    StopMetrics();
+    StopLogRelay();
+    StopLogWriter();
+    TVolume::StopBuilder();
+    TStorage::StopRemover();
     EventQueue->Stop();
     StopRpcQueue();
+
+    EnableStatShards(false);
+    SyncStatistics();
 }
 
 static TError TuneLimits() {
@@ -603,13 +917,33 @@ static TError CreateRootContainer() {
 static void RestoreContainers() {
     TIdMap ids(4, CONTAINER_ID_MAX - 4);
     std::list<TKeyValue> nodes;
+    size_t threads = config().daemon().restore_threads();
 
     TError error = TKeyValue::ListAll(ContainersKV, nodes);
     if (error)
         FatalError("Cannot list container kv", error);
 
-    for (auto node = nodes.begin(); node != nodes.end(); ) {
-        error = node->Load();
+    std::vector<TKeyValue *> load;
+    std::vector<TError> errors(nodes.size());
+    for (auto &node: nodes)
+        load.push_back(&node);
+
+    /* Indexed nodes are loaded right before restore */
+    ParallelFor(load.size(), threads, [&](size_t index) {
+        if (!load[index]->Indexed)
+            errors[index] = load[index]->Load();
+    });
+
+    size_t index = 0;
+    for (auto node = nodes.begin(); node != nodes.end(); index++) {
+        error = errors[index];
+        if (node->Indexed) {
+            if (StringToInt(node->Path.BaseName(), node->Id) ||
+                    (node->Id > 3 && ids.GetAt(node->Id)))
+                node->Id = 0;
+            ++node;
+            continue;
+        }
         if (!error) {
             if (!node->Has(P_RAW_ID))
                 error = TError("id not found");
@@ -632,6 +966,14 @@ static void RestoreContainers() {
 
     for (auto &node : nodes) {
         if (node.Name[0] != '/' && !node.Id) {
+            if (node.Indexed) {
+                node.Indexed = false;
+                error = node.Load();
+                if (error) {
+                    L_ERR("Cannot load {}: {}", node.Path, error);
+                    continue;
+                }
+            }
             error = ids.Get(node.Id);
             if (!error) {
                 L("Replace container {} id {}", node.Name, node.Id);
@@ -644,21 +986,52 @@ static void RestoreContainers() {
         }
     }
 
-    nodes.sort();
-
+    /* Parents must be restored before childs, siblings are independent */
+    std::map<int, std::vector<TKeyValue *>> levels;
     for (auto &node : nodes) {
-        if (node.Name[0] == '/')
-            continue;
-
-        std::shared_ptr<TContainer> ct;
-        error = TContainer::Restore(node, ct);
-        if (error) {
-            L_ERR("Cannot restore {}: {}", node.Name, error);
-            Statistics->ContainerLost++;
-            node.Path.Unlink();
-            continue;
+        if (node.Name[0] != '/') {
+            levels[std::count(node.Name.begin(), node.Name.end(), '/')].push_back(&node);
+            Statistics->RestoreTotal++;
         }
     }
+
+    for (auto &level: levels) {
+        auto &list = level.second;
+
+        std::sort(list.begin(), list.end(), [](const TKeyValue *a, const TKeyValue *b) {
+            return a->Name < b->Name;
+        });
+
+        ParallelFor(list.size(), threads, [&](size_t index) {
+            TKeyValue &node = *list[index];
+            std::shared_ptr<TContainer> ct;
+            TClient client("<restore>");
+            TClient *prev = CL;
+
+            TError err;
+            if (node.Indexed) {
+                err = node.Load();
+                if (!err && node.Get(P_RAW_NAME) != node.Name)
+                    err = TError("name does not match index");
+            }
+
+            client.ClientContainer = RootContainer;
+            CL = &client;
+            if (!err)
+                err = TContainer::Restore(node, ct);
+            CL = prev;
+
+            if (err) {
+                L_ERR("Cannot restore {}: {}", node.Name, err);
+                Statistics->ContainerLost++;
+                node.Path.Unlink();
+            } else
+                Statistics->ContainersRestored++;
+        });
+
+        L_SYS("Restored level {}: {} of {} containers", level.first,
+              Statistics->ContainersRestored.load(), Statistics->RestoreTotal.load());
+    }
 }
 
 static void CleanupCgroups() {
@@ -817,6 +1190,13 @@ static int Portod() {
         return EXIT_FAILURE;
     }
 
+    if (fcntl(PORTO_HANDOFF_FD, F_SETFD, FD_CLOEXEC) < 0)
+        L_WRN("Can't set close-on-exec flag on PORTO_HANDOFF_FD: {}", strerror(errno));
+    else
+        HandoffSock = PORTO_HANDOFF_FD;
+
+    (void)fcntl(PORTO_ADOPT_FD, F_SETFD, FD_CLOEXEC);
+
     umask(0);
 
     error = SetOomScoreAdj(0);
@@ -864,6 +1244,7 @@ static int Portod() {
     EpollLoop = std::unique_ptr<TEpollLoop>(new TEpollLoop());
     EventQueue = std::unique_ptr<TEventQueue>(new TEventQueue());
 
+    Statistics->EpollSources = 0;
     error = EpollLoop->Create();
     if (error)
         FatalError("Cannot initialize epoll", error);
@@ -895,6 +1276,8 @@ static int Portod() {
 
     DestroyContainers(true);
 
+    TContainer::CleanupSharedFiles();
+
     if (DiscardState) {
         DiscardState = false;
 
@@ -913,7 +1296,8 @@ static int Portod() {
     L_SYS("Cleanup workdir...");
     CleanupWorkdir();
 
-    L_SYS("Restore complete. time={} ms", GetCurrentTimeMs() - Statistics->PortoStarted);
+    Statistics->RestoreTimeMs = GetCurrentTimeMs() - Statistics->PortoStarted;
+    L_SYS("Restore complete. time={} ms", Statistics->RestoreTimeMs.load());
 
     PortodServer();
 
@@ -957,6 +1341,17 @@ static int Portod() {
         error = VolumesKV.UmountAll();
         if (error)
             L_ERR("Can't destroy volume key-value storage: {}", error);
+    } else if (config().keyvalue_index()) {
+        std::map<std::string, std::string> names;
+
+        auto lock = LockContainers();
+        for (auto &it: Containers)
+            names[std::to_string(it.second->Id)] = it.second->Name;
+        lock.unlock();
+
+        error = TKeyValue::SaveIndex(ContainersKV, names);
+        if (error)
+            L_WRN("Cannot save containers index: {}", error);
     }
 
     PortodPidFile.Remove();
@@ -1056,6 +1451,10 @@ static int UpgradeMaster() {
         args.push_back("--verbose");
     args.push_back(nullptr);
 
+    /* Clients handed off by slave are queued here, dup2 drops close-on-exec */
+    if (HandoffFd >= 0 && dup2(HandoffFd, PORTO_HANDOFF_FD) != PORTO_HANDOFF_FD)
+        L_ERR("Cannot keep handoff socket: {}", strerror(errno));
+
     execvp(args[0], (char **)args.data());
 
     args[0] = program_invocation_name;
@@ -1074,8 +1473,15 @@ static int UpgradeMaster() {
 static void SpawnPortod(std::shared_ptr<TEpollLoop> loop) {
     int evtfd[2];
     int ackfd[2];
+    int handoff[2];
     TError error;
 
+    /* Non-blocking: slave never waits, clients over queue limit are just closed */
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, handoff) < 0) {
+        L_ERR("socketpair(): {}", strerror(errno));
+        return;
+    }
+
     if (pipe2(evtfd, O_NONBLOCK | O_CLOEXEC) < 0) {
         L_ERR("pipe(): {}", strerror(errno));
         return;
@@ -1099,6 +1505,8 @@ static void SpawnPortod(std::shared_ptr<TEpollLoop> loop) {
     PortodPid = fork();
     if (PortodPid < 0) {
         L_ERR("fork(): {}", strerror(errno));
+        close(handoff[0]);
+        close(handoff[1]);
         goto exit;
     } else if (PortodPid == 0) {
         close(evtfd[1]);
@@ -1106,8 +1514,13 @@ static void SpawnPortod(std::shared_ptr<TEpollLoop> loop) {
         loop->Destroy();
         (void)dup2(evtfd[0], REAP_EVT_FD);
         (void)dup2(ackfd[1], REAP_ACK_FD);
+        (void)dup2(handoff[1], PORTO_HANDOFF_FD);
+        if (AdoptFd >= 0)
+            (void)dup2(AdoptFd, PORTO_ADOPT_FD);
         close(evtfd[0]);
         close(ackfd[1]);
+        close(handoff[0]);
+        close(handoff[1]);
         close(sigFd);
 
         _exit(Portod());
@@ -1116,6 +1529,13 @@ static void SpawnPortod(std::shared_ptr<TEpollLoop> loop) {
     close(evtfd[0]);
     close(ackfd[1]);
 
+    close(handoff[1]);
+    HandoffFd = handoff[0];
+    if (AdoptFd >= 0) {
+        close(AdoptFd);
+        AdoptFd = -1;
+    }
+
     L_SYS("Start portod {}", PortodPid);
     Statistics->PortoStarts++;
 
@@ -1229,6 +1649,14 @@ exit:
 
     close(evtfd[1]);
     close(ackfd[0]);
+
+    /* Handed off clients go to next slave */
+    if (HandoffFd >= 0) {
+        if (AdoptFd >= 0)
+            close(AdoptFd);
+        AdoptFd = HandoffFd;
+        HandoffFd = -1;
+    }
 }
 
 static int PortodMaster() {
@@ -1274,6 +1702,13 @@ static int PortodMaster() {
 
     ReadConfigs();
 
+    /* Clients handed off by slave before master re-exec */
+    struct stat handoff_stat;
+    if (!fstat(PORTO_HANDOFF_FD, &handoff_stat) && S_ISSOCK(handoff_stat.st_mode)) {
+        AdoptFd = fcntl(PORTO_HANDOFF_FD, F_DUPFD_CLOEXEC, 3);
+        close(PORTO_HANDOFF_FD);
+    }
+
     TPath pathVer(PORTO_VERSION_FILE);
 
     if (pathVer.ReadAll(PreviousVersion)) {
@@ -1306,6 +1741,7 @@ static int PortodMaster() {
     L_SYS("Previous version: {} {}", PreviousVersion, prevBin);
 
     std::shared_ptr<TEpollLoop> ELoop = std::make_shared<TEpollLoop>();
+    Statistics->EpollSources = 0;
     error = ELoop->Create();
     if (error)
         return EXIT_FAILURE;
@@ -1362,6 +1798,7 @@ static int PortodMaster() {
     pathVer.Unlink();
     TPath(PORTO_CONTAINERS_KV).Rmdir();
     TPath(PORTO_VOLUMES_KV).Rmdir();
+    TPath(PORTO_SHARED_FILES).RemoveAll();
     TPath("/run/porto").Rmdir();
     TPath(PORTOD_STAT_FILE).Unlink();
 
@@ -1744,6 +2181,10 @@ int main(int argc, char **argv) {
         return EXIT_SUCCESS;
     }
 
+    /* Internal, executed by portod itself */
+    if (cmd == "helper-server")
+        return HelperServerMain();
+
     ReadConfigs(true);
 
     if (cmd == "" || cmd == "daemon")
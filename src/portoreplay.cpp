@@ -0,0 +1,423 @@
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <climits>
+#include <cstring>
+
+#include "libporto.hpp"
+#include "version.hpp"
+#include "util/unix.hpp"
+#include "util/string.hpp"
+#include "fmt/format.h"
+
+#include <google/protobuf/text_format.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <google/protobuf/io/tokenizer.h>
+
+extern "C" {
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+}
+
+/*
+ * Records portod rpc traffic from debug log into compact binary trace
+ * and replays it with per-request latency percentiles.
+ *
+ * Trace: magic, then records of varint delay_us from previous request,
+ * varint client index, varint size and serialized TPortoRequest.
+ */
+
+static const std::string TRACE_MAGIC = "PORTOTRACE1\n";
+static const std::string RAW_REQUEST = "Raw request from ";
+
+struct TTraceRecord {
+    uint64_t TimeUs;    /* since trace start */
+    uint32_t Client;
+    Porto::TPortoRequest Req;
+};
+
+static std::string RequestName(const Porto::TPortoRequest &req) {
+    std::vector<const google::protobuf::FieldDescriptor *> fields;
+    req.GetReflection()->ListFields(req, &fields);
+    for (auto field: fields)
+        if (field->type() == google::protobuf::FieldDescriptor::TYPE_MESSAGE)
+            return field->name();
+    return "unknown";
+}
+
+static int Usage() {
+    fmt::print(stderr,
+        "Usage: portoctl replay record [-o <trace>] [portod.log...]\n"
+        "       portoctl replay show <trace>\n"
+        "       portoctl replay run [-j <threads>] [-s <speed>] [-n <loops>] [-T <timeout>] <trace>\n"
+        "\n"
+        "record  extract requests from portod log, debug logging must be enabled\n"
+        "        by log { debug: true } in portod.conf or portod --debug\n"
+        "        default log /var/log/portod.log, default trace porto.trace\n"
+        "show    print request mix of trace\n"
+        "run     replay trace against running portod and print latency percentiles\n"
+        "        -j  connections, default one per recorded client\n"
+        "        -s  speed multiplier, 0 - as fast as possible, default 1\n"
+        "        -n  repeat trace, default 1\n"
+        "        -T  request timeout in seconds\n");
+    return EXIT_FAILURE;
+}
+
+/* Unknown requests are counted as skipped, do not spam stderr */
+class TSilentErrors : public google::protobuf::io::ErrorCollector {
+    void AddError(int, int, const std::string &) override {}
+};
+
+/* "... DBG Raw request from CL5:comm(123) CT1:/ queued=123456: get { ... }" */
+static bool ParseLogLine(const std::string &line, std::string &client,
+                         uint64_t &queued, Porto::TPortoRequest &req) {
+    auto pos = line.find(RAW_REQUEST);
+    if (pos == std::string::npos)
+        return false;
+    pos += RAW_REQUEST.size();
+
+    auto sep = line.find(" queued=", pos);
+    if (sep == std::string::npos)
+        return false;
+    client = line.substr(pos, sep - pos);
+    client = client.substr(0, client.find(" CT"));
+
+    pos = sep + 8;
+    sep = line.find(": ", pos);
+    if (sep == std::string::npos || StringToUint64(line.substr(pos, sep - pos), queued))
+        return false;
+
+    google::protobuf::TextFormat::Parser parser;
+    TSilentErrors errors;
+    parser.RecordErrorsTo(&errors);
+
+    req.Clear();
+    if (!parser.ParseFromString(line.substr(sep + 2), &req))
+        return false;
+    req.clear_request_id();
+    return true;
+}
+
+static int Record(int argc, char **argv) {
+    std::string output = "porto.trace";
+    std::vector<std::string> logs;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "o:")) != -1) {
+        if (opt == 'o')
+            output = optarg;
+        else
+            return Usage();
+    }
+
+    for (int i = optind; i < argc; i++)
+        logs.push_back(argv[i]);
+    if (logs.empty())
+        logs.push_back("/var/log/portod.log");
+
+    int fd = open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        fmt::print(stderr, "Cannot create {}: {}\n", output, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    uint64_t count = 0, skipped = 0, prev = 0;
+    std::map<std::string, uint32_t> clients;
+    Porto::TPortoRequest req;
+    std::string buf;
+
+    {
+        google::protobuf::io::FileOutputStream file(fd);
+        google::protobuf::io::CodedOutputStream out(&file);
+
+        out.WriteRaw(TRACE_MAGIC.data(), TRACE_MAGIC.size());
+
+        for (auto &log: logs) {
+            std::ifstream in(log);
+            std::string line, client;
+            uint64_t queued;
+
+            if (!in.is_open()) {
+                fmt::print(stderr, "Cannot open {}\n", log);
+                continue;
+            }
+
+            while (std::getline(in, line)) {
+                if (line.find(RAW_REQUEST) == std::string::npos)
+                    continue;
+                if (!ParseLogLine(line, client, queued, req)) {
+                    skipped++;
+                    continue;
+                }
+
+                /* portod restart resets monotonic base, keep order */
+                uint64_t delay = (count && queued > prev) ? queued - prev : 0;
+                prev = queued;
+
+                auto it = clients.emplace(client, clients.size()).first;
+
+                req.SerializeToString(&buf);
+                out.WriteVarint64(delay);
+                out.WriteVarint32(it->second);
+                out.WriteVarint32(buf.size());
+                out.WriteString(buf);
+                count++;
+            }
+        }
+    }
+
+    close(fd);
+
+    fmt::print("Recorded {} requests from {} clients into {}, skipped {} lines\n",
+               count, clients.size(), output, skipped);
+
+    return count ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static bool LoadTrace(const std::string &path, std::vector<TTraceRecord> &trace, uint32_t &clients) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fmt::print(stderr, "Cannot open {}: {}\n", path, strerror(errno));
+        return false;
+    }
+
+    google::protobuf::io::FileInputStream file(fd);
+    google::protobuf::io::CodedInputStream in(&file);
+    std::string magic;
+    uint64_t time = 0;
+    bool ok = true;
+
+    in.SetTotalBytesLimit(INT_MAX);
+
+    if (!in.ReadString(&magic, TRACE_MAGIC.size()) || magic != TRACE_MAGIC) {
+        fmt::print(stderr, "Not a porto trace: {}\n", path);
+        ok = false;
+    }
+
+    clients = 0;
+
+    while (ok) {
+        uint64_t delay;
+        uint32_t client, size;
+
+        if (!in.ReadVarint64(&delay))
+            break;
+
+        TTraceRecord rec;
+        std::string buf;
+
+        if (!in.ReadVarint32(&client) || !in.ReadVarint32(&size) ||
+                !in.ReadString(&buf, size) || !rec.Req.ParseFromString(buf)) {
+            fmt::print(stderr, "Trace {} is corrupted at record {}\n", path, trace.size());
+            ok = false;
+            break;
+        }
+
+        time += delay;
+        rec.TimeUs = time;
+        rec.Client = client;
+        clients = std::max(clients, client + 1);
+        trace.emplace_back(std::move(rec));
+    }
+
+    close(fd);
+    return ok;
+}
+
+static int Show(int argc, char **argv) {
+    std::vector<TTraceRecord> trace;
+    uint32_t clients;
+
+    if (argc != 2)
+        return Usage();
+
+    if (!LoadTrace(argv[1], trace, clients))
+        return EXIT_FAILURE;
+
+    std::map<std::string, uint64_t> mix;
+    for (auto &rec: trace)
+        mix[RequestName(rec.Req)]++;
+
+    double duration = trace.empty() ? 0 : trace.back().TimeUs / 1e6;
+
+    fmt::print("{} requests from {} clients in {:.3f} s\n\n", trace.size(), clients, duration);
+    fmt::print("{:<24} {:>10} {:>8} {:>10}\n", "request", "count", "share", "rps");
+    for (auto &it: mix)
+        fmt::print("{:<24} {:>10} {:>7.2f}% {:>10.2f}\n", it.first, it.second,
+                   100. * it.second / trace.size(), duration > 0 ? it.second / duration : 0);
+
+    return EXIT_SUCCESS;
+}
+
+struct TLatencyStat {
+    std::vector<uint64_t> Latency;     /* us */
+    uint64_t Errors = 0;
+};
+
+static uint64_t Percentile(const std::vector<uint64_t> &sorted, double p) {
+    if (sorted.empty())
+        return 0;
+    size_t idx = std::min(sorted.size() - 1, (size_t)(p * sorted.size()));
+    return sorted[idx];
+}
+
+static int Run(int argc, char **argv) {
+    uint64_t threads = 0, loops = 1, timeout = 0;
+    double speed = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "j:s:n:T:")) != -1) {
+        switch (opt) {
+        case 'j':
+            if (StringToUint64(optarg, threads) || !threads)
+                return Usage();
+            break;
+        case 's': {
+            char *end;
+            speed = strtod(optarg, &end);
+            if (end == optarg || *end || speed < 0)
+                return Usage();
+            break;
+        }
+        case 'n':
+            if (StringToUint64(optarg, loops) || !loops)
+                return Usage();
+            break;
+        case 'T':
+            if (StringToUint64(optarg, timeout))
+                return Usage();
+            break;
+        default:
+            return Usage();
+        }
+    }
+
+    if (optind + 1 != argc)
+        return Usage();
+
+    std::vector<TTraceRecord> trace;
+    uint32_t clients;
+
+    if (!LoadTrace(argv[optind], trace, clients))
+        return EXIT_FAILURE;
+
+    if (trace.empty()) {
+        fmt::print(stderr, "Trace is empty\n");
+        return EXIT_FAILURE;
+    }
+
+    if (!threads)
+        threads = clients;
+
+    uint64_t traceUs = trace.back().TimeUs + 1;
+    std::map<std::string, TLatencyStat> stats;
+    uint64_t maxLagUs = 0, failedConnects = 0;
+    std::mutex statsMutex;
+
+    uint64_t startUs = GetCurrentTimeUs();
+
+    auto worker = [&](uint64_t index) {
+        std::map<std::string, TLatencyStat> local;
+        uint64_t lag = 0;
+        Porto::TPortoApi api;
+        Porto::TPortoResponse rsp;
+
+        if (timeout)
+            api.SetTimeout(timeout);
+
+        if (api.Connect()) {
+            std::lock_guard<std::mutex> guard(statsMutex);
+            failedConnects++;
+            return;
+        }
+
+        /* Recorded client keeps its own connection and request order */
+        for (uint64_t loop = 0; loop < loops; loop++) {
+            for (auto &rec: trace) {
+                if (rec.Client % threads != index)
+                    continue;
+
+                if (speed > 0) {
+                    uint64_t due = startUs + (loop * traceUs + rec.TimeUs) / speed;
+                    uint64_t now = GetCurrentTimeUs();
+                    if (due > now)
+                        usleep(due - now);
+                    else
+                        lag = std::max(lag, now - due);
+                }
+
+                auto &stat = local[RequestName(rec.Req)];
+                uint64_t begin = GetCurrentTimeUs();
+                if (api.Call(rec.Req, rsp))
+                    stat.Errors++;
+                stat.Latency.push_back(GetCurrentTimeUs() - begin);
+            }
+        }
+
+        std::lock_guard<std::mutex> guard(statsMutex);
+        for (auto &it: local) {
+            auto &stat = stats[it.first];
+            stat.Errors += it.second.Errors;
+            stat.Latency.insert(stat.Latency.end(), it.second.Latency.begin(), it.second.Latency.end());
+        }
+        maxLagUs = std::max(maxLagUs, lag);
+    };
+
+    std::vector<std::thread> workers;
+    for (uint64_t i = 0; i < threads; i++)
+        workers.emplace_back(worker, i);
+    for (auto &thread: workers)
+        thread.join();
+
+    double elapsed = (GetCurrentTimeUs() - startUs) / 1e6;
+    uint64_t total = 0;
+
+    if (failedConnects)
+        fmt::print(stderr, "{} of {} connections failed\n", failedConnects, threads);
+
+    fmt::print("{:<24} {:>8} {:>8} {:>10} {:>10} {:>10} {:>10} {:>10}\n",
+               "request", "count", "errors", "p50 ms", "p90 ms", "p99 ms", "p999 ms", "max ms");
+
+    for (auto &it: stats) {
+        auto &lat = it.second.Latency;
+        std::sort(lat.begin(), lat.end());
+        total += lat.size();
+        fmt::print("{:<24} {:>8} {:>8} {:>10.3f} {:>10.3f} {:>10.3f} {:>10.3f} {:>10.3f}\n",
+                   it.first, lat.size(), it.second.Errors,
+                   Percentile(lat, 0.5) / 1e3, Percentile(lat, 0.9) / 1e3,
+                   Percentile(lat, 0.99) / 1e3, Percentile(lat, 0.999) / 1e3,
+                   lat.back() / 1e3);
+    }
+
+    fmt::print("\n{} requests over {} connections in {:.3f} s, {:.1f} rps, max schedule lag {:.3f} ms\n",
+               total, threads, elapsed, elapsed > 0 ? total / elapsed : 0, maxLagUs / 1e3);
+
+    return failedConnects == threads ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2)
+        return Usage();
+
+    std::string cmd = argv[1];
+
+    if (cmd == "record")
+        return Record(argc - 1, argv + 1);
+    if (cmd == "show")
+        return Show(argc - 1, argv + 1);
+    if (cmd == "run")
+        return Run(argc - 1, argv + 1);
+    if (cmd == "-v" || cmd == "--version") {
+        fmt::print("{} {}\n", PORTO_VERSION, PORTO_REVISION);
+        return EXIT_SUCCESS;
+    }
+
+    return Usage();
+}
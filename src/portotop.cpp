@@ -377,40 +377,104 @@ void TPortoValueCache::Unregister(const std::string &container,
     }
 }
 
+void TPortoValueCache::Focus(const std::unordered_set<std::string> &containers,
+                             const std::string &variable) {
+    Focused = containers;
+    FocusVariable = variable;
+}
+
+bool TPortoValueCache::Fetched(const std::string &container) {
+    return FullyFetched.count(container);
+}
+
 std::string TPortoValueCache::GetValue(const std::string &container,
                                        const std::string &variable,
                                        bool prev) {
-    return Cache[CacheSelector ^ prev][container][variable];
-}
+    auto ct = Cache.find(container);
+    if (ct == Cache.end())
+        return "";
+    auto val = ct->second.find(variable);
+    if (val == ct->second.end())
+        return "";
+    return prev ? val->second.Prev : val->second.Value;
+}
+
+uint64_t TPortoValueCache::GetDt(const std::string &container,
+                                 const std::string &variable) {
+    auto &val = Cache[container][variable];
+    return val.Time - val.PrevTime;
+}
+
+int TPortoValueCache::Fetch(Porto::TPortoApi &api,
+                            const std::vector<std::string> &containers,
+                            const std::vector<std::string> &variables) {
+    /* No GET_SYNC: counters are served from stat cache with their timestamps */
+    auto rsp = api.Get(containers, variables, Porto::GET_REAL);
+    if (!rsp)
+        return api.Error();
+
+    uint64_t now = GetCurrentTimeMs();
+
+    for (auto &ct: rsp->list()) {
+        auto &ct_cache = Cache[ct.name()];
+
+        for (auto &kv: ct.keyval()) {
+            if (kv.variable() == "id" && ct_cache.count("id") &&
+                    ct_cache["id"].Value != kv.value())
+                ct_cache.clear();
+        }
+
+        for (auto &kv: ct.keyval()) {
+            auto &val = ct_cache[kv.variable()];
+            uint64_t time = kv.has_timestamp() ? kv.timestamp() : now;
+
+            /* Same sample from stat cache, keep previous for rate */
+            if (time == val.Time)
+                continue;
+
+            val.Prev = std::move(val.Value);
+            val.PrevTime = val.Time;
+            val.Value = kv.value();
+            val.Time = time;
+        }
+    }
 
-uint64_t TPortoValueCache::GetDt() {
-    return Time[CacheSelector] - Time[!CacheSelector];
+    return Porto::EError::Success;
 }
 
 int TPortoValueCache::Update(Porto::TPortoApi &api) {
-    std::vector<std::string> _containers;
-    for (auto &iter : Containers)
-        _containers.push_back(iter.first);
+    std::vector<std::string> focused, others;
+    for (auto &iter : Containers) {
+        if (Focused.empty() || Focused.count(iter.first) || iter.first == "/")
+            focused.push_back(iter.first);
+        else
+            others.push_back(iter.first);
+    }
 
     std::vector<std::string> _variables;
     for (auto &iter : Variables)
-        _variables.push_back(iter.first);;
-
-    CacheSelector = !CacheSelector;
-    Cache[CacheSelector].clear();
-    auto rsp = api.Get(_containers, _variables, Porto::GET_SYNC | Porto::GET_REAL);
-    if (rsp) {
-        for (auto &ct: rsp->list()) {
-            auto &ct_cache = Cache[CacheSelector][ct.name()];
-            for (auto &kv: ct.keyval())
-                ct_cache[kv.variable()] = kv.value();
-
-            auto &prev = Cache[!CacheSelector][ct.name()];
-            if (ct_cache.count("id") && prev.count("id") && ct_cache["id"] != prev["id"])
-                prev.clear();
-        }
+        _variables.push_back(iter.first);
+
+    for (auto it = Cache.begin(); it != Cache.end(); ) {
+        if (Containers.count(it->first))
+            it++;
+        else
+            it = Cache.erase(it);
+    }
+
+    FullyFetched.clear();
+    FullyFetched.insert(focused.begin(), focused.end());
+
+    int ret = Fetch(api, focused, _variables);
+    if (ret)
+        return ret;
+
+    /* Rows out of view only need value for sorting */
+    if (!others.empty() && Variables.count(FocusVariable)) {
+        ret = Fetch(api, others, {FocusVariable});
+        if (ret)
+            return ret;
     }
-    Time[CacheSelector] = GetCurrentTimeMs();
 
     return api.GetVersion(Version, Revision);
 }
@@ -541,7 +605,8 @@ void TPortoValue::Process() {
         if (prev.empty())
             AsNumber = 0;
         else
-            AsNumber = DfDt(AsNumber, ParseValue(prev, Index), Cache->GetDt());
+            AsNumber = DfDt(AsNumber, ParseValue(prev, Index),
+                            Cache->GetDt(Container->GetName(), Variable));
     }
 
     if (Flags & ValueFlags::PartOfRoot) {
@@ -552,7 +617,8 @@ void TPortoValue::Process() {
             if (prev.empty())
                 base = 0;
             else
-                base = DfDt(base, ParseValue(prev, Index), Cache->GetDt());
+                base = DfDt(base, ParseValue(prev, Index),
+                            Cache->GetDt("/", Variable));
         }
 
         if (base)
@@ -578,6 +644,9 @@ void TPortoValue::Process() {
 std::string TPortoValue::GetValue() const {
     return AsString;
 }
+const std::string &TPortoValue::GetVariable() const {
+    return Variable;
+}
 int TPortoValue::GetLength() const {
     return AsString.length();
 }
@@ -765,6 +834,9 @@ void TColumn::Update(std::shared_ptr<TPortoContainer> &tree, int maxlevel) {
 TPortoValue& TColumn::At(TPortoContainer &row) {
     return Cache[row.GetName()];
 }
+const std::string &TColumn::GetVariable() const {
+    return RootValue.GetVariable();
+}
 void TColumn::Process() {
     for (auto &iter : Cache) {
         iter.second.Process();
@@ -833,14 +905,50 @@ int TPortoTop::PrintCommon(TConsoleScreen &screen) {
     return y;
 }
 
+/* Rows on screen in current order of tree */
+std::unordered_set<std::string> TPortoTop::ViewRows() {
+    std::unordered_set<std::string> rows;
+    int y = 0;
+
+    if (ContainerTree && DisplayRows)
+        ContainerTree->ForEach([&] (std::shared_ptr<TPortoContainer> &row) {
+                if (y >= FirstRow && y < FirstRow + DisplayRows)
+                    rows.insert(row->GetName());
+                y++;
+            }, MaxLevel);
+
+    return rows;
+}
+
+/* Rows or columns came into view after last update */
+bool TPortoTop::NeedUpdate() {
+    for (auto &column : Columns)
+        if (!column.Hidden && !column.Fetched)
+            return true;
+
+    for (auto &name : ViewRows())
+        if (!Cache->Fetched(name))
+            return true;
+
+    return false;
+}
+
 void TPortoTop::Update() {
+    auto &sort = Columns[SortColumn];
+
+    /* Full refresh only for rows on screen and sort column for others */
+    Cache->Focus(ViewRows(), sort.GetVariable());
+
     for (auto &column : Columns)
         column.ClearCache();
     ContainerTree = TPortoContainer::ContainerTree(*Api);
     if (!ContainerTree)
         return;
-    for (auto &column : Columns)
-        column.Update(ContainerTree, MaxLevel);
+    for (auto &column : Columns) {
+        column.Fetched = !column.Hidden || &column == &sort;
+        if (column.Fetched)
+            column.Update(ContainerTree, MaxLevel);
+    }
     Cache->Update(*Api);
     Process();
 }
@@ -861,6 +969,9 @@ void TPortoTop::Sort() {
 
 void TPortoTop::Print(TConsoleScreen &screen) {
 
+    if (ContainerTree && NeedUpdate())
+        Update();
+
     screen.Erase();
 
     if (!ContainerTree)
@@ -88,17 +88,29 @@ class TPortoValueCache {
 public:
     void Register(const std::string &container, const std::string &variable);
     void Unregister(const std::string &container, const std::string &variable);
+    /* Fetch all variables only for these containers, others get one variable */
+    void Focus(const std::unordered_set<std::string> &containers,
+               const std::string &variable);
+    bool Fetched(const std::string &container);
     std::string GetValue(const std::string &container, const std::string &variable,
                          bool prev);
-    uint64_t GetDt();
+    uint64_t GetDt(const std::string &container, const std::string &variable);
     int Update(Porto::TPortoApi &api);
     std::string Version, Revision;
 private:
+    struct TValue {
+        std::string Value, Prev;
+        uint64_t Time = 0, PrevTime = 0;
+    };
+
+    int Fetch(Porto::TPortoApi &api, const std::vector<std::string> &containers,
+              const std::vector<std::string> &variables);
+
     std::unordered_map<std::string, unsigned long> Containers;
     std::unordered_map<std::string, unsigned long> Variables;
-    bool CacheSelector = false;
-    std::map<std::string, std::map<std::string, std::string>> Cache[2];
-    uint64_t Time[2] = {0, 0};
+    std::unordered_set<std::string> Focused, FullyFetched;
+    std::string FocusVariable;
+    std::unordered_map<std::string, std::unordered_map<std::string, TValue>> Cache;
 };
 
 namespace ValueFlags {
@@ -142,6 +154,7 @@ public:
 
     void Process();
     std::string GetValue() const;
+    const std::string &GetVariable() const;
     int GetLength() const;
     bool operator< (const TPortoValue &v);
 private:
@@ -182,6 +195,7 @@ public:
     int Flags;
     bool Selected = false;
     bool Sorted = false;
+    bool Fetched = false;
 
     int PrintTitle(int x, int y, TConsoleScreen &screen);
     int Print(TPortoContainer &row, int x, int y, TConsoleScreen &screen, int attr);
@@ -189,6 +203,7 @@ public:
     void Update(std::shared_ptr<TPortoContainer> &tree, int maxlevel);
     void Process();
     TPortoValue& At(TPortoContainer &row);
+    const std::string &GetVariable() const;
     int GetWidth();
     void SetWidth(int width);
 };
@@ -237,6 +252,8 @@ private:
                    int flags);
     void PrintTitle(int y, TConsoleScreen &screen);
     int PrintCommon(TConsoleScreen &screen);
+    std::unordered_set<std::string> ViewRows();
+    bool NeedUpdate();
 
     Porto::TPortoApi *Api;
     std::shared_ptr<TPortoValueCache> Cache;
@@ -6,6 +6,7 @@
 #include "container.hpp"
 #include "volume.hpp"
 #include "network.hpp"
+#include "rpc.hpp"
 #include "util/log.hpp"
 #include "util/string.hpp"
 #include "util/unix.hpp"
@@ -983,12 +984,14 @@ public:
     }
     TError Set(uint64_t val) {
         CT->NewMemGuarantee = val;
+        CT->UpdateMemGuarantee();
         if (CT->State != EContainerState::STOPPED) {
             TError error = CT->CheckMemGuarantee();
             /* always allow to decrease guarantee under overcommit */
             if (error && val > CT->MemGuarantee) {
                 Statistics->FailMemoryGuarantee++;
                 CT->NewMemGuarantee = CT->MemGuarantee;
+                CT->UpdateMemGuarantee();
                 return error;
             }
         }
@@ -1369,6 +1372,40 @@ public:
     }
 } static StderrOffset;
 
+class TStdoutRotations : public TSizeProperty {
+public:
+    TStdoutRotations() : TSizeProperty(P_STDOUT_ROTATIONS, EProperty::NONE,
+            "Count of stdout rotations")
+    {
+        IsReadOnly = true;
+        IsRuntimeOnly = true;
+    }
+    TError Get(uint64_t &val) {
+        val = CT->Stdout.Rotations;
+        return OK;
+    }
+    void Dump(Porto::TContainer &spec, uint64_t value) {
+        spec.set_stdout_rotations(value);
+    }
+} static StdoutRotations;
+
+class TStderrRotations : public TSizeProperty {
+public:
+    TStderrRotations() : TSizeProperty(P_STDERR_ROTATIONS, EProperty::NONE,
+            "Count of stderr rotations")
+    {
+        IsReadOnly = true;
+        IsRuntimeOnly = true;
+    }
+    TError Get(uint64_t &val) {
+        val = CT->Stderr.Rotations;
+        return OK;
+    }
+    void Dump(Porto::TContainer &spec, uint64_t value) {
+        spec.set_stderr_rotations(value);
+    }
+} static StderrRotations;
+
 class TStdout : public TProperty {
 public:
     TStdout() : TProperty(P_STDOUT, EProperty::NONE,
@@ -2777,6 +2814,77 @@ public:
     }
 } static HugetlbLimit;
 
+class THugetlbReserve : public TSizeProperty {
+public:
+    THugetlbReserve() : TSizeProperty(P_HUGETLB_RESERVE, EProperty::HUGETLB_RESERVE,
+            "Hugetlb pages reserved in pool at start [bytes]")
+    {
+        IsDynamic = true;
+    }
+    void Init(void) {
+        IsSupported = TPath("/sys/kernel/mm/hugepages/hugepages-2048kB/nr_hugepages").Exists();
+    }
+    TError Get(uint64_t &val) {
+        val = CT->HugetlbReserve;
+        return OK;
+    }
+    TError Set(uint64_t val) {
+        if (val && !CL->IsSuperUser())
+            return TError(EError::Permission, "Only superuser could reserve hugepages");
+        if (val && CT->HugetlbLimit && val > CT->HugetlbLimit)
+            return TError(EError::InvalidValue, "hugetlb reserve is greater than limit");
+        CT->HugetlbReserve = val;
+        CT->SetProp(EProperty::HUGETLB_RESERVE);
+        return OK;
+    }
+    void Dump(Porto::TContainer &spec, uint64_t val) {
+        spec.set_hugetlb_reserve(val);
+    }
+    bool Has(const Porto::TContainer &spec) {
+        return spec.has_hugetlb_reserve();
+    }
+    void Load(const Porto::TContainer &spec, uint64_t &val) {
+        val = spec.hugetlb_reserve();
+    }
+} static HugetlbReserve;
+
+class TThp : public TProperty {
+public:
+    TThp() : TProperty(P_THP, EProperty::THP,
+            "Transparent huge pages: always | madvise | never, default is inherited")
+    {
+    }
+    bool Madvise = false;
+    void Init(void) {
+        IsSupported = TPath("/sys/kernel/mm/transparent_hugepage/enabled").Exists();
+        Madvise = IsSupported && ThpExceptAdvisedSupported();
+    }
+    TError Get(std::string &value) {
+        value = CT->ThpMode;
+        return OK;
+    }
+    TError Set(const std::string &mode) {
+        if (mode != "" && mode != "always" && mode != "madvise" && mode != "never")
+            return TError(EError::InvalidValue, "invalid thp mode: " + mode);
+        if (mode == "madvise" && !Madvise)
+            return TError(EError::NotSupported, "thp mode madvise is not supported by kernel");
+        if (CT->ThpMode != mode) {
+            CT->ThpMode = mode;
+            CT->SetProp(EProperty::THP);
+        }
+        return OK;
+    }
+    void Dump(Porto::TContainer &spec) {
+        spec.set_thp(CT->ThpMode);
+    }
+    bool Has(const Porto::TContainer &spec) {
+        return spec.has_thp();
+    }
+    TError Load(const Porto::TContainer &spec) {
+        return Set(spec.thp());
+    }
+} static Thp;
+
 class TRechargeOnPgfault : public TBoolProperty {
 public:
     TRechargeOnPgfault() : TBoolProperty(P_RECHARGE_ON_PGFAULT, EProperty::RECHARGE_ON_PGFAULT,
@@ -2866,6 +2974,39 @@ public:
     }
 } static CpuLimit;
 
+class TCpuLimitBurst : public TCpuPowerProperty {
+public:
+    TCpuLimitBurst() : TCpuPowerProperty(P_CPU_LIMIT_BURST, EProperty::CPU_LIMIT_BURST,
+            "CPU limit burst, unused limit accumulated for bursts: <CPUS>c [cores]")
+    {
+        IsDynamic = true;
+        RequireControllers = CGROUP_CPU;
+    }
+    void Init(void) {
+        IsSupported = CpuSubsystem.HasBurst;
+    }
+    TError Get(uint64_t &val) {
+        val = CT->CpuLimitBurst;
+        return OK;
+    }
+    TError Set(uint64_t val) {
+        if (CT->CpuLimitBurst != val) {
+            CT->CpuLimitBurst = val;
+            CT->SetProp(EProperty::CPU_LIMIT_BURST);
+        }
+        return OK;
+    }
+    void Dump(Porto::TContainer &spec, uint64_t val) {
+        spec.set_cpu_limit_burst((double)val / NSEC_PER_SEC);
+    }
+    bool Has(const Porto::TContainer &spec) {
+        return spec.has_cpu_limit_burst();
+    }
+    void Load(const Porto::TContainer &spec, uint64_t &val) {
+        val = spec.cpu_limit_burst() * NSEC_PER_SEC;
+    }
+} static CpuLimitBurst;
+
 class TCpuLimitTotal : public TCpuPowerProperty {
 public:
     TCpuLimitTotal() : TCpuPowerProperty(P_CPU_TOTAL_LIMIT, EProperty::NONE,
@@ -3296,6 +3437,34 @@ public:
     }
 } static Respawn;
 
+class TWarm : public TBoolProperty {
+public:
+    TWarm() : TBoolProperty(P_WARM, EProperty::WARM,
+            "Keep cgroups and workdir after stop for fast restart")
+    {
+        IsDynamic = true;
+        IsAnyState = true;
+    }
+    TError Get(bool &val) {
+        val = CT->Warm;
+        return OK;
+    }
+    TError Set(bool val) {
+        CT->Warm = val;
+        CT->SetProp(EProperty::WARM);
+        return OK;
+    }
+    void Dump(Porto::TContainer &spec, bool val) {
+        spec.set_warm(val);
+    }
+    bool Has(const Porto::TContainer &spec) {
+        return spec.has_warm();
+    }
+    void Load(const Porto::TContainer &spec, bool &val) {
+        val = spec.warm();
+    }
+} static Warm;
+
 class TRespawnCount : public TSizeProperty {
 public:
     TRespawnCount() : TSizeProperty(P_RESPAWN_COUNT, EProperty::RESPAWN_COUNT,
@@ -4059,6 +4228,52 @@ public:
     }
 } static AnonUsage;
 
+class TMemoryNumaStat : public TProperty {
+public:
+    TMemoryNumaStat() : TProperty(P_MEMORY_NUMA_STAT, EProperty::NONE,
+            "Memory usage per numa node: anon|file_N<node>: <bytes>;...")
+    {
+        IsReadOnly = true;
+        IsRuntimeOnly = true;
+        RequireControllers = CGROUP_MEMORY;
+    }
+    void Init(void) {
+        IsSupported = MemorySubsystem.RootCgroup().Has(MemorySubsystem.NUMA_STAT);
+    }
+    TError GetMap(TUintMap &map) {
+        auto cg = CT->GetCgroup(MemorySubsystem);
+        return MemorySubsystem.GetNumaStat(cg, map);
+    }
+    TError Get(std::string &value) {
+        TUintMap map;
+        TError error = GetMap(map);
+        if (error)
+            return error;
+        return UintMapToString(map, value);
+    }
+    TError GetIndexed(const std::string &index, std::string &value) {
+        TUintMap map;
+        TError error = GetMap(map);
+        if (error)
+            return error;
+        auto it = map.find(index);
+        if (it == map.end())
+            return TError(EError::InvalidProperty, "Unknown {}", index);
+        value = std::to_string(it->second);
+        return OK;
+    }
+    void Dump(Porto::TContainer &spec) {
+        TUintMap map;
+        GetMap(map);
+        auto dump = spec.mutable_memory_numa_stat();
+        for (auto &it: map) {
+            auto kv = dump->add_map();
+            kv->set_key(it.first);
+            kv->set_val(it.second);
+        }
+    }
+} static MemoryNumaStat;
+
 class TAnonMaxUsage : public TSizeProperty {
 public:
     TAnonMaxUsage() : TSizeProperty(P_ANON_MAX_USAGE, EProperty::NONE,
@@ -4123,6 +4338,24 @@ public:
     }
 } static HugetlbUsage;
 
+class TThpUsage : public TSizeProperty {
+public:
+    TThpUsage() : TSizeProperty(P_THP_USAGE, EProperty::NONE,
+            "Anonymous transparent huge pages usage [bytes]")
+    {
+        IsReadOnly = true;
+        IsRuntimeOnly = true;
+        RequireControllers = CGROUP_MEMORY;
+    }
+    TError Get(uint64_t &val) {
+        auto cg = CT->GetCgroup(MemorySubsystem);
+        return MemorySubsystem.GetThpUsage(cg, val);
+    }
+    void Dump(Porto::TContainer &spec, uint64_t value) {
+        spec.set_thp_usage(value);
+    }
+} static ThpUsage;
+
 class TMinorFaults : public TSizeProperty {
 public:
     TMinorFaults() : TSizeProperty(P_MINOR_FAULTS, EProperty::NONE,
@@ -4134,12 +4367,8 @@ public:
     }
     TError Get(uint64_t &val) {
         auto cg = CT->GetCgroup(MemorySubsystem);
-        TUintMap stat;
-        TError error = MemorySubsystem.Statistics(cg, stat);
-        if (error)
-            return error;
-        val = stat["total_pgfault"] - stat["total_pgmajfault"];
-        return OK;
+        uint64_t major;
+        return MemorySubsystem.GetFaults(cg, val, major);
     }
     void Dump(Porto::TContainer &spec, uint64_t value) {
         spec.set_minor_faults(value);
@@ -4157,12 +4386,8 @@ public:
     }
     TError Get(uint64_t &val) {
         auto cg = CT->GetCgroup(MemorySubsystem);
-        TUintMap stat;
-        TError error = MemorySubsystem.Statistics(cg, stat);
-        if (error)
-            return error;
-        val = stat["total_pgmajfault"];
-        return OK;
+        uint64_t minor;
+        return MemorySubsystem.GetFaults(cg, minor, val);
     }
     void Dump(Porto::TContainer &spec, uint64_t value) {
         spec.set_major_faults(value);
@@ -4220,17 +4445,17 @@ public:
     }
     void Init(void) {
         TCgroup rootCg = MemorySubsystem.RootCgroup();
-        TUintMap stat;
+        TMemoryStat stat;
         IsSupported = MemorySubsystem.SupportAnonLimit() ||
-            (!MemorySubsystem.Statistics(rootCg, stat) && stat.count("total_max_rss"));
+            (!MemorySubsystem.GetStat(rootCg, stat) && stat.HasMaxRss);
     }
     TError Get(uint64_t &val) {
         auto cg = CT->GetCgroup(MemorySubsystem);
         TError error = MemorySubsystem.GetAnonMaxUsage(cg, val);
         if (error) {
-            TUintMap stat;
-            error = MemorySubsystem.Statistics(cg, stat);
-            val = stat["total_max_rss"];
+            TMemoryStat stat;
+            error = MemorySubsystem.GetStat(cg, stat);
+            val = stat.MaxRss;
         }
         return error;
     }
@@ -4320,6 +4545,45 @@ public:
     }
 } static CpuThrottled;
 
+class TCpuThrottleStat : public TProperty {
+public:
+    TCpuThrottleStat() : TProperty(P_CPU_THROTTLE_STAT, EProperty::NONE,
+            "CPU throttling in recent samples: samples|periods|throttled|throttled_time|max_ratio|"
+            "ratio_0|ratio_1|ratio_5|ratio_10|ratio_25|ratio_50|ratio_100: <value>;...")
+    {
+        IsReadOnly = true;
+        IsRuntimeOnly = true;
+        RequireControllers = CGROUP_CPU;
+    }
+    void Init(void) {
+        TUintMap stat;
+        IsSupported = !CpuSubsystem.RootCgroup().GetUintMap("cpu.stat", stat) && stat.count("nr_throttled");
+    }
+    TError Get(std::string &value) {
+        TUintMap stat;
+        CT->GetCpuThrottleStat(stat);
+        return UintMapToString(stat, value);
+    }
+    TError GetIndexed(const std::string &index, std::string &value) {
+        TUintMap stat;
+        CT->GetCpuThrottleStat(stat);
+        auto it = stat.find(index);
+        if (it == stat.end())
+            return TError(EError::InvalidValue, "Invalid subscript for property");
+        value = std::to_string(it->second);
+        return OK;
+    }
+    void Dump(Porto::TContainer &spec) {
+        TUintMap stat;
+        CT->GetCpuThrottleStat(stat);
+        for (auto &it: stat) {
+            auto kv = spec.mutable_cpu_throttle_stat()->add_map();
+            kv->set_key(it.first);
+            kv->set_val(it.second);
+        }
+    }
+} static CpuThrottleStat;
+
 class TNetClassId : public TProperty {
 public:
     TNetClassId() : TProperty(P_NET_CLASS_ID, EProperty::NONE,
@@ -4657,6 +4921,108 @@ TNetStatProperty NetTxPackets(P_NET_TX_PACKETS, &TNetStat::TxPackets,
 TNetStatProperty NetTxDrops(P_NET_TX_DROPS, &TNetStat::TxDrops,
         "Device TX drops: <interface>: <packets>;...");
 
+class TNetRateProperty : public TProperty {
+public:
+    TUintMap TNetClass:: *Member;
+
+    TNetRateProperty(std::string name, TUintMap TNetClass:: *member,
+                     std::string desc) : TProperty(name, EProperty::NONE, desc) {
+        Member = member;
+        IsReadOnly = true;
+        IsRuntimeOnly = true;
+    }
+
+    TError Has() {
+        if (CT->State == EContainerState::STOPPED)
+            return TError(EError::InvalidState, "Not available in stopped state");
+        if (!(CT->Controllers & CGROUP_NETCLS))
+            return TError(EError::ResourceNotAvailable, "RequireControllers is disabled");
+        return OK;
+    }
+
+    TError Get(std::string &value) {
+        auto lock = TNetwork::LockNetState();
+        return UintMapToString(CT->NetClass.Fold->*Member, value);
+    }
+
+    TError GetIndexed(const std::string &index, std::string &value) {
+        auto lock = TNetwork::LockNetState();
+        auto &rate = CT->NetClass.Fold->*Member;
+        auto it = rate.find(index);
+        if (it == rate.end())
+            return TError(EError::InvalidValue, "network device " + index + " not found");
+        value = std::to_string(it->second);
+        return OK;
+    }
+
+    void Dump(Porto::TContainer &spec) {
+        Porto::TUintMap *map;
+
+        if (Name == P_NET_BYTES_RATE)
+            map = spec.mutable_net_bytes_rate();
+        else
+            map = spec.mutable_net_packets_rate();
+
+        auto lock = TNetwork::LockNetState();
+        for (auto &it: CT->NetClass.Fold->*Member) {
+            auto kv = map->add_map();
+            kv->set_key(it.first);
+            kv->set_val(it.second);
+        }
+    }
+};
+
+TNetRateProperty NetBytesRate(P_NET_BYTES_RATE, &TNetClass::BytesRate,
+        "Class TX rate: <interface>: <bytes/s>;...");
+TNetRateProperty NetPacketsRate(P_NET_PACKETS_RATE, &TNetClass::PacketsRate,
+        "Class TX packets rate: <interface>: <packets/s>;...");
+
+class TNetTcpStat : public TProperty {
+public:
+    TNetTcpStat() : TProperty(P_NET_TCP_STAT, EProperty::NONE,
+            "TCP sockets in network namespace: connections|established|retransmits|rtt_p50|rtt_p90|rtt_p99|rtt_max: <count>|<usec>;...")
+    {
+        IsReadOnly = true;
+        IsRuntimeOnly = true;
+    }
+
+    TError Has() {
+        if (CT->State == EContainerState::STOPPED)
+            return TError(EError::InvalidState, "Not available in stopped state");
+        return OK;
+    }
+
+    TError Get(std::string &value) {
+        auto lock = TNetwork::LockNetState();
+        if (!CT->Net)
+            return TError(EError::InvalidState, "not available");
+        return UintMapToString(CT->Net->TcpStat, value);
+    }
+
+    TError GetIndexed(const std::string &index, std::string &value) {
+        auto lock = TNetwork::LockNetState();
+        if (!CT->Net)
+            return TError(EError::InvalidState, "not available");
+        auto it = CT->Net->TcpStat.find(index);
+        if (it == CT->Net->TcpStat.end())
+            return TError(EError::InvalidValue, "tcp stat " + index + " not found");
+        value = std::to_string(it->second);
+        return OK;
+    }
+
+    void Dump(Porto::TContainer &spec) {
+        auto lock = TNetwork::LockNetState();
+        if (!CT->Net)
+            return;
+        auto map = spec.mutable_net_tcp_stat();
+        for (auto &it: CT->Net->TcpStat) {
+            auto kv = map->add_map();
+            kv->set_key(it.first);
+            kv->set_val(it.second);
+        }
+    }
+} static NetTcpStat;
+
 class TIoStat : public TProperty {
 public:
     TIoStat(std::string name, EProperty prop, std::string desc) : TProperty(name, prop, desc) {
@@ -4724,9 +5090,9 @@ public:
 
         if (MemorySubsystem.SupportIoLimit()) {
             auto memCg = CT->GetCgroup(MemorySubsystem);
-            TUintMap memStat;
-            if (!MemorySubsystem.Statistics(memCg, memStat))
-                map["fs"] = memStat["fs_io_bytes"] - memStat["fs_io_write_bytes"];
+            TMemoryStat memStat;
+            if (!MemorySubsystem.GetStat(memCg, memStat))
+                map["fs"] = memStat.FsIoBytes - memStat.FsIoWriteBytes;
         }
 
         return OK;
@@ -4746,9 +5112,9 @@ public:
 
         if (MemorySubsystem.SupportIoLimit()) {
             auto memCg = CT->GetCgroup(MemorySubsystem);
-            TUintMap memStat;
-            if (!MemorySubsystem.Statistics(memCg, memStat))
-                map["fs"] = memStat["fs_io_write_bytes"];
+            TMemoryStat memStat;
+            if (!MemorySubsystem.GetStat(memCg, memStat))
+                map["fs"] = memStat.FsIoWriteBytes;
         }
 
         return OK;
@@ -4768,9 +5134,9 @@ public:
 
         if (MemorySubsystem.SupportIoLimit()) {
             auto memCg = CT->GetCgroup(MemorySubsystem);
-            TUintMap memStat;
-            if (!MemorySubsystem.Statistics(memCg, memStat))
-                map["fs"] = memStat["fs_io_operations"];
+            TMemoryStat memStat;
+            if (!MemorySubsystem.GetStat(memCg, memStat))
+                map["fs"] = memStat.FsIoOperations;
         }
 
         return OK;
@@ -4814,6 +5180,168 @@ public:
     }
 } static IoWaitStat;
 
+class TPressure : public TProperty {
+    const std::string Resource;
+public:
+    TPressure(std::string name, std::string resource, std::string desc) :
+        TProperty(name, EProperty::NONE, desc), Resource(resource)
+    {
+        IsReadOnly = true;
+        IsRuntimeOnly = true;
+        RequireControllers = CGROUP2;
+    }
+    void Init(void) {
+        IsSupported = Cgroup2Subsystem.Supported && Cgroup2Subsystem.SupportPressure();
+    }
+    TError GetMap(TStringMap &map) {
+        auto cg = CT->GetCgroup(Cgroup2Subsystem);
+        return Cgroup2Subsystem.GetPressure(cg, Resource, map);
+    }
+    TError Get(std::string &value) {
+        TStringMap map;
+        TError error = GetMap(map);
+        if (!error)
+            value = StringMapToString(map);
+        return error;
+    }
+    TError GetIndexed(const std::string &index, std::string &value) {
+        TStringMap map;
+        TError error = GetMap(map);
+        if (error)
+            return error;
+        auto it = map.find(index);
+        if (it == map.end())
+            return TError(EError::InvalidProperty, "Unknown {}", index);
+        value = it->second;
+        return OK;
+    }
+    void DumpMap(Porto::TStringMap &dump) {
+        TStringMap map;
+        GetMap(map);
+        for (auto &it: map) {
+            auto kv = dump.add_map();
+            kv->set_key(it.first);
+            kv->set_val(it.second);
+        }
+    }
+};
+
+class TCpuPressure : public TPressure {
+public:
+    TCpuPressure() : TPressure(P_CPU_PRESSURE, "cpu",
+            "CPU pressure stall: some|full_avg10|avg60|avg300: <%>, some|full_total: <usec>;...") {}
+    void Dump(Porto::TContainer &spec) {
+        DumpMap(*spec.mutable_cpu_pressure());
+    }
+} static CpuPressure;
+
+class TMemoryPressure : public TPressure {
+public:
+    TMemoryPressure() : TPressure(P_MEMORY_PRESSURE, "memory",
+            "Memory pressure stall: some|full_avg10|avg60|avg300: <%>, some|full_total: <usec>;...") {}
+    void Dump(Porto::TContainer &spec) {
+        DumpMap(*spec.mutable_memory_pressure());
+    }
+} static MemoryPressure;
+
+class TIoPressure : public TPressure {
+public:
+    TIoPressure() : TPressure(P_IO_PRESSURE, "io",
+            "IO pressure stall: some|full_avg10|avg60|avg300: <%>, some|full_total: <usec>;...") {}
+    void Dump(Porto::TContainer &spec) {
+        DumpMap(*spec.mutable_io_pressure());
+    }
+} static IoPressure;
+
+class TPressureTriggers : public TProperty {
+public:
+    TPressureTriggers() : TProperty(P_PRESSURE_TRIGGERS, EProperty::PRESSURE_TRIGGERS,
+            "Pressure stall triggers, reported as PORTO.<resource>_pressure, format: cpu|memory|io: some|full <stall_us> <window_us>;...")
+    {
+        IsDynamic = true;
+        RequireControllers = CGROUP2;
+    }
+    void Init(void) {
+        IsSupported = Cgroup2Subsystem.Supported && Cgroup2Subsystem.SupportPressure();
+    }
+    TError Check(const std::string &resource, const std::string &trigger) {
+        if (resource != "cpu" && resource != "memory" && resource != "io")
+            return TError(EError::InvalidValue, "Unknown pressure resource {}", resource);
+
+        auto word = SplitString(trigger, ' ');
+        uint64_t stall, window;
+        if (word.size() != 3 || (word[0] != "some" && word[0] != "full") ||
+                StringToUint64(word[1], stall) || StringToUint64(word[2], window))
+            return TError(EError::InvalidValue, "Invalid pressure trigger {}", trigger);
+
+        /* kernel accepts windows from 500ms to 10s */
+        if (window < 500000 || window > 10000000 || !stall || stall > window)
+            return TError(EError::InvalidValue, "Invalid pressure trigger {}", trigger);
+
+        return OK;
+    }
+    TError Get(std::string &value) {
+        value = StringMapToString(CT->PressureTriggers);
+        return OK;
+    }
+    TError GetIndexed(const std::string &index, std::string &value) {
+        auto it = CT->PressureTriggers.find(index);
+        if (it != CT->PressureTriggers.end())
+            value = it->second;
+        else
+            value = "";
+        return OK;
+    }
+    TError Set(TStringMap &map) {
+        for (auto &it: map) {
+            TError error = Check(it.first, it.second);
+            if (error)
+                return error;
+        }
+        CT->PressureTriggers = map;
+        CT->SetProp(EProperty::PRESSURE_TRIGGERS);
+        return OK;
+    }
+    TError Set(const std::string &value) {
+        TStringMap map;
+        TError error = StringToStringMap(value, map);
+        if (error)
+            return error;
+        return Set(map);
+    }
+    TError SetIndexed(const std::string &index, const std::string &value) {
+        TStringMap map = CT->PressureTriggers;
+        if (value == "")
+            map.erase(index);
+        else
+            map[index] = value;
+        return Set(map);
+    }
+    void Dump(Porto::TContainer &spec) {
+        auto out = spec.mutable_pressure_triggers();
+        for (auto &it: CT->PressureTriggers) {
+            auto s = out->add_map();
+            s->set_key(it.first);
+            s->set_val(it.second);
+        }
+    }
+    bool Has(const Porto::TContainer &spec) {
+        return spec.has_pressure_triggers();
+    }
+    TError Load(const Porto::TContainer &spec) {
+        TStringMap map;
+        if (spec.pressure_triggers().merge())
+            map = CT->PressureTriggers;
+        for (auto &it: spec.pressure_triggers().map()) {
+            if (it.has_val())
+                map[it.key()] = it.val();
+            else
+                map.erase(it.key());
+        }
+        return Set(map);
+    }
+} static PressureTriggers;
+
 class TTime : public TIntProperty {
 public:
     TTime() : TIntProperty(P_TIME, EProperty::NONE, "Running time [seconds]")
@@ -4881,6 +5409,33 @@ public:
     }
 } static StartTime;
 
+class TStartTrace : public TProperty {
+public:
+    TStartTrace() : TProperty(P_START_TRACE, EProperty::NONE,
+            "Time spent in last start: parents|prepare|cgroups|runtime|network|apply|namespaces|fork|configure|exec|save|total: usec;...") {
+        IsReadOnly = true;
+    }
+    TError Get(std::string &value) {
+        return UintMapToString(CT->GetStartTrace(), value);
+    }
+    TError GetIndexed(const std::string &index, std::string &value) {
+        auto trace = CT->GetStartTrace();
+        auto it = trace.find(index);
+        if (it == trace.end())
+            return TError(EError::InvalidValue, "Index not found {}", index);
+        value = std::to_string(it->second);
+        return OK;
+    }
+    void Dump(Porto::TContainer &spec) {
+        auto dump = spec.mutable_start_trace();
+        for (auto &it: CT->GetStartTrace()) {
+            auto kv = dump->add_map();
+            kv->set_key(it.first);
+            kv->set_val(it.second);
+        }
+    }
+} static StartTrace;
+
 class TDeathTime : public TDateTimeProperty {
 public:
     TDeathTime() : TDateTimeProperty(P_DEATH_TIME, EProperty::NONE, "Death time") {
@@ -4922,6 +5477,8 @@ public:
 } static PortoStat;
 
 void TPortoStat::Populate(TUintMap &m) {
+    SyncStatistics();
+
     m["spawned"] = Statistics->PortoStarts;
     m["porto_crash"] = Statistics->PortoCrash;
 
@@ -4934,6 +5491,10 @@ void TPortoStat::Populate(TUintMap &m) {
     m["queued_events"] = Statistics->QueuedEvents;
     m["remove_dead"] = Statistics->RemoveDead;
     m["restore_failed"] = Statistics->ContainerLost;
+    m["restore_total"] = Statistics->RestoreTotal;
+    m["restore_containers"] = Statistics->ContainersRestored;
+    m["restore_volumes"] = Statistics->VolumesRestored;
+    m["restore_time_ms"] = Statistics->RestoreTimeMs;
     uint64_t usage = 0;
     auto cg = MemorySubsystem.Cgroup(PORTO_DAEMON_CGROUP);
     TError error = MemorySubsystem.Usage(cg, usage);
@@ -4948,10 +5509,21 @@ void TPortoStat::Populate(TUintMap &m) {
     m["log_lines_lost"] = Statistics->LogLinesLost;
     m["log_bytes_lost"] = Statistics->LogBytesLost;
     m["log_open"] = Statistics->LogOpen;
+    m["log_lines_suppressed"] = Statistics->LogLinesSuppressed;
+    m["memory_reclaimed"] = Statistics->MemoryReclaimed;
+
+    m["nss_cache_hits"] = Statistics->NssCacheHits;
+    m["nss_cache_misses"] = Statistics->NssCacheMisses;
+    m["nss_lookup_us"] = Statistics->NssLookupUs;
 
     m["log_rotate_bytes"] = Statistics->LogRotateBytes;
     m["log_rotate_errors"] = Statistics->LogRotateErrors;
 
+    m["log_relay_lines"] = Statistics->LogRelayLines;
+    m["log_relay_bytes"] = Statistics->LogRelayBytes;
+    m["log_relay_lines_lost"] = Statistics->LogRelayLinesLost;
+    m["log_relay_bytes_lost"] = Statistics->LogRelayBytesLost;
+
     m["containers"] = Statistics->ContainersCount - NR_SERVICE_CONTAINERS;
 
     m["containers_created"] = Statistics->ContainersCreated;
@@ -4960,12 +5532,22 @@ void TPortoStat::Populate(TUintMap &m) {
     m["containers_oom"] = Statistics->ContainersOOM;
     m["containers_tainted"] = Statistics->ContainersTainted;
 
+    TContainer::StartTraceStat(m);
+    m["containers_stopped"] = Statistics->ContainersStopped;
+    m["containers_stop_ms"] = Statistics->StopTimeMs;
+    m["containers_longest_stop_ms"] = Statistics->LongestStopMs;
+
     m["running"] = RootContainer->RunningChildren;
     m["running_children"] = CT->RunningChildren;
     m["starting_children"] = CT->StartingChildren;
 
     m["layer_import"] = Statistics->LayerImport;
     m["layer_export"] = Statistics->LayerExport;
+    m["layer_import_bytes"] = Statistics->LayerImportBytes;
+    m["layer_import_ms"] = Statistics->LayerImportMs;
+    m["layer_export_bytes"] = Statistics->LayerExportBytes;
+    m["layer_export_ms"] = Statistics->LayerExportMs;
+    m["layer_dedup_bytes"] = Statistics->LayerDedupBytes;
     m["layer_remove"] = Statistics->LayerRemove;
 
     m["volumes"] = Statistics->VolumesCount;
@@ -4988,6 +5570,8 @@ void TPortoStat::Populate(TUintMap &m) {
     m["container_clients"] = CT->ClientsCount;
     m["container_oom"] = CT->OomEvents;
     m["container_requests"] = CT->ContainerRequests;
+    m["container_requests_cpu_us"] = CT->ContainerRequestsCpuUs;
+    m["container_memory_reclaimed"] = CT->MemoryReclaimed;
 
     m["requests_queued"] = Statistics->RequestsQueued;
     m["requests_completed"] = Statistics->RequestsCompleted;
@@ -5003,6 +5587,29 @@ void TPortoStat::Populate(TUintMap &m) {
     m["requests_longer_30s"] = Statistics->RequestsLonger30s;
     m["requests_longer_5m"] = Statistics->RequestsLonger5m;
     m["longest_read_request"] = Statistics->LongestRoRequest;
+
+    m["requests_queue_wait_ms"] = Statistics->RequestsQueueWaitMs;
+    m["requests_longest_wait_ms"] = Statistics->RequestsLongestWait;
+    m["requests_stolen"] = Statistics->RequestsStolen;
+    m["requests_queued_ro"] = Statistics->RequestsQueuedRo;
+    m["requests_queued_rw"] = Statistics->RequestsQueuedRw;
+    m["requests_queued_io"] = Statistics->RequestsQueuedIo;
+
+    RpcLatencyStat(m);
+
+    /* Exposes names of all clients */
+    if (CL && CL->IsSuperUser())
+        RpcClientCpuStat(m);
+
+    TContainer::LockStat(m);
+    CT->ActionLockStat.Dump(m, "container_lock_action");
+    CT->StateLockStat.Dump(m, "container_lock_state");
+}
+
+void GetPortoStat(TContainer &ct, TUintMap &stat) {
+    CT = &ct;
+    PortoStat.Populate(stat);
+    CT = nullptr;
 }
 
 TError TPortoStat::Get(std::string &value) {
@@ -5025,6 +5632,35 @@ TError TPortoStat::GetIndexed(const std::string &index,
     return OK;
 }
 
+class TSubtreeStat : public TProperty {
+public:
+    TSubtreeStat() : TProperty(P_SUBTREE_STAT, EProperty::NONE,
+            "Totals for subtree: cpu_usage|cpu_system|memory_usage|anon_usage|cache_usage|"
+            "io_read|io_write|io_ops|net_bytes|net_rx_bytes: <value>;...")
+    {
+        IsReadOnly = true;
+        IsRuntimeOnly = true;
+    }
+    TError Get(std::string &value) {
+        TUintMap stat;
+        TError error = CT->GetSubtreeStat(stat);
+        if (error)
+            return error;
+        return UintMapToString(stat, value);
+    }
+    TError GetIndexed(const std::string &index, std::string &value) {
+        TUintMap stat;
+        TError error = CT->GetSubtreeStat(stat);
+        if (error)
+            return error;
+        auto it = stat.find(index);
+        if (it == stat.end())
+            return TError(EError::InvalidValue, "Invalid subscript for property");
+        value = std::to_string(it->second);
+        return OK;
+    }
+} static SubtreeStat;
+
 class TProcessCount : public TSizeProperty {
 public:
     TProcessCount() : TSizeProperty(P_PROCESS_COUNT, EProperty::NONE,
@@ -3,6 +3,7 @@
 #include <map>
 #include <string>
 #include "common.hpp"
+#include "util/string.hpp"
 
 constexpr const char *P_RAW_ROOT_PID = "_root_pid";
 constexpr const char *P_SEIZE_PID = "seize_pid";
@@ -39,16 +40,21 @@ constexpr const char *P_MEM_LIMIT = "memory_limit";
 constexpr const char *P_DIRTY_LIMIT = "dirty_limit";
 constexpr const char *P_ANON_LIMIT = "anon_limit";
 constexpr const char *P_HUGETLB_LIMIT = "hugetlb_limit";
+constexpr const char *P_HUGETLB_RESERVE = "hugetlb_reserve";
+constexpr const char *P_THP = "thp";
 constexpr const char *P_RECHARGE_ON_PGFAULT = "recharge_on_pgfault";
 constexpr const char *P_PRESSURIZE_ON_DEATH = "pressurize_on_death";
 constexpr const char *P_MEMORY_USAGE = "memory_usage";
 constexpr const char *P_MEMORY_RECLAIMED = "memory_reclaimed";
+constexpr const char *P_MEMORY_PRESSURE = "memory_pressure";
+constexpr const char *P_MEMORY_NUMA_STAT = "memory_numa_stat";
 constexpr const char *P_ANON_USAGE = "anon_usage";
 constexpr const char *P_ANON_MAX_USAGE = "anon_max_usage";
 constexpr const char *P_ANON_ONLY = "anon_only";
 constexpr const char *P_MAX_RSS = "max_rss";
 constexpr const char *P_CACHE_USAGE = "cache_usage";
 constexpr const char *P_HUGETLB_USAGE = "hugetlb_usage";
+constexpr const char *P_THP_USAGE = "thp_usage";
 constexpr const char *P_MINOR_FAULTS = "minor_faults";
 constexpr const char *P_MAJOR_FAULTS = "major_faults";
 constexpr const char *P_VIRTUAL_MEMORY = "virtual_memory";
@@ -60,6 +66,7 @@ constexpr const char *P_CPU_POLICY = "cpu_policy";
 constexpr const char *P_CPU_GUARANTEE = "cpu_guarantee";
 constexpr const char *P_CPU_TOTAL_GUARANTEE = "cpu_guarantee_total";
 constexpr const char *P_CPU_LIMIT = "cpu_limit";
+constexpr const char *P_CPU_LIMIT_BURST = "cpu_limit_burst";
 constexpr const char *P_CPU_TOTAL_LIMIT = "cpu_limit_total";
 constexpr const char *P_CPU_PERIOD = "cpu_period";
 constexpr const char *P_CPU_WEIGHT = "cpu_weight";
@@ -69,6 +76,8 @@ constexpr const char *P_CPU_USAGE = "cpu_usage";
 constexpr const char *P_CPU_SYSTEM = "cpu_usage_system";
 constexpr const char *P_CPU_WAIT = "cpu_wait";
 constexpr const char *P_CPU_THROTTLED = "cpu_throttled";
+constexpr const char *P_CPU_THROTTLE_STAT = "cpu_throttle_stat";
+constexpr const char *P_CPU_PRESSURE = "cpu_pressure";
 
 constexpr const char *P_IO_POLICY = "io_policy";
 constexpr const char *P_IO_WEIGHT = "io_weight";
@@ -79,6 +88,7 @@ constexpr const char *P_NET_LIMIT = "net_limit";
 constexpr const char *P_NET_RX_LIMIT = "net_rx_limit";
 constexpr const char *P_RESPAWN = "respawn";
 constexpr const char *P_RESPAWN_COUNT = "respawn_count";
+constexpr const char *P_WARM = "warm";
 constexpr const char *P_RESPAWN_LIMIT = "max_respawns";
 constexpr const char *P_RESPAWN_DELAY = "respawn_delay";
 constexpr const char *P_ISOLATE = "isolate";
@@ -111,6 +121,7 @@ constexpr const char *P_OOM_IS_FATAL = "oom_is_fatal";
 constexpr const char *P_OOM_SCORE_ADJ = "oom_score_adj";
 constexpr const char *P_THREAD_LIMIT = "thread_limit";
 constexpr const char *P_SYSCTL = "sysctl";
+constexpr const char *P_PRESSURE_TRIGGERS = "pressure_triggers";
 constexpr const char *P_CORE_COMMAND = "core_command";
 
 constexpr const char *P_ID = "id";
@@ -132,6 +143,8 @@ constexpr const char *P_STDOUT = "stdout";
 constexpr const char *P_STDOUT_OFFSET = "stdout_offset";
 constexpr const char *P_STDERR = "stderr";
 constexpr const char *P_STDERR_OFFSET = "stderr_offset";
+constexpr const char *P_STDOUT_ROTATIONS = "stdout_rotations";
+constexpr const char *P_STDERR_ROTATIONS = "stderr_rotations";
 
 constexpr const char *P_NET_CLASS_ID = "net_class_id";
 constexpr const char *P_NET_BYTES = "net_bytes";
@@ -144,17 +157,23 @@ constexpr const char *P_NET_RX_DROPS = "net_rx_drops";
 constexpr const char *P_NET_TX_BYTES = "net_tx_bytes";
 constexpr const char *P_NET_TX_PACKETS = "net_tx_packets";
 constexpr const char *P_NET_TX_DROPS = "net_tx_drops";
+constexpr const char *P_NET_BYTES_RATE = "net_bytes_rate";
+constexpr const char *P_NET_PACKETS_RATE = "net_packets_rate";
+constexpr const char *P_NET_TCP_STAT = "net_tcp_stat";
 constexpr const char *P_IO_READ = "io_read";
 constexpr const char *P_IO_WRITE = "io_write";
 constexpr const char *P_IO_OPS = "io_ops";
 constexpr const char *P_IO_TIME = "io_time";
 constexpr const char *P_IO_WAIT = "io_wait";
+constexpr const char *P_IO_PRESSURE = "io_pressure";
 constexpr const char *P_TIME = "time";
 constexpr const char *P_CREATION_TIME = "creation_time";
 constexpr const char *P_START_TIME = "start_time";
+constexpr const char *P_START_TRACE = "start_trace";
 constexpr const char *P_DEATH_TIME = "death_time";
 constexpr const char *P_CHANGE_TIME = "change_time";
 constexpr const char *P_PORTO_STAT = "porto_stat";
+constexpr const char *P_SUBTREE_STAT = "subtree_stat";
 constexpr const char *P_CGROUPS = "cgroups";
 constexpr const char *P_PROCESS_COUNT = "process_count";
 constexpr const char *P_THREAD_COUNT = "thread_count";
@@ -249,6 +268,11 @@ enum class EProperty {
     NET_RX_LIMIT,
     CORE_COMMAND,
     REQUIRED_VOLUMES,
+    PRESSURE_TRIGGERS,
+    WARM,
+    CPU_LIMIT_BURST,
+    HUGETLB_RESERVE,
+    THP,
     NR_PROPERTIES,
 };
 
@@ -293,3 +317,6 @@ void InitContainerProperties(void);
 class TContainer;
 extern __thread TContainer *CT;
 extern std::map<std::string, TProperty*> ContainerProperties;
+
+/* porto_stat of container as map */
+void GetPortoStat(TContainer &ct, TUintMap &stat);
@@ -1,4 +1,6 @@
 #include <algorithm>
+#include <deque>
+#include <unordered_map>
 
 #include "rpc.hpp"
 #include "client.hpp"
@@ -15,6 +17,7 @@
 #include "util/cred.hpp"
 #include "portod.hpp"
 #include "storage.hpp"
+#include "trace.hpp"
 #include "util/quota.hpp"
 
 #include <google/protobuf/descriptor.h>
@@ -46,7 +49,10 @@ void TRequest::Classify() {
         Req.has_locateprocess() ||
         Req.has_getsystem() ||
         Req.has_getsystemconfig() ||
+        Req.has_gettrace() ||
         Req.has_getcontainer() ||
+        Req.has_subscribe() ||
+        Req.has_readstream() ||
         Req.has_getvolume();
 
     IoReq =
@@ -59,12 +65,39 @@ void TRequest::Classify() {
         Req.has_importlayer() ||
         Req.has_exportlayer() ||
         Req.has_removelayer() ||
+        Req.has_exec() ||
         Req.has_importstorage() ||
         Req.has_exportstorage() ||
         Req.has_removestorage() ||
         Req.has_createmetastorage() ||
         Req.has_removemetastorage() ||
-        Req.has_newvolume();
+        Req.has_newvolume() ||
+        Req.has_checkpoint() ||
+        Req.has_restore();
+
+    if (Req.has_version() ||
+            Req.has_list() ||
+            Req.has_findlabel() ||
+            Req.has_get() ||
+            Req.has_getproperty() ||
+            Req.has_getdataproperty() ||
+            Req.has_readstream() ||
+            Req.has_getcontainer() ||
+            Req.has_getsystem() ||
+            Req.has_locateprocess())
+        Priority = RPC_PRIO_HIGH;
+    else if (Req.has_destroy() ||
+            Req.has_importlayer() ||
+            Req.has_exportlayer() ||
+            Req.has_removelayer() ||
+            Req.has_importstorage() ||
+            Req.has_exportstorage() ||
+            Req.has_removestorage() ||
+            Req.has_checkpoint() ||
+            Req.has_restore())
+        Priority = RPC_PRIO_LOW;
+    else
+        Priority = RPC_PRIO_NORMAL;
 }
 
 void TRequest::Parse() {
@@ -136,6 +169,16 @@ void TRequest::Parse() {
     } else if (Req.has_respawn()) {
         Cmd = "Respawn";
         Arg = Req.respawn().name();
+    } else if (Req.has_checkpoint()) {
+        Cmd = "Checkpoint";
+        Arg = Req.checkpoint().name();
+        opts.push_back("path=" + Req.checkpoint().path());
+        if (Req.checkpoint().leave_running())
+            opts.push_back("leave_running=true");
+    } else if (Req.has_restore()) {
+        Cmd = "Restore";
+        Arg = Req.restore().name();
+        opts.push_back("path=" + Req.restore().path());
     } else if (Req.has_wait()) {
         Cmd = "Wait";
         for (int i = 0; i < Req.wait().name_size(); i++)
@@ -305,6 +348,9 @@ void TRequest::Parse() {
         Arg = Req.ShortDebugString();
     } else if (Req.has_getsystemconfig()) {
         Cmd = "GetSystemConfig";
+    } else if (Req.has_gettrace()) {
+        Cmd = "GetTrace";
+        Arg = Req.gettrace().format();
     } else if (Req.has_newvolume()) {
         Cmd = "NewVolume";
         Arg = Req.newvolume().volume().path();
@@ -318,6 +364,48 @@ void TRequest::Parse() {
         if (Req.setcontainer().has_container())
             Arg = Req.setcontainer().container().name();
         Opt = Req.setcontainer().ShortDebugString();
+    } else if (Req.has_subscribe()) {
+        Cmd = "Subscribe";
+        for (auto &name: Req.subscribe().name())
+            opts.push_back(name);
+        opts.push_back("--");
+        for (auto &var: Req.subscribe().variable())
+            opts.push_back(var);
+        opts.push_back(fmt::format("period={}", Req.subscribe().period_ms()));
+    } else if (Req.has_readstream()) {
+        Cmd = "ReadStream";
+        Arg = Req.readstream().name();
+        Opt = Req.readstream().ShortDebugString();
+    } else if (Req.has_exec()) {
+        Cmd = "Exec";
+        Arg = Req.exec().name();
+        Opt = Req.exec().ShortDebugString();
+    } else if (Req.has_batch()) {
+        Cmd = "Batch";
+        for (auto &item: Req.batch().item()) {
+            if (item.has_create())
+                opts.push_back("Create=" + item.create().name());
+            else if (item.has_destroy())
+                opts.push_back("Destroy=" + item.destroy().name());
+            else if (item.has_setproperty())
+                opts.push_back("Set=" + item.setproperty().name() + ":" +
+                               item.setproperty().property() + "=" +
+                               item.setproperty().value());
+            else if (item.has_start())
+                opts.push_back("Start=" + item.start().name());
+            else if (item.has_stop())
+                opts.push_back("Stop=" + item.stop().name());
+            else if (item.has_pause())
+                opts.push_back("Pause=" + item.pause().name());
+            else if (item.has_resume())
+                opts.push_back("Resume=" + item.resume().name());
+            else if (item.has_kill())
+                opts.push_back(fmt::format("Kill={}:{}", item.kill().name(), item.kill().sig()));
+            else
+                opts.push_back("Unknown");
+        }
+        if (Req.batch().stop_on_error())
+            opts.push_back("stop_on_error=true");
     } else if (Req.has_getcontainer()) {
         Cmd = "GetContainer";
     } else if (Req.has_getvolume()) {
@@ -423,7 +511,7 @@ noinline TError NewContainer(Porto::TNewContainerRequest &req,
     if (req.container().weak()) {
         ct->IsWeak = true;
         ct->SetProp(EProperty::WEAK);
-        CL->WeakContainers.emplace_back(ct);
+        CL->AddWeakContainer(ct);
     }
 
     auto container_spec = rsp.mutable_container();
@@ -490,9 +578,41 @@ noinline TError SetContainer(const Porto::TSetContainerRequest &req,
     return error;
 }
 
+/* Names of containers matching any of masks, ordered by name */
+static void MatchContainers(const std::vector<TStringMask> &masks, bool root,
+                            std::list<std::string> &names) {
+    auto index = ContainersIndex();
+    std::map<std::string, std::string> found;
+    std::string name;
+
+    if (root && !CL->ComposeName(ROOT_CONTAINER, name)) {
+        for (auto &mask: masks)
+            if (mask.Match(name))
+                found[ROOT_CONTAINER] = name;
+    }
+
+    /* Scan only range of names starting with literal prefix of mask */
+    for (auto &mask: masks) {
+        auto prefix = CL->PortoNamespace + mask.Prefix;
+
+        for (auto it = index->lower_bound(prefix);
+                it != index->end() && StringStartsWith(it->first, prefix); ++it) {
+            auto &ct = it->second;
+            if (ct->IsRoot() || found.count(it->first) ||
+                    CL->ComposeName(ct->Name, name) || !mask.Match(name))
+                continue;
+            found[it->first] = name;
+        }
+    }
+
+    for (auto &it: found)
+        names.push_back(it.second);
+}
+
 noinline TError GetContainer(const Porto::TGetContainerRequest &req,
                              Porto::TGetContainerResponse &rsp) {
-    std::list<std::string> masks, names;
+    std::vector<TStringMask> masks;
+    std::list<std::string> names;
     std::vector<std::string> props;
     TError error;
 
@@ -507,34 +627,18 @@ noinline TError GetContainer(const Porto::TGetContainerRequest &req,
     }
 
     if (names.empty() && masks.empty())
-        masks.push_back("***");
+        masks.emplace_back("***");
 
-    if (!masks.empty()) {
-        auto lock = LockContainers();
-        for (auto &it: Containers) {
-            auto &ct = it.second;
-            std::string name;
-            if (CL->ComposeName(ct->Name, name))
-                continue;
-            if (masks.empty())
-                names.push_back(name);
-            for (auto &mask: masks) {
-                if (StringMatch(name, mask)) {
-                    names.push_back(name);
-                    break;
-                }
-            }
-        }
-    }
+    if (!masks.empty())
+        MatchContainers(masks, true, names);
 
     for (auto &name: names) {
         std::shared_ptr<TContainer> ct;
 
-        auto lock = LockContainers();
-
-        error = CL->ResolveContainer(name, ct);
+        error = CL->LookupContainer(name, ct);
 
         if (!error && req.label_size()) {
+            auto lock = LockContainers();
             bool match = false;
             for (auto &label: req.label()) {
                 if (label.find_first_of("*?") == std::string::npos) {
@@ -553,8 +657,6 @@ noinline TError GetContainer(const Porto::TGetContainerRequest &req,
                 continue;
         }
 
-        lock.unlock();
-
         if (error && names.size() == 1)
             return error;
 
@@ -594,9 +696,9 @@ static noinline TError CreateContainer(std::string reqName, bool weak) {
         ct->IsWeak = true;
         ct->SetProp(EProperty::WEAK);
 
-        error = ct->Save();
+        error = ct->SaveLater();
         if (!error)
-            CL->WeakContainers.emplace_back(ct);
+            CL->AddWeakContainer(ct);
     }
 
     return error;
@@ -663,20 +765,97 @@ noinline TError RespawnContainer(const Porto::TRespawnRequest &req) {
     return ct->Respawn();
 }
 
+/* CRIU images hold credentials of tasks, restore from forged images gives root */
+static TError CheckCheckpointPath(const TPath &path) {
+    if (!CL->IsSuperUser())
+        return TError(EError::Permission, "Checkpoint and restore are allowed only for superuser");
+    if (!path.IsAbsolute())
+        return TError(EError::InvalidValue, "checkpoint path must be absolute");
+    return OK;
+}
+
+noinline TError CheckpointContainer(const Porto::TCheckpointRequest &req) {
+    TPath path = CL->ResolvePath(req.path());
+    std::shared_ptr<TContainer> ct;
+    TError error;
+
+    error = CheckCheckpointPath(path);
+    if (error)
+        return error;
+
+    error = CL->WriteContainer(req.name(), ct);
+    if (error)
+        return error;
+
+    return ct->Checkpoint(path, req.leave_running());
+}
+
+noinline TError RestoreContainer(const Porto::TRestoreRequest &req) {
+    TPath path = CL->ResolvePath(req.path());
+    std::shared_ptr<TContainer> ct;
+    Porto::TContainer spec;
+    std::string name;
+    bool created = false;
+    TError error;
+
+    error = CheckCheckpointPath(path);
+    if (error)
+        return error;
+
+    error = TContainer::LoadCheckpointSpec(path, spec);
+    if (error)
+        return error;
+
+    error = CL->ResolveName(req.name(), name);
+    if (error)
+        return error;
+
+    if (TContainer::Find(name)) {
+        error = CL->WriteContainer(req.name(), ct);
+        if (error)
+            return error;
+    } else {
+        error = TContainer::Create(name, ct);
+        if (error)
+            return error;
+        created = true;
+
+        error = CL->LockContainer(ct);
+        if (error)
+            return error;
+
+        error = ct->Load(spec);
+        if (error)
+            goto undo;
+    }
+
+    error = ct->RestoreCheckpoint(path);
+    if (error && created)
+        goto undo;
+
+    CL->ReleaseContainer();
+    return error;
+
+undo:
+    std::list<std::shared_ptr<TVolume>> unlinked;
+    (void)ct->Destroy(unlinked);
+    CL->ReleaseContainer();
+    TVolume::DeleteUnlinked(unlinked);
+    return error;
+}
+
 noinline TError ListContainers(const Porto::TListRequest &req,
                                Porto::TPortoResponse &rsp) {
-    std::string mask = req.has_mask() ? req.mask() : "***";
+    std::vector<TStringMask> masks = { TStringMask(req.has_mask() ? req.mask() : "***") };
     auto out = rsp.mutable_list();
+    std::list<std::string> names;
 
-    auto lock = LockContainers();
+    MatchContainers(masks, false, names);
 
-    for (auto &it: Containers) {
-        auto &ct = it.second;
-        std::string name;
-        if (ct->IsRoot() || CL->ComposeName(ct->Name, name) ||
-                !StringMatch(name, mask))
-            continue;
-        if (req.has_changed_since() && ct->ChangeTime < req.changed_since())
+    for (auto &name: names) {
+        std::shared_ptr<TContainer> ct;
+        if (req.has_changed_since() && (CL->LookupContainer(name, ct) ||
+                    ct->ChangeTime < req.changed_since()))
             continue;
         out->add_name(name);
     }
@@ -688,43 +867,42 @@ noinline TError ListContainers(const Porto::TListRequest &req,
 
 noinline TError FindLabel(const Porto::TFindLabelRequest &req, Porto::TFindLabelResponse &rsp) {
     auto label = req.label();
-    bool wild_label = label.find_first_of("*?") != std::string::npos;
+    TStringMask mask(req.mask());
+    std::vector<std::pair<TContainer *, std::string>> found;
 
+    /* labels are protected with ContainersMutex */
     auto lock = LockContainers();
-    for (auto &it: Containers) {
-        auto &ct = it.second;
+
+    /* Inherited labels are not indexed */
+    if (StringStartsWith(label, ".")) {
+        for (auto &it: Containers)
+            if (StringStartsWith(it.first, CL->PortoNamespace) &&
+                    label.find_first_of("*?") == std::string::npos)
+                found.emplace_back(it.second.get(), label);
+    } else
+        TContainer::FindLabels({ label }, CL->PortoNamespace, found);
+
+    for (auto &it: found) {
+        auto ct = it.first;
         std::string value;
         std::string name;
 
-        if (!StringStartsWith(ct->Name, CL->PortoNamespace))
-            continue;
-
         if (req.has_state() && TContainer::StateName(ct->State) != req.state())
             continue;
 
         name = ct->Name.substr(CL->PortoNamespace.length());
-        if (req.has_mask() && !StringMatch(name, req.mask()))
+        if (req.has_mask() && !mask.Match(name))
             continue;
 
-        if (wild_label) {
-            for (auto &it: ct->Labels) {
-                if (StringMatch(it.first, label) &&
-                        (!req.has_value() || it.second == req.value())) {
-                    auto l = rsp.add_list();
-                    l->set_name(name);
-                    l->set_state(TContainer::StateName(ct->State));
-                    l->set_label(it.first);
-                    l->set_value(it.second);
-                }
-            }
-        } else if (!ct->GetLabel(label, value) &&
-                (!req.has_value() || value == req.value())) {
-            auto l = rsp.add_list();
-            l->set_name(name);
-            l->set_state(TContainer::StateName(ct->State));
-            l->set_label(label);
-            l->set_value(value);
-        }
+        if (ct->GetLabel(it.second, value) ||
+                (req.has_value() && value != req.value()))
+            continue;
+
+        auto l = rsp.add_list();
+        l->set_name(name);
+        l->set_state(TContainer::StateName(ct->State));
+        l->set_label(it.second);
+        l->set_value(value);
     }
 
     return OK;
@@ -762,7 +940,7 @@ noinline TError SetLabel(const Porto::TSetLabelRequest &req, Porto::TSetLabelRes
     lock.unlock();
 
     TContainerWaiter::ReportAll(*ct, req.label(), req.value());
-    ct->Save();
+    ct->SaveLater();
 
     return OK;
 }
@@ -788,7 +966,7 @@ noinline TError IncLabel(const Porto::TIncLabelRequest &req, Porto::TIncLabelRes
         return error;
 
     TContainerWaiter::ReportAll(*ct, req.label(), std::to_string(result));
-    ct->Save();
+    ct->SaveLater();
 
     return OK;
 }
@@ -883,14 +1061,122 @@ out:
     return error;
 }
 
+noinline TError ReadStream(const Porto::TReadStreamRequest &req,
+                           Porto::TReadStreamResponse &rsp) {
+    std::shared_ptr<TContainer> ct;
+    TError error = CL->ReadContainer(req.name(), ct);
+    if (error)
+        return error;
+
+    ct->LockStateRead();
+
+    const TStdStream *stream;
+    if (!req.has_stream() || req.stream() == "stdout")
+        stream = &ct->Stdout;
+    else if (req.stream() == "stderr")
+        stream = &ct->Stderr;
+    else {
+        ct->UnlockState();
+        return TError(EError::InvalidValue, "Unknown stream {}", req.stream());
+    }
+
+    uint64_t offset = req.offset();
+    uint64_t limit = req.has_limit() ? req.limit() : stream->Limit;
+
+    /* Read right into response without intermediate copies */
+    error = stream->ReadAt(*ct, *rsp.mutable_data(), offset, limit,
+                           !req.has_offset());
+    if (!error) {
+        rsp.set_offset(offset);
+        rsp.set_next(offset + rsp.data().size());
+    }
+
+    ct->UnlockState();
+    return error;
+}
+
+noinline TError Exec(const Porto::TExecRequest &req,
+                     Porto::TExecResponse &rsp) {
+    std::shared_ptr<TContainer> ct;
+    TError error = CL->WriteContainer(req.name(), ct);
+    if (error)
+        return error;
+
+    /* Tasks are referenced by pid until reaped */
+    std::vector<TTask> tasks(req.command_size());
+    bool wait = req.has_wait() && req.wait();
+
+    for (int i = 0; i < req.command_size(); i++) {
+        std::vector<std::string> command(req.command(i).argv().begin(),
+                                         req.command(i).argv().end());
+        auto res = rsp.add_result();
+        pid_t pid;
+
+        ct->LockStateRead();
+        error = ct->Exec(command, wait, tasks[i], pid);
+        ct->UnlockState();
+
+        if (pid)
+            res->set_pid(pid);
+        if (error)
+            error.Dump(*res->mutable_error());
+    }
+
+    if (!wait)
+        return OK;
+
+    /* Do not block container operations while commands are running */
+    CL->ReleaseContainer();
+
+    /* Do not hold io worker forever, commands keep running after timeout */
+    uint64_t timeout = config().container().exec_timeout_ms();
+    if (req.has_timeout_ms() && req.timeout_ms() < timeout)
+        timeout = req.timeout_ms();
+    uint64_t deadline = GetCurrentTimeMs() + timeout;
+
+    for (int i = 0; i < req.command_size(); i++) {
+        auto res = rsp.mutable_result(i);
+        if (res->has_error())
+            continue;
+        uint64_t now = GetCurrentTimeMs();
+        if (!tasks[i].WaitDeliver(deadline > now ? deadline - now : 0)) {
+            tasks[i].Detach();
+            TError(EError::Busy, "Command is still running").Dump(*res->mutable_error());
+        } else
+            res->set_exit_status(tasks[i].Status);
+    }
+
+    return OK;
+}
+
+static TError GetValue(const Porto::TGetRequest &req, TContainer &ct,
+                       const TPropertyName &var, std::string &value,
+                       uint64_t &timestamp) {
+    TError error;
+
+    if (req.has_real() && req.real()) {
+        error = ct.HasProperty(var.Name);
+        if (error)
+            return error;
+    }
+
+    if (req.has_sync() && req.sync()) {
+        timestamp = GetRealTimeMs();
+        return ct.GetProperty(var, value);
+    }
+
+    return ct.GetCachedProperty(var, value, timestamp);
+}
+
 static void FillGetResponse(const Porto::TGetRequest &req,
+                            const std::vector<TPropertyName> &vars,
                             Porto::TGetResponse &rsp,
                             std::string &name) {
     std::shared_ptr<TContainer> ct;
+    TMemoryStatSnapshot memStat;
+    TIoStatSnapshot ioStat;
 
-    auto lock = LockContainers();
-    TError containerError = CL->ResolveContainer(name, ct);
-    lock.unlock();
+    TError containerError = CL->LookupContainer(name, ct);
 
     auto entry = rsp.add_list();
     entry->set_name(name);
@@ -906,19 +1192,18 @@ static void FillGetResponse(const Porto::TGetRequest &req,
         }
     }
 
-    for (int j = 0; j < req.variable_size(); j++) {
-        auto var = req.variable(j);
-
+    for (auto &var: vars) {
         auto keyval = entry->add_keyval();
         std::string value;
+        uint64_t timestamp = 0;
 
         TError error = containerError;
-        if (!error && req.has_real() && req.real())
-            error = ct->HasProperty(var);
         if (!error)
-            error = ct->GetProperty(var, value);
+            error = GetValue(req, *ct, var, value, timestamp);
 
-        keyval->set_variable(var);
+        keyval->set_variable(var.Name);
+        if (timestamp)
+            keyval->set_timestamp(timestamp);
         if (error) {
             keyval->set_error(error.Error);
             keyval->set_errormsg(error.Message());
@@ -932,10 +1217,96 @@ out:
         ct->UnlockState();
 }
 
+/* Canonical decimal which fits into uint64 */
+static bool IsNumericValue(const std::string &value) {
+    if (value.empty() || value.size() > 19 || (value[0] == '0' && value.size() > 1))
+        return false;
+    return value.find_first_not_of("0123456789") == std::string::npos;
+}
+
+/* Values of each variable are packed into one column, numeric if possible */
+static void FillGetColumns(const Porto::TGetRequest &req,
+                           const std::vector<TPropertyName> &vars,
+                           Porto::TGetResponse &rsp,
+                           std::list<std::string> &names) {
+    int nr_vars = req.variable_size();
+    std::vector<std::vector<std::string>> values(nr_vars);
+    std::vector<bool> numeric(nr_vars, true);
+    std::vector<Porto::TGetResponse::TGetColumn *> columns;
+
+    for (auto &var: req.variable()) {
+        auto column = rsp.add_column();
+        column->set_variable(var);
+        columns.push_back(column);
+    }
+
+    for (auto &name: names) {
+        std::shared_ptr<TContainer> ct;
+        TMemoryStatSnapshot memStat;
+        TIoStatSnapshot ioStat;
+
+        TError containerError = CL->LookupContainer(name, ct);
+
+        if (!containerError) {
+            ct->LockStateRead();
+
+            if (req.has_changed_since() && ct->ChangeTime < req.changed_since()) {
+                ct->UnlockState();
+                rsp.add_unchanged(name);
+                continue;
+            }
+        }
+
+        int row = rsp.container_size();
+        rsp.add_container(name);
+        rsp.add_change_time(containerError ? 0 : ct->ChangeTime);
+
+        for (int j = 0; j < nr_vars; j++) {
+            std::string value;
+            uint64_t timestamp = 0;
+
+            TError error = containerError;
+            if (!error)
+                error = GetValue(req, *ct, vars[j], value, timestamp);
+
+            if (error) {
+                columns[j]->add_error_row(row);
+                columns[j]->add_error(error.Error);
+                columns[j]->add_error_msg(error.Message());
+            } else if (numeric[j] && !IsNumericValue(value))
+                numeric[j] = false;
+
+            values[j].push_back(std::move(value));
+        }
+
+        if (!containerError)
+            ct->UnlockState();
+    }
+
+    for (int j = 0; j < nr_vars; j++) {
+        auto column = columns[j];
+
+        if (numeric[j]) {
+            column->mutable_number()->Reserve(values[j].size());
+            for (auto &value: values[j]) {
+                uint64_t number = 0;
+                if (!value.empty())
+                    StringToUint64(value, number);
+                column->add_number(number);
+            }
+        } else {
+            column->mutable_text()->Reserve(values[j].size());
+            for (auto &value: values[j])
+                column->add_text(std::move(value));
+        }
+    }
+}
+
 noinline TError GetContainerCombined(const Porto::TGetRequest &req,
                                      Porto::TPortoResponse &rsp) {
     auto get = rsp.mutable_get();
-    std::list <std::string> masks, names;
+    std::vector<TStringMask> masks;
+    std::list<std::string> names;
 
     for (int i = 0; i < req.name_size(); i++) {
         auto name = req.name(i);
@@ -945,29 +1316,68 @@ noinline TError GetContainerCombined(const Porto::TGetRequest &req,
             masks.push_back(name);
     }
 
-    if (!masks.empty()) {
-        auto lock = LockContainers();
-        for (auto &it: Containers) {
-            auto &ct = it.second;
-            std::string name;
-            if (ct->IsRoot() || CL->ComposeName(ct->Name, name))
-                continue;
-            if (masks.empty())
-                names.push_back(name);
-            for (auto &mask: masks) {
-                if (StringMatch(name, mask)) {
-                    names.push_back(name);
-                    break;
-                }
-            }
+    if (!masks.empty())
+        MatchContainers(masks, false, names);
+
+    if (req.has_sync() && req.sync()) {
+        std::list<std::shared_ptr<TContainer>> cts;
+        std::vector<std::string> vars(req.variable().begin(), req.variable().end());
+
+        for (auto &name: names) {
+            std::shared_ptr<TContainer> ct;
+            if (!CL->LookupContainer(name, ct))
+                cts.push_back(ct);
         }
+
+        TContainer::SyncProperties(cts, vars);
     }
 
-    if (req.has_sync() && req.sync())
-        TContainer::SyncPropertiesAll();
+    /* Parse and lookup property names once for all containers */
+    std::vector<TPropertyName> vars(req.variable().begin(), req.variable().end());
 
-    for (auto &name: names)
-        FillGetResponse(req, *get, name);
+    if (req.has_columnar() && req.columnar())
+        FillGetColumns(req, vars, *get, names);
+    else
+        for (auto &name: names)
+            FillGetResponse(req, vars, *get, name);
+
+    return OK;
+}
+
+/* Minimal period between subscription updates */
+constexpr uint64_t SUBSCRIPTION_MIN_PERIOD_MS = 100;
+
+noinline TError Subscribe(const Porto::TSubscribeRequest &req,
+                          Porto::TPortoResponse &rsp) {
+    auto conn = CL->Connection ? CL->Connection : CL->shared_from_this();
+    std::shared_ptr<TSubscription> sub;
+
+    rsp.mutable_subscribe();
+
+    if (req.period_ms()) {
+        if (req.period_ms() < SUBSCRIPTION_MIN_PERIOD_MS)
+            return TError(EError::InvalidValue, "Subscription period less than {} ms",
+                          SUBSCRIPTION_MIN_PERIOD_MS);
+        if (!req.name_size() || !req.variable_size())
+            return TError(EError::InvalidValue, "Containers and properties are not set");
+
+        sub = std::make_shared<TSubscription>();
+        sub->Client = conn;
+        sub->PeriodMs = req.period_ms();
+        for (auto &name: req.name())
+            sub->Request.add_name(name);
+        for (auto &var: req.variable())
+            sub->Request.add_variable(var);
+    }
+
+    /* Replaced subscription expires and stops reporting */
+    {
+        auto lock = conn->Lock();
+        conn->Subscription = sub;
+    }
+
+    if (sub)
+        sub->Schedule(0);
 
     return OK;
 }
@@ -1042,7 +1452,7 @@ noinline TError WaitContainers(const Porto::TWaitRequest &req, bool async,
         name = req.name(i);
 
         if (name == "***") {
-            waiter->Wildcards.push_back(name);
+            waiter->Wildcards.emplace_back(name);
             continue;
         }
 
@@ -1053,7 +1463,7 @@ noinline TError WaitContainers(const Porto::TWaitRequest &req, bool async,
         }
 
         if (name.find_first_of("*?") != std::string::npos) {
-            waiter->Wildcards.push_back(full_name);
+            waiter->Wildcards.emplace_back(full_name);
             continue;
         }
 
@@ -1086,25 +1496,30 @@ noinline TError WaitContainers(const Porto::TWaitRequest &req, bool async,
         }
     }
 
-    if (!waiter->Wildcards.empty()) {
+    if (!waiter->Wildcards.empty() && waiter->Labels.empty()) {
         for (auto &it: Containers) {
             auto &ct = it.second;
             if (!waiter->ShouldReport(*ct) || client->ComposeName(ct->Name, name))
                 continue;
 
-            if (waiter->Labels.empty()) {
-                client->MakeReport(name, ct->State, async);
-                if (!async)
-                    return TError::Queued();
-            } else {
-                for (auto &it: ct->Labels) {
-                    if (waiter->ShouldReportLabel(it.first)) {
-                        client->MakeReport(name, ct->State, async, it.first, it.second);
-                        if (!async)
-                            return TError::Queued();
-                    }
-                }
-            }
+            client->MakeReport(name, ct->State, async);
+            if (!async)
+                return TError::Queued();
+        }
+    } else if (!waiter->Wildcards.empty()) {
+        std::vector<std::pair<TContainer *, std::string>> found;
+
+        /* Only containers with matching labels, from label index */
+        TContainer::FindLabels(waiter->Labels, "", found);
+
+        for (auto &it: found) {
+            auto ct = it.first;
+            if (!waiter->ShouldReport(*ct) || client->ComposeName(ct->Name, name))
+                continue;
+
+            client->MakeReport(name, ct->State, async, it.second, ct->Labels.find(it.second)->second);
+            if (!async)
+                return TError::Queued();
         }
     }
 
@@ -1112,11 +1527,8 @@ noinline TError WaitContainers(const Porto::TWaitRequest &req, bool async,
         client->MakeReport("", EContainerState::UNDEFINED, async);
     } else {
         waiter->Activate(*client);
-        if (req.timeout_ms()) {
-            TEvent e(EEventType::WaitTimeout, nullptr);
-            e.WaitTimeout.Waiter = waiter;
-            EventQueue->Add(req.timeout_ms(), e);
-        }
+        if (req.timeout_ms())
+            waiter->SetTimeout(req.timeout_ms());
     }
 
     return async ? OK : TError::Queued();
@@ -1127,13 +1539,12 @@ noinline TError ConvertPath(const Porto::TConvertPathRequest &req,
     std::shared_ptr<TContainer> src, dst;
     TError error;
 
-    auto lock = LockContainers();
-    error = CL->ResolveContainer(
+    error = CL->LookupContainer(
             (req.has_source() && req.source().length()) ?
             req.source() : SELF_CONTAINER, src);
     if (error)
         return error;
-    error = CL->ResolveContainer(
+    error = CL->LookupContainer(
             (req.has_destination() && req.destination().length()) ?
             req.destination() : SELF_CONTAINER, dst);
     if (error)
@@ -1187,7 +1598,7 @@ noinline TError CreateVolume(const Porto::TCreateVolumeRequest &req,
     if (error)
         goto err;
 
-    error = TVolume::Create(spec, volume);
+    error = TVolume::Create(spec, volume, req.async_build());
     if (error)
         goto err;
 
@@ -1282,11 +1693,24 @@ noinline TError UnlinkVolume(const Porto::TUnlinkVolumeRequest &req) {
     if (error)
         return error;
 
+    /* Builder deletes volume by itself if build fails */
+    if (!ct) {
+        auto volumes_lock = LockVolumes();
+        if (volume->State == EVolumeState::BUILDING)
+            return TError(EError::VolumeNotReady, "Volume {} is building", volume->Path);
+    }
+
     if (ct) {
         std::list<std::shared_ptr<TVolume>> unlinked;
         error = volume->UnlinkVolume(ct, req.has_target() ? req.target() : "***", unlinked, req.strict());
         CL->ReleaseContainer();
-        TVolume::DeleteUnlinked(unlinked);
+        if (req.async_delete())
+            TVolume::DeleteAsync(unlinked);
+        else
+            TVolume::DeleteUnlinked(unlinked);
+    } else if (req.async_delete()) {
+        std::list<std::shared_ptr<TVolume>> unlinked = {volume};
+        TVolume::DeleteAsync(unlinked);
     } else {
         error = volume->Delete();
     }
@@ -1315,8 +1739,7 @@ noinline TError ListVolumes(const Porto::TListVolumesRequest &req,
     TPath base_path;
     if (req.has_container()) {
         std::shared_ptr<TContainer> ct;
-        auto lock = LockContainers();
-        error = CL->ResolveContainer(req.container(), ct);
+        error = CL->LookupContainer(req.container(), ct);
         if (error)
             return error;
         base_path = ct->RootPath;
@@ -1325,10 +1748,11 @@ noinline TError ListVolumes(const Porto::TListVolumesRequest &req,
 
     std::map<TPath, std::shared_ptr<TVolumeLink>> map;
     auto volumes_lock = LockVolumes();
-    for (auto &it: VolumeLinks) {
-        TPath path = base_path.InnerPath(it.first);
-        if (path)
-            map[path] = it.second;
+    for (auto it = VolumeLinks.lower_bound(base_path); it != VolumeLinks.end(); ++it) {
+        TPath path = base_path.InnerPath(it->first);
+        if (!path)
+            break;
+        map[path] = it->second;
     }
     volumes_lock.unlock();
 
@@ -1351,7 +1775,7 @@ noinline TError NewVolume(const Porto::TNewVolumeRequest &req,
     Statistics->VolumesCreated++;
 
     std::shared_ptr<TVolume> volume;
-    TError error = TVolume::Create(req.volume(), volume);
+    TError error = TVolume::Create(req.volume(), volume, req.async_build());
     if (error) {
         Statistics->VolumesFailed++;
         return error;
@@ -1399,7 +1823,12 @@ noinline TError GetVolume(const Porto::TGetVolumeRequest &req,
         std::map<TPath, std::shared_ptr<TVolumeLink>> map;
 
         auto volumes_lock = LockVolumes();
-        for (auto &it: VolumeLinks) {
+        for (auto link_it = VolumeLinks.lower_bound(ct->RootPath); link_it != VolumeLinks.end(); ++link_it) {
+            auto &it = *link_it;
+            TPath path = ct->RootPath.InnerPath(it.first);
+            if (!path)
+                break;
+
             auto volume = it.second->Volume.get();
 
             if (req.label_size()) {
@@ -1422,9 +1851,7 @@ noinline TError GetVolume(const Porto::TGetVolumeRequest &req,
                     continue;
             }
 
-            TPath path = ct->RootPath.InnerPath(it.first);
-            if (path)
-                map[path] = it.second;
+            map[path] = it.second;
         }
         volumes_lock.unlock();
 
@@ -1501,6 +1928,9 @@ noinline TError ExportLayer(const Porto::TExportLayerRequest &req) {
         if (error)
             return error;
 
+        if (req.has_changed_since())
+            return TError(EError::InvalidValue, "changed_since is supported only for volumes");
+
         return layer.ExportArchive(CL->ResolvePath(req.tarball()),
                                    req.has_compress() ? req.compress() : "");
     }
@@ -1520,7 +1950,8 @@ noinline TError ExportLayer(const Porto::TExportLayerRequest &req) {
         return error;
 
     return layer.ExportArchive(CL->ResolvePath(req.tarball()),
-                               req.has_compress() ? req.compress() : "");
+                               req.has_compress() ? req.compress() : "",
+                               req.changed_since());
 }
 
 noinline TError RemoveLayer(const Porto::TRemoveLayerRequest &req) {
@@ -1560,6 +1991,9 @@ noinline TError ListLayers(const Porto::TListLayersRequest &req,
         desc->set_owner_group(layer.Owner.Group());
         desc->set_private_value(layer.Private);
         desc->set_last_usage(layer.LastUsage());
+        uint64_t unique = layer.UniqueSize();
+        if (unique)
+            desc->set_unique_size(unique);
     }
 
     return error;
@@ -1715,6 +2149,15 @@ noinline TError ListStorages(const Porto::TListStoragesRequest &req,
         }
     }
 
+    TPlaceQueueStat stat;
+    TStorage::PlaceQueueStat(place.Place, stat);
+    auto queue = list->mutable_queue();
+    queue->set_running(stat.Running);
+    queue->set_queued(stat.Queued);
+    queue->set_queued_bytes(stat.QueuedBytes);
+    queue->set_rate(stat.Rate);
+    queue->set_eta(stat.Eta);
+
     return error;
 }
 
@@ -1822,13 +2265,79 @@ noinline TError SetSymlink(const Porto::TSetSymlinkRequest &req) {
     error = ct->SetSymlink(req.symlink(), req.target());
     if (error)
         return error;
-    return ct->Save();
+    return ct->SaveLater();
+}
+
+static std::string BatchItemName(const Porto::TBatchRequest::TBatchItem &item) {
+    if (item.has_setproperty())
+        return item.setproperty().name();
+    if (item.has_start())
+        return item.start().name();
+    if (item.has_stop())
+        return item.stop().name();
+    if (item.has_pause())
+        return item.pause().name();
+    if (item.has_resume())
+        return item.resume().name();
+    return "";
+}
+
+noinline TError Batch(const Porto::TBatchRequest &req,
+                      Porto::TBatchResponse &rsp) {
+    for (auto &item: req.item()) {
+        TError error;
+
+        int ops = item.has_create() + item.has_destroy() +
+                  item.has_setproperty() + item.has_start() +
+                  item.has_stop() + item.has_pause() +
+                  item.has_resume() + item.has_kill();
+
+        /*
+         * Action lock is kept while consecutive items change the same
+         * container, create, destroy and kill always start from scratch.
+         */
+        if (CL->LockedContainer) {
+            std::string name;
+            if (ops != 1 || CL->ResolveName(BatchItemName(item), name) ||
+                    name != CL->LockedContainer->Name)
+                CL->ReleaseContainer();
+        }
+
+        if (ops != 1)
+            error = TError(EError::InvalidMethod, "Batch item has {} methods", ops);
+        else if (item.has_create())
+            error = CreateContainer(item.create().name(), false);
+        else if (item.has_destroy())
+            error = DestroyContainer(item.destroy());
+        else if (item.has_setproperty())
+            error = SetContainerProperty(item.setproperty());
+        else if (item.has_start())
+            error = StartContainer(item.start());
+        else if (item.has_stop())
+            error = StopContainer(item.stop());
+        else if (item.has_pause())
+            error = PauseContainer(item.pause());
+        else if (item.has_resume())
+            error = ResumeContainer(item.resume());
+        else if (item.has_kill())
+            error = Kill(item.kill());
+
+        error.Dump(*rsp.add_result());
+
+        if (error && req.stop_on_error())
+            break;
+    }
+
+    CL->ReleaseContainer();
+
+    return OK;
 }
 
 noinline static TError GetSystemProperties(const Porto::TGetSystemRequest *, Porto::TGetSystemResponse *rsp) {
     rsp->set_porto_version(PORTO_VERSION);
     rsp->set_porto_revision(PORTO_REVISION);
     rsp->set_kernel_version(config().linux_version());
+    SyncStatistics();
     rsp->set_errors(Statistics->Errors);
     rsp->set_warnings(Statistics->Warns);
     rsp->set_porto_starts(Statistics->PortoStarts);
@@ -1883,6 +2392,12 @@ noinline static TError GetSystemProperties(const Porto::TGetSystemRequest *, Por
     rsp->set_request_longer_3s(Statistics->RequestsLonger3s);
     rsp->set_request_longer_30s(Statistics->RequestsLonger30s);
     rsp->set_request_longer_5m(Statistics->RequestsLonger5m);
+    rsp->set_request_queue_wait_ms(Statistics->RequestsQueueWaitMs);
+    rsp->set_request_longest_wait_ms(Statistics->RequestsLongestWait);
+    rsp->set_request_stolen(Statistics->RequestsStolen);
+    rsp->set_request_queued_ro(Statistics->RequestsQueuedRo);
+    rsp->set_request_queued_rw(Statistics->RequestsQueuedRw);
+    rsp->set_request_queued_io(Statistics->RequestsQueuedIo);
 
     rsp->set_fail_system(Statistics->FailSystem);
     rsp->set_fail_invalid_value(Statistics->FailInvalidValue);
@@ -1925,12 +2440,218 @@ noinline static TError GetSystemConfig(const Porto::TGetSystemConfigRequest *,
     return OK;
 }
 
+noinline static TError GetTrace(const Porto::TGetTraceRequest *req,
+                                Porto::TGetTraceResponse *rsp) {
+    if (!CL->IsSuperUser())
+        return TError(EError::Permission, "Only for super-user");
+
+    return DumpTrace(req->has_format() ? req->format() : "chrome",
+                     req->min_duration_ms(), *rsp->mutable_trace());
+}
+
+/*
+ * Log2 latency histograms per request type, separately for queue wait and
+ * handling. Each request thread counts into own buckets, read merges them.
+ */
+
+static const std::vector<std::string> RpcLatencyTypes = {
+    "Get", "Set", "List", "Create", "Destroy", "Start", "Stop", "Kill",
+    "Wait", "AsyncWait", "CreateVolume", "LinkVolume", "UnlinkVolume",
+    "ListVolumes", "ImportLayer", "ExportLayer", "RemoveLayer", "Other",
+};
+
+constexpr int RPC_LATENCY_TYPES = 18;
+constexpr int RPC_LATENCY_BUCKETS = 32;  /* bucket i: less than 2^i usec */
+
+struct TRpcLatency {
+    std::atomic<uint64_t> Wait[RPC_LATENCY_TYPES][RPC_LATENCY_BUCKETS];
+    std::atomic<uint64_t> Handle[RPC_LATENCY_TYPES][RPC_LATENCY_BUCKETS];
+    std::atomic<uint64_t> CpuUs[RPC_LATENCY_TYPES];
+};
+
+static std::mutex RpcLatencyMutex;
+static std::vector<std::shared_ptr<TRpcLatency>> RpcLatencyThreads;
+static thread_local std::shared_ptr<TRpcLatency> RpcLatencyLocal;
+
+static int RpcLatencyBucket(uint64_t usec) {
+    int bucket = 0;
+    while (usec && bucket < RPC_LATENCY_BUCKETS - 1) {
+        usec >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+static void RpcLatencyAccount(const std::string &cmd, uint64_t waitUs, uint64_t handleUs,
+                              uint64_t cpuUs) {
+    if (!RpcLatencyLocal) {
+        RpcLatencyLocal = std::make_shared<TRpcLatency>();
+        std::lock_guard<std::mutex> guard(RpcLatencyMutex);
+        RpcLatencyThreads.push_back(RpcLatencyLocal);
+    }
+
+    int type = RPC_LATENCY_TYPES - 1;
+    for (int i = 0; i < RPC_LATENCY_TYPES - 1; i++) {
+        if (RpcLatencyTypes[i] == cmd) {
+            type = i;
+            break;
+        }
+    }
+
+    RpcLatencyLocal->Wait[type][RpcLatencyBucket(waitUs)].fetch_add(1, std::memory_order_relaxed);
+    RpcLatencyLocal->Handle[type][RpcLatencyBucket(handleUs)].fetch_add(1, std::memory_order_relaxed);
+    RpcLatencyLocal->CpuUs[type].fetch_add(cpuUs, std::memory_order_relaxed);
+}
+
+/* Upper bound of bucket which contains given quantile */
+static uint64_t RpcLatencyQuantile(const uint64_t *hist, uint64_t count, uint64_t permille) {
+    uint64_t rank = (count * permille + 999) / 1000, sum = 0;
+    for (int i = 0; i < RPC_LATENCY_BUCKETS; i++) {
+        sum += hist[i];
+        if (sum >= rank)
+            return 1ull << i;
+    }
+    return 1ull << (RPC_LATENCY_BUCKETS - 1);
+}
+
+void RpcLatencyStat(TUintMap &stat) {
+    uint64_t wait[RPC_LATENCY_TYPES][RPC_LATENCY_BUCKETS] = {};
+    uint64_t handle[RPC_LATENCY_TYPES][RPC_LATENCY_BUCKETS] = {};
+    uint64_t cpu[RPC_LATENCY_TYPES] = {};
+
+    std::unique_lock<std::mutex> lock(RpcLatencyMutex);
+    for (auto &thread: RpcLatencyThreads) {
+        for (int t = 0; t < RPC_LATENCY_TYPES; t++) {
+            cpu[t] += thread->CpuUs[t].load(std::memory_order_relaxed);
+            for (int i = 0; i < RPC_LATENCY_BUCKETS; i++) {
+                wait[t][i] += thread->Wait[t][i].load(std::memory_order_relaxed);
+                handle[t][i] += thread->Handle[t][i].load(std::memory_order_relaxed);
+            }
+        }
+    }
+    lock.unlock();
+
+    for (int t = 0; t < RPC_LATENCY_TYPES; t++) {
+        uint64_t count = 0;
+        for (int i = 0; i < RPC_LATENCY_BUCKETS; i++)
+            count += handle[t][i];
+        if (!count)
+            continue;
+
+        std::string prefix = "rpc_" + RpcLatencyTypes[t];
+        std::transform(prefix.begin(), prefix.end(), prefix.begin(), ::tolower);
+        stat[prefix + "_count"] = count;
+        stat[prefix + "_cpu_us"] = cpu[t];
+        stat[prefix + "_wait_p50_us"] = RpcLatencyQuantile(wait[t], count, 500);
+        stat[prefix + "_wait_p99_us"] = RpcLatencyQuantile(wait[t], count, 990);
+        stat[prefix + "_handle_p50_us"] = RpcLatencyQuantile(handle[t], count, 500);
+        stat[prefix + "_handle_p99_us"] = RpcLatencyQuantile(handle[t], count, 990);
+        for (int i = 0; i < RPC_LATENCY_BUCKETS; i++) {
+            if (wait[t][i])
+                stat[prefix + "_wait_us_" + std::to_string(1ull << i)] = wait[t][i];
+            if (handle[t][i])
+                stat[prefix + "_handle_us_" + std::to_string(1ull << i)] = handle[t][i];
+        }
+    }
+}
+
+/*
+ * Thread cpu time of requests per client comm, client container and
+ * request type. Key "comm@container@Type" maps to one flame graph stack.
+ */
+
+constexpr size_t RPC_CPU_CLIENTS_MAX = 1024;
+
+struct TRpcCpu {
+    uint64_t Requests = 0;
+    uint64_t CpuUs = 0;
+};
+
+/* Per-thread maps, thread mutex is contended only by readers */
+struct TRpcCpuThread {
+    std::mutex Mutex;
+    std::unordered_map<std::string, TRpcCpu> Clients;
+};
+
+static std::mutex RpcCpuMutex;
+static std::vector<std::shared_ptr<TRpcCpuThread>> RpcCpuThreads;
+static thread_local std::shared_ptr<TRpcCpuThread> RpcCpuLocal;
+
+/* Keep key parsable as part of uint map */
+static std::string RpcCpuKeyPart(const std::string &str) {
+    std::string key = str.empty() ? "_" : str;
+    for (auto &c: key)
+        if (c == '@' || c == ':' || c == ';' || c == ',' || isspace((unsigned char)c))
+            c = '_';
+    return key;
+}
+
+static TRpcCpu &RpcCpuEntry(std::unordered_map<std::string, TRpcCpu> &clients,
+                            const std::string &key, const std::string &cmd) {
+    auto it = clients.find(key);
+    if (it == clients.end()) {
+        /* Stop growing, all new clients go into one bucket */
+        if (clients.size() >= RPC_CPU_CLIENTS_MAX)
+            return clients["other@other@" + cmd];
+        it = clients.emplace(key, TRpcCpu()).first;
+    }
+    return it->second;
+}
+
+static void RpcCpuAccount(const TClient &client, const std::string &cmd, uint64_t cpuUs) {
+    std::string key = RpcCpuKeyPart(client.Comm) + "@" +
+                      RpcCpuKeyPart(client.ClientContainer ? client.ClientContainer->Name : "") +
+                      "@" + cmd;
+
+    if (!RpcCpuLocal) {
+        RpcCpuLocal = std::make_shared<TRpcCpuThread>();
+        std::lock_guard<std::mutex> guard(RpcCpuMutex);
+        RpcCpuThreads.push_back(RpcCpuLocal);
+    }
+
+    std::lock_guard<std::mutex> guard(RpcCpuLocal->Mutex);
+    auto &entry = RpcCpuEntry(RpcCpuLocal->Clients, key, cmd);
+    entry.Requests++;
+    entry.CpuUs += cpuUs;
+}
+
+void RpcClientCpuStat(TUintMap &stat) {
+    std::unique_lock<std::mutex> lock(RpcCpuMutex);
+    auto threads = RpcCpuThreads;
+    lock.unlock();
+
+    std::unordered_map<std::string, TRpcCpu> clients;
+    for (auto &thread: threads) {
+        std::lock_guard<std::mutex> guard(thread->Mutex);
+        for (auto &it: thread->Clients) {
+            auto cmd = it.first.substr(it.first.rfind('@') + 1);
+            auto &entry = RpcCpuEntry(clients, it.first, cmd);
+            entry.Requests += it.second.Requests;
+            entry.CpuUs += it.second.CpuUs;
+        }
+    }
+
+    for (auto &it: clients) {
+        stat["client_requests_" + it.first] = it.second.Requests;
+        stat["client_cpu_us_" + it.first] = it.second.CpuUs;
+    }
+}
+
 TError TRequest::Check() {
     auto req_ref = Req.GetReflection();
 
     std::vector<const google::protobuf::FieldDescriptor *> req_fields;
     req_ref->ListFields(Req, &req_fields);
 
+    if (Req.has_request_id()) {
+        req_fields.erase(std::remove_if(req_fields.begin(), req_fields.end(),
+                    [](const google::protobuf::FieldDescriptor *field) {
+                        return field->number() == Porto::TPortoRequest::kRequestIdFieldNumber;
+                    }), req_fields.end());
+        if (Req.has_wait() || Req.has_asyncwait())
+            return TError(EError::InvalidMethod, "Wait cannot be pipelined");
+    }
+
     if (req_fields.size() != 1)
         return TError(EError::InvalidMethod, "Request has {} known methods", req_fields.size());
 
@@ -1951,17 +2672,30 @@ void TRequest::Handle() {
     Porto::TPortoResponse rsp;
     TError error;
 
+    if (Task) {
+        Task();
+        return;
+    }
+
     Client->StartRequest();
+    RequestTrace.Begin(Cmd, Arg);
     StartTime = GetCurrentTimeMs();
+    uint64_t startUs = GetCurrentTimeUs();
+    uint64_t startCpuUs = GetThreadCpuTimeUs();
     auto timestamp = time(nullptr);
 
+    StatAdd(STAT_REQUESTS_QUEUE_WAIT_MS, StartTime - QueueTime);
+    if (StartTime - QueueTime > Statistics->RequestsLongestWait)
+        Statistics->RequestsLongestWait = StartTime - QueueTime;
+
     Parse();
     error = Check();
 
     if (!error && (!RoReq || Verbose))
         L_REQ("{} {} {} from {}", Cmd, Arg, Opt, Client->Id);
 
-    L_DBG("Raw request: {}", Req.ShortDebugString());
+    /* Parsed by portoctl replay record */
+    L_DBG("Raw request from {} queued={}: {}", Client->Id, QueueTimeUs, Req.ShortDebugString());
 
     if (error)
         L_VERBOSE("Invalid request from {} : {} : {}", Client->Id, error, Req.ShortDebugString());
@@ -1975,6 +2709,14 @@ void TRequest::Handle() {
         error = SetContainer(Req.setcontainer(), *rsp.mutable_setcontainer());
     else if (Req.has_getcontainer())
         error = GetContainer(Req.getcontainer(), *rsp.mutable_getcontainer());
+    else if (Req.has_batch())
+        error = Batch(Req.batch(), *rsp.mutable_batch());
+    else if (Req.has_subscribe())
+        error = Subscribe(Req.subscribe(), rsp);
+    else if (Req.has_readstream())
+        error = ReadStream(Req.readstream(), *rsp.mutable_readstream());
+    else if (Req.has_exec())
+        error = Exec(Req.exec(), *rsp.mutable_exec());
     else if (Req.has_create())
         error = CreateContainer(Req.create().name(), false);
     else if (Req.has_createweak())
@@ -2001,6 +2743,10 @@ void TRequest::Handle() {
         error = ResumeContainer(Req.resume());
     else if (Req.has_respawn())
         error = RespawnContainer(Req.respawn());
+    else if (Req.has_checkpoint())
+        error = CheckpointContainer(Req.checkpoint());
+    else if (Req.has_restore())
+        error = RestoreContainer(Req.restore());
     else if (Req.has_listproperties())
         error = ListProperties(rsp);
     else if (Req.has_listdataproperties())
@@ -2083,14 +2829,26 @@ void TRequest::Handle() {
         error = SetSystemProperties(&Req.setsystem(), rsp.mutable_setsystem());
     else if (Req.has_getsystemconfig())
         error = GetSystemConfig(&Req.getsystemconfig(), rsp.mutable_getsystemconfig());
+    else if (Req.has_gettrace())
+        error = GetTrace(&Req.gettrace(), rsp.mutable_gettrace());
     else
         error = TError(EError::InvalidMethod, "invalid RPC method");
 
+    if (!error)
+        error = Client->FlushContainer();
+
     FinishTime = GetCurrentTimeMs();
+    RequestTrace.Finish();
     Client->FinishRequest();
 
-    Statistics->RequestsCompleted++;
-    Statistics->RequestsQueued--;
+    uint64_t cpuUs = GetThreadCpuTimeUs() - startCpuUs;
+    RpcLatencyAccount(Cmd, startUs - QueueTimeUs, GetCurrentTimeUs() - startUs, cpuUs);
+    RpcCpuAccount(*Client, Cmd, cpuUs);
+    if (Client->ClientContainer)
+        Client->ClientContainer->ContainerRequestsCpuUs += cpuUs;
+
+    StatAdd(STAT_REQUESTS_COMPLETED, 1);
+    StatAdd(STAT_REQUESTS_QUEUED, -1);
 
     uint64_t RequestTime = FinishTime - QueueTime;
     if (RequestTime > 1000)
@@ -2133,6 +2891,8 @@ void TRequest::Handle() {
     rsp.set_error(error.Error);
     rsp.set_errormsg(error.Message());
     rsp.set_timestamp(timestamp);
+    if (Req.has_request_id())
+        rsp.set_request_id(Req.request_id());
 
     if (!RoReq || Verbose) {
         L_RSP("{} {} {} to {} time={}+{} ms", Cmd, Arg, ResponseAsString(rsp),
@@ -2146,25 +2906,79 @@ void TRequest::Handle() {
 
     L_DBG("Raw response: {}", rsp.ShortDebugString());
 
-    auto lock = Client->Lock();
-    Client->Processing = false;
-    error = Client->QueueResponse(rsp);
-    if (!error && !Client->Sending)
-        error = Client->SendResponse(true);
+    auto conn = Client->Connection ? Client->Connection : Client;
+    auto lock = conn->Lock();
+    if (Client->Connection)
+        conn->Pipelined--;
+    else
+        conn->Processing = false;
+    error = conn->QueueResponse(rsp);
+    if (!error && !conn->Sending)
+        error = conn->SendResponse(true);
     if (error)
-        L_WRN("Cannot send response for {} : {}", Client->Id, error);
+        L_WRN("Cannot send response for {} : {}", conn->Id, error);
 }
 
+/* Take lower priority request after that many higher in a row */
+constexpr int RPC_PRIO_BURST = 8;
+
 class TRequestQueue {
     std::vector<std::unique_ptr<std::thread>> Threads;
-    std::queue<std::unique_ptr<TRequest>> Queue;
+    std::deque<std::unique_ptr<TRequest>> Queue[NR_RPC_PRIO];
+    int Burst[NR_RPC_PRIO] = { 0 };
+    size_t Size = 0;
+    int Idle = 0;
     std::condition_variable Wakeup;
     std::mutex Mutex;
     bool ShouldStop = false;
     const std::string Name;
+    std::atomic<uint64_t> TStatistics::*Depth;
+
+    /* idle threads of this queue pick requests from donor */
+    TRequestQueue *Donor = nullptr;
+    TRequestQueue *Thief = nullptr;
+
+    std::unique_ptr<TRequest> Pop() {
+        int prio = 0;
+
+        while (Queue[prio].empty())
+            prio++;
+
+        for (int next = prio + 1; next < NR_RPC_PRIO; next++) {
+            if (Queue[next].empty())
+                continue;
+            if (++Burst[prio] <= RPC_PRIO_BURST)
+                break;
+            Burst[prio] = 0;
+            prio = next;
+        }
+
+        auto request = std::unique_ptr<TRequest>(std::move(Queue[prio].front()));
+        Queue[prio].pop_front();
+        Size--;
+        (Statistics->*Depth)--;
+        return request;
+    }
+
+    /* called with own Mutex locked */
+    std::unique_ptr<TRequest> Steal() {
+        if (!Donor)
+            return nullptr;
+        std::unique_lock<std::mutex> lock(Donor->Mutex);
+        if (!Donor->Size || Donor->Idle)
+            return nullptr;
+        Statistics->RequestsStolen++;
+        return Donor->Pop();
+    }
 
 public:
-    TRequestQueue(const std::string &name) : Name(name) {}
+    TRequestQueue(const std::string &name, std::atomic<uint64_t> TStatistics::*depth) :
+        Name(name), Depth(depth) {}
+
+    void StealFrom(TRequestQueue &donor) {
+        Donor = &donor;
+        donor.Thief = this;
+    }
 
     void Start(int thread_count) {
         for (int index = 0; index < thread_count; index++)
@@ -2183,22 +2997,42 @@ public:
     }
 
     void Enqueue(std::unique_ptr<TRequest> &request) {
+        int prio = request->Priority;
+
         Mutex.lock();
-        Queue.push(std::move(request));
+        Queue[prio].push_back(std::move(request));
+        Size++;
+        (Statistics->*Depth)++;
+        bool idle = Idle;
         Mutex.unlock();
-        Wakeup.notify_one();
+
+        if (idle || !Thief) {
+            Wakeup.notify_one();
+        } else {
+            /* sync with thief which checks donor under own lock */
+            Thief->Mutex.lock();
+            Thief->Mutex.unlock();
+            Thief->Wakeup.notify_one();
+        }
     }
 
     void Run(int index) {
         SetProcessName(fmt::format("{}{}", Name, index));
         auto lock = std::unique_lock<std::mutex>(Mutex);
         while (true) {
-            while (Queue.empty() && !ShouldStop)
+            std::unique_ptr<TRequest> request;
+
+            Idle++;
+            while (!Size && !ShouldStop && !(request = Steal()))
                 Wakeup.wait(lock);
-            if (ShouldStop)
+            Idle--;
+
+            if (ShouldStop && !request)
                 break;
-            auto request = std::unique_ptr<TRequest>(std::move(Queue.front()));
-            Queue.pop();
+
+            if (!request)
+                request = Pop();
+
             lock.unlock();
             request->Handle();
             request = nullptr;
@@ -2208,11 +3042,13 @@ public:
     }
 };
 
-static TRequestQueue RwQueue("portod-RW");
-static TRequestQueue RoQueue("portod-RO");
-static TRequestQueue IoQueue("portod-IO");
+static TRequestQueue RwQueue("portod-RW", &TStatistics::RequestsQueuedRw);
+static TRequestQueue RoQueue("portod-RO", &TStatistics::RequestsQueuedRo);
+static TRequestQueue IoQueue("portod-IO", &TStatistics::RequestsQueuedIo);
 
 void StartRpcQueue() {
+    /* read requests never block, writer threads could serve them when idle */
+    RwQueue.StealFrom(RoQueue);
     RwQueue.Start(config().daemon().rw_threads());
     RoQueue.Start(config().daemon().ro_threads());
     IoQueue.Start(config().daemon().io_threads());
@@ -2225,8 +3061,9 @@ void StopRpcQueue() {
 }
 
 void QueueRpcRequest(std::unique_ptr<TRequest> &request) {
-    Statistics->RequestsQueued++;
+    StatAdd(STAT_REQUESTS_QUEUED, 1);
     request->QueueTime = GetCurrentTimeMs();
+    request->QueueTimeUs = GetCurrentTimeUs();
     request->Classify();
     if (request->RoReq)
         RoQueue.Enqueue(request);
@@ -2235,3 +3072,10 @@ void QueueRpcRequest(std::unique_ptr<TRequest> &request) {
     else
         RwQueue.Enqueue(request);
 }
+
+void QueueRoTask(const std::function<void()> &task) {
+    auto request = std::unique_ptr<TRequest>(new TRequest());
+    request->Task = task;
+    request->Priority = RPC_PRIO_LOW;
+    RoQueue.Enqueue(request);
+}
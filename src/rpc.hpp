@@ -1,9 +1,20 @@
 #pragma once
 
 #include "common.hpp"
+#include "util/string.hpp"
+
+#include <functional>
 
 class TClient;
 
+/* Lower value is served first */
+enum ERequestPriority {
+    RPC_PRIO_HIGH,      /* cheap monitoring reads */
+    RPC_PRIO_NORMAL,
+    RPC_PRIO_LOW,       /* bulk and slow writes */
+    NR_RPC_PRIO,
+};
+
 class TRequest {
 public:
     std::shared_ptr<TClient> Client;
@@ -12,20 +23,31 @@ public:
     uint64_t QueueTime;
     uint64_t StartTime;
     uint64_t FinishTime;
+    uint64_t QueueTimeUs;
 
     bool RoReq;
     bool IoReq;
+    int Priority;
 
     std::string Cmd;
     std::string Arg;
     std::string Opt;
 
+    std::function<void()> Task; /* internal read-only work without client */
+
     void Classify();
     void Parse();
     TError Check();
     void Handle();
 };
 
+TError GetContainerCombined(const Porto::TGetRequest &req,
+                            Porto::TPortoResponse &rsp);
+
+void RpcLatencyStat(TUintMap &stat);
+void RpcClientCpuStat(TUintMap &stat);
+
 void StartRpcQueue();
 void StopRpcQueue();
 void QueueRpcRequest(std::unique_ptr<TRequest> &req);
+void QueueRoTask(const std::function<void()> &task);
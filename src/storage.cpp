@@ -6,14 +6,18 @@
 #include "client.hpp"
 #include <algorithm>
 #include <condition_variable>
+#include <unordered_map>
 #include "util/unix.hpp"
 #include "util/log.hpp"
 #include "util/string.hpp"
 #include "util/md5.hpp"
+#include "util/sha256.hpp"
 #include "util/quota.hpp"
+#include "util/worker.hpp"
 
 extern "C" {
 #include <sys/stat.h>
+#include <sys/xattr.h>
 #include <fcntl.h>
 #include <unistd.h>
 }
@@ -25,6 +29,9 @@ static const char REMOVE_PREFIX[] = "_remove_";
 static const char PRIVATE_PREFIX[] = "_private_";
 static const char META_PREFIX[] = "_meta_";
 static const char META_LAYER[] = "_layer_";
+static const char DEDUP_STORE[] = "_dedup_";
+
+static constexpr uint64_t DEDUP_MIN_SIZE = 4096;
 
 /* Protected with VolumesMutex */
 
@@ -39,8 +46,56 @@ static bool PathIsActive(const TPath &path) {
 
 static std::condition_variable StorageCv;
 
-static TUintMap PlaceLoad;
+struct TPlaceWaiter {
+    uint64_t Seq;
+    uint64_t Bytes;
+    uint64_t Since;
+};
+
+struct TPlaceQueue {
+    uint64_t Running = 0;
+    uint64_t RunningBytes = 0;
+    uint64_t Rate = 0;          /* bytes per second, moving average */
+    std::list<TPlaceWaiter> Waiters;
+};
+
+static std::map<std::string, TPlaceQueue> PlaceQueues;
+static uint64_t PlaceWaiterSeq = 0;
 static TUintMap PlaceLoadLimit;
+static TUintMap RemoveIopsLimit;
+static TUintMap RemoveBpsLimit;
+
+struct TRemoveJob {
+    TPath Place;
+    TPath Path;
+    EStorageType Type;
+    uint64_t Bytes;
+};
+
+class TStorageRemover : public TWorker<TRemoveJob> {
+public:
+    TStorageRemover() : TWorker("portod-remove", 1) {}
+
+    const TRemoveJob &Top() override {
+        return Queue.front();
+    }
+
+    bool Handle(const TRemoveJob &job) override {
+        (void)TStorage::RemoveData(job.Place, job.Path, job.Type, job.Bytes);
+        return true;
+    }
+
+    /* Throttling delay, false if remover is stopping */
+    bool Sleep(uint64_t deadline) {
+        auto lock = ScopedLock();
+        auto until = std::chrono::steady_clock::now() +
+                     std::chrono::milliseconds(deadline - std::min(deadline, GetCurrentTimeMs()));
+        Cv.wait_until(lock, until, [this] { return !Valid; });
+        return Valid;
+    }
+};
+
+static std::unique_ptr<TStorageRemover> Remover;
 
 TError TStorage::Resolve(EStorageType type, const TPath &place, const std::string &name) {
     TError error;
@@ -96,27 +151,257 @@ void TStorage::Open(EStorageType type, const TPath &place, const std::string &na
 void TStorage::Init() {
     if (StringToUintMap(config().volumes().place_load_limit(), PlaceLoadLimit))
         PlaceLoadLimit = {{"default", 1}};
+    if (StringToUintMap(config().volumes().remove_iops_limit(), RemoveIopsLimit))
+        RemoveIopsLimit.clear();
+    if (StringToUintMap(config().volumes().remove_bps_limit(), RemoveBpsLimit))
+        RemoveBpsLimit.clear();
+}
+
+void TStorage::StartRemover() {
+    if (config().volumes().async_remove()) {
+        Remover = std::unique_ptr<TStorageRemover>(new TStorageRemover());
+        Remover->Start();
+    }
+}
+
+void TStorage::StopRemover() {
+    if (Remover) {
+        Remover->Stop();
+        Remover = nullptr;
+    }
+}
+
+static uint64_t PlaceLimit(const TUintMap &map, const TPath &place) {
+    auto it = map.find(place.ToString());
+    if (it == map.end())
+        it = map.find("default");
+    return it == map.end() ? 0 : it->second;
 }
 
-void TStorage::IncPlaceLoad(const TPath &place) {
+/* Unlink entries one by one keeping removal rate below place limits */
+static TError RemoveThrottled(const TPath &path, uint64_t iops, uint64_t bps) {
+    uint64_t start = GetCurrentTimeMs(), ops = 0, bytes = 0;
+    TPathWalk walk;
+    TError error;
+
+    error = walk.Open(path, FTS_NOCHDIR | FTS_PHYSICAL | FTS_XDEV);
+    if (error)
+        return error;
+
+    while (1) {
+        error = walk.Next();
+        if (error)
+            return error;
+        if (!walk.Path)
+            break;
+        if (walk.Directory && !walk.Postorder)
+            continue;
+
+        if (walk.Directory)
+            error = walk.Path.Rmdir();
+        else {
+            bytes += walk.Stat->st_blocks * 512ull;
+            error = walk.Path.Unlink();
+        }
+        if (error && error.Errno != ENOENT)
+            return error;
+
+        uint64_t delay = 0;
+        if (iops)
+            delay = std::max(delay, ++ops * 1000 / iops);
+        if (bps)
+            delay = std::max(delay, bytes * 1000 / bps);
+        delay += start;
+
+        uint64_t now = GetCurrentTimeMs();
+        if (delay <= now)
+            continue;
+
+        /* Rest is removed as junk at next start */
+        if (Remover && !Remover->Sleep(delay))
+            return TError(EError::Unknown, EINTR, "Remover is stopping");
+
+        if (!Remover)
+            usleep((delay - now) * 1000);
+    }
+
+    return OK;
+}
+
+TError TStorage::RemoveData(const TPath &place, const TPath &path,
+                            EStorageType type, uint64_t bytes) {
+    uint64_t iops = PlaceLimit(RemoveIopsLimit, place);
+    uint64_t bps = PlaceLimit(RemoveBpsLimit, place);
+    bool throttled = iops || bps;
+    TError error;
+
+    if (type == EStorageType::Meta) {
+        TProjectQuota quota(path);
+        error = quota.Destroy();
+        if (error)
+            L_WRN("Cannot destroy quota {}: {}", path, error);
+    }
+
+    /* Throttled removal is slow by design, it does not occupy place slot */
+    if (throttled) {
+        error = RemoveThrottled(path, iops, bps);
+        if (error && error.Errno == EINTR) {
+            L_ACT("Leave {} for next start: {}", path, error);
+        } else if (error) {
+            L_VERBOSE("Cannot remove storage {}: {}", path, error);
+            throttled = false;
+        }
+    }
+
+    if (!throttled) {
+        IncPlaceLoad(place, bytes);
+        uint64_t start = GetCurrentTimeMs();
+
+        error = RemoveRecursive(path);
+        if (error) {
+            L_VERBOSE("Cannot remove storage {}: {}", path, error);
+            error = path.RemoveAll();
+            if (error)
+                L_WRN("Cannot remove storage {}: {}", path, error);
+        }
+
+        DecPlaceLoad(place, bytes, start);
+    }
+
     auto lock = LockVolumes();
+    ActivePaths.remove(path);
+    lock.unlock();
+
+    return error;
+}
+
+static std::string PlaceLoadId(const TPath &place) {
     auto id = place.ToString();
     if (!PlaceLoadLimit.count(id))
         id = "default";
-    StorageCv.wait(lock, [&]{return PlaceLoad[id] < PlaceLoadLimit[id];});
-    PlaceLoad[id]++;
+    return id;
 }
 
-void TStorage::DecPlaceLoad(const TPath &place) {
+/* Smallest operation first, but waiters older than max wait go in order of arrival */
+static uint64_t NextPlaceWaiter(const TPlaceQueue &queue) {
+    uint64_t deadline = GetCurrentTimeMs() - config().volumes().place_queue_max_wait_ms();
+    const TPlaceWaiter *next = nullptr;
+
+    for (auto &waiter: queue.Waiters) {
+        if (waiter.Since <= deadline)
+            return waiter.Seq;
+        if (!next || waiter.Bytes < next->Bytes)
+            next = &waiter;
+    }
+
+    return next ? next->Seq : 0;
+}
+
+void TStorage::IncPlaceLoad(const TPath &place, uint64_t bytes) {
     auto lock = LockVolumes();
-    auto id = place.ToString();
-    if (!PlaceLoadLimit.count(id))
-        id = "default";
-    if (PlaceLoad[id]-- <= 1)
-        PlaceLoad.erase(id);
+    auto id = PlaceLoadId(place);
+    auto &queue = PlaceQueues[id];
+    uint64_t seq = ++PlaceWaiterSeq;
+
+    queue.Waiters.push_back({seq, bytes, GetCurrentTimeMs()});
+    StorageCv.wait(lock, [&]{
+        return queue.Running < PlaceLoadLimit[id] && NextPlaceWaiter(queue) == seq;
+    });
+    queue.Waiters.remove_if([&](const TPlaceWaiter &w) { return w.Seq == seq; });
+
+    queue.Running++;
+    queue.RunningBytes += bytes;
+
+    /* Next waiter might fit too */
     StorageCv.notify_all();
 }
 
+void TStorage::DecPlaceLoad(const TPath &place, uint64_t bytes, uint64_t start) {
+    auto lock = LockVolumes();
+    auto &queue = PlaceQueues[PlaceLoadId(place)];
+
+    queue.Running--;
+    queue.RunningBytes -= bytes;
+
+    uint64_t elapsed = start ? GetCurrentTimeMs() - start : 0;
+    if (bytes && elapsed) {
+        uint64_t rate = bytes * 1000 / elapsed;
+        queue.Rate = queue.Rate ? (queue.Rate * 3 + rate) / 4 : rate;
+    }
+
+    StorageCv.notify_all();
+}
+
+void TStorage::PlaceQueueStat(const TPath &place, TPlaceQueueStat &stat) {
+    auto lock = LockVolumes();
+    auto id = PlaceLoadId(place);
+
+    stat = TPlaceQueueStat();
+
+    auto it = PlaceQueues.find(id);
+    if (it == PlaceQueues.end())
+        return;
+
+    auto &queue = it->second;
+    stat.Running = queue.Running;
+    stat.Queued = queue.Waiters.size();
+    for (auto &waiter: queue.Waiters)
+        stat.QueuedBytes += waiter.Bytes;
+    stat.Rate = queue.Rate;
+
+    /* Pessimistic: running operations are counted as not started */
+    uint64_t limit = std::max(PlaceLoadLimit[id], (uint64_t)1);
+    if (stat.Rate)
+        stat.Eta = (stat.QueuedBytes + queue.RunningBytes) * 1000 / (stat.Rate * limit);
+}
+
+/* Disk usage of tree, hardlinks are counted at each link */
+static uint64_t DiskUsage(const TPath &path) {
+    uint64_t bytes = 0;
+    TPathWalk walk;
+
+    if (walk.OpenScan(path))
+        return 0;
+
+    while (!walk.Next() && walk.Path) {
+        if (!walk.Postorder)
+            bytes += walk.Stat->st_blocks * 512ull;
+    }
+
+    return bytes;
+}
+
+/* Cheap estimation of data size for IO scheduling, zero if unknown */
+uint64_t TStorage::EstimateSize() const {
+    /* Layers imported before size was saved are walked once */
+    if (Type == EStorageType::Layer)
+        return UniqueSize() ?: DiskUsage(Path);
+
+    if (Type == EStorageType::Meta || Type == EStorageType::Volume) {
+        TProjectQuota quota(Path);
+        TStatFS stat;
+        if (!quota.StatFS(stat))
+            return stat.SpaceUsage;
+    }
+
+    return 0;
+}
+
+/* Remove shared files which are not linked into any layer */
+void TStorage::CleanupDedup(const TPath &store) {
+    std::vector<std::string> list;
+    struct stat st;
+
+    if (store.ReadDirectory(list))
+        return;
+
+    for (auto &name: list) {
+        TPath path = store / name;
+        if (!path.StatStrict(st) && (!S_ISREG(st.st_mode) || st.st_nlink <= 1))
+            (void)path.Unlink();
+    }
+}
+
 /* FIXME racy. rewrite with openat... etc */
 TError TStorage::Cleanup(const TPath &place, EStorageType type, unsigned perms) {
     TPath base;
@@ -181,6 +466,12 @@ TError TStorage::Cleanup(const TPath &place, EStorageType type, unsigned perms)
             continue;
         }
 
+        if (type == EStorageType::Layer && name == DEDUP_STORE &&
+                path.IsDirectoryStrict()) {
+            CleanupDedup(path);
+            continue;
+        }
+
         if (path.IsDirectoryStrict()) {
             if (!CheckName(name))
                 continue;
@@ -269,7 +560,8 @@ TError TStorage::CheckName(const std::string &name, bool meta) {
             StringStartsWith(name, REMOVE_PREFIX) ||
             StringStartsWith(name, PRIVATE_PREFIX) ||
             StringStartsWith(name, META_PREFIX) ||
-            StringStartsWith(name, META_LAYER))
+            StringStartsWith(name, META_LAYER) ||
+            StringStartsWith(name, DEDUP_STORE))
         return TError(EError::InvalidValue, "invalid layer name '" + name + "'");
     return OK;
 }
@@ -481,6 +773,8 @@ static TError Compression(const TPath &archive, const TFile &arc,
             goto xz;
         if (compress == "tgz" || compress == "tar.gz")
             goto gz;
+        if (compress == "tzst" || compress == "tar.zst")
+            goto zst;
         if (compress == "tar")
             goto tar;
         if (StringEndsWith(compress, "squashfs"))
@@ -497,6 +791,8 @@ static TError Compression(const TPath &archive, const TFile &arc,
                 goto xz;
             if (!strncmp(magic, "\x1F\x8B\x08", 3))
                 goto gz;
+            if (!strncmp(magic, "\x28\xB5\x2F\xFD", 4))
+                goto zst;
             if (!strncmp(magic, "hsqs", 4))
                 goto squash;
         }
@@ -516,6 +812,9 @@ static TError Compression(const TPath &archive, const TFile &arc,
     if (StringEndsWith(name, ".gz") || StringEndsWith(name, ".tgz"))
         goto gz;
 
+    if (StringEndsWith(name, ".zst") || StringEndsWith(name, ".tzst"))
+        goto zst;
+
     if (StringEndsWith(name, ".squash") || StringEndsWith(name, ".squashfs"))
         goto squash;
 
@@ -523,7 +822,8 @@ tar:
     option = "--no-auto-compress";
     return OK;
 gz:
-    if (!arc && config().volumes().parallel_compression()) {
+    /* pigz and pixz also speed up extraction from stream */
+    if (config().volumes().parallel_compression()) {
         if (TPath("/usr/bin/pigz").Exists()) {
             option = "--use-compress-program=pigz";
             return OK;
@@ -532,7 +832,7 @@ gz:
     option = "--gzip";
     return OK;
 xz:
-    if (!arc && config().volumes().parallel_compression()) {
+    if (config().volumes().parallel_compression()) {
         if (TPath("/usr/bin/pixz").Exists()) {
             option = "--use-compress-program=pixz";
             return OK;
@@ -540,6 +840,9 @@ xz:
     }
     option = "--xz";
     return OK;
+zst:
+    option = "--zstd";
+    return OK;
 squash:
     format = "squashfs";
     auto sep = compress.find('.');
@@ -563,7 +866,23 @@ static bool TarSupportsXattrs() {
     return result;
 }
 
+/*
+ * Checksums of exported files keyed by device, inode, size, mtime and ctime.
+ * Owner can set mtime and any user.* xattr but not ctime, which changes at
+ * setxattr too, so cache lives in memory and is keyed by ctime after it.
+ */
+static constexpr size_t CHECKSUM_CACHE_MAX = 1 << 20;
+static std::mutex ChecksumCacheMutex;
+static std::unordered_map<std::string, std::string> ChecksumCache;
+
+static std::string ChecksumStamp(const struct stat &st) {
+    return fmt::format("{}:{} {} {}.{:09} {}.{:09}", st.st_dev, st.st_ino, st.st_size,
+                       st.st_mtim.tv_sec, st.st_mtim.tv_nsec,
+                       st.st_ctim.tv_sec, st.st_ctim.tv_nsec);
+}
+
 TError TStorage::SaveChecksums() {
+    std::vector<std::pair<TPath, std::string>> files;
     TPathWalk walk;
     TError error;
 
@@ -583,24 +902,214 @@ TError TStorage::SaveChecksums() {
             Size += walk.Stat->st_blocks * 512ull;
         if (!S_ISREG(walk.Stat->st_mode))
             continue;
+        files.emplace_back(walk.Path, ChecksumStamp(*walk.Stat));
+    }
+
+    std::mutex error_mutex;
+
+    ParallelFor(files.size(), config().volumes().checksum_threads(), [&](size_t index) {
+        auto &path = files[index].first;
+        std::string stamp = files[index].second;
+        std::string sum, prev;
+        struct stat st;
+        TError err;
+        TFile file;
+
+        err = file.OpenRead(path);
+        if (err)
+            goto out;
+
+        {
+            auto lock = std::unique_lock<std::mutex>(ChecksumCacheMutex);
+            auto it = ChecksumCache.find(stamp);
+            if (it != ChecksumCache.end())
+                sum = it->second;
+        }
+
+        if (sum.empty()) {
+            err = Md5Sum(file, sum);
+            if (err)
+                goto out;
+        } else if (!file.GetXAttr("user.porto.md5sum", prev) && prev == sum)
+            return;
+
+        /* Changed while hashed, do not cache */
+        err = file.Stat(st);
+        if (err || ChecksumStamp(st) != stamp) {
+            if (!err && lseek(file.Fd, 0, SEEK_SET))
+                err = TError::System("lseek");
+            if (!err)
+                err = Md5Sum(file, sum);
+            stamp.clear();
+        }
+
+        if (!err)
+            err = file.SetXAttr("user.porto.md5sum", sum);
+
+        if (!err && !stamp.empty() && !file.Stat(st)) {
+            auto lock = std::unique_lock<std::mutex>(ChecksumCacheMutex);
+            if (ChecksumCache.size() >= CHECKSUM_CACHE_MAX)
+                ChecksumCache.clear();
+            ChecksumCache[ChecksumStamp(st)] = sum;
+        }
+out:
+        if (err) {
+            std::lock_guard<std::mutex> guard(error_mutex);
+            if (!error)
+                error = TError(err, "Cannot checksum {}", path);
+        }
+    });
+
+    return error;
+}
+
+/* Hash match alone is not enough to replace file with link */
+static TError SameContent(const TFile &file, const TPath &path, bool &same) {
+    std::vector<char> buf(1 << 16), other(1 << 16);
+    TFile target;
+    TError error;
+    off_t off = 0;
+
+    same = false;
+
+    error = target.OpenRead(path);
+    if (error)
+        return error;
+
+    while (1) {
+        ssize_t len = pread(file.Fd, buf.data(), buf.size(), off);
+        if (len < 0)
+            return TError::System("pread");
+        ssize_t len2 = pread(target.Fd, other.data(), len ? len : 1, off);
+        if (len2 < 0)
+            return TError::System("pread");
+        if (len != len2 || memcmp(buf.data(), other.data(), len))
+            return OK;
+        if (!len)
+            break;
+        off += len;
+    }
+
+    same = true;
+    return OK;
+}
+
+/*
+ * Replace files which content is already present in place with hardlinks
+ * into shared store. Files with xattrs or small files are never shared.
+ */
+TError TStorage::DedupLayer(const TPath &layer) {
+    TPath store = Place / PORTO_LAYERS / DEDUP_STORE;
+    uint64_t unique = 0, shared = 0;
+    TPathWalk walk;
+    TError error;
+
+    if (!store.IsDirectoryStrict()) {
+        error = store.Mkdir(0700);
+        if (error)
+            return error;
+    }
+
+    error = walk.OpenScan(layer);
+    if (error)
+        return error;
+
+    while (1) {
+        error = walk.Next();
+        if (error)
+            return error;
+        if (!walk.Path)
+            break;
+        if (walk.Postorder)
+            continue;
+
+        auto &st = *walk.Stat;
+        uint64_t size = st.st_blocks * 512ull;
+
+        if (!S_ISREG(st.st_mode) || st.st_nlink != 1 ||
+                (uint64_t)st.st_size < DEDUP_MIN_SIZE) {
+            unique += size;
+            continue;
+        }
+
         TFile file;
         error = file.OpenRead(walk.Path);
         if (error)
             return error;
+
+        if (flistxattr(file.Fd, nullptr, 0) != 0) {
+            unique += size;
+            continue;
+        }
+
         std::string sum;
-        error = Md5Sum(file, sum);
+        error = Sha256Sum(file, sum);
         if (error)
             return error;
-        error = file.SetXAttr("user.porto.md5sum", sum);
+
+        TPath target = store / fmt::format("{}-{}-{:o}-{}-{}-{}", sum, st.st_size,
+                                           st.st_mode & 07777, st.st_uid,
+                                           st.st_gid, st.st_mtime);
+        struct stat target_st;
+
+        if (target.StatStrict(target_st)) {
+            error = target.Hardlink(walk.Path);
+            if (error)
+                return error;
+            unique += size;
+            continue;
+        }
+
+        bool same = false;
+        if (target_st.st_size == st.st_size) {
+            error = SameContent(file, target, same);
+            if (error)
+                return error;
+        }
+        if (!same) {
+            unique += size;
+            continue;
+        }
+
+        TPath temp = walk.Path.DirName() / (std::string(DEDUP_STORE) + walk.Path.BaseName());
+        error = temp.Hardlink(target);
+        if (!error) {
+            error = temp.Rename(walk.Path);
+            if (error)
+                (void)temp.Unlink();
+        }
         if (error)
             return error;
+
+        shared += size;
     }
 
-    return OK;
+    Statistics->LayerDedupBytes += shared;
+
+    L("Layer {} unique {} shared {}", Name, StringFormatSize(unique), StringFormatSize(shared));
+
+    TFile dir;
+    error = dir.OpenDir(layer);
+    if (!error)
+        error = dir.SetXAttr("trusted.porto.unique_size", std::to_string(unique));
+    return error;
+}
+
+uint64_t TStorage::UniqueSize() const {
+    std::string value;
+    uint64_t size;
+
+    if (Path.GetXAttr("trusted.porto.unique_size", value) ||
+            StringToUint64(value, size))
+        return 0;
+
+    return size;
 }
 
 TError TStorage::ImportArchive(const TPath &archive, const std::string &compress, bool merge) {
     TPath temp = TempPath(IMPORT_PREFIX);
+    uint64_t import_start, import_bytes = 0;
+    struct stat st;
     TError error;
     TFile arc;
 
@@ -678,8 +1187,12 @@ TError TStorage::ImportArchive(const TPath &archive, const std::string &compress
     ActivePaths.push_back(temp);
     lock.unlock();
 
-    IncPlaceLoad(Place);
+    if (!arc.Stat(st))
+        import_bytes = st.st_size;
+
+    IncPlaceLoad(Place, import_bytes);
     Statistics->LayerImport++;
+    import_start = GetCurrentTimeMs();
 
     if (compress_format == "tar") {
         TTuple args = { "tar",
@@ -706,10 +1219,8 @@ TError TStorage::ImportArchive(const TPath &archive, const std::string &compress
 
         TFile parent_dir;
         error = parent_dir.OpenDirStrictAt(import_dir, "..");
-        if (error)
-            return error;
-
-        error = RunCommand(args, parent_dir);
+        if (!error)
+            error = RunCommand(args, parent_dir);
     } else
         error = TError(EError::NotSupported, "Unsuported format " + compress_format);
 
@@ -720,6 +1231,27 @@ TError TStorage::ImportArchive(const TPath &archive, const std::string &compress
         error = SanitizeLayer(temp, merge);
         if (error)
             goto err;
+
+        bool dedup = false;
+
+        /* Hardlinks from meta storage would escape its project quota */
+        if (Meta.empty() && config().volumes().layer_dedup()) {
+            error = DedupLayer(temp);
+            if (error)
+                L_WRN("Cannot deduplicate layer {}: {}", Name, error);
+            else
+                dedup = true;
+        }
+
+        /* Without deduplication all data is unique */
+        if (!dedup) {
+            TFile dir;
+            error = dir.OpenDir(temp);
+            if (!error)
+                error = dir.SetXAttr("trusted.porto.unique_size", std::to_string(DiskUsage(temp)));
+            if (error)
+                L_WRN("Cannot save size of layer {}: {}", Name, error);
+        }
     }
 
     if (!Owner.IsUnknown()) {
@@ -742,7 +1274,10 @@ TError TStorage::ImportArchive(const TPath &archive, const std::string &compress
     if (error)
         goto err;
 
-    DecPlaceLoad(Place);
+    DecPlaceLoad(Place, import_bytes, import_start);
+
+    Statistics->LayerImportBytes += import_bytes;
+    Statistics->LayerImportMs += GetCurrentTimeMs() - import_start;
 
     StorageCv.notify_all();
 
@@ -753,7 +1288,7 @@ err:
     if (error2)
         L_WRN("Cannot cleanup layer: {}", error2);
 
-    DecPlaceLoad(Place);
+    DecPlaceLoad(Place, import_bytes);
 
     lock.lock();
     ActivePaths.remove(temp);
@@ -764,7 +1299,10 @@ err:
     return error;
 }
 
-TError TStorage::ExportArchive(const TPath &archive, const std::string &compress) {
+TError TStorage::ExportArchive(const TPath &archive, const std::string &compress,
+                               uint64_t changed_since) {
+    uint64_t export_start, export_bytes;
+    struct stat st;
     TFile dir, arc;
     TError error;
 
@@ -787,6 +1325,9 @@ TError TStorage::ExportArchive(const TPath &archive, const std::string &compress
     if (error)
         return error;
 
+    if (changed_since && compress_format != "tar")
+        return TError(EError::NotSupported, "Delta export requires tar format");
+
     error = dir.OpenDir(archive.DirName());
     if (error)
         return error;
@@ -806,14 +1347,19 @@ TError TStorage::ExportArchive(const TPath &archive, const std::string &compress
     if (error)
         return error;
 
-    IncPlaceLoad(Place);
+    export_bytes = EstimateSize();
+    IncPlaceLoad(Place, export_bytes);
     Statistics->LayerExport++;
+    export_start = GetCurrentTimeMs();
 
     if (Type == EStorageType::Volume && compress_format == "tar") {
         L_ACT("Save checksums in {}", Path);
         error = SaveChecksums();
-        if (error)
+        if (error) {
+            DecPlaceLoad(Place, export_bytes);
+            (void)dir.UnlinkAt(archive.BaseName());
             return error;
+        }
         L("Unpacked size {} {}", Path, StringFormatSize(Size));
         error = arc.SetXAttr("user.porto.unpacked_size", std::to_string(Size));
         if (error)
@@ -834,6 +1380,14 @@ TError TStorage::ExportArchive(const TPath &archive, const std::string &compress
         if (TarSupportsXattrs())
             args.insert(args.begin() + 4, "--xattrs");
 
+        /*
+         * Delta: files and whiteouts with mtime or ctime since given time.
+         * Add-only, removed upper-only files leave no whiteouts.
+         * Cutoff is one second earlier: inode timestamps are coarse and lag.
+         */
+        if (changed_since)
+            args.insert(args.begin() + 4, fmt::format("--newer=@{}", changed_since - 1));
+
         error = RunCommand(args, dir, TFile(), arc);
     } else if (compress_format == "squashfs") {
         TTuple args = { "mksquashfs", Path.ToString(),
@@ -849,8 +1403,13 @@ TError TStorage::ExportArchive(const TPath &archive, const std::string &compress
         error = arc.Chown(CL->TaskCred);
     if (error)
         (void)dir.UnlinkAt(archive.BaseName());
+    else {
+        if (!arc.Stat(st))
+            Statistics->LayerExportBytes += st.st_size;
+        Statistics->LayerExportMs += GetCurrentTimeMs() - export_start;
+    }
 
-    DecPlaceLoad(Place);
+    DecPlaceLoad(Place, export_bytes, error ? 0 : export_start);
 
     return error;
 }
@@ -875,6 +1434,8 @@ TError TStorage::Remove(bool weak) {
     if (error && !weak)
         return TError(error, "Cannot remove {}", Path);
 
+    uint64_t bytes = EstimateSize();
+
     auto lock = LockVolumes();
 
     error = CheckUsage();
@@ -905,29 +1466,13 @@ TError TStorage::Remove(bool weak) {
     if (error)
         return error;
 
-    IncPlaceLoad(Place);
     Statistics->LayerRemove++;
 
-    if (Type == EStorageType::Meta) {
-        TProjectQuota quota(temp);
-        error = quota.Destroy();
-        if (error)
-            L_WRN("Cannot destroy quota {}: {}", temp, error);
-    }
-
-    error = RemoveRecursive(temp);
-    if (error) {
-        L_VERBOSE("Cannot remove storage {}: {}", temp, error);
-        error = temp.RemoveAll();
-        if (error)
-            L_WRN("Cannot remove storage {}: {}", temp, error);
-    }
-
-    DecPlaceLoad(Place);
-
-    lock.lock();
-    ActivePaths.remove(temp);
-    lock.unlock();
+    /* Data is unreachable after rename, remove it in background */
+    if (Remover)
+        Remover->Push({Place, temp, Type, bytes});
+    else
+        error = RemoveData(Place, temp, Type, bytes);
 
     return error;
 }
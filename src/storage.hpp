@@ -11,6 +11,14 @@ enum EStorageType {
     Volume,
 };
 
+struct TPlaceQueueStat {
+    uint64_t Running = 0;
+    uint64_t Queued = 0;
+    uint64_t QueuedBytes = 0;
+    uint64_t Rate = 0;
+    uint64_t Eta = 0;
+};
+
 class TStorage {
 public:
     enum EStorageType Type;
@@ -34,10 +42,13 @@ public:
     static TError SanitizeLayer(const TPath &layer, bool merge);
     TError List(enum EStorageType type, std::list<TStorage> &list);
     TError ImportArchive(const TPath &archive, const std::string &compress = "", bool merge = false);
-    TError ExportArchive(const TPath &archive, const std::string &compress = "");
+    TError ExportArchive(const TPath &archive, const std::string &compress = "",
+                         uint64_t changed_since = 0);
     bool Exists() const;
     bool Weak() const;
     uint64_t LastUsage() const;
+    uint64_t UniqueSize() const;
+    uint64_t EstimateSize() const;
     TError Load();
     TError Remove(bool weak = false);
     TError Touch();
@@ -51,11 +62,18 @@ public:
     TError StatMeta(TStatFS &stat);
 
     static void Init();
-    static void IncPlaceLoad(const TPath &place);
-    static void DecPlaceLoad(const TPath &place);
+    static void StartRemover();
+    static void StopRemover();
+    static TError RemoveData(const TPath &place, const TPath &path,
+                             EStorageType type, uint64_t bytes = 0);
+    static void IncPlaceLoad(const TPath &place, uint64_t bytes = 0);
+    static void DecPlaceLoad(const TPath &place, uint64_t bytes = 0, uint64_t start = 0);
+    static void PlaceQueueStat(const TPath &place, TPlaceQueueStat &stat);
 
 private:
     static TError Cleanup(const TPath &place, EStorageType type, unsigned perms);
+    static void CleanupDedup(const TPath &store);
+    TError DedupLayer(const TPath &layer);
     TPath TempPath(const std::string &kind);
     TError CheckUsage();
 };
@@ -4,12 +4,19 @@
 #include "client.hpp"
 #include "container.hpp"
 
+#include <thread>
+#include <mutex>
+#include <unordered_map>
+
 extern "C" {
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 }
 
 bool TStdStream::IsNull(void) const {
@@ -21,8 +28,13 @@ bool TStdStream::IsRedirect(void) const {
     return StringStartsWith(Path.ToString(), "/dev/fd/");
 }
 
+/* "relay:" sends lines into log relay socket, nothing is stored */
+bool TStdStream::IsRelay(void) const {
+    return Path.ToString() == "relay:";
+}
+
 TPath TStdStream::ResolveOutside(const TContainer &container) const {
-    if (IsNull() || IsRedirect())
+    if (IsNull() || IsRedirect() || IsRelay())
         return TPath();
     if (Outside) {
         if (Path.IsAbsolute())
@@ -86,6 +98,15 @@ TError TStdStream::OpenOutside(const TContainer &container,
     if (IsNull())
         return Open("/dev/null", container.TaskCred);
 
+    if (IsRelay()) {
+        if (RelayFd < 0)
+            return TError(EError::InvalidValue, "Relay pipe is not open");
+        if (dup2(RelayFd, Stream) < 0)
+            return TError::System("dup2(" + std::to_string(RelayFd) +
+                                  ", " + std::to_string(Stream) + ")");
+        return OK;
+    }
+
     if (IsRedirect()) {
         int clientFd = -1;
         TError error;
@@ -122,7 +143,7 @@ TError TStdStream::OpenOutside(const TContainer &container,
 TError TStdStream::OpenInside(const TContainer &container) {
     TError error;
 
-    if (!Outside && !IsNull() && !IsRedirect())
+    if (!Outside && !IsNull() && !IsRedirect() && !IsRelay())
         error = Open(Path, container.TaskCred);
 
     /* Assign controlling terminal for our own session */
@@ -132,7 +153,351 @@ TError TStdStream::OpenInside(const TContainer &container) {
     return error;
 }
 
+/*
+ * Log relay reads container streams from pipes and forwards them line by
+ * line into unix datagram socket in journald native format. Sending blocks
+ * up to log_relay_timeout_ms, meanwhile pipes are filling and writers stall.
+ * Lines which still cannot be sent are dropped and counted.
+ *
+ * Pipes are fifos in PORTO_LOG_RELAY opened by task for read-write, thus
+ * writers never get SIGPIPE. While portod restarts data stays in fifo and
+ * next portod reopens it by path at restore.
+ */
+
+struct TRelayPipe {
+    int Fd = -1;
+    TPath Path;
+    ino_t Inode = 0;
+    std::string Container;
+    uint64_t ContainerId = 0;
+    std::string Stream;
+    std::string Partial;    /* line without newline yet */
+};
+
+static constexpr size_t RELAY_LINE_MAX = 16 << 10;
+
+static std::mutex RelayMutex;
+static std::unordered_map<int, std::unique_ptr<TRelayPipe>> RelayPipes;
+static std::thread RelayThread;
+static std::atomic<bool> RelayRunning(false);
+static int RelayEpollFd = -1;
+static int RelaySock = -1;
+
+static void RelayConnect() {
+    std::string path = config().container().log_relay_socket();
+    uint64_t timeout = config().container().log_relay_timeout_ms();
+    struct sockaddr_un addr;
+    struct timeval tv;
+
+    if (path.size() >= sizeof(addr.sun_path))
+        return;
+
+    int sock = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+        return;
+
+    tv.tv_sec = timeout / 1000;
+    tv.tv_usec = (timeout % 1000) * 1000;
+    (void)setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr))) {
+        close(sock);
+        return;
+    }
+
+    RelaySock = sock;
+}
+
+static void RelaySend(const TRelayPipe &pipe, const std::vector<std::string> &lines) {
+    uint64_t now = GetRealTimeMs();
+    std::vector<std::string> msgs(lines.size());
+    std::vector<struct iovec> iov(lines.size());
+    std::vector<struct mmsghdr> hdr(lines.size());
+    size_t sent = 0;
+
+    for (size_t i = 0; i < lines.size(); i++) {
+        msgs[i] = fmt::format("MESSAGE={}\nPORTO_CONTAINER={}\nPORTO_CONTAINER_ID={}\n"
+                              "PORTO_STREAM={}\nPORTO_TIME_MS={}\nSYSLOG_IDENTIFIER=porto\n",
+                              lines[i], pipe.Container, pipe.ContainerId,
+                              pipe.Stream, now);
+        iov[i].iov_base = &msgs[i][0];
+        iov[i].iov_len = msgs[i].size();
+        memset(&hdr[i], 0, sizeof(hdr[i]));
+        hdr[i].msg_hdr.msg_iov = &iov[i];
+        hdr[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    if (RelaySock < 0)
+        RelayConnect();
+
+    while (RelaySock >= 0 && sent < msgs.size()) {
+        int ret = sendmmsg(RelaySock, &hdr[sent], msgs.size() - sent, MSG_NOSIGNAL);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret <= 0) {
+            /* Reconnect at next batch if receiver is gone */
+            if (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                close(RelaySock);
+                RelaySock = -1;
+            }
+            break;
+        }
+        sent += ret;
+    }
+
+    for (size_t i = 0; i < lines.size(); i++) {
+        if (i < sent) {
+            Statistics->LogRelayLines++;
+            Statistics->LogRelayBytes += lines[i].size();
+        } else {
+            Statistics->LogRelayLinesLost++;
+            Statistics->LogRelayBytesLost += lines[i].size();
+        }
+    }
+}
+
+/* Returns false at end of stream */
+static bool RelayRead(TRelayPipe &pipe) {
+    std::vector<std::string> lines;
+    char buf[65536];
+
+    ssize_t len = read(pipe.Fd, buf, sizeof(buf));
+    bool eof = len == 0 || (len < 0 && errno != EAGAIN && errno != EINTR);
+
+    if (len > 0) {
+        ssize_t start = 0;
+        for (ssize_t i = 0; i < len; i++) {
+            if (buf[i] == '\n') {
+                pipe.Partial.append(buf + start, i - start);
+                lines.push_back(pipe.Partial);
+                pipe.Partial.clear();
+                start = i + 1;
+            }
+        }
+        pipe.Partial.append(buf + start, len - start);
+    }
+
+    if (pipe.Partial.size() >= RELAY_LINE_MAX || (eof && pipe.Partial.size())) {
+        lines.push_back(pipe.Partial);
+        pipe.Partial.clear();
+    }
+
+    if (lines.size())
+        RelaySend(pipe, lines);
+
+    return !eof;
+}
+
+static void RelayLoop() {
+    struct epoll_event evts[64];
+
+    SetProcessName("portod-LR");
+
+    while (RelayRunning) {
+        int nr = epoll_wait(RelayEpollFd, evts, 64, 1000);
+        for (int i = 0; i < nr; i++) {
+            auto pipe = static_cast<TRelayPipe *>(evts[i].data.ptr);
+            if (!RelayRead(*pipe)) {
+                std::lock_guard<std::mutex> guard(RelayMutex);
+                int fd = pipe->Fd;
+                struct stat st;
+
+                /* All writers are gone, path might be reused by next start */
+                if (!pipe->Path.StatStrict(st) && st.st_ino == pipe->Inode)
+                    (void)pipe->Path.Unlink();
+
+                (void)epoll_ctl(RelayEpollFd, EPOLL_CTL_DEL, fd, nullptr);
+                RelayPipes.erase(fd);
+                close(fd);
+            }
+        }
+    }
+}
+
+static TError RelayWatch(std::unique_ptr<TRelayPipe> &pipe) {
+    struct epoll_event ev;
+    struct stat st;
+
+    if (fstat(pipe->Fd, &st) || !S_ISFIFO(st.st_mode))
+        return TError(EError::Unknown, "Relay {} is not a fifo", pipe->Path);
+    pipe->Inode = st.st_ino;
+
+    if (RelayEpollFd >= 0) {
+        ev.events = EPOLLIN;
+        ev.data.ptr = pipe.get();
+        if (epoll_ctl(RelayEpollFd, EPOLL_CTL_ADD, pipe->Fd, &ev))
+            return TError::System("epoll_ctl");
+    }
+
+    int fd = pipe->Fd;
+    RelayPipes[fd] = std::move(pipe);
+
+    return OK;
+}
+
+static TError RelayAdd(std::unique_ptr<TRelayPipe> pipe, int &writeFd) {
+    std::lock_guard<std::mutex> guard(RelayMutex);
+    TPath dir(PORTO_LOG_RELAY);
+    TError error;
+
+    if (!RelayRunning || config().container().log_relay_socket().empty())
+        return TError(EError::NotSupported, "Log relay is not configured");
+
+    if (!dir.Exists()) {
+        error = dir.MkdirAll(0700);
+        if (error)
+            return error;
+    }
+
+    (void)pipe->Path.Unlink();
+    if (mkfifo(pipe->Path.c_str(), 0600))
+        return TError::System("mkfifo " + pipe->Path.ToString());
+
+    pipe->Fd = open(pipe->Path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (pipe->Fd < 0) {
+        error = TError::System("open " + pipe->Path.ToString());
+        (void)pipe->Path.Unlink();
+        return error;
+    }
+
+    /* Task keeps fifo open for read too, writers never see closed pipe */
+    writeFd = open(pipe->Path.c_str(), O_RDWR | O_CLOEXEC);
+    if (writeFd < 0)
+        error = TError::System("open " + pipe->Path.ToString());
+    else
+        error = RelayWatch(pipe);
+
+    if (error) {
+        if (writeFd >= 0)
+            close(writeFd);
+        writeFd = -1;
+        close(pipe->Fd);
+        (void)pipe->Path.Unlink();
+    }
+
+    return error;
+}
+
+void StartLogRelay() {
+    std::lock_guard<std::mutex> guard(RelayMutex);
+
+    /* Restored pipes are drained even if relay is not configured anymore */
+    if (config().container().log_relay_socket().empty() && RelayPipes.empty())
+        return;
+
+    RelayEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (RelayEpollFd < 0) {
+        L_ERR("Cannot start log relay: {}", TError::System("epoll_create1"));
+        return;
+    }
+
+    for (auto &it: RelayPipes) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = it.second.get();
+        if (epoll_ctl(RelayEpollFd, EPOLL_CTL_ADD, it.first, &ev))
+            L_ERR("Cannot watch relay {}: {}", it.second->Path, TError::System("epoll_ctl"));
+    }
+
+    RelayRunning = true;
+    RelayThread = std::thread(RelayLoop);
+}
+
+void StopLogRelay() {
+    if (!RelayRunning)
+        return;
+
+    RelayRunning = false;
+    RelayThread.join();
+
+    std::lock_guard<std::mutex> guard(RelayMutex);
+    for (auto &it: RelayPipes)
+        close(it.first);
+    RelayPipes.clear();
+
+    close(RelayEpollFd);
+    RelayEpollFd = -1;
+
+    if (RelaySock >= 0) {
+        close(RelaySock);
+        RelaySock = -1;
+    }
+}
+
+TPath TStdStream::RelayPath(const TContainer &container) const {
+    return TPath(PORTO_LOG_RELAY) / fmt::format("{}-{}", container.Id,
+                                                Stream == 1 ? "stdout" : "stderr");
+}
+
+static std::unique_ptr<TRelayPipe> RelayPipe(const TStdStream &stream,
+                                             const TContainer &container) {
+    auto pipe = std::unique_ptr<TRelayPipe>(new TRelayPipe);
+    pipe->Path = stream.RelayPath(container);
+    pipe->Container = container.Name;
+    pipe->ContainerId = container.Id;
+    pipe->Stream = stream.Stream == 1 ? "stdout" : "stderr";
+    return pipe;
+}
+
+TError TStdStream::OpenRelay(const TContainer &container) {
+    if (!IsRelay())
+        return OK;
+
+    if (!Stream)
+        return TError(EError::InvalidValue, "Relay works only for stdout and stderr");
+
+    return RelayAdd(RelayPipe(*this, container), RelayFd);
+}
+
+/* Reopen fifo left by previous portod, task is still writing into it */
+TError TStdStream::RestoreRelay(const TContainer &container) {
+    if (!IsRelay() || !Stream)
+        return OK;
+
+    auto pipe = RelayPipe(*this, container);
+    if (!pipe->Path.Exists())
+        return OK;
+
+    std::lock_guard<std::mutex> guard(RelayMutex);
+
+    pipe->Fd = open(pipe->Path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (pipe->Fd < 0)
+        return TError::System("open " + pipe->Path.ToString());
+
+    int fd = pipe->Fd;
+    TError error = RelayWatch(pipe);
+    if (error)
+        close(fd);
+
+    return error;
+}
+
+void TStdStream::CloseRelay(void) {
+    if (RelayFd >= 0) {
+        close(RelayFd);
+        RelayFd = -1;
+    }
+}
+
 TError TStdStream::Remove(const TContainer &container) {
+    /* Fifo might be left if task has died while portod was down */
+    if (IsRelay()) {
+        TPath path = RelayPath(container);
+        struct stat st;
+        if (!path.StatStrict(st) && S_ISFIFO(st.st_mode)) {
+            std::lock_guard<std::mutex> guard(RelayMutex);
+            for (auto &it: RelayPipes)
+                if (it.second->Inode == st.st_ino)
+                    return OK;
+            (void)path.Unlink();
+        }
+        return OK;
+    }
+
     /* Custom stdout/stderr files are not removed */
     if (!Outside || Path.IsAbsolute())
         return OK;
@@ -149,14 +514,22 @@ TError TStdStream::Remove(const TContainer &container) {
 
 TError TStdStream::Rotate(const TContainer &container) {
     TPath path = ResolveOutside(container);
-    if (path.IsEmpty() || !path.IsRegularStrict())
+    struct stat st;
+    if (path.IsEmpty() || path.StatStrict(st) || !S_ISREG(st.st_mode))
         return OK;
+
+    /* Most streams are below limit, do not open them at all */
+    if ((uint64_t)st.st_blocks * 512 <= Limit)
+        return OK;
+
     off_t loss;
     TError error = path.RotateLog(Limit, loss);
     if (error) {
         Statistics->LogRotateErrors++;
         return error;
     }
+    if (loss)
+        Rotations++;
     Statistics->LogRotateBytes += loss;
     Offset += loss;
     return OK;
@@ -167,14 +540,6 @@ TError TStdStream::Read(const TContainer &container, std::string &text,
     std::string off = "", lim = "";
     uint64_t offset, limit;
     TError error;
-    TPath path = ResolveOutside(container);
-
-    if (path.IsEmpty())
-        return TError(EError::InvalidData, "Data not available");
-    if (!path.Exists())
-        return TError(EError::InvalidData, "File not found");
-    if (!path.IsRegularStrict())
-        return TError(EError::InvalidData, "File is non-regular");
 
     /* [offset][:limit] */
     if (range.size()) {
@@ -192,7 +557,6 @@ TError TStdStream::Read(const TContainer &container, std::string &text,
             return error;
         if (offset < Offset)
             return TError(EError::InvalidData, "Requested offset lower than current {}", Offset);
-        offset -= Offset;
     } else
         offset = 0;
 
@@ -203,6 +567,25 @@ TError TStdStream::Read(const TContainer &container, std::string &text,
     } else
         limit = Limit;
 
+    return ReadAt(container, text, offset, limit, !off.size());
+}
+
+/* Offset is absolute, returns offset of first byte actually read */
+TError TStdStream::ReadAt(const TContainer &container, std::string &text,
+                          uint64_t &offset, uint64_t limit, bool tail) const {
+    TPath path = ResolveOutside(container);
+    uint64_t base = Offset;
+    TError error;
+
+    text.clear();
+
+    if (path.IsEmpty())
+        return TError(EError::InvalidData, "Data not available");
+    if (!path.Exists())
+        return TError(EError::InvalidData, "File not found");
+    if (!path.IsRegularStrict())
+        return TError(EError::InvalidData, "File is non-regular");
+
     TFile file;
 
     error = file.Open(path, O_RDONLY | O_NOCTTY | O_NOFOLLOW | O_CLOEXEC);
@@ -213,17 +596,20 @@ TError TStdStream::Read(const TContainer &container, std::string &text,
         return TError(EError::Permission, "Real path doesn't match: " + path.ToString());
 
     uint64_t size = lseek(file.Fd, 0, SEEK_END);
+    uint64_t pos = (tail || offset < base) ? 0 : offset - base;
 
-    if (size <= offset)
+    if (size <= pos)
         limit = 0;
-    else if (size <= offset + limit)
-        limit = size - offset;
-    else if (!off.size())
-        offset = size - limit;
+    else if (size <= pos + limit)
+        limit = size - pos;
+    else if (tail)
+        pos = size - limit;
+
+    offset = base + pos;
 
     if (limit) {
         text.resize(limit);
-        ssize_t result = pread(file.Fd, &text[0], limit, offset);
+        ssize_t result = pread(file.Fd, &text[0], limit, pos);
 
         if (result < 0)
             return TError::System("Read " + path.ToString());
@@ -13,6 +13,8 @@ public:
     bool Outside = false;
     uint64_t Limit = 0;
     uint64_t Offset = 0;
+    uint64_t Rotations = 0;
+    int RelayFd = -1;       /* write end of relay fifo while starting */
 
     TStdStream(int stream): Stream(stream) { }
 
@@ -28,15 +30,26 @@ public:
 
     bool IsNull(void) const;
     bool IsRedirect(void) const;
+    bool IsRelay(void) const;
     TPath ResolveOutside(const TContainer &container) const;
 
     TError Open(const TPath &path, const TCred &cred);
     TError OpenOutside(const TContainer &container, const TClient &client);
     TError OpenInside(const TContainer &container);
 
+    TPath RelayPath(const TContainer &container) const;
+    TError OpenRelay(const TContainer &container);
+    TError RestoreRelay(const TContainer &container);
+    void CloseRelay(void);
+
     TError Remove(const TContainer &container);
 
     TError Rotate(const TContainer &container);
     TError Read(const TContainer &container, std::string &text,
                 const std::string &range = "") const;
+    TError ReadAt(const TContainer &container, std::string &text,
+                  uint64_t &offset, uint64_t limit, bool tail) const;
 };
+
+void StartLogRelay();
+void StopLogRelay();
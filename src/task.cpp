@@ -2,6 +2,8 @@
 #include <sstream>
 #include <iterator>
 #include <csignal>
+#include <mutex>
+#include <thread>
 
 #include "task.hpp"
 #include "container.hpp"
@@ -20,11 +22,14 @@ extern "C" {
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#include <sys/syscall.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <wordexp.h>
 #include <grp.h>
 #include <net/if.h>
+#include <sys/prctl.h>
+#include <sched.h>
 }
 
 std::list<std::string> IpcSysctls = {
@@ -46,6 +51,59 @@ std::list<std::string> IpcSysctls = {
     "kernel.sem",
 };
 
+/* Distinct profiles are few, bound just in case */
+constexpr size_t MAX_TASK_PROFILES = 256;
+
+/* Values in fresh ipc namespace, writing them again is pointless */
+static TStringMap IpcSysctlDefaults;
+
+static std::mutex TaskProfilesMutex;
+static std::map<std::string, std::shared_ptr<const TSysctlProfile>> SysctlProfiles;
+static std::map<std::string, std::shared_ptr<const TUlimit>> UlimitProfiles;
+
+static std::once_flag PortodUlimitOnce;
+static TUlimit PortodUlimit;
+
+/* Kernel separates fields with tabs, configs usually with spaces */
+static std::string SysctlValue(const std::string &value) {
+    std::string val;
+    bool space = false;
+    for (auto c: StringTrim(value)) {
+        if (isspace((unsigned char)c)) {
+            space = true;
+            continue;
+        }
+        if (space)
+            val += ' ';
+        space = false;
+        val += c;
+    }
+    return val;
+}
+
+static std::string SysctlPath(const std::string &key) {
+    /* all . -> / so abusing /../ is impossible */
+    std::string path = key;
+    std::replace(path.begin(), path.end(), '.', '/');
+    return path;
+}
+
+static void ProbeIpcSysctlDefaults() {
+    /* unshare affects only this thread, sysctls are read from its namespace */
+    std::thread probe([] {
+        if (unshare(CLONE_NEWIPC)) {
+            L_WRN("Cannot probe ipc sysctl defaults: {}", TError::System("unshare"));
+            return;
+        }
+        for (const auto &key: IpcSysctls) {
+            std::string val;
+            if (!GetSysctl(key, val))
+                IpcSysctlDefaults[key] = SysctlValue(val);
+        }
+    });
+    probe.join();
+}
+
 void InitIpcSysctl() {
     for (const auto &key: IpcSysctls) {
         bool set = false;
@@ -59,6 +117,11 @@ void InitIpcSysctl() {
             sysctl->set_val(val);
         }
     }
+
+    ProbeIpcSysctlDefaults();
+
+    auto lock = std::unique_lock<std::mutex>(TaskProfilesMutex);
+    SysctlProfiles.clear();
 }
 
 unsigned ProcBaseDirs;
@@ -110,6 +173,69 @@ static int ChildFn(void *arg) {
     return EXIT_FAILURE;
 }
 
+#ifndef PR_THP_DISABLE_EXCEPT_ADVISED
+# define PR_THP_DISABLE_EXCEPT_ADVISED (1 << 1)
+#endif
+
+/* Flag is checked at set and mm state is per process, so probe in child */
+bool ThpExceptAdvisedSupported() {
+    static int supported = -1;
+
+    if (supported < 0) {
+        int status;
+        pid_t pid = fork();
+        if (!pid)
+            _exit(prctl(PR_SET_THP_DISABLE, 1, PR_THP_DISABLE_EXCEPT_ADVISED, 0, 0) ? 1 : 0);
+        supported = pid > 0 && waitpid(pid, &status, 0) == pid &&
+                    WIFEXITED(status) && !WEXITSTATUS(status);
+        L_SYS("prctl PR_THP_DISABLE_EXCEPT_ADVISED {}supported", supported ? "" : "not ");
+    }
+
+    return supported;
+}
+
+TError SetThpMode(const std::string &thp) {
+    if (thp == "never" && prctl(PR_SET_THP_DISABLE, 1, 0, 0, 0))
+        return TError::System("prctl(PR_SET_THP_DISABLE)");
+    if (thp == "madvise" && prctl(PR_SET_THP_DISABLE, 1, PR_THP_DISABLE_EXCEPT_ADVISED, 0, 0))
+        return TError::System("prctl(PR_SET_THP_DISABLE, PR_THP_DISABLE_EXCEPT_ADVISED)");
+    return OK;
+}
+
+#ifndef CLONE_INTO_CGROUP
+# define CLONE_INTO_CGROUP 0x200000000ULL
+#endif
+
+#ifndef __NR_clone3
+# define __NR_clone3 435
+#endif
+
+struct TCloneArgs {
+    uint64_t flags;
+    uint64_t pidfd;
+    uint64_t child_tid;
+    uint64_t parent_tid;
+    uint64_t exit_signal;
+    uint64_t stack;
+    uint64_t stack_size;
+    uint64_t tls;
+    uint64_t set_tid;
+    uint64_t set_tid_size;
+    uint64_t cgroup;
+};
+
+/* Fork-like clone3() right into cgroup, fails if kernel cannot do that */
+static pid_t CloneIntoCgroup(int flags, int cgroupFd) {
+    struct TCloneArgs args;
+
+    memset(&args, 0, sizeof(args));
+    args.flags = (flags & ~CSIGNAL) | CLONE_INTO_CGROUP;
+    args.exit_signal = flags & CSIGNAL;
+    args.cgroup = cgroupFd;
+
+    return syscall(__NR_clone3, &args, sizeof(args));
+}
+
 TError TTaskEnv::OpenNamespaces(TContainer &ct) {
     TError error;
 
@@ -252,15 +378,24 @@ TError TTaskEnv::SetHostname() {
     return error;
 }
 
-TError TTaskEnv::ApplySysctl() {
-    TError error;
+TError TTaskEnv::PrepareSysctl() {
+    std::string key = fmt::format("{} {} {}", CT->Isolate, CT->NetIsolate,
+                                  StringMapToString(CT->Sysctl));
+
+    auto lock = std::unique_lock<std::mutex>(TaskProfilesMutex);
+    auto cached = SysctlProfiles.find(key);
+    if (cached != SysctlProfiles.end()) {
+        Sysctl = cached->second;
+        return OK;
+    }
+    lock.unlock();
+
+    auto profile = std::make_shared<TSysctlProfile>();
+    TStringMap values;
 
     if (CT->Isolate) {
-        for (const auto &it: config().container().ipc_sysctl()) {
-            error = SetSysctlAt(Mnt.ProcSysFd, it.key(), it.val());
-            if (error)
-                return error;
-        }
+        for (const auto &it: config().container().ipc_sysctl())
+            values[it.key()] = it.val();
     }
 
     for (const auto &it: CT->Sysctl) {
@@ -276,7 +411,79 @@ TError TTaskEnv::ApplySysctl() {
         } else
             return TError(EError::Permission, "Sysctl " + key + " is not allowed");
 
-        error = SetSysctlAt(Mnt.ProcSysFd, key, it.second);
+        values[key] = it.second;
+    }
+
+    for (const auto &it: values) {
+        auto def = IpcSysctlDefaults.find(it.first);
+        if (def != IpcSysctlDefaults.end() && def->second == SysctlValue(it.second))
+            continue;
+        profile->Writes.emplace_back(SysctlPath(it.first), it.second);
+        profile->Text += fmt::format("{}{}={}", profile->Text.empty() ? "" : " ",
+                                     it.first, it.second);
+    }
+
+    lock.lock();
+    if (SysctlProfiles.size() >= MAX_TASK_PROFILES)
+        SysctlProfiles.clear();
+    SysctlProfiles[key] = profile;
+    Sysctl = profile;
+
+    return OK;
+}
+
+void TTaskEnv::PrepareUlimit() {
+    auto ulimit = CT->GetUlimit();
+    std::string key = ulimit.Format();
+
+    auto lock = std::unique_lock<std::mutex>(TaskProfilesMutex);
+    auto cached = UlimitProfiles.find(key);
+    if (cached != UlimitProfiles.end()) {
+        Ulimit = cached->second;
+        return;
+    }
+    lock.unlock();
+
+    /* Task inherits limits of portod, which are set once at start */
+    std::call_once(PortodUlimitOnce, [] {
+        TError error = PortodUlimit.Load();
+        if (error) {
+            L_WRN("Cannot load portod ulimit: {}", error);
+            PortodUlimit.Clear();
+        }
+    });
+
+    auto profile = std::make_shared<TUlimit>();
+    for (auto &res: ulimit.Resources) {
+        auto cap = [](uint64_t val) { return std::min(val, (uint64_t)RLIM_INFINITY); };
+        bool same = false;
+        for (auto &cur: PortodUlimit.Resources)
+            if (cur.Type == res.Type)
+                same = cap(cur.Soft) == cap(res.Soft) && cap(cur.Hard) == cap(res.Hard);
+        if (!same)
+            profile->Resources.push_back(res);
+    }
+
+    lock.lock();
+    if (UlimitProfiles.size() >= MAX_TASK_PROFILES)
+        UlimitProfiles.clear();
+    UlimitProfiles[key] = profile;
+    Ulimit = profile;
+}
+
+TError TTaskEnv::ApplySysctl() {
+    TError error;
+
+    if (!Sysctl || Sysctl->Writes.empty())
+        return OK;
+
+    L_ACT("Set sysctl {}", Sysctl->Text);
+
+    for (const auto &it: Sysctl->Writes) {
+        TFile file;
+        error = file.OpenAt(Mnt.ProcSysFd, it.first, O_WRONLY | O_CLOEXEC | O_NOCTTY, 0);
+        if (!error)
+            error = file.WriteAll(it.second);
         if (error)
             return error;
     }
@@ -287,7 +494,13 @@ TError TTaskEnv::ApplySysctl() {
 TError TTaskEnv::ConfigureChild() {
     TError error;
 
-    error = CT->GetUlimit().Apply();
+    if (Ulimit) {
+        error = Ulimit->Apply();
+        if (error)
+            return error;
+    }
+
+    error = SetThpMode(CT->GetThpMode());
     if (error)
         return error;
 
@@ -333,7 +546,11 @@ TError TTaskEnv::ConfigureChild() {
     if (error)
         return error;
 
-    if (CT->EtcHosts.size()) {
+    if (EtcHosts) {
+        error = TPath("/etc/hosts").BindFile(EtcHosts, true);
+        if (error)
+            return error;
+    } else if (CT->EtcHosts.size()) {
         error = TPath("/etc/hosts").WritePrivate(CT->EtcHosts);
         if (error)
             return error;
@@ -544,8 +761,23 @@ TError TTaskEnv::Start() {
 
         (void)setsid();
 
+        /*
+         * Without triple fork this process exits right after clone,
+         * so task could be cloned directly into cgroup2 and
+         * migration of this process could be skipped.
+         */
+        const TCgroup *intoCgroup = nullptr;
+        int intoCgroupFd = -1;
+
         // move to target cgroups
         for (auto &cg : Cgroups) {
+            if (!TripleFork && cg.Subsystem == &Cgroup2Subsystem) {
+                intoCgroupFd = open(cg.Path().c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                if (intoCgroupFd >= 0) {
+                    intoCgroup = &cg;
+                    continue;
+                }
+            }
             error = cg.Attach(GetPid());
             if (error)
                 Abort(error);
@@ -640,7 +872,24 @@ TError TTaskEnv::Start() {
         if (CT->Isolate || CT->Hostname != "")
             cloneFlags |= CLONE_NEWUTS;
 
-        pid_t clonePid = clone(ChildFn, stack + sizeof(stack), cloneFlags, this);
+        pid_t clonePid = -1;
+
+        if (intoCgroup) {
+            clonePid = CloneIntoCgroup(cloneFlags, intoCgroupFd);
+            if (!clonePid)
+                _exit(ChildFn(this));
+            close(intoCgroupFd);
+
+            /* Old kernel, fallback to migration and clone() */
+            if (clonePid < 0) {
+                error = intoCgroup->Attach(GetPid());
+                if (error)
+                    Abort(error);
+            }
+        }
+
+        if (clonePid < 0)
+            clonePid = clone(ChildFn, stack + sizeof(stack), cloneFlags, this);
 
         if (clonePid < 0) {
             TError error(errno == ENOMEM ?
@@ -700,6 +949,7 @@ TError TTaskEnv::Start() {
     error = MasterSock.RecvPid(CT->WaitTask.Pid, CT->TaskVPid);
     if (error)
         goto kill_all;
+    CT->TraceStart("fork");
 
     /* Ack WPid */
     error = MasterSock.SendZero();
@@ -709,6 +959,7 @@ TError TTaskEnv::Start() {
     error = MasterSock.RecvPid(CT->Task.Pid, CT->TaskVPid);
     if (error)
         goto kill_all;
+    CT->TraceStart("configure");
 
     error2 = task.Wait();
 
@@ -721,6 +972,7 @@ TError TTaskEnv::Start() {
     error = MasterSock.RecvError();
     if (error)
         goto kill_all;
+    CT->TraceStart("exec");
 
     if (!error && error2) {
         error = error2;
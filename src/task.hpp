@@ -14,10 +14,17 @@
 class TContainer;
 class TClient;
 
+/* Validated sysctl writes, shared by containers with the same sysctl set */
+struct TSysctlProfile {
+    std::vector<std::pair<std::string, std::string>> Writes;  /* /proc/sys path, value */
+    std::string Text;
+};
+
 struct TTaskEnv {
     std::shared_ptr<TContainer> CT;
     TClient *Client;
     TFile PortoInit;
+    TFile EtcHosts;
     TMountNamespace Mnt;
 
     TNamespaceFd IpcFd;
@@ -37,6 +44,10 @@ struct TTaskEnv {
     TCred Cred;
     uid_t LoginUid;
 
+    /* Prepared in parent, only what differs from inherited state */
+    std::shared_ptr<const TSysctlProfile> Sysctl;
+    std::shared_ptr<const TUlimit> Ulimit;
+
     TUnixSocket Sock, MasterSock;
     TUnixSocket Sock2, MasterSock2;
     int ReportStage = 0;
@@ -49,6 +60,8 @@ struct TTaskEnv {
     TError ConfigureChild();
     TError WriteResolvConf();
     TError SetHostname();
+    TError PrepareSysctl();
+    void PrepareUlimit();
     TError ApplySysctl();
 
     TError WaitAutoconf();
@@ -58,6 +71,12 @@ struct TTaskEnv {
     void Abort(const TError &error);
 };
 
+/* thp=madvise needs PR_THP_DISABLE_EXCEPT_ADVISED */
+bool ThpExceptAdvisedSupported();
+
+/* Applies thp mode of container to current process */
+TError SetThpMode(const std::string &thp);
+
 extern std::list<std::string> IpcSysctls;
 void InitIpcSysctl();
 
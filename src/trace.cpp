@@ -0,0 +1,214 @@
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <unordered_set>
+
+#include "trace.hpp"
+#include "config.hpp"
+#include "util/log.hpp"
+#include "util/unix.hpp"
+
+extern "C" {
+#include <time.h>
+}
+
+/* Keep memory bounded for requests which touch many cgroups */
+constexpr size_t TRACE_SPANS_PER_REQUEST = 1024;
+
+/* Slow request log shows only first spans */
+constexpr size_t TRACE_LOG_SPANS = 100;
+
+static std::atomic<uint64_t> TraceSeq(0);
+static uint64_t TraceEpoch = GetRealTimeMs();
+
+thread_local TTraceContext RequestTrace;
+
+static std::mutex TraceMutex;
+static std::vector<TTraceSpan> TraceRing;
+static size_t TraceRingHead = 0;
+
+static uint64_t TraceTimeUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void TTraceContext::Begin(const std::string &name, const std::string &arg) {
+    Spans.clear();
+    TraceId = 0;
+    CurrentSpan = 0;
+
+    if (!config().daemon().trace_spans())
+        return;
+
+    TraceId = ++TraceSeq;
+    CurrentSpan = 1;
+
+    Spans.emplace_back();
+    auto &span = Spans.back();
+    span.TraceId = TraceId;
+    span.SpanId = 1;
+    span.StartUs = TraceTimeUs();
+    span.Tid = GetTid();
+    span.Name = name;
+    span.Arg = arg;
+}
+
+void TTraceContext::Finish() {
+    if (!TraceId)
+        return;
+
+    auto &root = Spans[0];
+    root.DurationUs = TraceTimeUs() - root.StartUs;
+
+    uint64_t slowMs = config().daemon().trace_slow_ms();
+    if (slowMs && root.DurationUs >= slowMs * 1000) {
+        std::vector<int> depth(Spans.size(), 0);
+
+        L("Trace {} {} {} time={} ms spans={}", TraceId, root.Name, root.Arg,
+          root.DurationUs / 1000, Spans.size());
+
+        for (size_t i = 1; i < Spans.size() && i <= TRACE_LOG_SPANS; i++) {
+            auto &span = Spans[i];
+            depth[i] = depth[span.ParentId - 1] + 1;
+            L("Trace {} {}{} {} +{} time={} us", TraceId,
+              std::string(depth[i] * 2, ' '), span.Name, span.Arg,
+              span.StartUs - root.StartUs, span.DurationUs);
+        }
+    }
+
+    size_t size = config().daemon().trace_spans();
+    if (!size) {
+        Spans.clear();
+        TraceId = 0;
+        return;
+    }
+
+    auto lock = std::unique_lock<std::mutex>(TraceMutex);
+    if (TraceRing.size() != size) {
+        TraceRing.clear();
+        TraceRing.resize(size);
+        TraceRingHead = 0;
+    }
+    for (auto &span: Spans) {
+        TraceRing[TraceRingHead] = std::move(span);
+        TraceRingHead = (TraceRingHead + 1) % size;
+    }
+    lock.unlock();
+
+    Spans.clear();
+    TraceId = 0;
+    CurrentSpan = 0;
+}
+
+TTraceScope::TTraceScope(const char *name, const std::string &arg) {
+    if (!RequestTrace.TraceId || RequestTrace.Spans.size() >= TRACE_SPANS_PER_REQUEST)
+        return;
+
+    Trace = &RequestTrace;
+    Index = Trace->Spans.size();
+    Parent = Trace->CurrentSpan;
+    Trace->CurrentSpan = Index + 1;
+
+    Trace->Spans.emplace_back();
+    auto &span = Trace->Spans.back();
+    span.TraceId = Trace->TraceId;
+    span.SpanId = Index + 1;
+    span.ParentId = Parent;
+    span.Tid = GetTid();
+    span.Name = name;
+    span.Arg = arg;
+    span.StartUs = TraceTimeUs();
+}
+
+TTraceScope::~TTraceScope() {
+    if (!Trace)
+        return;
+
+    auto &span = Trace->Spans[Index];
+    span.DurationUs = TraceTimeUs() - span.StartUs;
+    Trace->CurrentSpan = Parent;
+}
+
+static std::string JsonString(const std::string &str) {
+    std::string out = "\"";
+    for (unsigned char c: str) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c < 0x20) {
+            out += fmt::format("\\u{:04x}", c);
+        } else
+            out += c;
+    }
+    out += "\"";
+    return out;
+}
+
+TError DumpTrace(const std::string &format, uint64_t minDurationMs, std::string &out) {
+    std::vector<TTraceSpan> spans;
+    std::unordered_set<uint64_t> traces;
+
+    if (format != "chrome" && format != "otlp")
+        return TError(EError::InvalidValue, "Unknown trace format: {}", format);
+
+    auto lock = std::unique_lock<std::mutex>(TraceMutex);
+    for (size_t i = 0; i < TraceRing.size(); i++) {
+        auto &span = TraceRing[(TraceRingHead + i) % TraceRing.size()];
+        if (!span.TraceId)
+            continue;
+        if (!span.ParentId && span.DurationUs >= minDurationMs * 1000)
+            traces.insert(span.TraceId);
+        spans.push_back(span);
+    }
+    lock.unlock();
+
+    /* Spans of requests which root is already overwritten go only without filter */
+    if (minDurationMs)
+        spans.erase(std::remove_if(spans.begin(), spans.end(),
+                    [&](const TTraceSpan &span) {
+                        return !traces.count(span.TraceId);
+                    }), spans.end());
+
+    out.clear();
+
+    if (format == "chrome") {
+        pid_t pid = GetPid();
+
+        out += "{\"traceEvents\":[";
+        for (auto &span: spans) {
+            if (&span != &spans[0])
+                out += ",";
+            out += fmt::format("{{\"name\":{},\"cat\":\"porto\",\"ph\":\"X\","
+                               "\"ts\":{},\"dur\":{},\"pid\":{},\"tid\":{},"
+                               "\"args\":{{\"trace\":{},\"arg\":{}}}}}",
+                               JsonString(span.Name), span.StartUs, span.DurationUs,
+                               pid, span.Tid, span.TraceId, JsonString(span.Arg));
+        }
+        out += "]}";
+        return OK;
+    }
+
+    out += "{\"resourceSpans\":[{\"resource\":{\"attributes\":["
+           "{\"key\":\"service.name\",\"value\":{\"stringValue\":\"portod\"}}]},"
+           "\"scopeSpans\":[{\"scope\":{\"name\":\"porto\"},\"spans\":[";
+    for (auto &span: spans) {
+        if (&span != &spans[0])
+            out += ",";
+        out += fmt::format("{{\"traceId\":\"{:016x}{:016x}\",\"spanId\":\"{:016x}\",",
+                           TraceEpoch, span.TraceId, span.SpanId);
+        if (span.ParentId)
+            out += fmt::format("\"parentSpanId\":\"{:016x}\",", span.ParentId);
+        out += fmt::format("\"name\":{},\"kind\":{},"
+                           "\"startTimeUnixNano\":\"{}\",\"endTimeUnixNano\":\"{}\","
+                           "\"attributes\":["
+                           "{{\"key\":\"porto.arg\",\"value\":{{\"stringValue\":{}}}}},"
+                           "{{\"key\":\"thread.id\",\"value\":{{\"intValue\":\"{}\"}}}}]}}",
+                           JsonString(span.Name), span.ParentId ? 1 : 2,
+                           span.StartUs * 1000, (span.StartUs + span.DurationUs) * 1000,
+                           JsonString(span.Arg), span.Tid);
+    }
+    out += "]}]}]}";
+
+    return OK;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "util/error.hpp"
+
+/*
+ * Request tracing. Spans of subsystems are collected into trace of request
+ * handled by current thread, finished requests are moved into ring buffer
+ * and dumped into log if they are slow. Threads which only borrow client
+ * context (CL), like volume builders, do not record spans.
+ */
+
+struct TTraceSpan {
+    uint64_t TraceId = 0;
+    uint32_t SpanId = 0;
+    uint32_t ParentId = 0;      /* 0 for request itself */
+    uint64_t StartUs = 0;       /* realtime */
+    uint64_t DurationUs = 0;
+    pid_t Tid = 0;
+    std::string Name;
+    std::string Arg;
+};
+
+struct TTraceContext {
+    uint64_t TraceId = 0;
+    uint32_t CurrentSpan = 0;
+    std::vector<TTraceSpan> Spans;
+
+    void Begin(const std::string &name, const std::string &arg);
+    void Finish();
+};
+
+/* Trace of request handled by current thread, see TRequest::Handle */
+extern thread_local TTraceContext RequestTrace;
+
+/* Span for scope, does nothing outside of request */
+class TTraceScope {
+public:
+    TTraceScope(const char *name, const std::string &arg = "");
+    ~TTraceScope();
+
+private:
+    TTraceContext *Trace = nullptr;
+    size_t Index = 0;
+    uint32_t Parent = 0;
+};
+
+/* Finished traces in "chrome" or "otlp" json format */
+TError DumpTrace(const std::string &format, uint64_t minDurationMs, std::string &out);
@@ -1,11 +1,17 @@
 #include "util/cred.hpp"
 #include "util/log.hpp"
+#include "util/unix.hpp"
 #include "config.hpp"
 #include "common.hpp"
 
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+
 extern "C" {
 #include <grp.h>
 #include <pwd.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/prctl.h>
 #include <sys/syscall.h>
@@ -16,10 +22,76 @@ extern "C" {
 gid_t PortoGroup;
 gid_t PortoCtGroup;
 
+/*
+ * NSS could be backed by LDAP or SSSD where one lookup takes milliseconds.
+ * Results are cached for nss_cache_ms, failures for nss_negative_cache_ms.
+ */
+struct TNssCacheEntry {
+    uint64_t Time = 0;
+    TError Error;
+    uid_t Uid = NoUser;
+    gid_t Gid = NoGroup;
+    std::string Name;
+    std::vector<gid_t> Groups;
+};
+
+constexpr size_t NSS_CACHE_MAX_SIZE = 65536;
+
+uint64_t NssCacheMs = 0;
+uint64_t NssNegativeCacheMs = 0;
+
+static std::mutex NssCacheMutex;
+static std::unordered_map<std::string, TNssCacheEntry> NssCache;
+
+static uint64_t NssTimeUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void NssCached(const std::string &key, TNssCacheEntry &entry,
+                      std::function<TError(TNssCacheEntry &)> lookup) {
+    uint64_t ttl = NssCacheMs;
+    uint64_t negative_ttl = NssNegativeCacheMs;
+
+    /* portoctl and helpers don't cache */
+    if (!ttl || !Statistics) {
+        entry.Error = lookup(entry);
+        return;
+    }
+
+    uint64_t now = GetCurrentTimeMs();
+    auto lock = std::unique_lock<std::mutex>(NssCacheMutex);
+    auto it = NssCache.find(key);
+    if (it != NssCache.end() &&
+            now - it->second.Time < (it->second.Error ? negative_ttl : ttl)) {
+        entry = it->second;
+        Statistics->NssCacheHits++;
+        return;
+    }
+    lock.unlock();
+
+    uint64_t start = NssTimeUs();
+    entry.Error = lookup(entry);
+    entry.Time = now;
+    Statistics->NssLookupUs += NssTimeUs() - start;
+    Statistics->NssCacheMisses++;
+
+    lock.lock();
+    if (NssCache.size() >= NSS_CACHE_MAX_SIZE)
+        NssCache.clear();
+    NssCache[key] = entry;
+}
+
+void FlushNssCache() {
+    auto lock = std::unique_lock<std::mutex>(NssCacheMutex);
+    NssCache.clear();
+}
+
 static size_t PwdBufSize = sysconf(_SC_GETPW_R_SIZE_MAX) > 0 ?
                            sysconf(_SC_GETPW_R_SIZE_MAX) : 16384;
 
-TError FindUser(const std::string &user, uid_t &uid, gid_t &gid) {
+static TError LookupUser(const std::string &user, uid_t &uid, gid_t &gid) {
     struct passwd pwd, *ptr;
     std::vector<char> buf(PwdBufSize, '\0');
     int id, err;
@@ -44,7 +116,7 @@ TError FindUser(const std::string &user, uid_t &uid, gid_t &gid) {
     return OK;
 }
 
-TError FindGroups(const std::string &user, gid_t gid, std::vector<gid_t> &groups) {
+static TError LookupGroups(const std::string &user, gid_t gid, std::vector<gid_t> &groups) {
     int ngroups = 32;
 
     for (int retry = 0; retry < 3; retry++) {
@@ -58,7 +130,7 @@ TError FindGroups(const std::string &user, gid_t gid, std::vector<gid_t> &groups
     return TError("Cannot list groups for " + user);
 }
 
-TError UserId(const std::string &user, uid_t &uid) {
+static TError LookupUserId(const std::string &user, uid_t &uid) {
     struct passwd pwd, *ptr;
     std::vector<char> buf(PwdBufSize, '\0');
     int id;
@@ -83,7 +155,7 @@ TError UserId(const std::string &user, uid_t &uid) {
     return OK;
 }
 
-std::string UserName(uid_t uid) {
+static std::string LookupUserName(uid_t uid) {
     struct passwd pwd, *ptr;
     std::vector<char> buf(PwdBufSize, '\0');
 
@@ -105,7 +177,7 @@ std::string UserName(uid_t uid) {
 static size_t GrpBufSize = sysconf(_SC_GETGR_R_SIZE_MAX) > 0 ?
                            sysconf(_SC_GETGR_R_SIZE_MAX) : 16384;
 
-TError GroupId(const std::string &group, gid_t &gid) {
+static TError LookupGroupId(const std::string &group, gid_t &gid) {
     struct group grp, *ptr;
     std::vector<char> buf(GrpBufSize, '\0');
     int id;
@@ -130,7 +202,7 @@ TError GroupId(const std::string &group, gid_t &gid) {
     return OK;
 }
 
-std::string GroupName(gid_t gid) {
+static std::string LookupGroupName(gid_t gid) {
     struct group grp, *ptr;
     std::vector<char> buf(GrpBufSize, '\0');
 
@@ -149,6 +221,84 @@ std::string GroupName(gid_t gid) {
     return std::string(grp.gr_name);
 }
 
+TError FindUser(const std::string &user, uid_t &uid, gid_t &gid) {
+    TNssCacheEntry entry;
+
+    NssCached("user:" + user, entry, [&](TNssCacheEntry &e) {
+        return LookupUser(user, e.Uid, e.Gid);
+    });
+
+    if (!entry.Error) {
+        uid = entry.Uid;
+        gid = entry.Gid;
+    }
+    return entry.Error;
+}
+
+TError FindGroups(const std::string &user, gid_t gid, std::vector<gid_t> &groups) {
+    TNssCacheEntry entry;
+
+    NssCached(fmt::format("groups:{}:{}", user, gid), entry, [&](TNssCacheEntry &e) {
+        return LookupGroups(user, gid, e.Groups);
+    });
+
+    if (!entry.Error)
+        groups = entry.Groups;
+    return entry.Error;
+}
+
+TError UserId(const std::string &user, uid_t &uid) {
+    TNssCacheEntry entry;
+
+    NssCached("uid:" + user, entry, [&](TNssCacheEntry &e) {
+        return LookupUserId(user, e.Uid);
+    });
+
+    if (!entry.Error)
+        uid = entry.Uid;
+    return entry.Error;
+}
+
+std::string UserName(uid_t uid) {
+    TNssCacheEntry entry;
+
+    if (uid == NoUser)
+        return "";
+
+    NssCached("username:" + std::to_string(uid), entry, [&](TNssCacheEntry &e) {
+        e.Name = LookupUserName(uid);
+        return OK;
+    });
+
+    return entry.Name;
+}
+
+TError GroupId(const std::string &group, gid_t &gid) {
+    TNssCacheEntry entry;
+
+    NssCached("gid:" + group, entry, [&](TNssCacheEntry &e) {
+        return LookupGroupId(group, e.Gid);
+    });
+
+    if (!entry.Error)
+        gid = entry.Gid;
+    return entry.Error;
+}
+
+std::string GroupName(gid_t gid) {
+    TNssCacheEntry entry;
+
+    if (gid == NoGroup)
+        return "";
+
+    NssCached("groupname:" + std::to_string(gid), entry, [&](TNssCacheEntry &e) {
+        e.Name = LookupGroupName(gid);
+        return OK;
+    });
+
+    return entry.Name;
+}
+
 TCred TCred::Current() {
     TCred cred(geteuid(), getegid());
 
@@ -16,6 +16,13 @@ std::string GroupName(gid_t gid);
 
 void InitPortoGroups();
 
+/* Set from config, without them user and group lookups aren't cached */
+extern uint64_t NssCacheMs;
+extern uint64_t NssNegativeCacheMs;
+
+/* Drop cached user and group lookups, called at config reload */
+void FlushNssCache();
+
 constexpr uid_t RootUser = (uid_t)0;
 constexpr gid_t RootGroup = (gid_t)0;
 
@@ -6,11 +6,31 @@
 #include "common.hpp"
 #include "log.hpp"
 
+/* Next-fit id allocator over bitmap, scans 64 ids at once */
 class TIdMap : public TPortoNonCopyable {
 private:
     int Base;
+    int Size = 0;
     int Last = -1;
-    std::vector<bool> Used;
+    std::vector<uint64_t> Used;
+
+    bool Test(int idx) const {
+        return Used[idx / 64] & (1ull << (idx % 64));
+    }
+
+    /* First free index in [from, to) or -1 */
+    int FindFree(int from, int to) const {
+        for (int idx = from; idx < to; ) {
+            uint64_t word = ~Used[idx / 64] & (~0ull << (idx % 64));
+            if (word) {
+                int found = idx / 64 * 64 + __builtin_ctzll(word);
+                return found < to ? found : -1;
+            }
+            idx = (idx / 64 + 1) * 64;
+        }
+        return -1;
+    }
+
 public:
     TIdMap(int base, int size) {
         Base = base;
@@ -18,38 +38,42 @@ public:
     }
 
     void Resize(int size) {
-        Used.resize(size, false);
+        /* Bits beyond new size must be clear for later growth */
+        for (int idx = size; idx < Size && idx < (int)Used.size() * 64; idx++)
+            Used[idx / 64] &= ~(1ull << (idx % 64));
+        Used.resize((size + 63) / 64, 0);
+        Size = size;
     }
 
     TError GetAt(int id) {
-        if (id < Base || id >= Base + (int)Used.size())
+        if (id < Base || id >= Base + Size)
             return TError("Id " + std::to_string(id) + " out of range");
-        if (Used[id - Base])
+        if (Test(id - Base))
             return TError("Id " + std::to_string(id) + " already used");
-        Used[id - Base] = true;
+        Used[(id - Base) / 64] |= 1ull << ((id - Base) % 64);
         return OK;
     }
 
     TError Get(int &id) {
-        auto it = std::find(Used.begin() + Last + 1, Used.end(), false);
-        if (Last && it == Used.end())
-            it = std::find(Used.begin(), Used.end(), false);
-        if (it == Used.end()) {
+        int idx = FindFree(Last + 1, Size);
+        if (Last && idx < 0)
+            idx = FindFree(0, Size);
+        if (idx < 0) {
             id = -1;
             return TError(EError::ResourceNotAvailable, "Cannot allocate id");
         }
-        Last = it - Used.begin();
+        Last = idx;
         id = Base + Last;
-        *it = true;
+        Used[idx / 64] |= 1ull << (idx % 64);
         return OK;
     }
 
     TError Put(int id) {
-        if (id < Base || id >= Base + (int)Used.size())
+        if (id < Base || id >= Base + Size)
             return TError("Id out of range");
-        if (!Used[id - Base])
+        if (!Test(id - Base))
             return TError("Freeing not allocated id");
-        Used[id - Base] = false;
+        Used[(id - Base) / 64] &= ~(1ull << ((id - Base) % 64));
         return OK;
     }
 };
@@ -1,6 +1,10 @@
 #pragma once
 
 #include <mutex>
+#include <atomic>
+
+#include "util/string.hpp"
+#include "util/unix.hpp"
 
 typedef std::unique_lock<std::mutex> TScopedLock;
 
@@ -12,3 +16,33 @@ public:
 private:
     std::mutex Mutex;
 };
+
+/* Contention counters, touched only when lock was busy */
+struct TLockStat {
+    std::atomic<uint64_t> Waits{0};
+    std::atomic<uint64_t> WaitUs{0};
+    std::atomic<uint64_t> MaxWaitUs{0};
+
+    void Account(uint64_t waitUs) {
+        Waits++;
+        WaitUs += waitUs;
+        uint64_t max = MaxWaitUs;
+        while (waitUs > max && !MaxWaitUs.compare_exchange_weak(max, waitUs));
+    }
+
+    void Dump(TUintMap &stat, const std::string &prefix) const {
+        stat[prefix + "_waits"] = Waits;
+        stat[prefix + "_wait_us"] = WaitUs;
+        stat[prefix + "_max_wait_us"] = MaxWaitUs;
+    }
+};
+
+static inline TScopedLock LockWithStat(std::mutex &mutex, TLockStat &stat) {
+    TScopedLock lock(mutex, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        uint64_t start = GetCurrentTimeUs();
+        lock.lock();
+        stat.Account(GetCurrentTimeUs() - start);
+    }
+    return lock;
+}
@@ -3,6 +3,13 @@
 #include "util/signal.hpp"
 #include "common.hpp"
 
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 extern "C" {
 #include <unistd.h>
 #include <sys/types.h>
@@ -11,6 +18,7 @@ extern "C" {
 #include <fcntl.h>
 #include <execinfo.h>
 #include <cxxabi.h>
+#include <pthread.h>
 }
 
 bool StdLog = false;
@@ -19,6 +27,51 @@ bool Debug = false;
 
 TStatistics *Statistics = nullptr;
 
+constexpr int NR_STAT_SHARDS = 64;
+
+static TStatShard StatShards[NR_STAT_SHARDS];
+static std::atomic<unsigned> StatShardNext(0);
+
+/* Same order as EStatShard */
+static std::atomic<uint64_t> TStatistics::* const StatShardFields[NR_STAT_SHARD_COUNTERS] = {
+    &TStatistics::RequestsQueued,
+    &TStatistics::RequestsCompleted,
+    &TStatistics::RequestsQueueWaitMs,
+    &TStatistics::LogLines,
+    &TStatistics::LogBytes,
+};
+
+/* Forked children have private copy of shards, nobody folds them */
+static std::atomic<bool> StatShardsEnabled(false);
+static std::atomic<pid_t> StatShardsPid(0);
+thread_local TStatShard *StatShard = nullptr;
+
+void EnableStatShards(bool enable) {
+    StatShardsPid = enable ? GetPid() : 0;
+    StatShardsEnabled = enable;
+}
+
+bool StatShardsActive() {
+    return StatShardsEnabled && StatShardsPid == GetPid();
+}
+
+TStatShard *PickStatShard() {
+    return &StatShards[StatShardNext++ % NR_STAT_SHARDS];
+}
+
+void SyncStatistics() {
+    if (!Statistics)
+        return;
+
+    for (auto &shard: StatShards) {
+        for (int i = 0; i < NR_STAT_SHARD_COUNTERS; i++) {
+            if (!shard.Value[i].load(std::memory_order_relaxed))
+                continue;
+            Statistics->*StatShardFields[i] += shard.Value[i].exchange(0);
+        }
+    }
+}
+
 void InitStatistics() {
     TError error;
     TFile file;
@@ -72,19 +125,34 @@ void OpenLog(const TPath &path) {
     }
 }
 
-void WriteLog(const char *prefix, const std::string &log_msg) {
-    std::string msg = fmt::format("{} {}[{}]: {} {}\n",
-            FormatTime(time(nullptr)), GetTaskName(), GetTid(), prefix, log_msg);
-
-    if (Statistics) {
-        Statistics->LogLines++;
-        Statistics->LogBytes += msg.size();
-    }
-
-    if (!LogFile)
+/*
+ * Async mode: threads append lines into own buffers, writer thread drains
+ * them into log file. Buffers are bounded, overflow is counted as lost.
+ * Forked children have no writer and always log synchronously.
+ */
+
+struct TLogBuffer {
+    std::mutex Mutex;
+    std::string Data;
+};
+
+static constexpr size_t LOG_BUFFER_MAX = 4 << 20;
+static constexpr size_t LOG_BUFFER_KICK = 64 << 10;
+static constexpr uint64_t LOG_FLUSH_MS = 10;
+
+static std::atomic<bool> LogAsync(false);
+static std::mutex LogWriterMutex;
+static std::condition_variable LogWriterCv;
+static std::vector<std::shared_ptr<TLogBuffer>> LogBuffers;
+static std::thread LogWriterThread;
+static bool LogWriterStop = false;
+static thread_local std::shared_ptr<TLogBuffer> ThreadLogBuffer;
+
+static void WriteLogData(const std::string &data) {
+    if (!LogFile || data.empty())
         return;
 
-    TError error = LogFile.WriteAll(msg);
+    TError error = LogFile.WriteAll(data);
     if (error && Statistics) {
         if (error.Errno != ENOSPC &&
                 error.Errno != EDQUOT &&
@@ -92,17 +160,177 @@ void WriteLog(const char *prefix, const std::string &log_msg) {
                 error.Errno != EIO &&
                 error.Errno != EUCLEAN)
             Statistics->Warns++;
-        Statistics->LogLinesLost++;
-        Statistics->LogBytesLost += msg.size();
+        Statistics->LogLinesLost += std::count(data.begin(), data.end(), '\n');
+        Statistics->LogBytesLost += data.size();
     }
 }
 
+static void FlushLogBuffers(const std::vector<std::shared_ptr<TLogBuffer>> &buffers,
+                            bool wait) {
+    std::string data;
+
+    for (auto &buf: buffers) {
+        std::unique_lock<std::mutex> lock(buf->Mutex, std::defer_lock);
+        if (wait)
+            lock.lock();
+        else if (!lock.try_lock())
+            continue;
+        data.swap(buf->Data);
+        lock.unlock();
+
+        WriteLogData(data);
+        data.clear();
+    }
+}
+
+static void LogWriter() {
+    std::unique_lock<std::mutex> lock(LogWriterMutex);
+
+    SetProcessName("portod-LOG");
+
+    while (!LogWriterStop) {
+        LogWriterCv.wait_for(lock, std::chrono::milliseconds(LOG_FLUSH_MS));
+
+        auto buffers = LogBuffers;
+        lock.unlock();
+        FlushLogBuffers(buffers, true);
+        lock.lock();
+
+        /* Forget buffers of finished threads */
+        LogBuffers.erase(std::remove_if(LogBuffers.begin(), LogBuffers.end(),
+                    [](const std::shared_ptr<TLogBuffer> &buf) {
+                        return buf.use_count() == 1 && buf->Data.empty();
+                    }), LogBuffers.end());
+    }
+}
+
+static void QueueLog(const std::string &msg) {
+    if (!ThreadLogBuffer) {
+        ThreadLogBuffer = std::make_shared<TLogBuffer>();
+        std::lock_guard<std::mutex> guard(LogWriterMutex);
+        LogBuffers.push_back(ThreadLogBuffer);
+    }
+
+    size_t size;
+    {
+        std::lock_guard<std::mutex> guard(ThreadLogBuffer->Mutex);
+        size = ThreadLogBuffer->Data.size() + msg.size();
+        if (size <= LOG_BUFFER_MAX)
+            ThreadLogBuffer->Data += msg;
+    }
+
+    if (size > LOG_BUFFER_MAX) {
+        if (Statistics) {
+            Statistics->LogLinesLost++;
+            Statistics->LogBytesLost += msg.size();
+        }
+    } else if (size >= LOG_BUFFER_KICK)
+        LogWriterCv.notify_one();
+}
+
+void StartLogWriter() {
+    static bool registered = false;
+
+    if (LogAsync)
+        return;
+
+    if (!registered) {
+        pthread_atfork(nullptr, nullptr, []() { LogAsync = false; });
+        registered = true;
+    }
+
+    LogWriterStop = false;
+    LogWriterThread = std::thread(LogWriter);
+    LogAsync = true;
+}
+
+void StopLogWriter() {
+    if (!LogAsync)
+        return;
+
+    LogAsync = false;
+
+    {
+        std::lock_guard<std::mutex> guard(LogWriterMutex);
+        LogWriterStop = true;
+    }
+    LogWriterCv.notify_one();
+    LogWriterThread.join();
+
+    std::lock_guard<std::mutex> guard(LogWriterMutex);
+    FlushLogBuffers(LogBuffers, true);
+    LogBuffers.clear();
+}
+
+/* Switch to synchronous logging at crash, do not wait for any locks */
+void FlushLog() {
+    if (!LogAsync)
+        return;
+
+    LogAsync = false;
+
+    std::unique_lock<std::mutex> lock(LogWriterMutex, std::try_to_lock);
+    if (lock)
+        FlushLogBuffers(LogBuffers, false);
+}
+
+uint64_t LogRateLimit = 0;
+
+static constexpr size_t LOG_SITES = 1024;
+
+static struct {
+    std::atomic<uint64_t> Second;
+    std::atomic<uint64_t> Count;
+} LogSites[LOG_SITES];
+
+/* Sites are hashed by format string, collisions only share the limit */
+bool LogRateLimited(const void *site) {
+    if (!LogRateLimit)
+        return false;
+
+    auto &s = LogSites[((uintptr_t)site >> 3) % LOG_SITES];
+    uint64_t now = GetCurrentTimeMs() / 1000;
+
+    if (s.Second != now) {
+        s.Second = now;
+        s.Count = 0;
+    }
+
+    if (++s.Count <= LogRateLimit)
+        return false;
+
+    if (Statistics)
+        Statistics->LogLinesSuppressed++;
+
+    return true;
+}
+
+void WriteLog(const char *prefix, const std::string &log_msg) {
+    std::string msg = fmt::format("{} {}[{}]: {} {}\n",
+            FormatTime(time(nullptr)), GetTaskName(), GetTid(), prefix, log_msg);
+
+    if (StatShardsActive()) {
+        StatAdd(STAT_LOG_LINES, 1);
+        StatAdd(STAT_LOG_BYTES, msg.size());
+    } else if (Statistics) {
+        Statistics->LogLines++;
+        Statistics->LogBytes += msg.size();
+    }
+
+    if (LogAsync)
+        QueueLog(msg);
+    else
+        WriteLogData(msg);
+}
+
 void porto_assert(const char *msg, const char *file, size_t line) {
+    FlushLog();
     L_ERR("Assertion failed: {} at {}:{}", msg, file, line);
     Crash();
 }
 
 void FatalError(const std::string &text, TError &error) {
+    FlushLog();
     L_ERR("{}: {}", text, error);
     _exit(EXIT_FAILURE);
 }
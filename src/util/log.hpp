@@ -10,8 +10,14 @@ extern bool Verbose;
 extern bool Debug;
 extern TFile LogFile;
 
+extern uint64_t LogRateLimit;
+
 void OpenLog(const TPath &path);
 void WriteLog(const char *prefix, const std::string &log_msg);
+bool LogRateLimited(const void *site);
+void StartLogWriter();
+void StopLogWriter();
+void FlushLog();
 void Stacktrace();
 
 struct TStatistics {
@@ -67,6 +73,33 @@ struct TStatistics {
     std::atomic<uint64_t> NetworkProblems;
     std::atomic<uint64_t> NetworkRepairs;
     std::atomic<uint64_t> PortoCrash;
+    std::atomic<uint64_t> RequestsQueueWaitMs;
+    std::atomic<uint64_t> RequestsLongestWait;
+    std::atomic<uint64_t> RequestsStolen;
+    std::atomic<uint64_t> RequestsQueuedRo;
+    std::atomic<uint64_t> RequestsQueuedRw;
+    std::atomic<uint64_t> RequestsQueuedIo;
+    std::atomic<uint64_t> RestoreTotal;
+    std::atomic<uint64_t> ContainersRestored;
+    std::atomic<uint64_t> VolumesRestored;
+    std::atomic<uint64_t> RestoreTimeMs;
+    std::atomic<uint64_t> LayerImportBytes;
+    std::atomic<uint64_t> LayerImportMs;
+    std::atomic<uint64_t> LayerExportBytes;
+    std::atomic<uint64_t> LayerExportMs;
+    std::atomic<uint64_t> LayerDedupBytes;
+    std::atomic<uint64_t> ContainersStopped;
+    std::atomic<uint64_t> StopTimeMs;
+    std::atomic<uint64_t> LongestStopMs;
+    std::atomic<uint64_t> LogRelayLines;
+    std::atomic<uint64_t> LogRelayBytes;
+    std::atomic<uint64_t> LogRelayLinesLost;
+    std::atomic<uint64_t> LogRelayBytesLost;
+    std::atomic<uint64_t> LogLinesSuppressed;
+    std::atomic<uint64_t> MemoryReclaimed;
+    std::atomic<uint64_t> NssCacheHits;
+    std::atomic<uint64_t> NssCacheMisses;
+    std::atomic<uint64_t> NssLookupUs;
 
     /* --- add new fields at the end --- */
 };
@@ -75,7 +108,42 @@ extern TStatistics *Statistics;
 
 void InitStatistics();
 
+/*
+ * Counters touched by each request are sharded by thread into separate
+ * cache lines, SyncStatistics() folds them into shared Statistics.
+ * It is called periodically by main loop and before reading them.
+ */
+enum EStatShard {
+    STAT_REQUESTS_QUEUED,
+    STAT_REQUESTS_COMPLETED,
+    STAT_REQUESTS_QUEUE_WAIT_MS,
+    STAT_LOG_LINES,
+    STAT_LOG_BYTES,
+    NR_STAT_SHARD_COUNTERS,
+};
+
+struct alignas(64) TStatShard {
+    std::atomic<uint64_t> Value[NR_STAT_SHARD_COUNTERS];
+};
+
+extern thread_local TStatShard *StatShard;
+
+/* Only in process which enabled them, children update Statistics directly */
+void EnableStatShards(bool enable);
+bool StatShardsActive();
+
+TStatShard *PickStatShard();
+void SyncStatistics();
+
+/* Wraps for decrement, folded sum stays right */
+static inline void StatAdd(EStatShard counter, uint64_t value) {
+    if (!StatShard)
+        StatShard = PickStatShard();
+    StatShard->Value[counter].fetch_add(value, std::memory_order_relaxed);
+}
+
 static inline void ResetStatistics() {
+    SyncStatistics();
     Statistics->ContainersCount = 0;
     Statistics->ContainersTainted = 0;
     Statistics->ClientsCount = 0;
@@ -85,6 +153,10 @@ static inline void ResetStatistics() {
     Statistics->RequestsQueued = 0;
     Statistics->NetworksCount = 0;
     Statistics->LongestRoRequest = 0;
+    Statistics->RequestsLongestWait = 0;
+    Statistics->RequestsQueuedRo = 0;
+    Statistics->RequestsQueuedRw = 0;
+    Statistics->RequestsQueuedIo = 0;
 }
 
 template <typename... Args> inline void L_DBG(const char* fmt, const Args&... args) {
@@ -104,12 +176,16 @@ template <typename... Args> inline void L(const char* fmt, const Args&... args)
 template <typename... Args> inline void L_WRN(const char* fmt, const Args&... args) {
     if (Statistics)
         Statistics->Warns++;
+    if (LogRateLimited(fmt))
+        return;
     WriteLog("WRN", fmt::format(fmt, args...));
 }
 
 template <typename... Args> inline void L_ERR(const char* fmt, const Args&... args) {
     if (Statistics)
         Statistics->Errors++;
+    if (LogRateLimited(fmt))
+        return;
     WriteLog("ERR", fmt::format(fmt, args...));
     if (Verbose)
         Stacktrace();
@@ -35,8 +35,15 @@
  * compile-time configuration.
  */
 
+#include <vector>
+
 #include "md5.hpp"
 
+extern "C" {
+#include <errno.h>
+#include <unistd.h>
+}
+
 /* Any 32-bit or wider unsigned integer data type will do */
 typedef unsigned int MD5_u32plus;
 
@@ -297,17 +304,17 @@ static void MD5_Final(unsigned char *result, MD5_CTX *ctx)
 TError Md5Sum(TFile &file, std::string &sum) {
     MD5_CTX ctx;
     unsigned char bin[16];
-    std::string buf;
-    TError error;
+    std::vector<char> buf(1 << 20);
+    ssize_t len;
 
     MD5_Init(&ctx);
-    while (1) {
-        error = file.Read(buf);
-        if (error)
-            return error;
-        if (!buf.size())
-            break;
-        MD5_Update(&ctx, buf.c_str(), buf.size());
+    while ((len = read(file.Fd, buf.data(), buf.size())) != 0) {
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+            return TError::System("read");
+        }
+        MD5_Update(&ctx, buf.data(), len);
     }
     MD5_Final(bin, &ctx);
     sum = "";
@@ -1,6 +1,7 @@
 #include <sstream>
 #include <algorithm>
 #include <cmath>
+#include <atomic>
 
 #include "netlink.hpp"
 #include "util/log.hpp"
@@ -15,8 +16,11 @@ extern "C" {
 #include <linux/if.h>
 #include <linux/if_ether.h>
 #include <linux/if_addrlabel.h>
+#include <linux/inet_diag.h>
+#include <linux/sock_diag.h>
 #include <linux/pkt_sched.h>
 #include <netinet/ether.h>
+#include <netinet/tcp.h>
 #include <netlink/route/class.h>
 #include <netlink/route/classifier.h>
 #include <netlink/route/cls/cgroup.h>
@@ -82,7 +86,7 @@ void TNl::Dump(const std::string &prefix, void *obj) const {
     L_NL("{} {}", prefix, StringReplaceAll(ss.str(), "\n", " "));
 }
 
-TError TNl::Connect() {
+TError TNl::Connect(bool events) {
     int ret;
     TError error;
 
@@ -100,9 +104,46 @@ TError TNl::Connect() {
     ret = nl_connect(Sock, NETLINK_ROUTE);
     if (ret < 0) {
         nl_socket_free(Sock);
+        Sock = nullptr;
         return Error(ret, "Cannot connect netlink socket");
     }
 
+    if (!events)
+        return OK;
+
+    /* Socket must be created in the same network namespace */
+    EventSock = nl_socket_alloc();
+    if (!EventSock)
+        return OK;
+
+    nl_socket_disable_seq_check(EventSock);
+
+    ret = nl_connect(EventSock, NETLINK_ROUTE);
+    if (!ret)
+        ret = nl_socket_add_memberships(EventSock, RTNLGRP_LINK, RTNLGRP_TC, 0);
+    if (!ret)
+        ret = nl_socket_set_nonblocking(EventSock);
+    if (ret < 0) {
+        L_NL("Cannot subscribe to netlink notifications: {}", nl_geterror(ret));
+        nl_close(EventSock);
+        nl_socket_free(EventSock);
+        EventSock = nullptr;
+    }
+
+    auto diag = nl_socket_alloc();
+    if (!diag)
+        return OK;
+
+    ret = nl_connect(diag, NETLINK_SOCK_DIAG);
+    if (ret < 0) {
+        L_NL("Cannot connect sock_diag socket: {}", nl_geterror(ret));
+        nl_socket_free(diag);
+        return OK;
+    }
+
+    auto lock = std::unique_lock<std::mutex>(DiagMutex);
+    DiagSock = diag;
+
     return OK;
 }
 
@@ -112,9 +153,165 @@ void TNl::Disconnect() {
         nl_socket_free(Sock);
         Sock = nullptr;
     }
+    if (EventSock) {
+        nl_close(EventSock);
+        nl_socket_free(EventSock);
+        EventSock = nullptr;
+    }
+    auto lock = std::unique_lock<std::mutex>(DiagMutex);
+    if (DiagSock) {
+        nl_close(DiagSock);
+        nl_socket_free(DiagSock);
+        DiagSock = nullptr;
+    }
+}
+
+bool TNl::TopologyChanged() {
+    char buf[8192];
+    bool changed = false;
+
+    if (!EventSock)
+        return true;
+
+    while (true) {
+        ssize_t len = recv(nl_socket_get_fd(EventSock), buf, sizeof(buf), MSG_DONTWAIT);
+        if (len > 0) {
+            changed = true;
+        } else if (len < 0 && errno == EINTR) {
+            continue;
+        } else {
+            /* ENOBUFS means overflow, some notifications are lost */
+            if (len < 0 && errno != EAGAIN)
+                changed = true;
+            break;
+        }
+    }
+
+    return changed;
+}
+
+TError TNl::GetLinkStats(std::unordered_map<int, struct rtnl_link_stats64> &stats) {
+    struct if_stats_msg ifsm = {};
+    struct nl_msg *msg;
+    struct nl_cb *cb;
+    int ret;
+
+    msg = nlmsg_alloc_simple(RTM_GETSTATS, NLM_F_DUMP);
+    if (!msg)
+        return TError("Cannot allocate netlink message");
+
+    ifsm.family = AF_UNSPEC;
+    ifsm.filter_mask = IFLA_STATS_FILTER_BIT(IFLA_STATS_LINK_64);
+
+    ret = nlmsg_append(msg, &ifsm, sizeof(ifsm), NLMSG_ALIGNTO);
+    if (!ret)
+        ret = nl_send_auto(Sock, msg);
+    nlmsg_free(msg);
+    if (ret < 0)
+        return Error(ret, "Cannot request link stats");
+
+    cb = nl_cb_clone(nl_socket_get_cb(Sock));
+    if (!cb)
+        return TError("Cannot allocate netlink callback");
+
+    nl_cb_set(cb, NL_CB_VALID, NL_CB_CUSTOM, [](struct nl_msg *msg, void *data) -> int {
+        auto stats = (std::unordered_map<int, struct rtnl_link_stats64> *)data;
+        auto hdr = nlmsg_hdr(msg);
+        struct nlattr *tb[IFLA_STATS_MAX + 1];
+
+        if (hdr->nlmsg_type != RTM_NEWSTATS)
+            return NL_SKIP;
+
+        auto ifsm = (struct if_stats_msg *)nlmsg_data(hdr);
+        if (nlmsg_parse(hdr, sizeof(*ifsm), tb, IFLA_STATS_MAX, nullptr) < 0 ||
+                !tb[IFLA_STATS_LINK_64] ||
+                nla_len(tb[IFLA_STATS_LINK_64]) < (int)sizeof(struct rtnl_link_stats64))
+            return NL_SKIP;
+
+        memcpy(&(*stats)[ifsm->ifindex], nla_data(tb[IFLA_STATS_LINK_64]),
+               sizeof(struct rtnl_link_stats64));
+        return NL_OK;
+    }, &stats);
+
+    ret = nl_recvmsgs(Sock, cb);
+    nl_cb_put(cb);
+    if (ret < 0)
+        return Error(ret, "Cannot dump link stats");
+
+    return OK;
 }
 
-TError TNl::ProxyNeighbour(int ifindex, const TNlAddr &addr, bool add) {
+TError TNl::GetTcpStat(TNlTcpStat &stat) {
+    struct nl_cb *cb;
+    int ret;
+
+    auto lock = std::unique_lock<std::mutex>(DiagMutex);
+    if (!DiagSock)
+        return TError(EError::NotSupported, "sock_diag is not available");
+
+    cb = nl_cb_clone(nl_socket_get_cb(DiagSock));
+    if (!cb)
+        return TError("Cannot allocate netlink callback");
+
+    nl_cb_set(cb, NL_CB_VALID, NL_CB_CUSTOM, [](struct nl_msg *msg, void *data) -> int {
+        auto stat = (TNlTcpStat *)data;
+        auto hdr = nlmsg_hdr(msg);
+        struct nlattr *tb[INET_DIAG_MAX + 1];
+
+        if (hdr->nlmsg_type != SOCK_DIAG_BY_FAMILY)
+            return NL_SKIP;
+
+        auto diag = (struct inet_diag_msg *)nlmsg_data(hdr);
+        stat->Connections++;
+        if (diag->idiag_state == TCP_ESTABLISHED)
+            stat->Established++;
+
+        if (nlmsg_parse(hdr, sizeof(*diag), tb, INET_DIAG_MAX, nullptr) < 0 ||
+                !tb[INET_DIAG_INFO] ||
+                nla_len(tb[INET_DIAG_INFO]) < (int)(offsetof(struct tcp_info, tcpi_total_retrans) +
+                                                    sizeof(uint32_t)))
+            return NL_OK;
+
+        auto info = (struct tcp_info *)nla_data(tb[INET_DIAG_INFO]);
+        stat->Retransmits += info->tcpi_total_retrans;
+        if (diag->idiag_state == TCP_ESTABLISHED)
+            stat->Rtt.push_back(info->tcpi_rtt);
+        return NL_OK;
+    }, &stat);
+
+    for (int family: { AF_INET, AF_INET6 }) {
+        struct inet_diag_req_v2 req = {};
+        struct nl_msg *msg;
+
+        req.sdiag_family = family;
+        req.sdiag_protocol = IPPROTO_TCP;
+        req.idiag_ext = 1 << (INET_DIAG_INFO - 1);
+        req.idiag_states = ((1 << (TCP_CLOSING + 1)) - 1) & ~(1 << TCP_LISTEN);
+
+        msg = nlmsg_alloc_simple(SOCK_DIAG_BY_FAMILY, NLM_F_DUMP);
+        if (!msg) {
+            nl_cb_put(cb);
+            return TError("Cannot allocate netlink message");
+        }
+
+        ret = nlmsg_append(msg, &req, sizeof(req), NLMSG_ALIGNTO);
+        if (!ret)
+            ret = nl_send_auto(DiagSock, msg);
+        nlmsg_free(msg);
+        if (ret >= 0)
+            ret = nl_recvmsgs(DiagSock, cb);
+        if (ret < 0) {
+            nl_cb_put(cb);
+            return Error(ret, "Cannot dump tcp sockets");
+        }
+    }
+
+    nl_cb_put(cb);
+    return OK;
+}
+
+TError TNl::ProxyNeighbour(int ifindex, const TNlAddr &addr, bool add,
+                           TNlBatch *batch) {
     struct rtnl_neigh *neigh;
     int ret;
 
@@ -132,6 +329,21 @@ TError TNl::ProxyNeighbour(int ifindex, const TNlAddr &addr, bool add) {
     rtnl_neigh_set_state(neigh, NUD_PERMANENT);
     rtnl_neigh_set_ifindex(neigh, ifindex);
 
+    if (batch) {
+        struct nl_msg *msg;
+
+        Dump(add ? "batch add" : "batch del", neigh);
+        if (add)
+            ret = rtnl_neigh_build_add_request(neigh, NLM_F_CREATE | NLM_F_REPLACE, &msg);
+        else
+            ret = rtnl_neigh_build_delete_request(neigh, 0, &msg);
+        rtnl_neigh_put(neigh);
+        if (ret)
+            return Error(ret, "Cannot build neighbour request");
+        batch->Add(msg, "Cannot modify neighbour for l3 network", add ? 0 : ENOENT);
+        return OK;
+    }
+
     if (add) {
         Dump("add", neigh);
         ret = rtnl_neigh_add(Sock, neigh, NLM_F_CREATE | NLM_F_REPLACE);
@@ -150,7 +362,8 @@ TError TNl::ProxyNeighbour(int ifindex, const TNlAddr &addr, bool add) {
 }
 
 TError TNl::PermanentNeighbour(int ifindex, const TNlAddr &addr,
-                               const TNlAddr &lladdr, bool add) {
+                               const TNlAddr &lladdr, bool add,
+                               TNlBatch *batch) {
     struct rtnl_neigh *neigh;
     int ret;
 
@@ -168,6 +381,21 @@ TError TNl::PermanentNeighbour(int ifindex, const TNlAddr &addr,
     rtnl_neigh_set_state(neigh, NUD_PERMANENT);
     rtnl_neigh_set_ifindex(neigh, ifindex);
 
+    if (batch) {
+        struct nl_msg *msg;
+
+        Dump(add ? "batch add" : "batch del", neigh);
+        if (add)
+            ret = rtnl_neigh_build_add_request(neigh, NLM_F_CREATE | NLM_F_REPLACE, &msg);
+        else
+            ret = rtnl_neigh_build_delete_request(neigh, 0, &msg);
+        rtnl_neigh_put(neigh);
+        if (ret)
+            return Error(ret, "Cannot build neighbour request");
+        batch->Add(msg, "Cannot modify neighbour entry", add ? 0 : ENOENT);
+        return OK;
+    }
+
     if (add) {
         Dump("add", neigh);
         ret = rtnl_neigh_add(Sock, neigh, NLM_F_CREATE | NLM_F_REPLACE);
@@ -234,6 +462,102 @@ int TNl::GetFd() {
 }
 
 
+TNlBatch::~TNlBatch() {
+    for (auto &item: Items)
+        nlmsg_free(item.Msg);
+}
+
+void TNlBatch::Add(struct nl_msg *msg, const std::string &desc, int ignore) {
+    Items.push_back({msg, desc, ignore, 0});
+}
+
+/* Sequence numbers out of libnl range to keep its own tracking intact */
+static std::atomic<uint32_t> BatchSeq(1u << 31);
+
+TError TNlBatch::Send(size_t first, size_t last) {
+    int fd = nl_socket_get_fd(Nl->GetSock());
+    uint32_t port = nl_socket_get_local_port(Nl->GetSock());
+    uint32_t seq = BatchSeq.fetch_add(last - first);
+    std::vector<char> buf;
+    size_t pending = last - first;
+
+    for (size_t i = first; i < last; i++) {
+        auto hdr = nlmsg_hdr(Items[i].Msg);
+        hdr->nlmsg_pid = port;
+        hdr->nlmsg_seq = seq + (i - first);
+        hdr->nlmsg_flags |= NLM_F_REQUEST | NLM_F_ACK;
+        buf.insert(buf.end(), (char *)hdr, (char *)hdr + NLMSG_ALIGN(hdr->nlmsg_len));
+    }
+
+    while (send(fd, buf.data(), buf.size(), 0) < 0) {
+        if (errno != EINTR)
+            return TError::System("netlink batch send");
+    }
+
+    std::vector<char> rbuf(std::max(getpagesize(), 8192));
+
+    while (pending) {
+        ssize_t len = recv(fd, rbuf.data(), rbuf.size(), 0);
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+            return TError::System("netlink batch recv");
+        }
+
+        int left = len;
+        for (auto hdr = (struct nlmsghdr *)rbuf.data(); NLMSG_OK(hdr, left);
+                hdr = NLMSG_NEXT(hdr, left)) {
+            if (hdr->nlmsg_type != NLMSG_ERROR || hdr->nlmsg_seq - seq >= last - first)
+                continue;
+            auto err = (struct nlmsgerr *)NLMSG_DATA(hdr);
+            auto &item = Items[first + hdr->nlmsg_seq - seq];
+            item.Errno = -err->error;
+            if (item.Errno == item.Ignore)
+                item.Errno = 0;
+            pending--;
+        }
+    }
+
+    return OK;
+}
+
+TError TNlBatch::Commit() {
+    /* Keep each send well below default socket buffer */
+    const size_t chunk_size = 65536;
+    TError error;
+
+    for (size_t first = 0, last; first < Items.size(); first = last) {
+        size_t size = 0;
+
+        for (last = first; last < Items.size(); last++) {
+            size += NLMSG_ALIGN(nlmsg_hdr(Items[last].Msg)->nlmsg_len);
+            if (size > chunk_size && last > first)
+                break;
+        }
+
+        error = Send(first, last);
+        if (error)
+            break;
+    }
+
+    if (!error) {
+        for (auto &item: Items) {
+            if (item.Errno) {
+                error = TError(EError::Unknown, item.Errno, item.Desc);
+                break;
+            }
+        }
+    }
+
+    L_NL("batch of {} requests: {}", Items.size(), error ? error.ToString() : "ok");
+
+    for (auto &item: Items)
+        nlmsg_free(item.Msg);
+    Items.clear();
+
+    return error;
+}
+
 TNlLink::TNlLink(std::shared_ptr<TNl> sock, const std::string &name, int index) {
     Nl = sock;
     Link = rtnl_link_alloc();
@@ -346,7 +670,7 @@ TError TNlLink::ChangeNs(const std::string &newName, int nsFd) {
     return OK;
 }
 
-TError TNlLink::AddDirectRoute(const TNlAddr &addr, bool ecn) {
+TError TNlLink::AddDirectRoute(const TNlAddr &addr, bool ecn, TNlBatch *batch) {
     struct rtnl_route *route;
     struct rtnl_nexthop *nh;
     int ret;
@@ -376,6 +700,18 @@ TError TNlLink::AddDirectRoute(const TNlAddr &addr, bool ecn) {
             return Error(ret, "Cannot enable ECN");
     }
 
+    if (batch) {
+        struct nl_msg *msg;
+
+        Dump("batch add", route);
+        ret = rtnl_route_build_add_request(route, NLM_F_CREATE | NLM_F_REPLACE, &msg);
+        rtnl_route_put(route);
+        if (ret < 0)
+            return Error(ret, "Cannot build direct route request");
+        batch->Add(msg, GetDesc() + " Cannot add direct route");
+        return OK;
+    }
+
     Dump("add", route);
     ret = rtnl_route_add(GetSock(), route, NLM_F_CREATE | NLM_F_REPLACE);
     rtnl_route_put(route);
@@ -385,7 +721,7 @@ TError TNlLink::AddDirectRoute(const TNlAddr &addr, bool ecn) {
     return OK;
 }
 
-TError TNlLink::SetDefaultGw(const TNlAddr &addr, bool ecn, int mtu) {
+TError TNlLink::SetDefaultGw(const TNlAddr &addr, bool ecn, int mtu, TNlBatch *batch) {
     struct rtnl_route *route;
     struct rtnl_nexthop *nh;
     TError error;
@@ -428,6 +764,18 @@ TError TNlLink::SetDefaultGw(const TNlAddr &addr, bool ecn, int mtu) {
             return Error(ret, "Cannot set default gateway mtu");
     }
 
+    if (batch) {
+        struct nl_msg *msg;
+
+        Dump("batch add", route);
+        ret = rtnl_route_build_add_request(route, NLM_F_MATCH, &msg);
+        rtnl_route_put(route);
+        if (ret < 0)
+            return Error(ret, "Cannot build default gateway request");
+        batch->Add(msg, GetDesc() + " Cannot set default gateway");
+        return OK;
+    }
+
     Dump("add", route);
     ret = rtnl_route_add(GetSock(), route, NLM_F_MATCH);
     rtnl_route_put(route);
@@ -437,7 +785,7 @@ TError TNlLink::SetDefaultGw(const TNlAddr &addr, bool ecn, int mtu) {
     return OK;
 }
 
-TError TNlLink::AddAddress(const TNlAddr &addr) {
+TError TNlLink::AddAddress(const TNlAddr &addr, TNlBatch *batch) {
     struct rtnl_addr *a = rtnl_addr_alloc();
     if (!a)
         return TError("Cannot allocate address");
@@ -452,6 +800,18 @@ TError TNlLink::AddAddress(const TNlAddr &addr) {
         return Error(ret, "Cannot set local address");
     }
 
+    if (batch) {
+        struct nl_msg *msg;
+
+        Dump("batch add", a);
+        ret = rtnl_addr_build_add_request(a, 0, &msg);
+        rtnl_addr_put(a);
+        if (ret < 0)
+            return Error(ret, "Cannot build address request");
+        batch->Add(msg, GetDesc() + " Cannot add address");
+        return OK;
+    }
+
     ret = rtnl_addr_add(GetSock(), a, 0);
     if (ret < 0) {
         rtnl_addr_put(a);
@@ -881,6 +1241,122 @@ bool TNlClass::Exists(const TNl &nl) {
     return !Load(nl);
 }
 
+/* Kernel rounds rates while converting into internal units */
+static bool RateMatches(uint64_t kernel, uint64_t rate) {
+    return kernel == rate || (kernel > rate ? kernel - rate : rate - kernel) <= rate / 100;
+}
+
+/* Buffers are kept in scheduler ticks, that is below microsecond at given rate */
+static bool BufferMatches(uint64_t kernel, uint64_t buffer, uint64_t rate) {
+    return (kernel > buffer ? kernel - buffer : buffer - kernel) <= buffer / 100 + rate / 1000000 + 1;
+}
+
+/* Service curve delay is kept in internal units, microseconds are rounded */
+static bool CurveMatches(const struct tc_service_curve &sc, uint64_t m1, uint64_t m2, uint64_t d) {
+    return RateMatches(sc.m1, m1) && RateMatches(sc.m2, m2) &&
+           (sc.d > d ? sc.d - d : d - sc.d) <= d / 100 + 1;
+}
+
+/* Compare with class in dumped class cache, every parameter set by Create */
+bool TNlClass::Matches(struct nl_cache *cache) const {
+    struct rtnl_class *tclass;
+    bool match = false;
+
+    tclass = rtnl_class_get(cache, Index, Handle);
+    if (!tclass)
+        return false;
+
+    if (Kind != rtnl_tc_get_kind(TC_CAST(tclass)) ||
+            rtnl_tc_get_parent(TC_CAST(tclass)) != Parent)
+        goto out;
+
+    if (Kind == "htb") {
+        uint64_t maxRate = INT32_MAX;
+        uint64_t rate = std::min(Rate ?: 1, maxRate);
+        uint64_t ceil = std::min(Ceil ?: maxRate, maxRate);
+
+        match = RateMatches(rtnl_htb_get_rate(tclass), rate) &&
+                RateMatches(rtnl_htb_get_ceil(tclass), ceil) &&
+                rtnl_htb_get_prio(tclass) == 3 &&
+                (!Quantum || rtnl_htb_get_quantum(tclass) == Quantum);
+
+        /* Without burst libnl sets buffer for one tick at rate plus MTU */
+        if (match && (RateBurst || MTU))
+            match = BufferMatches(rtnl_htb_get_rbuffer(tclass),
+                                  RateBurst ?: rate / nl_get_psched_hz() + MTU, rate);
+        if (match && (CeilBurst || MTU))
+            match = BufferMatches(rtnl_htb_get_cbuffer(tclass),
+                                  CeilBurst ?: ceil / nl_get_psched_hz() + MTU, ceil);
+    } else if (Kind == "hfsc") {
+        uint64_t maxRate = UINT32_MAX;
+        uint64_t rate = std::min(Rate, maxRate);
+        uint64_t fair = std::min(std::max(Rate, defRate), maxRate);
+        uint64_t ceil = std::min(Ceil, maxRate);
+        uint64_t m1;
+        struct tc_service_curve sc;
+
+        m1 = std::min(Rate * 2, maxRate);
+        match = Rate ? !rtnl_class_hfsc_get_rsc(tclass, &sc) &&
+                       CurveMatches(sc, m1, rate, m1 ? std::ceil(Quantum * 1000000. / m1) : 0) :
+                       !!rtnl_class_hfsc_get_rsc(tclass, &sc);
+
+        m1 = std::min(std::max(Rate, defRate) * 2, maxRate);
+        match = match && !rtnl_class_hfsc_get_fsc(tclass, &sc) &&
+                CurveMatches(sc, m1, fair, m1 ? std::ceil(RateBurst * 1000000. / m1) : 0);
+
+        m1 = std::min(Ceil * 2, maxRate);
+        match = match && (Ceil ? !rtnl_class_hfsc_get_usc(tclass, &sc) &&
+                                 CurveMatches(sc, m1, ceil, m1 ? std::ceil(CeilBurst * 1000000. / m1) : 0) :
+                                 !!rtnl_class_hfsc_get_usc(tclass, &sc));
+    }
+
+out:
+    rtnl_class_put(tclass);
+    return match;
+}
+
+/* Compare with qdisc in dumped qdisc cache, every parameter set by Create */
+bool TNlQdisc::Matches(struct nl_cache *cache) const {
+    struct rtnl_qdisc *qdisc;
+    bool match;
+
+    qdisc = rtnl_qdisc_get_by_parent(cache, Index, Parent);
+    if (!qdisc)
+        return Kind == "";
+
+    match = Kind == rtnl_tc_get_kind(TC_CAST(qdisc)) &&
+            rtnl_tc_get_handle(TC_CAST(qdisc)) == Handle;
+
+    if (!match)
+        goto out;
+
+    if (Kind == "bfifo" || Kind == "pfifo") {
+        match = !Limit || rtnl_qdisc_fifo_get_limit(qdisc) == (int)Limit;
+    } else if (Kind == "htb") {
+        match = (!Default || rtnl_htb_get_defcls(qdisc) == Default) &&
+                (!Quantum || rtnl_htb_get_rate2quantum(qdisc) == Quantum);
+    } else if (Kind == "hfsc") {
+        match = !Default || rtnl_qdisc_hfsc_get_defcls(qdisc) == Default;
+    } else if (Kind == "sfq") {
+        match = (!Limit || rtnl_sfq_get_limit(qdisc) == (int)Limit) &&
+                (!Quantum || rtnl_sfq_get_quantum(qdisc) == (int)Quantum);
+    } else if (Kind == "fq_codel") {
+        auto &net = config().network();
+        match = (!Limit || rtnl_qdisc_fq_codel_get_limit(qdisc) == (int)Limit) &&
+                (!Quantum || rtnl_qdisc_fq_codel_get_quantum(qdisc) == Quantum) &&
+                (!net.has_codel_target() ||
+                 rtnl_qdisc_fq_codel_get_target(qdisc) == net.codel_target()) &&
+                (!net.has_codel_interval() ||
+                 rtnl_qdisc_fq_codel_get_interval(qdisc) == net.codel_interval()) &&
+                (!net.has_codel_ecn() ||
+                 rtnl_qdisc_fq_codel_get_ecn(qdisc) == (int)net.codel_ecn());
+    }
+
+out:
+    rtnl_qdisc_put(qdisc);
+    return match;
+}
+
 TError TNlQdisc::Create(const TNl &nl) {
     TError error = OK;
     int ret;
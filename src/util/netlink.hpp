@@ -3,19 +3,25 @@
 #include <string>
 #include <functional>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 #include "common.hpp"
 extern "C" {
 #include <arpa/inet.h>
 #include <linux/netlink.h>
 #include <linux/pkt_cls.h>
+#include <linux/if_link.h>
 }
 
 struct nl_sock;
+struct nl_msg;
 struct rtnl_link;
 struct nl_cache;
 struct nl_addr;
 class TNlLink;
+class TNlBatch;
 
 class TNlAddr {
 public:
@@ -50,32 +56,87 @@ public:
 
 uint32_t TcHandle(uint16_t maj, uint16_t min);
 
+/* TCP sockets summary of network namespace collected via sock_diag */
+struct TNlTcpStat {
+    uint64_t Connections = 0;
+    uint64_t Established = 0;
+    uint64_t Retransmits = 0;   /* total for alive sockets */
+    std::vector<uint32_t> Rtt;  /* usec, established sockets */
+};
+
 class TNl : public std::enable_shared_from_this<TNl>,
             public TPortoNonCopyable {
     struct nl_sock *Sock = nullptr;
 
+    /* Subscribed to link and tc notifications, never read by libnl */
+    struct nl_sock *EventSock = nullptr;
+
+    /*
+     * NETLINK_SOCK_DIAG socket, opened together with EventSock. Dump runs
+     * without network lock, DiagMutex keeps socket alive until it ends.
+     */
+    std::mutex DiagMutex;
+    struct nl_sock *DiagSock = nullptr;
+
 public:
 
     TNl() {}
     ~TNl() { Disconnect(); }
 
-    TError Connect();
+    TError Connect(bool events = false);
     void Disconnect();
 
     struct nl_sock *GetSock() const { return Sock; }
 
     int GetFd();
 
+    /* Drains notifications, true if links or tc might have changed */
+    bool TopologyChanged();
+
+    /* Dumps only link counters via RTM_GETSTATS */
+    TError GetLinkStats(std::unordered_map<int, struct rtnl_link_stats64> &stats);
+
+    /* Dumps tcp_info of all IPv4 and IPv6 sockets except listening */
+    TError GetTcpStat(TNlTcpStat &stat);
+
     static TError Error(int nl_err, const std::string &desc);
     void Dump(const std::string &prefix, void *obj) const;
     void DumpCache(struct nl_cache *cache) const;
 
-    TError ProxyNeighbour(int ifindex, const TNlAddr &addr, bool add);
+    TError ProxyNeighbour(int ifindex, const TNlAddr &addr, bool add,
+                          TNlBatch *batch = nullptr);
     TError PermanentNeighbour(int ifindex, const TNlAddr &addr,
-                              const TNlAddr &lladdr, bool add);
+                              const TNlAddr &lladdr, bool add,
+                              TNlBatch *batch = nullptr);
     TError AddrLabel(const TNlAddr &prefix, uint32_t label);
 };
 
+/* Queues rtnetlink requests and sends them together, ACKs are collected at commit */
+class TNlBatch : public TPortoNonCopyable {
+    struct TItem {
+        struct nl_msg *Msg;
+        std::string Desc;
+        int Ignore;
+        int Errno;
+    };
+
+    std::shared_ptr<TNl> Nl;
+    std::vector<TItem> Items;
+
+    TError Send(size_t first, size_t last);
+
+public:
+    TNlBatch(std::shared_ptr<TNl> nl) : Nl(nl) {}
+    ~TNlBatch();
+
+    /* Takes ownership of message, errno "ignore" counts as success */
+    void Add(struct nl_msg *msg, const std::string &desc, int ignore = 0);
+    size_t Size() const { return Items.size(); }
+
+    /* Returns first failed request, all requests are sent anyway */
+    TError Commit();
+};
+
 class TNlLink : public TPortoNonCopyable {
     std::shared_ptr<TNl> Nl;
     struct rtnl_link *Link = nullptr;
@@ -123,9 +184,11 @@ public:
     static bool ValidMacVlanType(const std::string &type);
     static bool ValidMacAddr(const std::string &hw);
 
-    TError AddDirectRoute(const TNlAddr &addr, bool ecn = false);
-    TError SetDefaultGw(const TNlAddr &addr, bool ecn = false, int mtu = -1);
-    TError AddAddress(const TNlAddr &addr);
+    TError AddDirectRoute(const TNlAddr &addr, bool ecn = false,
+                          TNlBatch *batch = nullptr);
+    TError SetDefaultGw(const TNlAddr &addr, bool ecn = false, int mtu = -1,
+                        TNlBatch *batch = nullptr);
+    TError AddAddress(const TNlAddr &addr, TNlBatch *batch = nullptr);
     TError WaitAddress(int timeout_s);
     int GetMtu();
     TError SetMtu(int mtu);
@@ -150,6 +213,7 @@ public:
     TError Create(const TNl &nl);
     TError Delete(const TNl &nl);
     bool Check(const TNl &nl);
+    bool Matches(struct nl_cache *cache) const;
 };
 
 class TNlClass {
@@ -174,6 +238,7 @@ public:
     TError Delete(const TNl &nl);
     TError Load(const TNl &nl);
     bool Exists(const TNl &nl);
+    bool Matches(struct nl_cache *cache) const;
 };
 
 class TNlCgFilter : public TPortoNonCopyable {
@@ -1,5 +1,6 @@
 #include <sstream>
 #include <algorithm>
+#include <atomic>
 
 #include "path.hpp"
 #include "util/string.hpp"
@@ -28,6 +29,63 @@ extern "C" {
 #define FALLOC_FL_COLLAPSE_RANGE        0x08
 #endif
 
+#ifndef SYS_mount_setattr
+#define SYS_mount_setattr               442
+#endif
+
+#ifndef AT_RECURSIVE
+#define AT_RECURSIVE                    0x8000
+#endif
+
+/* struct mount_attr, linux/mount.h conflicts with sys/mount.h */
+struct TMountAttr {
+    uint64_t AttrSet;
+    uint64_t AttrClr;
+    uint64_t Propagation;
+    uint64_t UsernsFd;
+};
+
+static std::atomic<bool> HasMountSetattr(true);
+
+/* Change flags of whole mount tree in one syscall, Linux >= 5.12 */
+static bool MountSetattrRecursive(const std::string &path, uint64_t flags) {
+    static const struct {
+        uint64_t Set;
+        uint64_t Allow;
+        uint64_t Attr;  /* MOUNT_ATTR_* */
+    } attrs[] = {
+        { MS_RDONLY, MS_ALLOW_WRITE, 0x1 },
+        { MS_NOSUID, MS_ALLOW_SUID, 0x2 },
+        { MS_NODEV, MS_ALLOW_DEV, 0x4 },
+        { MS_NOEXEC, MS_ALLOW_EXEC, 0x8 },
+    };
+    uint64_t handled = MS_BIND | MS_SILENT;
+    TMountAttr attr = { 0, 0, 0, 0 };
+
+    if (!HasMountSetattr)
+        return false;
+
+    /* flags not set keep their values, as remount preserves them */
+    for (auto &a: attrs) {
+        handled |= a.Set | a.Allow;
+        if (flags & a.Set)
+            attr.AttrSet |= a.Attr;
+        else if (flags & a.Allow)
+            attr.AttrClr |= a.Attr;
+    }
+
+    if (flags & ~handled)
+        return false;
+
+    if (!syscall(SYS_mount_setattr, AT_FDCWD, path.c_str(), AT_RECURSIVE, &attr, sizeof(attr)))
+        return true;
+
+    if (errno == ENOSYS)
+        HasMountSetattr = false;
+
+    return false;
+}
+
 void TStatFS::Init(const struct statfs &st) {
     SpaceUsage = (uint64_t)(st.f_blocks - st.f_bfree) * st.f_bsize;
     SpaceAvail = (uint64_t)st.f_bavail * st.f_bsize;
@@ -161,23 +219,27 @@ bool TPath::PathExists() const {
     return lstat(Path.c_str(), &st) == 0;
 }
 
-std::string TPath::ToString() const {
-    return Path;
+TPath TPath::AddComponent(const TPath &component) const {
+    TPath result;
+
+    result.Path.reserve(Path.size() + component.Path.size() + 1);
+    result.Path = Path;
+    result.AppendComponent(component.Path);
+    return result;
 }
 
-TPath TPath::AddComponent(const TPath &component) const {
-    if (component.IsAbsolute()) {
+TPath &TPath::AppendComponent(const std::string &component) {
+    if (component[0] == '/') {
         if (IsRoot())
-            return TPath(component.Path);
-        if (component.IsRoot())
-            return TPath(Path);
-        return TPath(Path + component.Path);
+            Path = component;
+        else if (component.size() > 1)
+            Path += component;
+    } else if (!component.empty()) {
+        if (!IsRoot())
+            Path += '/';
+        Path += component;
     }
-    if (IsRoot())
-        return TPath("/" + component.Path);
-    if (component.IsEmpty())
-        return TPath(Path);
-    return TPath(Path + "/" + component.Path);
+    return *this;
 }
 
 std::vector<std::string> TPath::Components() const {
@@ -308,21 +370,28 @@ TError TPath::Mkfile(unsigned int mode) const {
 }
 
 TPath TPath::NormalPath() const {
-    std::stringstream ss(Path);
-    std::string component, path;
+    std::string path;
 
     if (IsEmpty())
         return TPath();
 
+    path.reserve(Path.size());
+
     if (IsAbsolute())
         path = "/";
 
-    while (std::getline(ss, component, '/')) {
+    for (size_t pos = 0, end; pos < Path.size(); pos = end + 1) {
+        end = Path.find('/', pos);
+        if (end == std::string::npos)
+            end = Path.size();
+
+        const char *component = Path.data() + pos;
+        size_t length = end - pos;
 
-        if (component == "" || component == ".")
+        if (!length || (length == 1 && component[0] == '.'))
             continue;
 
-        if (component == "..") {
+        if (length == 2 && component[0] == '.' && component[1] == '.') {
             auto last = path.rfind('/');
 
             if (last == std::string::npos) {
@@ -341,14 +410,14 @@ TPath TPath::NormalPath() const {
         }
 
         if (!path.empty() && path != "/")
-            path += "/";
-        path += component;
+            path += '/';
+        path.append(component, length);
     }
 
     if (path.empty())
         path = ".";
 
-    return TPath(path);
+    return TPath(std::move(path));
 }
 
 TPath TPath::AbsolutePath(const TPath &base) const {
@@ -814,6 +883,10 @@ TError TPath::Remount(uint64_t mnt_flags) const {
 
     /* vfsmount remount isn't recursive in kernel */
     if (recursive && (remount_flags & MS_BIND)) {
+        /* Otherwise, or in case of locked mounts, remount one by one */
+        if (MountSetattrRecursive(Path, remount_flags))
+            return OK;
+
         TPath normal = NormalPath();
         std::list<TMount> mounts;
         TError error = TPath::ListAllMounts(mounts);
@@ -966,6 +1039,24 @@ TError TPath::WritePrivate(const std::string &text) const {
     TError error;
     TFile file;
 
+    TPath temp = "/run/" + BaseName() + ".XXXXXX";
+    error = file.CreateTemporary(temp);
+    if (error)
+        return error;
+
+    error = temp.WriteAll(text);
+    if (!error)
+        error = file.Chmod(0644);
+    if (!error)
+        error = BindFile(file);
+    (void)temp.Unlink();
+    return error;
+}
+
+/* Bind-mount opened file over this path, creating it if needed */
+TError TPath::BindFile(const TFile &file, bool rdonly) const {
+    TError error;
+
     if (!Exists()) {
         error = DirName().MkdirAll(755);
         if (!error)
@@ -975,20 +1066,14 @@ TError TPath::WritePrivate(const std::string &text) const {
     } else if (!IsRegularStrict())
         return TError(EError::InvalidValue, "non-regular file " + Path);
 
-    TPath temp = "/run/" + BaseName() + ".XXXXXX";
-    error = file.CreateTemporary(temp);
+    error = UmountAll();
     if (error)
         return error;
 
-    error = temp.WriteAll(text);
-    if (!error)
-        error = file.Chmod(0644);
-    if (!error)
-        error = UmountAll();
-    if (!error)
-        error = Bind(file.ProcPath());
-    (void)temp.Unlink();
-    return error;
+    if (rdonly)
+        return BindRemount(file.ProcPath(), MS_RDONLY);
+
+    return Bind(file.ProcPath());
 }
 
 TError TPath::ReadLines(std::vector<std::string> &lines, size_t max) const {
@@ -1274,6 +1359,29 @@ TError TFile::Read(std::string &text) const {
     return OK;
 }
 
+/* Read from offset 0 without fstat, short read is treated as end of file */
+TError TFile::PreadAll(std::string &text, size_t max) const {
+    size_t size = 16 << 10, off = 0;
+    ssize_t ret;
+
+    text.resize(size);
+    while (1) {
+        ret = pread(Fd, &text[off], size - off, off);
+        if (ret < 0)
+            return TError::System("pread");
+        off += ret;
+        if (off < size)
+            break;
+        size *= 2;
+        if (size > max)
+            return TError("File too large: {}", size);
+        text.resize(size);
+    }
+    text.resize(off);
+
+    return OK;
+}
+
 TError TFile::ReadAll(std::string &text, size_t max) const {
     struct stat st;
     if (fstat(Fd, &st) < 0)
@@ -27,6 +27,7 @@ struct TStatFS {
 };
 
 struct TMount;
+class TFile;
 
 #ifndef MS_LAZYTIME
 # define MS_LAZYTIME    (1<<25)
@@ -47,9 +48,14 @@ private:
 
 public:
     TPath(const std::string &path) : Path(path) {}
+    TPath(std::string &&path) : Path(std::move(path)) {}
     TPath(const char *path) : Path(path) {}
     TPath() : Path("") {}
 
+    /* Append component in place, as operator/= without temporary paths */
+    TPath &AppendComponent(const std::string &component);
+    void Reserve(size_t size) { Path.reserve(size); }
+
     bool IsAbsolute() const { return Path[0] == '/'; }
 
     bool IsSimple() const { return Path.find('/') == std::string::npos; }
@@ -74,7 +80,7 @@ public:
     const char *c_str() const noexcept { return Path.c_str(); }
 
     TPath operator+(const TPath &p) const {
-        return TPath(Path + p.ToString());
+        return TPath(Path + p.Path);
     }
 
     friend bool operator==(const TPath& a, const TPath& b) {
@@ -102,8 +108,7 @@ public:
     }
 
     TPath& operator/=(const TPath &b) {
-        *this = AddComponent(b);
-        return *this;
+        return AppendComponent(b.Path);
     }
 
     TPath NormalPath() const;
@@ -136,7 +141,7 @@ public:
     static TError GetDevName(dev_t dev, std::string &name);
 
     int64_t SinceModificationMs() const;
-    std::string ToString() const;
+    const std::string &ToString() const { return Path; }
     bool Exists() const;
     bool PathExists() const; /* or dangling symlink */
 
@@ -195,11 +200,25 @@ public:
     TError WriteAll(const std::string &text) const;
     TError WriteAtomic(const std::string &text) const;
     TError WritePrivate(const std::string &text) const;
+    TError BindFile(const TFile &file, bool rdonly = false) const;
 };
 
 // FIXME replace with streaming someday
 constexpr const size_t MOUNT_INFO_LIMIT = 64 << 20;
 
+/* Orders paths by components: any subtree forms a contiguous range */
+struct TPathLess {
+    static unsigned Rank(char c) {
+        return c == '/' ? 1 : c ? (unsigned char)c + 1u : 0;
+    }
+
+    bool operator()(const TPath &a, const TPath &b) const {
+        const char *x = a.c_str(), *y = b.c_str();
+        for (; *x && *x == *y; x++, y++);
+        return Rank(*x) < Rank(*y);
+    }
+};
+
 struct TMount {
     TPath Source;
     TPath Target;
@@ -262,6 +281,7 @@ public:
     TPath ProcPath(void) const;
     TError Read(std::string &text) const;
     TError ReadAll(std::string &text, size_t max) const;
+    TError PreadAll(std::string &text, size_t max) const;
     TError ReadEnds(std::string &text, size_t max) const;
     TError Truncate(off_t size) const;
     TError WriteAll(const std::string &text) const;
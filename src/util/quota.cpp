@@ -1,7 +1,9 @@
 #include "quota.hpp"
 #include "log.hpp"
+#include "unix.hpp"
 #include "config.hpp"
 #include <mutex>
+#include <unordered_map>
 
 extern "C" {
 #include <linux/quota.h>
@@ -272,6 +274,60 @@ TError TProjectQuota::FindProject() {
     return OK;
 }
 
+struct TQuotaDevice {
+    TPath Device;
+    TPath RootPath;
+    std::string Type;
+};
+
+struct TQuotaUsage {
+    uint64_t SpaceLimit;
+    uint64_t SpaceUsage;
+    uint64_t InodeLimit;
+    uint64_t InodeUsage;
+};
+
+struct TQuotaSample {
+    uint64_t Time = 0;
+    std::unordered_map<uint32_t, TQuotaUsage> Projects;
+};
+
+/* Mountinfo lookups and usage samples shared by all volumes */
+static std::mutex QuotaCacheMutex;
+static std::map<dev_t, TQuotaDevice> QuotaDevices;
+static std::map<std::string, TQuotaSample> QuotaSamples;
+
+static void ForgetQuota(const TPath &device, uint32_t id) {
+    auto lock = std::unique_lock<std::mutex>(QuotaCacheMutex);
+    auto it = QuotaSamples.find(device.ToString());
+    if (it != QuotaSamples.end())
+        it->second.Projects.erase(id);
+}
+
+/* Enumerate all projects at device at once */
+static TError SampleQuotas(const TPath &device, TQuotaSample &sample) {
+    struct if_nextdqblk quota;
+    uint32_t id = 0;
+
+    sample.Projects.clear();
+
+    while (!quotactl(QCMD(Q_GETNEXTQUOTA, PRJQUOTA), device.c_str(),
+                     id, (caddr_t)&quota)) {
+        sample.Projects[quota.dqb_id] = {
+            quota.dqb_bhardlimit * QIF_DQBLKSIZE, quota.dqb_curspace,
+            quota.dqb_ihardlimit, quota.dqb_curinodes };
+        if (quota.dqb_id == UINT32_MAX)
+            break;
+        id = quota.dqb_id + 1;
+    }
+
+    if (errno != ENOENT && errno != ESRCH)
+        return TError::System("Cannot enumerate project quotas");
+
+    sample.Time = GetCurrentTimeMs();
+    return OK;
+}
+
 TError TProjectQuota::FindDevice() {
     TMount mount;
     TError error;
@@ -284,6 +340,16 @@ TError TProjectQuota::FindDevice() {
     if (!device)
         return TError("device not found: " + Path.ToString());
 
+    auto lock = std::unique_lock<std::mutex>(QuotaCacheMutex);
+    auto it = QuotaDevices.find(device);
+    if (it != QuotaDevices.end()) {
+        Type = it->second.Type;
+        Device = it->second.Device;
+        RootPath = it->second.RootPath;
+        return OK;
+    }
+    lock.unlock();
+
     std::vector<std::string> lines;
     error = TPath("/proc/self/mountinfo").ReadLines(lines, MOUNT_INFO_LIMIT);
     if (error)
@@ -301,6 +367,8 @@ TError TProjectQuota::FindDevice() {
             Type = mount.Type;
             Device = mount.Source;
             RootPath = mount.Target;
+            lock.lock();
+            QuotaDevices[device] = { Device, RootPath, Type };
             return OK;
         }
     }
@@ -327,8 +395,13 @@ TError TProjectQuota::Load() {
         return error;
 
     if (quotactl(QCMD(Q_GETQUOTA, PRJQUOTA), Device.c_str(),
-                 ProjectId, (caddr_t)&quota))
-        return TError::System("Cannot get quota state");
+                 ProjectId, (caddr_t)&quota)) {
+        error = TError::System("Cannot get quota state");
+        /* Device might be remounted */
+        auto lock = std::unique_lock<std::mutex>(QuotaCacheMutex);
+        QuotaDevices.erase(Path.GetDev());
+        return error;
+    }
 
     SpaceLimit = quota.dqb_bhardlimit * QIF_DQBLKSIZE;
     SpaceUsage = quota.dqb_curspace;
@@ -338,6 +411,49 @@ TError TProjectQuota::Load() {
     return OK;
 }
 
+TError TProjectQuota::LoadCached() {
+    uint64_t period = config().volumes().quota_sample_ms();
+    TError error;
+
+    if (!period)
+        return Load();
+
+    error = FindProject();
+    if (error)
+        return error;
+
+    error = FindDevice();
+    if (error)
+        return error;
+
+    auto lock = std::unique_lock<std::mutex>(QuotaCacheMutex);
+    auto &sample = QuotaSamples[Device.ToString()];
+
+    if (GetCurrentTimeMs() - sample.Time >= period) {
+        error = SampleQuotas(Device, sample);
+        if (error) {
+            L_VERBOSE("Cannot sample quotas at {}: {}", Device, error);
+            QuotaSamples.erase(Device.ToString());
+            lock.unlock();
+            return Load();
+        }
+    }
+
+    auto it = sample.Projects.find(ProjectId);
+    if (it == sample.Projects.end()) {
+        /* Created after last sample */
+        lock.unlock();
+        return Load();
+    }
+
+    SpaceLimit = it->second.SpaceLimit;
+    SpaceUsage = it->second.SpaceUsage;
+    InodeLimit = it->second.InodeLimit;
+    InodeUsage = it->second.InodeUsage;
+
+    return OK;
+}
+
 TError TProjectQuota::Create() {
     struct if_dqblk quota;
     TError error;
@@ -391,6 +507,7 @@ TError TProjectQuota::Create() {
         return TError::System("Cannot set project quota {} limits", ProjectId);
 
     quotactl(QCMD(Q_SYNC, PRJQUOTA), Device.c_str(), 0, NULL);
+    ForgetQuota(Device, ProjectId);
 
     /* Move files into project */
     if (CurrentId != ProjectId) {
@@ -428,6 +545,7 @@ TError TProjectQuota::Resize() {
         return TError::System("Cannot set project quota {} limits", ProjectId);
 
     quotactl(QCMD(Q_SYNC, PRJQUOTA), Device.c_str(), 0, NULL);
+    ForgetQuota(Device, ProjectId);
     return OK;
 }
 
@@ -458,6 +576,7 @@ TError TProjectQuota::Destroy() {
                 ProjectId, TError::System(""));
 
     quotactl(QCMD(Q_SYNC, PRJQUOTA), Device.c_str(), 0, NULL);
+    ForgetQuota(Device, ProjectId);
 
     return error;
 }
@@ -469,7 +588,7 @@ TError TProjectQuota::StatFS(TStatFS &result) {
     if (error)
         return error;
 
-    error = Load();
+    error = LoadCached();
     if (error)
         return error;
 
@@ -34,6 +34,7 @@ public:
     bool Exists();
 
     TError Load();
+    TError LoadCached();
     TError Create();
     TError Resize();
     TError Destroy();
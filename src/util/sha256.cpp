@@ -0,0 +1,168 @@
+/*
+ * SHA-256 Secure Hash Algorithm (FIPS 180-4).
+ *
+ * Straightforward portable implementation, written for porto and placed
+ * in the public domain. It is meant to be correct and small rather than
+ * as fast as possible.
+ */
+
+#include <vector>
+
+#include "sha256.hpp"
+
+extern "C" {
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+}
+
+typedef struct {
+    uint32_t state[8];
+    uint64_t length;
+    unsigned char block[64];
+    size_t used;
+} SHA256_CTX;
+
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void SHA256_Transform(SHA256_CTX *ctx, const unsigned char *data)
+{
+    uint32_t w[64], a, b, c, d, e, f, g, h;
+    int i;
+
+    for (i = 0; i < 16; i++)
+        w[i] = (uint32_t)data[i * 4] << 24 | (uint32_t)data[i * 4 + 1] << 16 |
+               (uint32_t)data[i * 4 + 2] << 8 | (uint32_t)data[i * 4 + 3];
+
+    for (i = 16; i < 64; i++) {
+        uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    a = ctx->state[0];
+    b = ctx->state[1];
+    c = ctx->state[2];
+    d = ctx->state[3];
+    e = ctx->state[4];
+    f = ctx->state[5];
+    g = ctx->state[6];
+    h = ctx->state[7];
+
+    for (i = 0; i < 64; i++) {
+        uint32_t t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) +
+                      ((e & f) ^ (~e & g)) + K[i] + w[i];
+        uint32_t t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) +
+                      ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    ctx->state[0] += a;
+    ctx->state[1] += b;
+    ctx->state[2] += c;
+    ctx->state[3] += d;
+    ctx->state[4] += e;
+    ctx->state[5] += f;
+    ctx->state[6] += g;
+    ctx->state[7] += h;
+}
+
+static void SHA256_Init(SHA256_CTX *ctx)
+{
+    static const uint32_t init[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+
+    memcpy(ctx->state, init, sizeof(init));
+    ctx->length = 0;
+    ctx->used = 0;
+}
+
+static void SHA256_Update(SHA256_CTX *ctx, const unsigned char *data, size_t size)
+{
+    ctx->length += size;
+
+    if (ctx->used) {
+        size_t part = 64 - ctx->used;
+        if (part > size)
+            part = size;
+        memcpy(ctx->block + ctx->used, data, part);
+        ctx->used += part;
+        data += part;
+        size -= part;
+        if (ctx->used < 64)
+            return;
+        SHA256_Transform(ctx, ctx->block);
+        ctx->used = 0;
+    }
+
+    for (; size >= 64; data += 64, size -= 64)
+        SHA256_Transform(ctx, data);
+
+    memcpy(ctx->block, data, size);
+    ctx->used = size;
+}
+
+static void SHA256_Final(unsigned char *result, SHA256_CTX *ctx)
+{
+    uint64_t bits = ctx->length * 8;
+    int i;
+
+    ctx->block[ctx->used++] = 0x80;
+    if (ctx->used > 56) {
+        memset(ctx->block + ctx->used, 0, 64 - ctx->used);
+        SHA256_Transform(ctx, ctx->block);
+        ctx->used = 0;
+    }
+    memset(ctx->block + ctx->used, 0, 56 - ctx->used);
+    for (i = 0; i < 8; i++)
+        ctx->block[56 + i] = bits >> (56 - i * 8);
+    SHA256_Transform(ctx, ctx->block);
+
+    for (i = 0; i < 32; i++)
+        result[i] = ctx->state[i / 4] >> (24 - (i % 4) * 8);
+
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+TError Sha256Sum(TFile &file, std::string &sum) {
+    SHA256_CTX ctx;
+    unsigned char bin[32];
+    std::vector<char> buf(1 << 20);
+    ssize_t len;
+
+    SHA256_Init(&ctx);
+    while ((len = read(file.Fd, buf.data(), buf.size())) != 0) {
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+            return TError::System("read");
+        }
+        SHA256_Update(&ctx, (const unsigned char *)buf.data(), len);
+    }
+    SHA256_Final(bin, &ctx);
+    sum = "";
+    for (int i = 0; i < 32; ++i)
+        sum += fmt::format("{:02x}", bin[i]);
+    return OK;
+}
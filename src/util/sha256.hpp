@@ -0,0 +1,5 @@
+#pragma once
+
+#include "util/path.hpp"
+
+TError Sha256Sum(TFile &file, std::string &sum);
@@ -10,6 +10,7 @@ extern "C" {
 }
 
 void Crash() {
+    FlushLog();
     L_ERR("Crashed");
     Stacktrace();
 
@@ -23,6 +24,7 @@ void FatalSignal(int sig) {
     /* don't hang */
     alarm(5);
 
+    FlushLog();
     L_ERR("Fatal signal: {}", std::string(strsignal(sig)));
     Stacktrace();
 
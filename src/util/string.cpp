@@ -215,21 +215,28 @@ ok:
     return OK;
 }
 
+/* Same as std::getline loop: no token after trailing separator, rest of line after max */
 TTuple SplitString(const std::string &str, const char sep, int max) {
     std::vector<std::string> tokens;
-    std::istringstream ss(str);
-    std::string tok;
-
-    while(std::getline(ss, tok, sep)) {
-        if (max && !--max) {
-            std::string rem;
-            std::getline(ss, rem);
-            if (rem.length()) {
-                tok += sep;
-                tok += rem;
+    size_t pos = 0, end;
+
+    while (pos < str.size()) {
+        end = str.find(sep, pos);
+        if (end == std::string::npos)
+            end = str.size();
+        tokens.emplace_back(str, pos, end - pos);
+        pos = end + 1;
+
+        if (max && !--max && pos < str.size()) {
+            end = str.find('\n', pos);
+            if (end == std::string::npos)
+                end = str.size();
+            if (end > pos) {
+                tokens.back() += sep;
+                tokens.back().append(str, pos, end - pos);
             }
+            pos = end + 1;
         }
-        tokens.push_back(tok);
     }
 
     return tokens;
@@ -375,6 +382,26 @@ bool StringMatch(const std::string &str, const std::string &pattern) {
     return fnmatch(pattern.c_str(), str.c_str(), FNM_PATHNAME) == 0;
 }
 
+TStringMask::TStringMask(const std::string &pattern) :
+    Pattern(pattern),
+    Prefix(pattern.substr(0, pattern.find_first_of("*?[\\"))),
+    Any(pattern == "***")
+{
+    if (Any)
+        Prefix = "";
+}
+
+bool TStringMask::Match(const std::string &str) const {
+    if (Any)
+        return true;
+    if (str.compare(0, Prefix.size(), Prefix))
+        return false;
+    if (Prefix.size() == Pattern.size())
+        return str.size() == Prefix.size();
+    return fnmatch(Pattern.c_str() + Prefix.size(),
+                   str.c_str() + Prefix.size(), FNM_PATHNAME) == 0;
+}
+
 std::string StringFormatFlags(uint64_t flags,
                               const TFlagsNames &names,
                               const std::string sep) {
@@ -35,6 +35,16 @@ bool StringStartsWith(const std::string &str, const std::string &prefix);
 bool StringEndsWith(const std::string &str, const std::string &suffix);
 bool StringMatch(const std::string &str, const std::string &pattern);
 
+/* Pattern for StringMatch parsed once, literal prefix allows range lookups */
+struct TStringMask {
+    std::string Pattern;
+    std::string Prefix;
+    bool Any;
+
+    TStringMask(const std::string &pattern);
+    bool Match(const std::string &str) const;
+};
+
 typedef std::vector<std::pair<uint64_t, std::string>> TFlagsNames;
 std::string StringFormatFlags(uint64_t flags,
                               const TFlagsNames &names,
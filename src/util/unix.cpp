@@ -1,6 +1,7 @@
 #include <string>
 #include <sstream>
 #include <algorithm>
+#include <cstdlib>
 #include <mutex>
 #include <iomanip>
 #include <chrono>
@@ -74,6 +75,25 @@ bool TTask::IsZombie() const {
     return state == 'Z';
 }
 
+/* Exit status of zombie, in format of wait() */
+TError TTask::GetExitStatus(int &status) const {
+    std::string text;
+    TError error = TPath("/proc/" + std::to_string(Pid) + "/stat").ReadAll(text);
+    if (error)
+        return error;
+
+    auto pos = text.rfind(')');
+    if (pos == std::string::npos)
+        return TError(EError::Unknown, "Cannot parse stat for {}", Pid);
+
+    /* Fields after comm, starting from state (3), exit_code is 52 */
+    auto fields = SplitString(text.substr(pos + 2), ' ');
+    if (fields.size() < 50 || fields[0] != "Z")
+        return TError(EError::InvalidState, "Task {} is not zombie", Pid);
+
+    return StringToInt(StringTrim(fields[49]), status);
+}
+
 pid_t TTask::GetPPid() const {
     std::string path = "/proc/" + std::to_string(Pid) + "/stat";
     int res, ppid;
@@ -170,6 +190,24 @@ uint64_t GetCurrentTimeMs() {
     return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
+uint64_t GetCurrentTimeUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint64_t GetThreadCpuTimeUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint64_t GetRealTimeMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
 bool WaitDeadline(uint64_t deadline, uint64_t wait) {
     uint64_t now = GetCurrentTimeMs();
     if (!deadline || int64_t(deadline - now) < 0)
@@ -188,6 +226,25 @@ uint64_t GetTotalMemory() {
     return (uint64_t)si.totalram * si.mem_unit;
 }
 
+/* MemAvailable from /proc/meminfo, free memory for older kernels */
+uint64_t GetAvailableMemory() {
+    std::vector<std::string> lines;
+    uint64_t kb;
+
+    if (!TPath("/proc/meminfo").ReadLines(lines)) {
+        for (auto &line: lines) {
+            if (StringStartsWith(line, "MemAvailable:") &&
+                    !StringToUint64(StringTrim(line.substr(13), " \tkB"), kb))
+                return kb << 10;
+        }
+    }
+
+    struct sysinfo si;
+    if (sysinfo(&si) < 0)
+        return 0;
+    return (uint64_t)si.freeram * si.mem_unit;
+}
+
 /* total size in bytes, including surplus */
 uint64_t GetHugetlbMemory() {
     int pages;
@@ -196,6 +253,19 @@ uint64_t GetHugetlbMemory() {
     return (uint64_t)pages << 21;
 }
 
+/* count of 2Mb pages in pool and not allocated yet */
+TError GetHugetlbPages(int &total, int &free) {
+    TError error = TPath("/sys/kernel/mm/hugepages/hugepages-2048kB/nr_hugepages").ReadInt(total);
+    if (!error)
+        error = TPath("/sys/kernel/mm/hugepages/hugepages-2048kB/free_hugepages").ReadInt(free);
+    return error;
+}
+
+/* kernel allocates as many pages as it could find */
+TError SetHugetlbPages(int total) {
+    return TPath("/sys/kernel/mm/hugepages/hugepages-2048kB/nr_hugepages").WriteAll(std::to_string(total));
+}
+
 static __thread std::string *processName;
 
 void SetProcessName(const std::string &name) {
@@ -552,6 +622,15 @@ TError TranslatePid(pid_t pid, pid_t pidns, pid_t &result) {
     TError error;
     TTask task;
 
+    /* Same pid namespace, no need to fork into it */
+    ino_t inode = TNamespaceFd::PidInode(pidns, "ns/pid");
+    if (inode && inode == TNamespaceFd::PidInode(GetPid(), "ns/pid")) {
+        if (kill(std::abs(pid), 0) && errno == ESRCH)
+            return TError(EError::InvalidValue, "Task {} not found", std::abs(pid));
+        result = std::abs(pid);
+        return OK;
+    }
+
     error = TUnixSocket::SocketPair(sock, sk);
     if (error)
         return error;
@@ -681,6 +760,20 @@ TError TTask::Wait() {
     return OK;
 }
 
+/* Wait for exit reported by Deliver, false at timeout */
+bool TTask::WaitDeliver(uint64_t timeoutMs) {
+    auto lock = std::unique_lock<std::mutex>(ForkLock);
+    return TasksCV.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+                            [this] { return !Running; });
+}
+
+/* Exit of detached task is handled as unknown child */
+void TTask::Detach() {
+    auto lock = std::unique_lock<std::mutex>(ForkLock);
+    if (Running)
+        Tasks.erase(Pid);
+}
+
 bool TTask::Deliver(pid_t pid, int status) {
     auto lock = std::unique_lock<std::mutex>(ForkLock);
     auto it = Tasks.find(pid);
@@ -22,10 +22,13 @@ struct TTask {
 
     TError Fork(bool detach = false);
     TError Wait();
+    bool WaitDeliver(uint64_t timeoutMs);
+    void Detach();
     static bool Deliver(pid_t pid, int status);
 
     bool Exists() const;
     bool IsZombie() const;
+    TError GetExitStatus(int &status) const;
     pid_t GetPPid() const;
     TError Kill(int signal) const;
     TError KillPg(int signal) const;
@@ -40,9 +43,15 @@ pid_t GetTid();
 TError GetTaskChildrens(pid_t pid, std::vector<pid_t> &childrens);
 
 uint64_t GetCurrentTimeMs();
+uint64_t GetCurrentTimeUs();
+uint64_t GetThreadCpuTimeUs();
+uint64_t GetRealTimeMs();
 bool WaitDeadline(uint64_t deadline, uint64_t sleep = 10);
 uint64_t GetTotalMemory();
+uint64_t GetAvailableMemory();
 uint64_t GetHugetlbMemory();
+TError GetHugetlbPages(int &total, int &free);
+TError SetHugetlbPages(int total);
 void SetProcessName(const std::string &name);
 void SetDieOnParentExit(int sig);
 std::string GetTaskName(pid_t pid = 0);
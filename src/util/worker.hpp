@@ -3,6 +3,7 @@
 #include <condition_variable>
 #include <thread>
 #include <queue>
+#include <atomic>
 
 #include "util/log.hpp"
 #include "util/unix.hpp"
@@ -83,3 +84,28 @@ public:
     virtual const T &Top() =0;
     virtual bool Handle(const T &elem) =0;
 };
+
+/* Call fn(index) for each index in [0, count) using up to nr threads */
+template<typename F>
+void ParallelFor(size_t count, size_t nr, F fn) {
+    if (nr > count)
+        nr = count;
+
+    if (nr <= 1) {
+        for (size_t index = 0; index < count; index++)
+            fn(index);
+        return;
+    }
+
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> threads;
+
+    for (size_t i = 0; i < nr; i++)
+        threads.emplace_back([&] {
+            for (size_t index = next++; index < count; index = next++)
+                fn(index);
+        });
+
+    for (auto &thread: threads)
+        thread.join();
+}
@@ -1,6 +1,10 @@
 #include <sstream>
 #include <algorithm>
 #include <condition_variable>
+#include <set>
+#include <unordered_set>
+#include <atomic>
+#include <functional>
 
 #include "volume.hpp"
 #include "storage.hpp"
@@ -9,10 +13,12 @@
 #include "util/string.hpp"
 #include "util/unix.hpp"
 #include "util/quota.hpp"
+#include "util/worker.hpp"
 #include "config.hpp"
 #include "kvalue.hpp"
 #include "helpers.hpp"
 #include "client.hpp"
+#include "trace.hpp"
 #include "filesystem.hpp"
 
 extern "C" {
@@ -20,6 +26,7 @@ extern "C" {
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/sysmacros.h>
 #include <sys/vfs.h>
 #include <sys/mount.h>
 #include <linux/falloc.h>
@@ -29,8 +36,19 @@ extern "C" {
 
 TPath VolumesKV;
 std::mutex VolumesMutex;
-std::map<TPath, std::shared_ptr<TVolume>> Volumes;
-std::map<TPath, std::shared_ptr<TVolumeLink>> VolumeLinks;
+TLockStat VolumesLockStat;
+std::map<TPath, std::shared_ptr<TVolume>, TPathLess> Volumes;
+std::map<TPath, std::shared_ptr<TVolumeLink>, TPathLess> VolumeLinks;
+
+/* Paths used by volumes besides their own, for CheckConflicts */
+enum class EVolumeClaim {
+    Place,
+    Storage,
+    BindStorage,
+    Layer,
+};
+
+static std::multimap<TPath, std::pair<TVolume *, EVolumeClaim>, TPathLess> VolumeClaims;
 static uint64_t NextId = 1;
 
 static std::condition_variable VolumesCv;
@@ -438,6 +456,87 @@ public:
     }
 };
 
+#ifndef LOOP_CONFIGURE
+#define LOOP_CONFIGURE 0x4C0A
+struct loop_config {
+    __u32 fd;
+    __u32 block_size;
+    struct loop_info64 info;
+    __u64 __reserved[8];
+};
+#endif
+
+/* Loop devices created in advance and not bound yet */
+static std::mutex LoopPoolMutex;
+static std::vector<int> LoopPool;
+static int LoopPoolNext = 0;
+static std::atomic<bool> LoopConfigure(true);
+
+static int TakeLoopDev() {
+    auto lock = std::unique_lock<std::mutex>(LoopPoolMutex);
+    if (LoopPool.empty())
+        return -1;
+    int nr = LoopPool.back();
+    LoopPool.pop_back();
+    return nr;
+}
+
+/* Keep volumes.loop_pool_size free devices, creating device is slow */
+static void RefillLoopPool(const TFile &ctl) {
+    size_t size = config().volumes().loop_pool_size();
+    auto lock = std::unique_lock<std::mutex>(LoopPoolMutex);
+
+    while (LoopPool.size() < size) {
+        int nr = LoopPoolNext++;
+        lock.unlock();
+        int ret = ioctl(ctl.Fd, LOOP_CTL_ADD, nr);
+        if (ret < 0 && errno != EEXIST) {
+            L_WRN("Cannot add loop device {}: {}", nr, TError::System("ioctl(LOOP_CTL_ADD)"));
+            break;
+        }
+        lock.lock();
+        if (ret >= 0)
+            LoopPool.push_back(ret);
+    }
+}
+
+/* LOOP_CONFIGURE binds file, sets status and direct io at once, EBUSY means device is taken */
+static TError ConfigureLoopDev(const TFile &ctl, const TFile &file, const TPath &path, int &loopNr) {
+    struct loop_config cfg;
+    int retry = 10;
+    TError error;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.fd = file.Fd;
+    strncpy((char *)cfg.info.lo_file_name, path.c_str(), LO_NAME_SIZE - 1);
+    if (config().volumes().direct_io_loop())
+        cfg.info.lo_flags |= LO_FLAGS_DIRECT_IO;
+
+    while (retry-- > 0) {
+        TFile dev;
+        int nr = TakeLoopDev();
+
+        if (nr < 0)
+            nr = ioctl(ctl.Fd, LOOP_CTL_GET_FREE);
+        if (nr < 0)
+            return TError::System("ioctl(LOOP_CTL_GET_FREE)");
+
+        error = dev.OpenReadWrite("/dev/loop" + std::to_string(nr));
+        if (error)
+            return error;
+
+        if (!ioctl(dev.Fd, LOOP_CONFIGURE, &cfg)) {
+            loopNr = nr;
+            return OK;
+        }
+
+        if (errno != EBUSY)
+            return TError::System("ioctl(LOOP_CONFIGURE)");
+    }
+
+    return TError::System("ioctl(LOOP_CONFIGURE)");
+}
+
 static TError SetupLoopDev(const TFile &file, const TPath &path, int &loopNr) {
     static std::mutex BigLoopLock;
     TFile ctl, dev;
@@ -449,6 +548,18 @@ static TError SetupLoopDev(const TFile &file, const TPath &path, int &loopNr) {
     if (error)
         return error;
 
+    if (LoopConfigure) {
+        error = ConfigureLoopDev(ctl, file, path, loopNr);
+        if (!error) {
+            RefillLoopPool(ctl);
+            return OK;
+        }
+        if (error.Errno != EINVAL && error.Errno != ENOTTY)
+            return error;
+        L("Fallback to LOOP_SET_FD: {}", error);
+        LoopConfigure = false;
+    }
+
     if (config().volumes().direct_io_loop() &&
             fcntl(file.Fd, F_SETFL, fcntl(file.Fd, F_GETFL) | O_DIRECT))
         L("Cannot enable O_DIRECT for loop {}", TError::System("fcntl"));
@@ -456,7 +567,9 @@ static TError SetupLoopDev(const TFile &file, const TPath &path, int &loopNr) {
     auto lock = std::unique_lock<std::mutex>(BigLoopLock);
 
 again:
-    nr = ioctl(ctl.Fd, LOOP_CTL_GET_FREE);
+    nr = TakeLoopDev();
+    if (nr < 0)
+        nr = ioctl(ctl.Fd, LOOP_CTL_GET_FREE);
     if (nr < 0)
         return TError::System("ioctl(LOOP_CTL_GET_FREE)");
 
@@ -483,6 +596,9 @@ again:
         return error;
     }
 
+    lock.unlock();
+    RefillLoopPool(ctl);
+
     loopNr = nr;
     return error;
 }
@@ -692,6 +808,118 @@ public:
     }
 };
 
+/* Shared read-only overlays of lower layer stacks */
+
+#ifndef OVERLAYFS_SUPER_MAGIC
+# define OVERLAYFS_SUPER_MAGIC 0x794c7630
+#endif
+
+static std::mutex LayerStacksMutex;
+static std::map<std::string, int> LayerStacks;
+
+static TError AcquireLayerStack(const TPath &place,
+                                const std::vector<std::string> &layers,
+                                std::string &stack) {
+    std::string lower, key = place.ToString();
+    struct statfs st;
+    TError error;
+
+    /* Overlay on top of overlay over layers would exceed stacking depth */
+    if (statfs((place / PORTO_LAYERS).c_str(), &st))
+        return TError::System("statfs {}", place / PORTO_LAYERS);
+    if (st.f_type == OVERLAYFS_SUPER_MAGIC)
+        return TError(EError::NotSupported, "Layers are on overlayfs");
+
+    for (auto &name: layers) {
+        TStorage layer;
+        layer.Open(EStorageType::Layer, place, name);
+        std::string path = place.InnerPath(layer.Path, false).ToString();
+        if (path.find_first_of(":,\\") != std::string::npos)
+            return TError(EError::NotSupported, "Layer name {} cannot be stacked", name);
+        if (lower.size())
+            lower += ":";
+        lower += path;
+        key += "\n" + name;
+    }
+
+    stack = fmt::format("{:016x}", std::hash<std::string>()(key));
+
+    auto lock = std::unique_lock<std::mutex>(LayerStacksMutex);
+
+    if (LayerStacks[stack]++)
+        return OK;
+
+    TPath path = TPath(PORTO_LAYER_STACKS) / stack;
+
+    L_ACT("Mount layer stack {} of {} layers", path, layers.size());
+
+    error = path.MkdirAll(0700);
+    if (!error)
+        error = place.Chdir();
+    if (!error) {
+        error = path.Mount("overlay", "overlay",
+                           MS_RDONLY | MS_NODEV | MS_NOSUID,
+                           { "lowerdir=" + lower });
+        (void)TPath("/").Chdir();
+    }
+    if (error) {
+        (void)path.Rmdir();
+        LayerStacks.erase(stack);
+        stack.clear();
+    }
+
+    return error;
+}
+
+static void ReleaseLayerStack(std::string &stack) {
+    if (stack.empty())
+        return;
+
+    auto lock = std::unique_lock<std::mutex>(LayerStacksMutex);
+
+    /* Mounted volumes hold lower layers by themselves */
+    if (!--LayerStacks[stack]) {
+        TPath path = TPath(PORTO_LAYER_STACKS) / stack;
+        TError error = path.UmountAll();
+        if (!error)
+            error = path.Rmdir();
+        if (error)
+            L_WRN("Cannot remove layer stack {}: {}", path, error);
+        LayerStacks.erase(stack);
+    }
+
+    stack.clear();
+}
+
+/* Restored volume keeps using its stack */
+static void RestoreLayerStack(const std::string &stack) {
+    auto lock = std::unique_lock<std::mutex>(LayerStacksMutex);
+    LayerStacks[stack]++;
+}
+
+/* Detach stacks not used by restored volumes */
+static void CleanupLayerStacks() {
+    TPath base(PORTO_LAYER_STACKS);
+    std::vector<std::string> list;
+
+    if (base.ReadDirectory(list))
+        return;
+
+    auto lock = std::unique_lock<std::mutex>(LayerStacksMutex);
+
+    for (auto &name: list) {
+        if (LayerStacks.count(name))
+            continue;
+        TPath path = base / name;
+        L_ACT("Remove unused layer stack {}", path);
+        (void)path.UmountAll();
+        (void)path.Rmdir();
+    }
+
+    if (LayerStacks.empty())
+        (void)base.Rmdir();
+}
+
 /* TVolumeOverlayBackend - project quota + overlayfs */
 
 class TVolumeOverlayBackend : public TVolumeBackend {
@@ -744,29 +972,57 @@ public:
                   return error;
         }
 
-        for (auto &name: Volume->Layers) {
-            TPath path, temp;
-            TFile pin;
+        auto &layers = Volume->Layers;
+        std::vector<TFile> pins(layers.size());
+        std::vector<TError> errors(layers.size());
+        bool stackable = config().volumes().overlay_stack_layers() >= 2 &&
+                         layers.size() >= config().volumes().overlay_stack_layers();
 
-            if (name[0] == '/') {
-                error = pin.OpenDir(name);
-                if (error)
-                    goto err;
-                error = CL->WriteAccess(pin);
-                if (error) {
-                    error = TError(error, "Layer {}", name);
-                    goto err;
-                }
-                path = pin.ProcPath();
+        /* Pin and touch layers in parallel, this hits disk for each */
+        ParallelFor(layers.size(), config().volumes().layer_threads(), [&](size_t index) {
+            if (layers[index][0] == '/') {
+                errors[index] = pins[index].OpenDir(layers[index]);
             } else {
                 TStorage layer;
-                layer.Open(EStorageType::Layer, Volume->Place, name);
+                layer.Open(EStorageType::Layer, Volume->Place, layers[index]);
                 /* Imported layers are available for everybody */
                 (void)layer.Touch();
+            }
+        });
+
+        for (size_t index = 0; index < layers.size(); index++) {
+            if (layers[index][0] != '/')
+                continue;
+            stackable = false;
+            error = errors[index];
+            if (!error)
+                error = CL->WriteAccess(pins[index]);
+            if (error) {
+                error = TError(error, "Layer {}", layers[index]);
+                goto err;
+            }
+        }
+
+        if (stackable) {
+            error = AcquireLayerStack(Volume->Place, layers, Volume->LayerStack);
+            if (error)
+                L_WRN("Cannot use layer stack for volume {}: {}", Volume->Path, error);
+            else
+                lower = (TPath(PORTO_LAYER_STACKS) / Volume->LayerStack).ToString();
+        }
+
+        for (size_t index = 0; Volume->LayerStack.empty() && index < layers.size(); index++) {
+            TPath path, temp;
+
+            if (layers[index][0] == '/') {
+                path = pins[index].ProcPath();
+            } else {
+                TStorage layer;
+                layer.Open(EStorageType::Layer, Volume->Place, layers[index]);
                 path = layer.Path;
             }
 
-            std::string layer_id = "L" + std::to_string(Volume->Layers.size() - ++layer_idx);
+            std::string layer_id = "L" + std::to_string(layers.size() - ++layer_idx);
             temp = Volume->GetInternal(layer_id);
             error = temp.Mkdir(700);
             if (!error)
@@ -774,7 +1030,7 @@ public:
             if (error)
                 goto err;
 
-            pin.Close();
+            pins[index].Close();
 
             if (layer_idx > 1)
                 lower += ":";
@@ -850,6 +1106,8 @@ err:
         if (!error)
             return error;
 
+        ReleaseLayerStack(Volume->LayerStack);
+
         if (Volume->HaveQuota())
             (void)quota.Destroy();
         return error;
@@ -859,6 +1117,8 @@ err:
         TProjectQuota quota(Volume->StoragePath);
         TError error = Volume->InternalPath.UmountAll();
 
+        ReleaseLayerStack(Volume->LayerStack);
+
         if (Volume->HaveQuota() && quota.Exists()) {
             L_ACT("Destroying project quota: {}", quota.Path);
             TError error2 = quota.Destroy();
@@ -951,6 +1211,18 @@ public:
         if (error)
             goto err;
 
+        /*
+         * Volume is ready right now, image is read ahead in background.
+         * Loop in direct-io mode bypasses page cache of image, skip it.
+         */
+        if (config().volumes().squash_prefetch()) {
+            int dio = 0;
+            (void)TPath("/sys/block/loop" + std::to_string(Volume->DeviceIndex) +
+                        "/loop/dio").ReadInt(dio);
+            if (!dio && posix_fadvise(lowerFd.Fd, 0, 0, POSIX_FADV_WILLNEED))
+                L_WRN("Cannot prefetch {}", Volume->Layers[0]);
+        }
+
         /* shortcut for read-only volumes without extra layers */
         if (Volume->IsReadOnly && Volume->Layers.size() == 1) {
             error = Volume->InternalPath.BindRemount(lower, Volume->GetMountFlags());
@@ -1137,6 +1409,14 @@ public:
 
     TError UnmapDevice(std::string device) {
         L_ACT("Unmap rbd device {}", device);
+
+        /* Kernel interface does not need ceph config and runs in parallel */
+        TPath remove("/sys/bus/rbd/remove_single_major");
+        if (!remove.Exists())
+            remove = "/sys/bus/rbd/remove";
+        if (StringStartsWith(device, "/dev/rbd") && !remove.WriteAll(device.substr(8)))
+            return OK;
+
         return RunCommand({"rbd", "unmap", device});
     }
 
@@ -1216,6 +1496,94 @@ public:
 
 /* TVolumeLvmBackend - ext4 on LVM */
 
+/*
+ * Concurrent lvm commands for one volume group are collected while
+ * previous batch runs and then executed by one lvm shell, thus they
+ * parse metadata and take volume group lock once. Groups are independent.
+ */
+
+struct TLvmBatch {
+    std::vector<std::vector<std::string>> Commands;
+    bool Done = false;
+    TError Error;
+};
+
+struct TLvmGroup {
+    bool Running = false;
+    std::shared_ptr<TLvmBatch> Pending;
+};
+
+static std::mutex LvmMutex;
+static std::condition_variable LvmCv;
+static std::map<std::string, TLvmGroup> LvmGroups;
+
+static TError RunLvmBatch(const TLvmBatch &batch) {
+    if (batch.Commands.size() == 1) {
+        std::vector<std::string> command = {"lvm"};
+        command.insert(command.end(), batch.Commands[0].begin(), batch.Commands[0].end());
+        return RunCommand(command);
+    }
+
+    std::string script;
+    for (auto &command: batch.Commands)
+        script += MergeEscapeStrings(command, ' ') + "\n";
+
+    TFile in;
+    TError error = in.CreateUnnamed("/tmp");
+    if (!error)
+        error = in.WriteAll(script);
+    if (error)
+        return error;
+    if (lseek(in.Fd, 0, SEEK_SET))
+        return TError::System("lseek");
+
+    L_ACT("Run {} lvm commands in one batch", batch.Commands.size());
+
+    return RunCommand({"lvm"}, TFile(), in);
+}
+
+/* Lvm shell exit code is not per command: caller checks own result */
+static TError RunLvm(const std::string &group,
+                     const std::vector<std::string> &command,
+                     std::function<bool()> done) {
+    auto lock = std::unique_lock<std::mutex>(LvmMutex);
+    auto &vg = LvmGroups[group];
+
+    if (!vg.Pending)
+        vg.Pending = std::make_shared<TLvmBatch>();
+    auto batch = vg.Pending;
+    batch->Commands.push_back(command);
+
+    while (vg.Running && !batch->Done)
+        LvmCv.wait(lock);
+
+    if (!batch->Done) {
+        vg.Running = true;
+        vg.Pending = nullptr;
+        lock.unlock();
+        TError error = RunLvmBatch(*batch);
+        lock.lock();
+        batch->Error = error;
+        batch->Done = true;
+        vg.Running = false;
+        LvmCv.notify_all();
+    }
+
+    lock.unlock();
+
+    if (batch->Commands.size() == 1)
+        return batch->Error;
+
+    /* Batch might succeed while this command failed and vice versa */
+    if (done())
+        return OK;
+
+    if (batch->Error)
+        return batch->Error;
+
+    return TError(EError::Unknown, "lvm {} failed in batch", command[0]);
+}
+
 class TVolumeLvmBackend : public TVolumeBackend {
 public:
 
@@ -1315,20 +1683,22 @@ public:
         if (!TPath(Device).Exists() || !Persistent) {
             Volume->KeepStorage = false; /* Do chown and chmod */
 
+            auto created = [&]() { return TPath(Device).Exists(); };
+
             if (Origin.size()) {
-                error = RunCommand({"lvm", "lvcreate", "--name", Name,
-                                    "--snapshot", Group + "/" + Origin,
-                                    "--setactivationskip", "n"});
+                error = RunLvm(Group, {"lvcreate", "--name", Name,
+                                       "--snapshot", Group + "/" + Origin,
+                                       "--setactivationskip", "n"}, created);
                 if (!error && Volume->SpaceLimit)
                     error = Resize(Volume->SpaceLimit, Volume->InodeLimit);
             } else if (Thin.size()) {
-                error = RunCommand({"lvm", "lvcreate", "--name", Name, "--thin",
-                                    "--virtualsize", std::to_string(Volume->SpaceLimit) + "B",
-                                    Group + "/" + Thin});
+                error = RunLvm(Group, {"lvcreate", "--name", Name, "--thin",
+                                       "--virtualsize", std::to_string(Volume->SpaceLimit) + "B",
+                                       Group + "/" + Thin}, created);
             } else {
-                error = RunCommand({"lvm", "lvcreate", "--name", Name,
-                                    "--size", std::to_string(Volume->SpaceLimit) + "B",
-                                    Group});
+                error = RunLvm(Group, {"lvcreate", "--name", Name,
+                                       "--size", std::to_string(Volume->SpaceLimit) + "B",
+                                       Group}, created);
             }
             if (error)
                 return error;
@@ -1351,15 +1721,20 @@ public:
                                                  "errors=continue" });
 
         if (error && !Persistent)
-            (void)RunCommand({"lvm", "lvremove", "--force", Device });
+            (void)Remove();
 
         return error;
     }
 
+    TError Remove() {
+        return RunLvm(Group, {"lvremove", "--force", Device},
+                      [&]() { return !TPath(Device).Exists(); });
+    }
+
     TError Delete() override {
         TError error = Volume->InternalPath.UmountAll();
         if (!Persistent) {
-            TError error2 = RunCommand({"lvm", "lvremove", "--force", Device});
+            TError error2 = Remove();
             if (!error)
                 error = error2;
         }
@@ -1661,6 +2036,114 @@ TError TVolume::ClaimPlace(uint64_t size) {
     return OK;
 }
 
+/* Block device under volume filesystem as "major:minor" */
+TError TVolume::GetIoDisk(std::string &disk) const {
+    dev_t dev = InternalPath.GetDev();
+
+    if (!dev || !major(dev))
+        return TError(EError::NotSupported, "Volume {} has no backend disk", Path);
+
+    disk = fmt::format("{}:{}", major(dev), minor(dev));
+    if (!TPath("/sys/dev/block/" + disk + "/stat").Exists())
+        return TError(EError::NotSupported, "Volume {} has no backend disk", Path);
+
+    return OK;
+}
+
+TError TVolume::GetIoStat(TUintMap &stat) const {
+    std::vector<std::string> fields;
+    std::string disk, text;
+    TError error;
+
+    /* Disk of other backends is shared with host */
+    if (!OwnDisk())
+        return TError(EError::NotSupported, "Volume {} has no own disk", Path);
+
+    error = GetIoDisk(disk);
+    if (error)
+        return error;
+
+    error = TPath("/sys/dev/block/" + disk + "/stat").ReadAll(text);
+    if (error)
+        return error;
+
+    /* see Documentation/block/stat.txt */
+    fields = SplitString(StringTrim(text), ' ');
+    fields.erase(std::remove(fields.begin(), fields.end(), ""), fields.end());
+    if (fields.size() < 11)
+        return TError(EError::Unknown, "Unexpected disk {} stat: {}", disk, text);
+
+    uint64_t val[11];
+    for (int i = 0; i < 11; i++) {
+        error = StringToUint64(fields[i], val[i]);
+        if (error)
+            return error;
+    }
+
+    stat["read"] = val[2] * 512;
+    stat["read_ops"] = val[0];
+    stat["read_time"] = val[3];
+    stat["write"] = val[6] * 512;
+    stat["write_ops"] = val[4];
+    stat["write_time"] = val[7];
+    stat["time"] = val[9];
+
+    return OK;
+}
+
+/*
+ * Volume io limits are set per backend disk in blkio cgroups of linked
+ * containers: blk-throttle in root cgroup does not limit its children.
+ */
+TError TVolume::CheckIoLimit() const {
+    std::string disk;
+
+    if (!BlkioSubsystem.Supported || !BlkioSubsystem.HasThrottler)
+        return TError(EError::NotSupported, "blkio throttler is not supported");
+
+    /* Disk of other backends is shared with host */
+    if (!OwnDisk())
+        return TError(EError::NotSupported, "Volume io limits require own block device: loop, lvm or rbd backend");
+
+    return GetIoDisk(disk);
+}
+
+/* Under volumes lock, the lowest limit wins for the same disk */
+void TVolume::GetIoLimits(const TContainer &ct, bool iops, TUintMap &map) {
+    for (auto &link: ct.VolumeLinks) {
+        auto &vol = link->Volume;
+        uint64_t limit = iops ? vol->IopsLimit : vol->IoLimit;
+        std::string disk;
+
+        if (!limit || !vol->IoLimitSet || vol->GetIoDisk(disk))
+            continue;
+
+        auto &val = map[disk];
+        if (!val || limit < val)
+            val = limit;
+    }
+}
+
+void TVolume::ApplyIoLimit(std::shared_ptr<TContainer> ct) {
+    if (ct->IsRoot() || !(ct->Controllers & CGROUP_BLKIO)) {
+        if (IoLimit || IopsLimit)
+            L_WRN("Volume {} io limit is not applied to CT{}:{} without blkio controller",
+                  Path, ct->Id, ct->Name);
+        return;
+    }
+
+    if (!ct->GetCgroup(BlkioSubsystem).Exists())
+        return;
+
+    L_ACT("Apply volume {} io limit {} bps {} iops in CT{}:{}", Path, IoLimit, IopsLimit, ct->Id, ct->Name);
+
+    TError error = ct->ApplyIoLimit(false);
+    if (!error)
+        error = ct->ApplyIoLimit(true);
+    if (error)
+        L_WRN("Cannot apply volume {} io limit in CT{}:{}: {}", Path, ct->Id, ct->Name, error);
+}
+
 TError TVolume::DependsOn(const TPath &path) {
     if (State == EVolumeState::READY && !path.Exists())
         return TError(EError::VolumeNotFound, "Volume {} depends on non-existent path {}", Path, path);
@@ -1709,47 +2192,87 @@ TError TVolume::CheckDependencies() {
     return error;
 }
 
-TError TVolume::CheckConflicts(const TPath &path) {
-    if (IsSystemPath(path))
-        return TError(EError::InvalidPath, "Volume path {} in system directory", path);
+void TVolume::AddClaims() {
+    PORTO_LOCKED(VolumesMutex);
 
-    for (auto &it : Volumes) {
-        auto &vol = it.second;
+    VolumeClaims.emplace(Place, std::make_pair(this, EVolumeClaim::Place));
 
-        if (vol->Path == path)
-            return TError(EError::Busy, "Volume path {} is used by volume {}", path, vol->Path);
+    if (!RemoteStorage() && StoragePath) {
+        bool bind = BackendType == "bind" || BackendType == "rbind";
+        VolumeClaims.emplace(StoragePath, std::make_pair(this, bind ? EVolumeClaim::BindStorage :
+                                                                      EVolumeClaim::Storage));
+    }
 
-        if (vol->Path.IsInside(path))
-            return TError(EError::InvalidPath, "Volume path {} overlaps with volume {}", path, vol->Path);
+    for (auto &l: Layers) {
+        TPath layer(l);
+        if (layer.IsAbsolute())
+            VolumeClaims.emplace(layer, std::make_pair(this, EVolumeClaim::Layer));
+    }
+}
 
-        if (path.IsInside(vol->Path) && !(vol->State & (EVolumeState::READY |
-                                                        EVolumeState::TUNING)))
-            return TError(EError::VolumeNotReady, "Volume path {} inside volume {} and it is not ready", path, vol->Path);
+void TVolume::RemoveClaims() {
+    PORTO_LOCKED(VolumesMutex);
 
-        if (vol->Place.IsInside(path))
-            return TError(EError::InvalidPath, "Volume path {} overlaps with place {}", path, vol->Place);
+    for (auto it = VolumeClaims.begin(); it != VolumeClaims.end(); ) {
+        if (it->second.first == this)
+            it = VolumeClaims.erase(it);
+        else
+            ++it;
+    }
+}
 
-        if (vol->RemoteStorage()) {
+/* Looks only at path ancestors and subtree, indexes are ordered by TPathLess */
+TError TVolume::CheckConflicts(const TPath &path) {
+    PORTO_LOCKED(VolumesMutex);
 
-        } else if (vol->BackendType == "bind" || vol->BackendType == "rbind") {
-            if (vol->StoragePath.IsInside(path))
-                return TError(EError::InvalidPath, "Volume path {} overlaps with volume {} storage {}", path, vol->Path, vol->StoragePath);
-        } else {
-            if (vol->StoragePath.IsInside(path) || path.IsInside(vol->StoragePath))
-                return TError(EError::InvalidPath, "Volume path {} overlaps with volume {} storage {}", path, vol->Path, vol->StoragePath);
+    if (IsSystemPath(path))
+        return TError(EError::InvalidPath, "Volume path {} in system directory", path);
+
+    for (auto p = path; ; p = p.DirNameNormal()) {
+        auto vol_it = Volumes.find(p);
+        if (vol_it != Volumes.end()) {
+            auto &vol = vol_it->second;
+            if (p == path)
+                return TError(EError::Busy, "Volume path {} is used by volume {}", path, vol->Path);
+            if (!(vol->State & (EVolumeState::READY | EVolumeState::TUNING)))
+                return TError(EError::VolumeNotReady, "Volume path {} inside volume {} and it is not ready", path, vol->Path);
         }
 
-        for (auto &l: vol->Layers) {
-            TPath layer(l);
-            if (layer.IsAbsolute() && (layer.IsInside(path) || path.IsInside(layer)))
-                return TError(EError::InvalidPath, "Volume path {} overlaps with layer {}", path, layer);
+        auto range = VolumeClaims.equal_range(p);
+        for (auto it = range.first; it != range.second; ++it) {
+            auto vol = it->second.first;
+            if (it->second.second == EVolumeClaim::Storage)
+                return TError(EError::InvalidPath, "Volume path {} overlaps with volume {} storage {}", path, vol->Path, vol->StoragePath);
+            if (it->second.second == EVolumeClaim::Layer)
+                return TError(EError::InvalidPath, "Volume path {} overlaps with layer {}", path, p);
         }
 
-        for (auto &link: vol->Links) {
-            if (link->HostTarget == path)
-                return TError(EError::Busy, "Volume path {} is used by volume {} for {}", path, vol->Path, link->Container->Name);
-            if (link->HostTarget.IsInside(path))
-                return TError(EError::InvalidPath, "Volume path {} overlaps with volume {} link {} for {}", path, vol->Path, link->HostTarget, link->Container->Name);
+        if (p.IsRoot() || !p.IsAbsolute())
+            break;
+    }
+
+    for (auto it = Volumes.lower_bound(path); it != Volumes.end() && it->first.IsInside(path); ++it) {
+        if (it->first != path)
+            return TError(EError::InvalidPath, "Volume path {} overlaps with volume {}", path, it->second->Path);
+    }
+
+    for (auto it = VolumeLinks.lower_bound(path); it != VolumeLinks.end() && it->first.IsInside(path); ++it) {
+        auto &link = it->second;
+        if (link->HostTarget == path)
+            return TError(EError::Busy, "Volume path {} is used by volume {} for {}", path, link->Volume->Path, link->Container->Name);
+        return TError(EError::InvalidPath, "Volume path {} overlaps with volume {} link {} for {}", path, link->Volume->Path, link->HostTarget, link->Container->Name);
+    }
+
+    for (auto it = VolumeClaims.lower_bound(path); it != VolumeClaims.end() && it->first.IsInside(path); ++it) {
+        auto vol = it->second.first;
+        switch (it->second.second) {
+        case EVolumeClaim::Place:
+            return TError(EError::InvalidPath, "Volume path {} overlaps with place {}", path, vol->Place);
+        case EVolumeClaim::Storage:
+        case EVolumeClaim::BindStorage:
+            return TError(EError::InvalidPath, "Volume path {} overlaps with volume {} storage {}", path, vol->Path, vol->StoragePath);
+        case EVolumeClaim::Layer:
+            return TError(EError::InvalidPath, "Volume path {} overlaps with layer {}", path, it->first);
         }
     }
 
@@ -1923,13 +2446,34 @@ TError TVolume::Configure(const TPath &target_root) {
 }
 
 TError TVolume::MergeLayers() {
+    bool reflink = true;
+    TCgroup memcg;
     TError error;
 
     if (!HaveLayers())
         return OK;
 
+    /* Charge pages of memory volume to owner rather than to porto helpers */
+    for (auto ct = VolumeOwnerContainer; MemoryStorage() && ct && !ct->IsRoot(); ct = ct->Parent) {
+        if (ct->Controllers & CGROUP_MEMORY) {
+            memcg = ct->GetCgroup(MemorySubsystem);
+            if (!memcg.Exists())
+                memcg = TCgroup();
+            break;
+        }
+    }
+
+    ParallelFor(Layers.size(), config().volumes().layer_threads(), [&](size_t index) {
+        if (Layers[index][0] != '/') {
+            TStorage layer;
+            layer.Open(EStorageType::Layer, Place, Layers[index]);
+            (void)layer.Touch();
+        }
+    });
+
     for (auto &name : Layers) {
         L_ACT("Merge layer {} into volume: {}", name, Path);
+        Progress = 10 + 70 * (&name - &Layers[0]) / Layers.size();
 
         if (name[0] == '/') {
             TPath temp;
@@ -1952,21 +2496,22 @@ TError TVolume::MergeLayers() {
                 return error;
             }
 
-            error = CopyRecursive(temp, InternalPath);
+            error = CopyRecursive(temp, InternalPath, &reflink, memcg);
 
             (void)temp.UmountAll();
             (void)temp.Rmdir();
         } else {
             TStorage layer_storage;
             layer_storage.Open(EStorageType::Layer, Place, name);
-            (void)layer_storage.Touch();
             /* Imported layers are available for everybody */
-            error = CopyRecursive(layer_storage.Path, InternalPath);
+            error = CopyRecursive(layer_storage.Path, InternalPath, &reflink, memcg);
         }
         if (error)
             return error;
     }
 
+    LayersCopy = reflink ? "reflink" : "copy";
+
     error = TStorage::SanitizeLayer(InternalPath, true);
     if (error)
         return error;
@@ -2165,6 +2710,8 @@ TError TVolume::MakeShares(const TFile &base, bool cow) {
 }
 
 TError TVolume::Build() {
+    TTraceScope trace("VolumeBuild", BackendType);
+
     L_ACT("Build volume: {} backend: {}", Path, BackendType);
 
     TError error = GetInternal("").Mkdir(0755);
@@ -2247,6 +2794,13 @@ TError TVolume::Build() {
     if (error)
         return error;
 
+    if (IoLimit || IopsLimit) {
+        error = CheckIoLimit();
+        if (error)
+            return error;
+        IoLimitSet = true;
+    }
+
     if (BackendType != "overlay" && BackendType != "squash") {
         error = MergeLayers();
         if (error)
@@ -2475,6 +3029,7 @@ void TVolume::DeleteAll() {
         if (error)
             L_WRN("Cannot destroy volume {} : {}", vol->Path , error);
     }
+    CleanupLayerStacks();
 }
 
 TError TVolume::Delete() {
@@ -2595,6 +3150,7 @@ TError TVolume::Delete() {
             it.second->Nested.erase(volume);
 
         Volumes.erase(volume->Path);
+        volume->RemoveClaims();
 
         /* Remove common link */
         if (VolumeLinks.erase(volume->Path))
@@ -2748,7 +3304,9 @@ TError TVolume::Tune(const std::map<std::string, std::string> &properties) {
         if (p.first != V_INODE_LIMIT &&
             p.first != V_INODE_GUARANTEE &&
             p.first != V_SPACE_LIMIT &&
-            p.first != V_SPACE_GUARANTEE)
+            p.first != V_SPACE_GUARANTEE &&
+            p.first != V_IO_LIMIT &&
+            p.first != V_IOPS_LIMIT)
             /* Prop not found omitted */
                 return TError(EError::InvalidProperty,
                               "Volume property " + p.first + " cannot be changed");
@@ -2824,6 +3382,37 @@ TError TVolume::Tune(const std::map<std::string, std::string> &properties) {
         volumes_lock.unlock();
     }
 
+    if (properties.count(V_IO_LIMIT) || properties.count(V_IOPS_LIMIT)) {
+        uint64_t io_limit = IoLimit, iops_limit = IopsLimit;
+
+        if (properties.count(V_IO_LIMIT)) {
+            error = StringToSize(properties.at(V_IO_LIMIT), io_limit);
+            if (error)
+                goto out;
+        }
+        if (properties.count(V_IOPS_LIMIT)) {
+            error = StringToUint64(properties.at(V_IOPS_LIMIT), iops_limit);
+            if (error)
+                goto out;
+        }
+
+        error = CheckIoLimit();
+        if (error)
+            goto out;
+
+        volumes_lock.lock();
+        IoLimit = io_limit;
+        IopsLimit = iops_limit;
+        IoLimitSet = true;
+        std::vector<std::shared_ptr<TContainer>> linked;
+        for (auto &link: Links)
+            linked.push_back(link->Container);
+        volumes_lock.unlock();
+
+        for (auto &ct: linked)
+            ApplyIoLimit(ct);
+    }
+
 out:
 
     volumes_lock.lock();
@@ -2924,6 +3513,9 @@ TError TVolume::LinkVolume(std::shared_ptr<TContainer> container,
 
     link->Busy = false;
 
+    if (IoLimitSet)
+        ApplyIoLimit(container);
+
     return OK;
 
 undo:
@@ -3048,6 +3640,10 @@ done:
     volumes_lock.unlock();
     link.reset();
 
+    /* Drop limit of backend disk, it might be reused by next volume */
+    if (IoLimitSet)
+        ApplyIoLimit(container);
+
     /* Save changes only after umounting */
     (void)Save();
 
@@ -3149,6 +3745,8 @@ void TVolume::DumpDescription(TVolumeLink *link, const TPath &path, Porto::TVolu
     ret[V_INODE_LIMIT] = std::to_string(InodeLimit);
     ret[V_SPACE_GUARANTEE] = std::to_string(SpaceGuarantee);
     ret[V_INODE_GUARANTEE] = std::to_string(InodeGuarantee);
+    ret[V_IO_LIMIT] = std::to_string(IoLimit);
+    ret[V_IOPS_LIMIT] = std::to_string(IopsLimit);
 
     if (HaveLayers()) {
         std::vector<std::string> layers = Layers;
@@ -3165,6 +3763,12 @@ void TVolume::DumpDescription(TVolumeLink *link, const TPath &path, Porto::TVolu
     if (DeviceName.size())
         ret[V_DEVICE_NAME] = DeviceName;
 
+    if (LayersCopy.size())
+        ret[V_LAYERS_COPY] = LayersCopy;
+
+    if (State == EVolumeState::BUILDING)
+        ret[V_PROGRESS] = std::to_string(Progress);
+
     if (Backend)
         ret[V_PLACE_KEY] = Backend->ClaimPlace();
 
@@ -3205,8 +3809,14 @@ void TVolume::DumpDescription(TVolumeLink *link, const TPath &path, Porto::TVolu
         ret[V_INODE_USED] = std::to_string(stat.InodeUsage);
         ret[V_SPACE_AVAILABLE] = std::to_string(stat.SpaceAvail);
         ret[V_INODE_AVAILABLE] = std::to_string(stat.InodeAvail);
+        if (MemoryStorage())
+            ret[V_MEMORY_USAGE] = std::to_string(stat.SpaceUsage);
     }
 
+    TUintMap io_stat;
+    if (!GetIoStat(io_stat))
+        UintMapToString(io_stat, ret[V_IO_STAT]);
+
     dump->set_path(path.ToString());
     dump->set_change_time(ChangeTime);
 
@@ -3262,16 +3872,25 @@ TError TVolume::Save() {
     if (!Labels.empty())
         node.Set(V_LABELS, StringMapToString(Labels));
     node.Set(V_LOOP_DEV, std::to_string(DeviceIndex));
+    if (!LayerStack.empty())
+        node.Set(V_LAYER_STACK, LayerStack);
     node.Set(V_READ_ONLY, BoolToString(IsReadOnly));
     node.Set(V_LAYERS, MergeEscapeStrings(Layers, ';'));
     node.Set(V_SPACE_LIMIT, std::to_string(SpaceLimit));
     node.Set(V_SPACE_GUARANTEE, std::to_string(SpaceGuarantee));
     node.Set(V_INODE_LIMIT, std::to_string(InodeLimit));
     node.Set(V_INODE_GUARANTEE, std::to_string(InodeGuarantee));
+    if (IoLimit)
+        node.Set(V_IO_LIMIT, std::to_string(IoLimit));
+    if (IopsLimit)
+        node.Set(V_IOPS_LIMIT, std::to_string(IopsLimit));
 
     if (DeviceName.size())
         node.Set(V_DEVICE_NAME, DeviceName);
 
+    if (LayersCopy.size())
+        node.Set(V_LAYERS_COPY, LayersCopy);
+
     TMultiTuple links;
     for (auto &link: Links) {
         if (link->Target)
@@ -3287,18 +3906,36 @@ TError TVolume::Save() {
 
     node.Set(V_PLACE, Place.ToString());
 
-    error = node.Save();
+    error = node.Save(KvState);
     if (error)
         L_WRN("Cannot save volume {} {}", Path, error);
 
     return error;
 }
 
+/* Snapshot of mountpoints while volumes are restored */
+static const std::unordered_set<std::string> *RestoreMounts = nullptr;
+
+static TError CheckMounted(const TPath &path) {
+    if (RestoreMounts && RestoreMounts->count(path.NormalPath().ToString()))
+        return OK;
+    TMount mount;
+    return path.FindMount(mount, true);
+}
+
 TError TVolume::Restore(const TKeyValue &node) {
+    TStringMap cfg = node.Data;
     Porto::TVolume spec;
+    std::string stack;
     TError error;
 
-    error = ParseConfig(node.Data, spec);
+    /* Internal state, not a volume property */
+    if (cfg.count(V_LAYER_STACK)) {
+        stack = cfg[V_LAYER_STACK];
+        cfg.erase(V_LAYER_STACK);
+    }
+
+    error = ParseConfig(cfg, spec);
     if (error)
         return error;
 
@@ -3314,6 +3951,8 @@ TError TVolume::Restore(const TKeyValue &node) {
 
     InternalPath = Place / PORTO_VOLUMES / Id / "volume";
 
+    IoLimitSet = OwnDisk() && (IoLimit || IopsLimit);
+
     if (!spec.has_owner())
         VolumeOwner = VolumeCred;
 
@@ -3345,6 +3984,17 @@ TError TVolume::Restore(const TKeyValue &node) {
     if (error)
         return error;
 
+    /* Mounted volume holds lower layers by itself if stack is gone */
+    if (!stack.empty()) {
+        error = CheckMounted(TPath(PORTO_LAYER_STACKS) / stack);
+        if (error) {
+            L_WRN("Layer stack {} of volume {} is lost: {}", stack, Path, error);
+        } else {
+            RestoreLayerStack(stack);
+            LayerStack = stack;
+        }
+    }
+
     error = ClaimPlace(SpaceLimit);
     if (error)
         return error;
@@ -3359,6 +4009,7 @@ TError TVolume::Restore(const TKeyValue &node) {
         L_WRN("Duplicate volume link: {}", Path);
 
     Volumes[Path] = shared_from_this();
+    AddClaims();
 
     /* Restore common link */
     auto common_link = std::make_shared<TVolumeLink>(shared_from_this(), RootContainer);
@@ -3413,8 +4064,7 @@ TError TVolume::Restore(const TKeyValue &node) {
             L("Restore volume {} link {} for CT{}:{} target {}", Path, link->HostTarget,
                     link->Container->Id, link->Container->Name, link->Target);
 
-            TMount mount;
-            error = link->HostTarget.FindMount(mount, true);
+            error = CheckMounted(link->HostTarget);
             if (error) {
                 L("Link is lost: {}", error);
                 continue;
@@ -3432,6 +4082,77 @@ TError TVolume::Restore(const TKeyValue &node) {
     return OK;
 }
 
+struct TVolumeJob {
+    std::shared_ptr<TVolume> Volume;
+    std::shared_ptr<TVolumeLink> Link;
+    std::shared_ptr<Porto::TVolume> Spec;
+    std::list<std::shared_ptr<TVolume>> Unlinked;
+    std::shared_ptr<TClient> Client;
+};
+
+/* Completes asynchronous create and delete requests */
+class TVolumeBuilder : public TWorker<TVolumeJob> {
+public:
+    TVolumeBuilder() : TWorker("portod-VB", config().volumes().build_threads()) {}
+
+    const TVolumeJob &Top() override {
+        return Queue.front();
+    }
+
+    bool Handle(const TVolumeJob &job) override {
+        CL = job.Client.get();
+        if (job.Volume) {
+            TError error = job.Volume->Complete(*job.Spec, job.Link);
+            if (error) {
+                L_WRN("Cannot build volume {}: {}", job.Volume->Path, error);
+                Statistics->VolumesFailed++;
+            }
+        } else {
+            /* nobody waits for result, report failures loudly */
+            for (auto &volume: job.Unlinked) {
+                TError error = volume->Delete();
+                if (error)
+                    L_ERR("Cannot delete volume {} asynchronously for {}: {}",
+                          volume->Path, job.Client->Id, error);
+            }
+        }
+        CL = nullptr;
+        return true;
+    }
+};
+
+static std::unique_ptr<TVolumeBuilder> Builder;
+
+void TVolume::StartBuilder() {
+    if (config().volumes().build_threads()) {
+        Builder = std::unique_ptr<TVolumeBuilder>(new TVolumeBuilder());
+        Builder->Start();
+    }
+}
+
+void TVolume::StopBuilder() {
+    if (Builder) {
+        Builder->Stop();
+        Builder = nullptr;
+    }
+}
+
+void TVolume::DeleteAsync(std::list<std::shared_ptr<TVolume>> &unlinked) {
+    if (!Builder) {
+        DeleteUnlinked(unlinked);
+        return;
+    }
+
+    if (unlinked.empty())
+        return;
+
+    TVolumeJob job;
+    job.Unlinked = unlinked;
+    job.Client = std::make_shared<TClient>(CL->shared_from_this());
+    Builder->Push(job);
+    unlinked.clear();
+}
+
 std::vector<TVolumeProperty> VolumeProperties = {
     { V_BACKEND,     "dir|plain|bind|rbind|tmpfs|hugetmpfs|quota|native|overlay|squash|lvm|loop|rbd (default - autodetect)", false },
     { V_STORAGE,     "path to data storage (default - internal)", false },
@@ -3452,6 +4173,8 @@ std::vector<TVolumeProperty> VolumeProperties = {
     { V_LAYERS,      "top-layer;...;bottom-layer - overlayfs layers", false },
     { V_PLACE,       "place for layers and default storage (optional)", false },
     { V_DEVICE_NAME, "name of backend disk device (ro)", true },
+    { V_LAYERS_COPY, "reflink|copy - how layers were merged into native or plain volume (ro)", true },
+    { V_PROGRESS,    "percent of construction done while building (ro)", true },
     { V_PLACE_KEY,   "key for charging place_limit for owner_container (ro)", true },
     { V_SPACE_LIMIT, "disk space limit (dynamic, default zero - unlimited)", false },
     { V_INODE_LIMIT, "disk inode limit (dynamic, default zero - unlimited)", false },
@@ -3461,10 +4184,15 @@ std::vector<TVolumeProperty> VolumeProperties = {
     { V_INODE_USED,  "current disk inode used (ro)", true },
     { V_SPACE_AVAILABLE,    "available disk space (ro)", true },
     { V_INODE_AVAILABLE,    "available disk inodes (ro)", true },
+    { V_MEMORY_USAGE,       "memory used by tmpfs and hugetmpfs (ro)", true },
+    { V_IO_LIMIT,    "backend disk io limit, bytes per second (dynamic, default zero - unlimited)", false },
+    { V_IOPS_LIMIT,  "backend disk io operations limit per second (dynamic, default zero - unlimited)", false },
+    { V_IO_STAT,     "backend disk io statistics: read|write|read_ops|write_ops|read_time|write_time|time (ro)", true },
 };
 
 TError TVolume::Create(const Porto::TVolume &spec,
-                       std::shared_ptr<TVolume> &volume) {
+                       std::shared_ptr<TVolume> &volume,
+                       bool async) {
     TError error;
 
     if (!CL)
@@ -3571,6 +4299,7 @@ TError TVolume::Create(const Porto::TVolume &spec,
     }
 
     Volumes[volume->Path] = volume;
+    volume->AddClaims();
 
     volume->VolumeOwnerContainer = owner;
     owner->OwnedVolumes.push_back(volume);
@@ -3584,14 +4313,45 @@ TError TVolume::Create(const Porto::TVolume &spec,
     /* release owner */
     CL->ReleaseContainer();
 
-    if (error)
-        goto undo;
+    if (error) {
+        common_link->Busy = false;
+        volume->Delete();
+        return error;
+    }
+
+    if (async && Builder) {
+        TVolumeJob job;
+
+        job.Volume = volume;
+        job.Link = common_link;
+        job.Spec = std::make_shared<Porto::TVolume>(spec);
+        job.Client = std::make_shared<TClient>(CL->shared_from_this());
+
+        /* Spec must live until build completes */
+        volume->Spec = job.Spec.get();
+
+        Builder->Push(job);
+        return OK;
+    }
+
+    return volume->Complete(spec, common_link);
+}
+
+TError TVolume::Complete(const Porto::TVolume &spec,
+                         std::shared_ptr<TVolumeLink> common_link) {
+    auto volume = shared_from_this();
+    std::unique_lock<std::mutex> volumes_lock(VolumesMutex, std::defer_lock);
+    TError error;
+
+    volume->Progress = 10;
 
     error = volume->Build();
     volume->Spec = nullptr;
     if (error)
         goto undo;
 
+    volume->Progress = 80;
+
     if (spec.links().size()) {
         for (auto &link: spec.links()) {
             std::shared_ptr<TContainer> ct;
@@ -3616,6 +4376,8 @@ TError TVolume::Create(const Porto::TVolume &spec,
     if (error)
         goto undo;
 
+    volume->Progress = 90;
+
     /* Mount common link in requested path */
     if (volume->Path != volume->InternalPath) {
         error = volume->MountLink(common_link);
@@ -3639,6 +4401,7 @@ next_link:
     }
 
     /* Complete costriction */
+    volume->Progress = 100;
     volume->SetState(EVolumeState::READY);
     common_link->Busy = false;
     volumes_lock.unlock();
@@ -3670,8 +4433,28 @@ void TVolume::RestoreAll(void) {
     if (error)
         L_ERR("Cannot list nodes: {}", error);
 
+    std::vector<TKeyValue *> load;
+    std::vector<TError> errors(nodes.size());
+    for (auto &node: nodes)
+        load.push_back(&node);
+
+    ParallelFor(load.size(), config().daemon().restore_threads(), [&](size_t index) {
+        errors[index] = load[index]->Load();
+    });
+
+    /* Do not rescan mountinfo for each volume and link */
+    std::list<TMount> mounts;
+    std::unordered_set<std::string> mounted;
+    if (!TPath::ListAllMounts(mounts)) {
+        mounted.reserve(mounts.size());
+        for (auto &mnt: mounts)
+            mounted.insert(mnt.Target.ToString());
+        RestoreMounts = &mounted;
+    }
+
+    size_t index = 0;
     for (auto &node : nodes) {
-        error = node.Load();
+        error = errors[index++];
         if (error) {
             L_WRN("Cannot load {} removed: {}", node.Path, error);
             node.Path.Unlink();
@@ -3727,8 +4510,7 @@ void TVolume::RestoreAll(void) {
         }
 
         if (volume->BackendType != "dir" && volume->BackendType != "quota") {
-            TMount mount;
-            error = volume->Path.FindMount(mount, true);
+            error = CheckMounted(volume->Path);
             if (error) {
                 L("Volume {} is not mounted: {}", volume->Path, error);
                 broken_volumes.push_back(volume);
@@ -3761,9 +4543,12 @@ next_link:
         if (RootContainer->VolumeMounts != (int)VolumeLinks.size())
             L_WRN("Volume links index out of sync: {} != {}", RootContainer->VolumeMounts, VolumeLinks.size());
 
+        Statistics->VolumesRestored++;
         L("Volume {} restored", volume->Path);
     }
 
+    RestoreMounts = nullptr;
+
     L_SYS("Remove broken volumes...");
 
     for (auto &volume : broken_volumes) {
@@ -3775,6 +4560,9 @@ next_link:
 
     TPath volumes = place.Path / PORTO_VOLUMES;
 
+    /* Stacks used by restored volumes are counted */
+    CleanupLayerStacks();
+
     L_SYS("Remove stale volumes...");
 
     std::vector<std::string> subdirs;
@@ -3889,6 +4677,8 @@ TError TVolume::ParseConfig(const TStringMap &cfg, Porto::TVolume &spec) {
             spec.set_device_index(v);;
         } else if (key == V_DEVICE_NAME) {
             spec.set_device_name(val);
+        } else if (key == V_LAYERS_COPY) {
+            spec.set_layers_copy(val);
         } else if (key == V_BACKEND) {
             spec.set_backend(val);
         } else if (key == V_OWNER_CONTAINER) {
@@ -3948,6 +4738,14 @@ TError TVolume::ParseConfig(const TStringMap &cfg, Porto::TVolume &spec) {
         } else if (key == V_LAYERS) {
             for (auto &l: SplitEscapedString(val, ';'))
                 spec.add_layers(l);
+        } else if (key == V_IO_LIMIT) {
+            uint64_t v;
+            error = StringToSize(val, v);
+            spec.set_io_limit(v);
+        } else if (key == V_IOPS_LIMIT) {
+            uint64_t v;
+            error = StringToUint64(val, v);
+            spec.set_iops_limit(v);
         } else if (key == V_SPACE_LIMIT) {
             uint64_t v;
             error = StringToSize(val, v);
@@ -4011,6 +4809,9 @@ TError TVolume::Load(const Porto::TVolume &spec, bool full) {
     if (spec.has_device_name() && full)
         DeviceName = spec.device_name();
 
+    if (spec.has_layers_copy() && full)
+        LayersCopy = spec.layers_copy();
+
     if (spec.has_place())
         Place = spec.place();
 
@@ -4054,6 +4855,12 @@ TError TVolume::Load(const Porto::TVolume &spec, bool full) {
         InodeGuarantee = spec.inodes().guarantee();
     }
 
+    if (spec.has_io_limit())
+        IoLimit = spec.io_limit();
+
+    if (spec.has_iops_limit())
+        IopsLimit = spec.iops_limit();
+
     if (spec.has_build_time() && full)
         BuildTime = spec.build_time();
 
@@ -4096,6 +4903,12 @@ void TVolume::Dump(Porto::TVolume &spec, bool full) {
     if (DeviceName.size())
         spec.set_device_name(DeviceName);
 
+    if (LayersCopy.size())
+        spec.set_layers_copy(LayersCopy);
+
+    if (State == EVolumeState::BUILDING)
+        spec.set_progress(Progress);
+
     if (HaveStorage()) {
         if (UserStorage() && !RemoteStorage())
             spec.set_storage(CL->ComposePath(StoragePath).ToString());
@@ -4126,6 +4939,10 @@ void TVolume::Dump(Porto::TVolume &spec, bool full) {
         spec.mutable_inodes()->set_limit(InodeLimit);
     if (InodeGuarantee)
         spec.mutable_inodes()->set_guarantee(InodeGuarantee);
+    if (IoLimit)
+        spec.set_io_limit(IoLimit);
+    if (IopsLimit)
+        spec.set_iops_limit(IopsLimit);
 
     for (auto &layer: Layers) {
         TPath path(layer);
@@ -4158,5 +4975,16 @@ void TVolume::Dump(Porto::TVolume &spec, bool full) {
         spec.mutable_space()->set_available(stat.SpaceAvail);
         spec.mutable_inodes()->set_usage(stat.InodeUsage);
         spec.mutable_inodes()->set_available(stat.InodeAvail);
+        if (MemoryStorage())
+            spec.set_memory_usage(stat.SpaceUsage);
+    }
+
+    TUintMap io_stat;
+    if (!full && !GetIoStat(io_stat)) {
+        for (auto &it: io_stat) {
+            auto stat = spec.mutable_io_stat()->add_map();
+            stat->set_key(it.first);
+            stat->set_val(it.second);
+        }
     }
 }
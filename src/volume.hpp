@@ -4,9 +4,12 @@
 #include <string>
 #include <set>
 #include <mutex>
+#include <atomic>
 #include "common.hpp"
+#include "kvalue.hpp"
 #include "util/path.hpp"
 #include "util/log.hpp"
+#include "util/locks.hpp"
 
 constexpr const char *V_ID = "id";
 constexpr const char *V_PATH = "path";
@@ -23,6 +26,7 @@ constexpr const char *V_RAW_CONTAINERS = "_containers";
 constexpr const char *V_CONTAINERS = "containers";
 constexpr const char *V_LOOP_DEV = "_loop_dev";
 constexpr const char *V_AUTO_PATH = "_auto_path";
+constexpr const char *V_LAYER_STACK = "_layer_stack";
 constexpr const char *V_TARGET_CONTAINER = "target_container";
 
 constexpr const char *V_OWNER_CONTAINER = "owner_container";
@@ -48,9 +52,16 @@ constexpr const char *V_INODE_USED = "inode_used";
 constexpr const char *V_SPACE_AVAILABLE = "space_available";
 constexpr const char *V_INODE_AVAILABLE = "inode_available";
 
+constexpr const char *V_IO_LIMIT = "io_limit";
+constexpr const char *V_IOPS_LIMIT = "iops_limit";
+constexpr const char *V_IO_STAT = "io_stat";
+constexpr const char *V_MEMORY_USAGE = "memory_usage";
+
 constexpr const char *V_PLACE = "place";
 constexpr const char *V_PLACE_KEY = "place_key";
 constexpr const char *V_DEVICE_NAME = "device_name";
+constexpr const char *V_LAYERS_COPY = "layers_copy";
+constexpr const char *V_PROGRESS = "progress";
 
 using Porto::EVolumeState;
 
@@ -94,6 +105,8 @@ class TVolume : public std::enable_shared_from_this<TVolume>,
     std::unique_ptr<TVolumeBackend> Backend;
     TError OpenBackend();
 
+    TKeyValueState KvState;
+
 public:
     TPath Path;
     TPath InternalPath;
@@ -101,6 +114,12 @@ public:
     uint64_t BuildTime = 0;
     uint64_t ChangeTime = 0;
 
+    /* How layers were merged: reflink or copy */
+    std::string LayersCopy;
+
+    /* Percent of construction done, reported while building */
+    std::atomic<unsigned> Progress{0};
+
     TPath Place;
 
     std::string Storage;
@@ -120,6 +139,8 @@ public:
     int DeviceIndex = -1;
     bool IsReadOnly = false;
 
+    std::string LayerStack;     /* shared overlay of lower layers */
+
     bool HasDependentContainer = false;
 
     std::vector<std::string> Layers;
@@ -131,6 +152,11 @@ public:
     uint64_t InodeLimit = 0;
     uint64_t InodeGuarantee = 0;
 
+    /* Throttling of backend disk, bytes and operations per second */
+    uint64_t IoLimit = 0;
+    uint64_t IopsLimit = 0;
+    bool IoLimitSet = false;    /* by porto, reset at destroy */
+
     /* protected with VolumesLock */
     std::shared_ptr<TContainer> VolumeOwnerContainer;
 
@@ -157,7 +183,13 @@ public:
     static TError ParseConfig(const TStringMap &cfg, Porto::TVolume &spec);
 
     static TError Create(const Porto::TVolume &spec,
-                         std::shared_ptr<TVolume> &volume);
+                         std::shared_ptr<TVolume> &volume,
+                         bool async = false);
+    TError Complete(const Porto::TVolume &spec,
+                    std::shared_ptr<TVolumeLink> common_link);
+
+    static void StartBuilder();
+    static void StopBuilder();
 
     /* link target path */
     static std::shared_ptr<TVolumeLink> ResolveLinkLocked(const TPath &path);
@@ -179,6 +211,8 @@ public:
     TError DependsOn(const TPath &path);
     TError CheckDependencies();
     static TError CheckConflicts(const TPath &path);
+    void AddClaims();
+    void RemoveClaims();
 
     TError Build(void);
 
@@ -211,11 +245,18 @@ public:
     static void UnlinkAllVolumes(std::shared_ptr<TContainer> container,
                                  std::list<std::shared_ptr<TVolume>> &unlinked);
     static void DeleteUnlinked(std::list<std::shared_ptr<TVolume>> &unlinked);
+    static void DeleteAsync(std::list<std::shared_ptr<TVolume>> &unlinked);
 
     static TError CheckRequired(TContainer &ct);
 
     TError ClaimPlace(uint64_t size);
 
+    TError GetIoDisk(std::string &disk) const;
+    TError GetIoStat(TUintMap &stat) const;
+    TError CheckIoLimit() const;
+    void ApplyIoLimit(std::shared_ptr<TContainer> ct);
+    static void GetIoLimits(const TContainer &ct, bool iops, TUintMap &map);
+
     TPath GetInternal(const std::string &type) const;
     unsigned long GetMountFlags(void) const;
 
@@ -251,6 +292,18 @@ public:
         return BackendType == "loop";
     }
 
+    /* Block device belongs to volume alone */
+    bool OwnDisk(void) const {
+        return BackendType == "loop" ||
+               BackendType == "lvm" ||
+               BackendType == "rbd";
+    }
+
+    /* Data lives in memory and charged into memory cgroups */
+    bool MemoryStorage(void) const {
+        return BackendType == "tmpfs" || BackendType == "hugetmpfs";
+    }
+
     bool HaveLayers(void) const {
         return !Layers.empty();
     }
@@ -274,12 +327,14 @@ struct TVolumeProperty {
 extern std::vector<TVolumeProperty> VolumeProperties;
 
 extern std::mutex VolumesMutex;
-extern std::map<TPath, std::shared_ptr<TVolume>> Volumes;
-extern std::map<TPath, std::shared_ptr<TVolumeLink>> VolumeLinks;
+extern std::map<TPath, std::shared_ptr<TVolume>, TPathLess> Volumes;
+extern std::map<TPath, std::shared_ptr<TVolumeLink>, TPathLess> VolumeLinks;
 extern TPath VolumesKV;
 
+extern TLockStat VolumesLockStat;
+
 static inline std::unique_lock<std::mutex> LockVolumes() {
-    return std::unique_lock<std::mutex>(VolumesMutex);
+    return LockWithStat(VolumesMutex, VolumesLockStat);
 }
 
 extern TError PutLoopDev(const int loopNr); /* Legacy */
@@ -1,14 +1,77 @@
 #include "waiter.hpp"
 #include "client.hpp"
+#include "event.hpp"
+#include "rpc.hpp"
+#include "portod.hpp"
+#include <set>
+#include <unordered_map>
+#include <algorithm>
 #include <time.h>
 
 static std::mutex ContainerWaitersLock;
-static std::list<TContainerWaiter *> ContainerWaiters;
+
+/*
+ * Active waiters indexed by exact container name, by namespace of wildcard
+ * and by prefix of label mask, all protected with ContainerWaitersLock.
+ */
+typedef std::unordered_map<std::string, std::vector<TContainerWaiter *>> TWaitersIndex;
+static TWaitersIndex WaitersByName;
+static TWaitersIndex WaitersByNamespace;
+static TWaitersIndex WaitersByLabel;
+static uint64_t WaitersSeq = 0;
 
 static inline std::unique_lock<std::mutex> LockWaiters() {
     return std::unique_lock<std::mutex>(ContainerWaitersLock);
 }
 
+/* "a/b*" waits in namespace "a/", "***" and "ab*" in "" */
+static std::string WildcardNamespace(const std::string &wildcard) {
+    auto sep = wildcard.rfind('/', wildcard.find_first_of("*?[\\"));
+    if (sep == std::string::npos)
+        return "";
+    return wildcard.substr(0, sep + 1);
+}
+
+/* "PREFIX.*" waits for labels "PREFIX.", masks like "*.name" for any */
+static std::string LabelMaskPrefix(const std::string &mask) {
+    auto sep = mask.find('.');
+    if (sep == std::string::npos || mask.find_first_of("*?[\\") < sep)
+        return "";
+    return mask.substr(0, sep + 1);
+}
+
+static void IndexWaiter(TWaitersIndex &index, const std::string &key,
+                        TContainerWaiter *waiter, bool add) {
+    if (add) {
+        index[key].push_back(waiter);
+        return;
+    }
+
+    auto it = index.find(key);
+    if (it == index.end())
+        return;
+    auto &list = it->second;
+    list.erase(std::remove(list.begin(), list.end(), waiter), list.end());
+    if (list.empty())
+        index.erase(it);
+}
+
+static void IndexWaiter(TContainerWaiter *waiter, bool add) {
+    for (auto &name: waiter->Names)
+        IndexWaiter(WaitersByName, name, waiter, add);
+    for (auto &wc: waiter->Wildcards)
+        IndexWaiter(WaitersByNamespace, WildcardNamespace(wc.Pattern), waiter, add);
+    for (auto &label: waiter->Labels)
+        IndexWaiter(WaitersByLabel, LabelMaskPrefix(label), waiter, add);
+}
+
+static void CollectWaiters(const TWaitersIndex &index, const std::string &key,
+                           std::vector<TContainerWaiter *> &waiters) {
+    auto it = index.find(key);
+    if (it != index.end())
+        waiters.insert(waiters.end(), it->second.begin(), it->second.end());
+}
+
 TContainerWaiter::~TContainerWaiter() {
     PORTO_ASSERT(!Client);
 }
@@ -25,7 +88,8 @@ void TContainerWaiter::Activate(TClient &client) {
     if (!Names.empty() || !Wildcards.empty()) {
         Client = &client;
         *link = shared_from_this();
-        ContainerWaiters.push_back(this);
+        Seq = ++WaitersSeq;
+        IndexWaiter(this, true);
     }
 }
 
@@ -40,9 +104,14 @@ void TContainerWaiter::DeactivateLocked() {
     auto link = Async ? &Client->AsyncWaiter : &Client->SyncWaiter;
     PORTO_ASSERT(link->get() == this);
 
-    ContainerWaiters.remove(this);
+    IndexWaiter(this, false);
     Client = nullptr;
 
+    if (TimeoutEvent) {
+        EventQueue->Cancel(TimeoutEvent);
+        TimeoutEvent = 0;
+    }
+
     link->reset();
 }
 
@@ -61,7 +130,7 @@ bool TContainerWaiter::ShouldReport(TContainer &ct) {
             return true;
 
     for (auto &wc: Wildcards)
-        if (StringMatch(ct.Name, wc) && ct.Level)
+        if (wc.Match(ct.Name) && ct.Level)
             return true;
 
     return false;
@@ -75,25 +144,69 @@ bool TContainerWaiter::ShouldReportLabel(const std::string &label) {
 }
 
 void TContainerWaiter::ReportAll(TContainer &ct, const std::string &label, const std::string &value) {
+    bool userLabel = !label.empty() && !(label[0] >= 'a' && label[0] <= 'z');
+    EContainerState state = ct.State;
+    std::vector<TContainerWaiter *> waiters;
+    struct TReport {
+        std::shared_ptr<TClient> Client;
+        std::string Name;
+        bool Async;
+    };
+    std::vector<TReport> reports;
+
     auto lock = LockWaiters();
-    for (auto it = ContainerWaiters.begin(); it != ContainerWaiters.end();) {
-        auto waiter = *it;
-        if (waiter->ShouldReport(ct) &&
-                (label.empty() || (label[0] >= 'a' && label[0] <= 'z') ||
-                 waiter->ShouldReportLabel(label))) {
-
-            std::string name;
-            if (!waiter->Client->ComposeName(ct.Name, name)) {
-                waiter->Client->MakeReport(name, ct.State, waiter->Async, label, value);
-                if (!waiter->Async) {
-                    ++it;
-                    waiter->DeactivateLocked();
-                    continue;
-                }
-            }
-        }
-        ++it;
+
+    if (userLabel) {
+        /* User labels are reported only to waiters for labels */
+        CollectWaiters(WaitersByLabel, "", waiters);
+        auto sep = label.find('.');
+        if (sep != std::string::npos)
+            CollectWaiters(WaitersByLabel, label.substr(0, sep + 1), waiters);
+    } else {
+        CollectWaiters(WaitersByName, ct.Name, waiters);
+        CollectWaiters(WaitersByNamespace, "", waiters);
+        for (auto sep = ct.Name.find('/'); sep != std::string::npos;
+                sep = ct.Name.find('/', sep + 1))
+            CollectWaiters(WaitersByNamespace, ct.Name.substr(0, sep + 1), waiters);
+    }
+
+    /* Waiter could be found by several names or masks */
+    std::sort(waiters.begin(), waiters.end(),
+              [](const TContainerWaiter *a, const TContainerWaiter *b) {
+                  return a->Seq < b->Seq;
+              });
+    waiters.erase(std::unique(waiters.begin(), waiters.end()), waiters.end());
+
+    for (auto waiter: waiters) {
+        std::string name;
+
+        if (!waiter->ShouldReport(ct) ||
+                (userLabel && !waiter->ShouldReportLabel(label)) ||
+                waiter->Client->ComposeName(ct.Name, name))
+            continue;
+
+        reports.push_back({waiter->Client->shared_from_this(), name, waiter->Async});
+
+        /* Might drop last reference to waiter */
+        if (!waiter->Async)
+            waiter->DeactivateLocked();
     }
+
+    lock.unlock();
+
+    /* Sending is done outside of waiters lock */
+    for (auto &report: reports)
+        report.Client->MakeReport(report.Name, state, report.Async, label, value);
+}
+
+/* Timeout is cancelled at deactivation */
+void TContainerWaiter::SetTimeout(uint64_t timeoutMs) {
+    TEvent e(EEventType::WaitTimeout, nullptr);
+    e.WaitTimeout.Waiter = shared_from_this();
+
+    auto lock = LockWaiters();
+    if (Client)
+        TimeoutEvent = EventQueue->Add(timeoutMs, e);
 }
 
 void TContainerWaiter::Timeout() {
@@ -103,3 +216,109 @@ void TContainerWaiter::Timeout() {
         DeactivateLocked();
     }
 }
+
+void TSubscription::Schedule(uint64_t delayMs) {
+    TEvent e(EEventType::ReportSubscription, nullptr);
+    e.ReportSubscription.Subscription = shared_from_this();
+    EventQueue->Add(delayMs, e);
+}
+
+static std::string SubscriptionValue(const Porto::TGetResponse::TContainerGetValueResponse &kv) {
+    if (kv.has_error())
+        return "\1" + std::to_string(kv.error()) + ":" + kv.errormsg();
+    return kv.value();
+}
+
+void TSubscription::Report() {
+    auto conn = Client.lock();
+    if (!conn)
+        return;
+
+    bool busy;
+    {
+        auto lock = conn->Lock();
+        busy = conn->Sending || conn->Fd < 0;
+    }
+
+    /* Client does not read, changes will be merged into next update */
+    if (busy) {
+        Schedule(PeriodMs);
+        return;
+    }
+
+    Porto::TPortoResponse rsp;
+
+    /* Collect values in the name of subscriber */
+    TClient client(conn);
+    TClient *prev = CL;
+    CL = nullptr;
+    client.StartRequest();
+    TError error = GetContainerCombined(Request, rsp);
+    client.FinishRequest();
+    CL = prev;
+
+    if (error) {
+        L_WRN("Cannot report subscription for {}: {}", conn->Id, error);
+        Schedule(PeriodMs);
+        return;
+    }
+
+    Porto::TPortoResponse update;
+    auto upd = update.mutable_subscribeupdate();
+    std::set<std::string> seen;
+
+    for (auto &entry: rsp.get().list()) {
+        auto &last = Values[entry.name()];
+        Porto::TGetResponse::TContainerGetListResponse *out = nullptr;
+
+        seen.insert(entry.name());
+
+        for (auto &kv: entry.keyval()) {
+            std::string value = SubscriptionValue(kv);
+            auto it = last.find(kv.variable());
+
+            if (it != last.end() && it->second == value)
+                continue;
+
+            last[kv.variable()] = value;
+
+            if (!out) {
+                out = upd->add_list();
+                out->set_name(entry.name());
+                out->set_change_time(entry.change_time());
+            }
+            *out->add_keyval() = kv;
+        }
+    }
+
+    for (auto it = Values.begin(); it != Values.end(); ) {
+        if (seen.count(it->first)) {
+            ++it;
+            continue;
+        }
+
+        auto out = upd->add_list();
+        out->set_name(it->first);
+        for (auto &var: Request.variable()) {
+            auto kv = out->add_keyval();
+            kv->set_variable(var);
+            kv->set_error(EError::ContainerDoesNotExist);
+            kv->set_errormsg("Container does not exist");
+        }
+        it = Values.erase(it);
+    }
+
+    if (upd->list_size()) {
+        update.set_error(EError::Success);
+        update.set_timestamp(time(nullptr));
+
+        auto lock = conn->Lock();
+        error = conn->QueueResponse(update);
+        if (!error && !conn->Sending)
+            error = conn->SendResponse(true);
+        if (error)
+            L_WRN("Cannot send subscription update to {}: {}", conn->Id, error);
+    }
+
+    Schedule(PeriodMs);
+}
@@ -2,6 +2,7 @@
 
 #include <string>
 #include <vector>
+#include <map>
 
 #include "common.hpp"
 #include "container.hpp"
@@ -23,9 +24,11 @@ class TContainerWaiter : public std::enable_shared_from_this<TContainerWaiter> {
 public:
     TClient *Client = nullptr;
     std::vector<std::string> Names;
-    std::vector<std::string> Wildcards;
+    std::vector<TStringMask> Wildcards;
     std::vector<std::string> Labels;
     bool Async;
+    uint64_t TimeoutEvent = 0;
+    uint64_t Seq = 0;           /* activation order */
 
     TContainerWaiter(bool async) : Async(async) { }
     ~TContainerWaiter();
@@ -36,7 +39,22 @@ public:
 
     bool ShouldReport(TContainer &ct);
     bool ShouldReportLabel(const std::string &label);
+    void SetTimeout(uint64_t timeoutMs);
     void Timeout();
 
     static void ReportAll(TContainer &ct, const std::string &label = "", const std::string &value = "");
 };
+
+/* Owned by client, expires together with connection */
+class TSubscription : public std::enable_shared_from_this<TSubscription> {
+public:
+    std::weak_ptr<TClient> Client;
+    Porto::TGetRequest Request;
+    uint64_t PeriodMs = 0;
+
+    /* Last reported values: container -> variable -> value */
+    std::map<std::string, std::map<std::string, std::string>> Values;
+
+    void Schedule(uint64_t delayMs);
+    void Report();
+};
@@ -0,0 +1,266 @@
+#include <iostream>
+#include <functional>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include "config.hpp"
+#include "container.hpp"
+#include "property.hpp"
+#include "client.hpp"
+#include "cgroup.hpp"
+#include "kvalue.hpp"
+#include "rpc.hpp"
+#include "event.hpp"
+#include "epoll.hpp"
+#include "util/log.hpp"
+#include "util/string.hpp"
+#include "util/unix.hpp"
+#include "portod.hpp"
+
+#include "fmt/format.h"
+
+extern "C" {
+#include <unistd.h>
+#include <stdlib.h>
+}
+
+/* Microbenchmarks for daemon hot paths, run in process without portod */
+
+/* Definitions normally provided by portod.cpp */
+std::string PreviousVersion;
+std::unique_ptr<TEpollLoop> EpollLoop;
+std::unique_ptr<TEventQueue> EventQueue;
+bool PortodFrozen = false;
+bool ShutdownPortod = false;
+
+void CheckPortoSocket() { }
+void AckExitStatus(int pid) { (void)pid; }
+void ReopenMasterLog() { }
+int ReopenLog() { return EXIT_SUCCESS; }
+int UpgradePortod() { return EXIT_FAILURE; }
+
+static std::atomic<uint64_t> AllocCount(0);
+static std::atomic<uint64_t> AllocBytes(0);
+
+void *operator new(size_t size) {
+    AllocCount.fetch_add(1, std::memory_order_relaxed);
+    AllocBytes.fetch_add(size, std::memory_order_relaxed);
+    void *ptr = malloc(size ? size : 1);
+    if (!ptr)
+        abort();
+    return ptr;
+}
+
+void operator delete(void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    free(ptr);
+}
+
+struct TBench {
+    std::string Name;
+    std::function<void()> Fn;
+};
+
+static std::vector<TBench> Benches;
+static uint64_t BenchTimeMs = 500;
+
+static void Bench(const std::string &name, std::function<void()> fn) {
+    Benches.push_back({name, fn});
+}
+
+static void Run(const TBench &bench) {
+    uint64_t iters = 1, elapsed;
+
+    /* Warmup and calibration: grow until run takes tenth of budget */
+    while (true) {
+        uint64_t start = GetCurrentTimeUs();
+        for (uint64_t i = 0; i < iters; i++)
+            bench.Fn();
+        elapsed = GetCurrentTimeUs() - start;
+        if (elapsed * 10 >= BenchTimeMs * 1000 || iters >= (1ull << 30))
+            break;
+        iters *= elapsed ? std::min<uint64_t>(10, BenchTimeMs * 100 / elapsed + 1) : 10;
+    }
+
+    iters = std::max<uint64_t>(1, iters * BenchTimeMs * 1000 / std::max<uint64_t>(elapsed, 1));
+
+    uint64_t allocs = AllocCount, bytes = AllocBytes;
+    uint64_t start = GetCurrentTimeUs();
+    for (uint64_t i = 0; i < iters; i++)
+        bench.Fn();
+    elapsed = GetCurrentTimeUs() - start;
+    allocs = AllocCount - allocs;
+    bytes = AllocBytes - bytes;
+
+    std::cout << fmt::format("{:<40} {:>10} {:>12.1f} ns/op {:>8.1f} allocs/op {:>10.1f} B/op",
+                             bench.Name, iters, elapsed * 1000.0 / iters,
+                             (double)allocs / iters, (double)bytes / iters) << std::endl;
+}
+
+static TPath TempDir;
+
+static TError SetupFixtures(std::shared_ptr<TContainer> &ct) {
+    TError error;
+
+    Statistics = new TStatistics();
+
+    ReadConfigs(true);
+    config().mutable_container()->set_knob_cache_size(0);
+
+    static TClient client("portobench");
+    CL = &client;
+
+    auto lock = LockContainers();
+    RootContainer = std::make_shared<TContainer>(nullptr, ROOT_CONTAINER_ID, ROOT_CONTAINER);
+    RootContainer->Register();
+    client.ClientContainer = RootContainer;
+
+    ct = std::make_shared<TContainer>(RootContainer, ROOT_CONTAINER_ID + 100, "bench");
+    ct->Register();
+    lock.unlock();
+
+    ct->Command = "/bin/sleep 1000";
+    ct->SetProp(EProperty::COMMAND);
+    ct->MemLimit = 1 << 30;
+    ct->SetProp(EProperty::MEM_LIMIT);
+    ct->EnvCfg = "A=1;B=2;C=3";
+    ct->SetProp(EProperty::ENV);
+
+    char tmpl[] = "/tmp/portobench.XXXXXX";
+    if (!mkdtemp(tmpl))
+        return TError::System("mkdtemp");
+    TempDir = tmpl;
+
+    return OK;
+}
+
+static const std::vector<std::string> GetVariables = {
+    "state", "command", "memory_limit", "cpu_limit", "env", "respawn", "cwd",
+};
+
+int main(int argc, char **argv) {
+    std::vector<std::string> filter;
+    std::shared_ptr<TContainer> ct;
+    TError error;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--time-ms" && i + 1 < argc) {
+            BenchTimeMs = std::stoull(argv[++i]);
+        } else if (arg == "-h" || arg == "--help") {
+            std::cout << "usage: " << argv[0] << " [--time-ms <ms>] [name-substring]..." << std::endl;
+            return EXIT_SUCCESS;
+        } else
+            filter.push_back(arg);
+    }
+
+    error = SetupFixtures(ct);
+    if (error) {
+        std::cerr << "Cannot setup fixtures: " << error << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    Bench("container_get_property", [&] {
+        std::string value;
+        ct->LockStateRead();
+        for (auto &var: GetVariables)
+            (void)ct->GetProperty(var, value);
+        ct->UnlockState();
+    });
+
+    Porto::TGetRequest getReq;
+    getReq.add_name("bench");
+    for (auto &var: GetVariables)
+        getReq.add_variable(var);
+
+    Bench("get_combined_response", [&] {
+        Porto::TPortoResponse rsp;
+        (void)GetContainerCombined(getReq, rsp);
+    });
+
+    Porto::TPortoResponse getRsp;
+    (void)GetContainerCombined(getReq, getRsp);
+    std::string encoded;
+
+    Bench("protobuf_encode_get_response", [&] {
+        encoded.clear();
+        getRsp.SerializeToString(&encoded);
+    });
+
+    getRsp.SerializeToString(&encoded);
+
+    Bench("protobuf_decode_get_response", [&] {
+        Porto::TPortoResponse rsp;
+        rsp.ParseFromString(encoded);
+    });
+
+    TKeyValue node(TempDir / "kv");
+    node.Id = ct->Id;
+    node.Name = ct->Name;
+    for (int i = 0; i < 50; i++)
+        node.Set(fmt::format("property_{}", i), std::string(32, 'x'));
+
+    Bench("keyvalue_save", [&] {
+        (void)node.Save();
+    });
+
+    TKeyValueState state;
+    int generation = 0;
+
+    Bench("keyvalue_save_incremental", [&] {
+        node.Set("property_0", std::to_string(generation++));
+        (void)node.Save(state);
+    });
+
+    static TSubsystem fake(0, "bench");
+    fake.Root = TempDir;
+    TCgroup cg(&fake, "cg");
+    (void)cg.Path().Mkdir(0755);
+    std::string stat;
+    for (int i = 0; i < 40; i++)
+        stat += fmt::format("counter_{} {}\n", i, i * 4096);
+    (void)cg.Knob("memory.stat").WriteAll(stat);
+
+    Bench("cgroup_get_uint_map", [&] {
+        TUintMap map;
+        (void)cg.GetUintMap("memory.stat", map);
+    });
+
+    TCgroup nested(&fake, "porto/bench/nested");
+
+    Bench("cgroup_knob_path", [&] {
+        TPath knob = nested.Knob("memory.usage_in_bytes");
+        (void)knob;
+    });
+
+    TPath messy("/place/porto_volumes/./bench//layers/../volume/");
+
+    Bench("path_normal", [&] {
+        TPath normal = messy.NormalPath();
+        (void)normal;
+    });
+
+    std::string cgroupLine = "4:memory:/porto%bench%nested";
+
+    Bench("split_string", [&] {
+        auto fields = SplitString(cgroupLine, ':', 3);
+        (void)fields;
+    });
+
+    for (auto &bench: Benches) {
+        bool match = filter.empty();
+        for (auto &f: filter)
+            match |= bench.Name.find(f) != std::string::npos;
+        if (match)
+            Run(bench);
+    }
+
+    (void)TempDir.RemoveAll();
+
+    return EXIT_SUCCESS;
+}
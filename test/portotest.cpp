@@ -38,9 +38,30 @@ static int Stresstest(int argc, char *argv[]) {
     return test::StressTest(threads, iter, killPorto);
 }
 
+static int Benchtest(int argc, char *argv[]) {
+    int threads = 4, iter = 100;
+    std::string volume, net, report;
+
+    if (argc >= 1)
+        StringToInt(argv[0], threads);
+    if (argc >= 2)
+        StringToInt(argv[1], iter);
+    for (int i = 2; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (StringStartsWith(arg, "volume="))
+            volume = arg.substr(7);
+        else if (StringStartsWith(arg, "net="))
+            net = arg.substr(4);
+        else if (StringStartsWith(arg, "report="))
+            report = arg.substr(7);
+    }
+    return test::BenchTest(threads, iter, volume, net, report);
+}
+
 static void Usage() {
     std::cout << "usage: " << program_invocation_short_name << " [--except] <selftest>..." << std::endl;
     std::cout << "       " << program_invocation_short_name << " stress [threads] [iterations] [kill=on/off]" << std::endl;
+    std::cout << "       " << program_invocation_short_name << " bench [threads] [iterations] [volume=<backend>] [net=<net>] [report=<path>]" << std::endl;
 }
 
 static int TestConnectivity() {
@@ -94,5 +115,8 @@ int main(int argc, char *argv[])
     if (what == "stress")
         return Stresstest(argc - 2, argv + 2);
 
+    if (what == "bench")
+        return Benchtest(argc - 2, argv + 2);
+
     return Selftest(argc - 1, argv + 1);
 }
@@ -2341,6 +2341,18 @@ static void TestIdmap(Porto::TPortoApi &) {
 
     ExpectOk(idmap.Get(id));
     ExpectEq(id, 2);
+
+    TIdMap wide(0, 200);
+    ExpectOk(wide.GetAt(130));
+    ExpectEq(wide.GetAt(130).Error, EError::Unknown);
+    for (int i = 0; i < 199; i++) {
+        ExpectOk(wide.Get(id));
+        Expect(id != 130);
+    }
+    ExpectEq(wide.Get(id).Error, EError::ResourceNotAvailable);
+    ExpectOk(wide.Put(64));
+    ExpectOk(wide.Get(id));
+    ExpectEq(id, 64);
 }
 
 static void TestFormat(Porto::TPortoApi &) {
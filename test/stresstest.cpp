@@ -8,6 +8,7 @@
 
 #include "config.hpp"
 #include "util/string.hpp"
+#include "util/unix.hpp"
 #include "test.hpp"
 
 extern "C" {
@@ -279,4 +280,187 @@ int StressTest(int threads, int iter, bool killPorto) {
 
     return 0;
 }
+
+/*
+ * Benchmark: each thread runs create, start, wait, destroy cycles of
+ * trivial container, optionally with volume and network, and report
+ * shows latency percentiles for each phase and portod resource usage.
+ */
+
+enum EBenchPhase {
+    BENCH_CREATE,
+    BENCH_VOLUME,
+    BENCH_START,
+    BENCH_WAIT,
+    BENCH_DESTROY,
+    NR_BENCH_PHASES,
+};
+
+static const char *BenchPhaseNames[NR_BENCH_PHASES] = {
+    "create",
+    "volume",
+    "start",
+    "wait",
+    "destroy",
+};
+
+struct TBenchStat {
+    std::vector<uint64_t> LatencyUs[NR_BENCH_PHASES];
+    uint64_t Cycles = 0;
+    uint64_t Errors = 0;
+};
+
+static void BenchTask(int n, int iter, const std::string &volume,
+                      const std::string &net, TBenchStat &stat) {
+    std::string name = "bench-" + std::to_string(n);
+    Porto::TPortoApi api;
+    uint64_t time;
+
+    auto phase = [&](EBenchPhase phase, int error) {
+        uint64_t now = GetCurrentTimeUs();
+        if (error) {
+            stat.Errors++;
+            return false;
+        }
+        stat.LatencyUs[phase].push_back(now - time);
+        time = now;
+        return true;
+    };
+
+    (void)api.Destroy(name);
+
+    for (; iter > 0; iter--) {
+        std::string path, state;
+
+        time = GetCurrentTimeUs();
+        if (!phase(BENCH_CREATE, api.Create(name)))
+            continue;
+
+        if (api.SetProperty(name, "command", "true") ||
+                (net != "" && api.SetProperty(name, "net", net))) {
+            stat.Errors++;
+            goto destroy;
+        }
+
+        if (volume != "") {
+            time = GetCurrentTimeUs();
+            if (!phase(BENCH_VOLUME, api.CreateVolume(path, {{"backend", volume},
+                                                             {"containers", name}})))
+                goto destroy;
+        }
+
+        time = GetCurrentTimeUs();
+        if (!phase(BENCH_START, api.Start(name)) ||
+                !phase(BENCH_WAIT, api.WaitContainer(name, state, 60)))
+            goto destroy;
+
+        if (state != "dead")
+            stat.Errors++;
+        else
+            stat.Cycles++;
+
+destroy:
+        time = GetCurrentTimeUs();
+        phase(BENCH_DESTROY, api.Destroy(name));
+    }
+}
+
+static uint64_t PortodCpuMs(int pid) {
+    std::string stat;
+    if (TPath("/proc/" + std::to_string(pid) + "/stat").ReadAll(stat))
+        return 0;
+
+    /* utime and stime, fields 14 and 15 */
+    auto fields = SplitString(stat.substr(stat.rfind(')') + 2), ' ');
+    uint64_t utime, stime;
+    if (fields.size() < 13 || StringToUint64(fields[11], utime) ||
+            StringToUint64(fields[12], stime))
+        return 0;
+
+    return (utime + stime) * 1000 / sysconf(_SC_CLK_TCK);
+}
+
+static uint64_t Percentile(const std::vector<uint64_t> &sorted, int percent) {
+    if (sorted.empty())
+        return 0;
+    return sorted[std::min(sorted.size() - 1, sorted.size() * percent / 100)];
+}
+
+int BenchTest(int threads, int iter, const std::string &volume,
+              const std::string &net, const std::string &report) {
+    std::vector<TBenchStat> stats(threads);
+    std::vector<std::thread> thrTasks;
+    std::atomic<int> running(threads);
+    int pid = ReadPid(PORTO_PIDFILE);
+    int rssMax = 0;
+
+    (void)signal(SIGPIPE, SIG_IGN);
+
+    uint64_t cpuStart = PortodCpuMs(pid);
+    uint64_t timeStart = GetCurrentTimeMs();
+
+    for (int i = 0; i < threads; i++)
+        thrTasks.push_back(std::thread([&, i] {
+            BenchTask(i, iter, volume, net, stats[i]);
+            running--;
+        }));
+
+    while (running) {
+        rssMax = std::max(rssMax, GetVmRss(std::to_string(pid)));
+        usleep(100000);
+    }
+
+    for (auto &th : thrTasks)
+        th.join();
+
+    uint64_t timeMs = std::max(GetCurrentTimeMs() - timeStart, (uint64_t)1);
+    uint64_t cpuMs = PortodCpuMs(pid) - cpuStart;
+
+    TBenchStat total;
+    for (auto &stat: stats) {
+        total.Cycles += stat.Cycles;
+        total.Errors += stat.Errors;
+        for (int p = 0; p < NR_BENCH_PHASES; p++)
+            total.LatencyUs[p].insert(total.LatencyUs[p].end(),
+                                      stat.LatencyUs[p].begin(),
+                                      stat.LatencyUs[p].end());
+    }
+
+    std::string out = fmt::format("{{\"threads\":{},\"iterations\":{},"
+                                  "\"volume\":\"{}\",\"net\":\"{}\","
+                                  "\"cycles\":{},\"errors\":{},\"time_ms\":{},"
+                                  "\"cycles_per_sec\":{:.2f},"
+                                  "\"portod_cpu_ms\":{},\"portod_rss_max_kb\":{},"
+                                  "\"phases\":{{",
+                                  threads, iter, volume, net,
+                                  total.Cycles, total.Errors, timeMs,
+                                  total.Cycles * 1000.0 / timeMs,
+                                  cpuMs, rssMax);
+
+    for (int p = 0; p < NR_BENCH_PHASES; p++) {
+        auto &lat = total.LatencyUs[p];
+        std::sort(lat.begin(), lat.end());
+        out += fmt::format("{}\"{}\":{{\"count\":{},\"p50_us\":{},\"p90_us\":{},"
+                           "\"p99_us\":{},\"max_us\":{}}}",
+                           p ? "," : "", BenchPhaseNames[p], lat.size(),
+                           Percentile(lat, 50), Percentile(lat, 90),
+                           Percentile(lat, 99), lat.empty() ? 0 : lat.back());
+    }
+    out += "}}\n";
+
+    if (report != "") {
+        TFile file;
+        TError error = file.CreateTrunc(report, 0644);
+        if (!error)
+            error = file.WriteAll(out);
+        if (error) {
+            std::cerr << "Cannot write report: " << error << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::cout << out;
+
+    return total.Errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
 }
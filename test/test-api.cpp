@@ -1,6 +1,7 @@
 #include <libporto.hpp>
 
 #include <cassert>
+#include <unistd.h>
 
 #define Expect(a)   assert(a)
 #define ExpectEq(a, b)   assert((a) == (b))
@@ -36,6 +37,75 @@ int main(int, char **) {
 
     ExpectSuccess(api.Call("Version {}", str));
 
+    {
+        Porto::TPortoRequest req;
+        int done = 0;
+
+        req.mutable_version();
+        for (int i = 0; i < 3; i++)
+            ExpectSuccess(api.CallAsync(req, [&](const Porto::TPortoResponse &rsp) {
+                ExpectEq(rsp.error(), Porto::EError::Success);
+                Expect(rsp.has_version());
+                done++;
+            }));
+
+        req.Clear();
+        req.mutable_getproperty()->set_name("/");
+        req.mutable_getproperty()->set_property("state");
+        ExpectSuccess(api.CallAsync(req, [&](const Porto::TPortoResponse &rsp) {
+            ExpectEq(rsp.getproperty().value(), "meta");
+            done++;
+        }));
+
+        ExpectEq(api.PendingCallsCount(), 4);
+        ExpectSuccess(api.Complete());
+        ExpectEq(api.PendingCallsCount(), 0);
+        ExpectEq(done, 4);
+    }
+
+    {
+        Porto::TPortoPool pool(4);
+        Porto::TPortoRequest req;
+        Porto::TPortoResponse rsp;
+        std::vector<std::future<Porto::TPortoResponse>> futures;
+        std::atomic<int> done(0);
+
+        req.mutable_version();
+        ExpectSuccess(pool.Call(req, rsp));
+        Expect(rsp.has_version());
+
+        for (int i = 0; i < 100; i++)
+            futures.push_back(pool.CallFuture(req));
+
+        req.Clear();
+        req.mutable_getproperty()->set_name("/");
+        req.mutable_getproperty()->set_property("state");
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; t++)
+            threads.emplace_back([&] {
+                for (int i = 0; i < 25; i++)
+                    ExpectSuccess(pool.CallAsync(req, [&](const Porto::TPortoResponse &rsp) {
+                        ExpectEq(rsp.getproperty().value(), "meta");
+                        done++;
+                    }));
+            });
+        for (auto &thread: threads)
+            thread.join();
+
+        for (auto &future: futures) {
+            rsp = future.get();
+            ExpectSuccess(rsp.error());
+            Expect(rsp.has_version());
+        }
+
+        /* Callbacks are called by pool thread after dequeue */
+        for (int i = 0; i < 5000 && done < 100; i++)
+            usleep(1000);
+        ExpectEq(done, 100);
+        ExpectEq(pool.PendingCallsCount(), 0);
+    }
+
     ExpectSuccess(api.GetProperty("/", "state", str));
     ExpectEq(str, "meta");
 
@@ -43,6 +113,19 @@ int main(int, char **) {
     Expect(ct != nullptr);
     ExpectEq(ct->name(), "/");
 
+    for (int flags: {0, (int)Porto::GET_COLUMNAR}) {
+        Porto::TGetTable table;
+
+        ExpectSuccess(api.GetTable({"/"}, {"state", "memory_usage", "__wrong__"}, table, flags));
+        ExpectEq(table.Rows(), 1);
+        ExpectEq(table.Columns(), 3);
+        ExpectEq(table.Name(0), "/");
+        ExpectEq(table.Value(0, 0), "meta");
+        ExpectSuccess(table.GetUint(0, 1, val));
+        ExpectNeq(val, 0);
+        ExpectNeq(table.Error(0, 2), Porto::EError::Success);
+    }
+
     val = 0;
     ExpectSuccess(api.GetProperty("/", "memory_usage", val));
     ExpectNeq(val, 0);
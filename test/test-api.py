@@ -2,6 +2,7 @@ from test_common import *
 
 import sys
 import os
+import time
 import porto
 
 AsAlice()
@@ -152,6 +153,53 @@ assert a["command"] == "sleep 5"
 assert a["private"] == volume_private
 a.Destroy()
 
+res = c.Batch([{'Create': {'name': container_name}},
+               {'SetProperty': {'name': container_name, 'property': 'command', 'value': 'sleep 60'}},
+               {'SetProperty': {'name': container_name, 'property': 'private', 'value': volume_private}},
+               {'Start': {'name': container_name}},
+               {'SetProperty': {'name': container_name, 'property': 'no_such_property', 'value': ''}},
+               {'Pause': {'name': container_name}},
+               {'Resume': {'name': container_name}}])
+assert len(res) == 7
+assert res[:4] == [None, None, None, None]
+assert isinstance(res[4], porto.exceptions.InvalidProperty)
+assert res[5:] == [None, None]
+a = c.Find(container_name)
+assert a["state"] == "running"
+assert a["private"] == volume_private
+
+res = c.Batch([{'Kill': {'name': container_name, 'sig': 9}},
+               {'Start': {'name': container_name}},
+               {'Destroy': {'name': container_name}}], stop_on_error=True)
+assert len(res) == 2
+assert res[0] is None
+assert isinstance(res[1], porto.exceptions.InvalidState)
+a.Destroy()
+assert Catch(c.Find, container_name) == porto.exceptions.ContainerDoesNotExist
+
+updates = []
+a = c.Create(container_name)
+c.Subscribe([container_name], ["state", "command"], 0.1, updates.append)
+time.sleep(0.5)
+c.Version()
+assert updates[0] == {container_name: {"state": "stopped", "command": ""}}
+assert len(updates) == 1
+a.SetProperty("command", "sleep 60")
+time.sleep(0.5)
+c.Version()
+assert {container_name: {"command": "sleep 60"}} in updates
+a.Destroy()
+time.sleep(0.5)
+c.Version()
+assert isinstance(updates[-1][container_name]["state"], porto.exceptions.ContainerDoesNotExist)
+c.Unsubscribe()
+
+names, columns = c.GetColumns(["/", container_name], ["memory_usage", "state"])
+assert names == ["/", container_name]
+assert columns["memory_usage"][0] > 0
+assert columns["state"][0] == "meta"
+assert isinstance(columns["state"][1], porto.exceptions.ContainerDoesNotExist)
+
 
 # LAYERS
 
@@ -0,0 +1,43 @@
+import os
+import sys
+import shutil
+import porto
+from distutils.spawn import find_executable
+from test_common import *
+
+if not find_executable('criu'):
+    print("criu not found, skip")
+    sys.exit(0)
+
+conn = porto.Connection()
+
+path = '/tmp/test-checkpoint'
+shutil.rmtree(path, ignore_errors=True)
+
+a = conn.Run('test-checkpoint', command='sleep 1000', labels='TEST.checkpoint: 1')
+
+a.Checkpoint(path, leave_running=True)
+ExpectProp(a, 'state', 'running')
+Expect(os.path.exists(path + '/container.spec'))
+a.Stop()
+shutil.rmtree(path)
+
+a.Start()
+a.Checkpoint(path)
+ExpectProp(a, 'state', 'stopped')
+
+ExpectEq(Catch(a.Checkpoint, path), porto.exceptions.InvalidState)
+
+a.Restore(path)
+ExpectProp(a, 'state', 'running')
+ExpectProp(a, 'command', 'sleep 1000')
+a.Destroy()
+
+# container is created from saved spec
+a = conn.Restore('test-checkpoint', path)
+ExpectProp(a, 'state', 'running')
+ExpectProp(a, 'command', 'sleep 1000')
+ExpectEq(a.GetLabel('TEST.checkpoint'), '1')
+a.Destroy()
+
+shutil.rmtree(path)
@@ -138,6 +138,12 @@ tests = {
 "anon_limit": size_test,
 "dirty_limit": size_test,
 "hugetlb_limit": size_test,
+"hugetlb_reserve": [],
+"thp": [
+    "always",
+    "madvise",
+    "never",
+],
 "recharge_on_pgfault": bool_test,
 "pressurize_on_death": bool_test,
 "anon_only":  bool_test,
@@ -158,6 +164,7 @@ tests = {
 "cpu_guarantee": cpu_test,
 "cpu_limit": cpu_test,
 "cpu_period": [],
+"cpu_limit_burst": [],
 "cpu_weight": weight_test,
 "cpu_set": [
     ("0-1", {'policy': 'set', 'count': 2, 'list': '0-1', 'cpu': [0, 1]}),
@@ -179,6 +186,7 @@ tests = {
 "respawn": bool_test,
 "max_respawns": size_test,
 "respawn_delay": size_test,
+"warm": bool_test,
 "isolate": bool_test,
 "private": [
     ("", ""),
@@ -258,6 +266,10 @@ tests = {
 ],
 }
 
+# thp=madvise needs PR_THP_DISABLE_EXCEPT_ADVISED
+if tuple(int(v) for v in re.match(r"(\d+)\.(\d+)", platform.uname()[2]).groups()) < (6, 18):
+    tests["thp"].remove("madvise")
+
 
 ro_tests = {
 "taint": [],
@@ -278,6 +290,7 @@ ro_tests = {
 "anon_max_usage": [],
 "cache_usage": [],
 "hugetlb_usage": [],
+"thp_usage": [],
 "minor_faults": [],
 "major_faults": [],
 "virtual_memory": [],
@@ -289,6 +302,7 @@ ro_tests = {
 "cpu_usage_system": [],
 "cpu_wait": [],
 "cpu_throttled": [],
+"cpu_throttle_stat": [],
 "capabilities_allowed": [],
 "capabilities_ambient_allowed": [],
 
@@ -306,6 +320,8 @@ ro_tests = {
 
 "stdout_offset": [],
 "stderr_offset": [],
+"stdout_rotations": [],
+"stderr_rotations": [],
 
 "net_class_id": [],
 "net_bytes": [],
@@ -318,6 +334,9 @@ ro_tests = {
 "net_tx_bytes": [],
 "net_tx_packets": [],
 "net_tx_drops": [],
+"net_bytes_rate": [],
+"net_packets_rate": [],
+"net_tcp_stat": [],
 "io_read": [],
 "io_write": [],
 "io_ops": [],
@@ -350,8 +369,15 @@ skip_tests = {
 "stdout": [],
 "stderr": [],
 "porto_stat": [],
+"subtree_stat": [],
 "start_error": [],
 "command_argv": [],
+"cpu_pressure": [],
+"memory_pressure": [],
+"memory_numa_stat": [],
+"io_pressure": [],
+"pressure_triggers": [],
+"start_trace": [],
 }
 
 ConfigurePortod('test-coredump', """
@@ -490,6 +516,24 @@ ExpectEq(get_old('ulimit[core]'), 'unlimited unlimited')
 ct.Destroy()
 
 
+print " -  subtree_stat"
+
+ct = conn.Run(ct_name)
+sub = conn.Run(ct_name + "/b", command="sleep 1000")
+
+stat = dict(kv.split(': ') for kv in get_old('subtree_stat').split('; ') if kv)
+for key in ['cpu_usage', 'memory_usage']:
+    Expect(key in stat)
+
+sub_cpu = int(conn.GetProperty(ct_name + "/b", 'subtree_stat[cpu_usage]'))
+ExpectLe(sub_cpu, int(get_old('subtree_stat[cpu_usage]')))
+ExpectLe(int(get_old('subtree_stat[cpu_usage]')),
+         int(conn.GetProperty('/', 'subtree_stat[cpu_usage]')))
+
+sub.Destroy()
+ct.Destroy()
+
+
 print " -  command_argv"
 
 ct = conn.Create(ct_name, weak=True);
@@ -552,6 +596,8 @@ volume_properties = {
 'inode_guarantee': None,
 'inode_limit': '0',
 'inode_used': None,
+'io_limit': '0',
+'iops_limit': '0',
 'owner_container': '/',
 'owner_group': 'root',
 'owner_user': 'root',
@@ -575,6 +621,10 @@ volume_config = [
 'containers',
 'target_container',
 'layers',
+'layers_copy',
+'progress',
+'io_stat',
+'memory_usage',
 ]
 
 volume_spec = [
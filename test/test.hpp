@@ -67,6 +67,8 @@ namespace test {
 
     int SelfTest(std::vector<std::string> args);
     int StressTest(int threads, int iter, bool killPorto);
+    int BenchTest(int threads, int iter, const std::string &volume,
+                  const std::string &net, const std::string &report);
     int FuzzyTest(int threads, int iter);
 
     enum class KernelFeature {